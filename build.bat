@@ -7,6 +7,7 @@ set BUILD_PERF_TESTS=1
 set BUILD_LIB=1
 set BUILD_EXECUTABLE=1
 set BUILD_ASSET_LOADER=1
+set BUILD_TOOLS=1
 
 set CompilerFlags=-DPLATFORM_WINDOWS -MT -F16777216 -nologo -Gm- -GR- -EHa -W4 -WX -wd4702 -wd4305 -wd4127 -wd4201 -wd4189 -wd4100 -wd4996 -wd4505 -FC -Z7 -I..\src
 set LinkerFlags=-opt:ref -incremental:no
@@ -159,4 +160,12 @@ if %BUILD_EXECUTABLE%==1 (
         asset_loader.lib
 )
 
+if %BUILD_TOOLS%==1 (
+    REM Build partial render merge tool
+    cl ../src/merge_partials.cpp ^
+        %CompilerFlags% ^
+        -O2 ^
+        -link %LinkerFlags%
+)
+
 popd
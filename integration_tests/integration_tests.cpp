@@ -8,6 +8,7 @@
 #include <assimp/postprocess.h>
 
 #include "platform.h"
+#include "intrinsics.h"
 #include "math_lib.h"
 #include "tile.h"
 #include "memory_pool.h"
@@ -15,10 +16,17 @@
 #include "ray_intersection.h"
 #include "asset_loader/asset_loader.h"
 #include "mesh.h"
+#include "sp_sampler.h"
 #include "sp_scene.h"
 #include "sp_material_system.h"
+#include "sp_radiance_cache.h"
+#include "sp_path_guiding.h"
+#include "sp_accumulation.h"
+#include "sp_shading_cache.h"
 #include "sp_metrics.h"
 #include "simd_path_tracer.h"
+#include "sp_temporal.h"
+#include "sp_denoiser.h"
 
 #include "simd.h"
 #include "aabb.h"
@@ -31,13 +39,22 @@
 #include "cmdline.cpp"
 
 #define SAMPLES_PER_PIXEL 1
+#define MAX_BOUNCES 3
+#define RUSSIAN_ROULETTE_MIN_BOUNCES 3
 
 #include "ray_intersection.cpp"
 #include "memory_pool.cpp"
 #include "bvh.cpp"
+#include "sp_sampler.cpp"
 #include "sp_scene.cpp"
 #include "sp_material_system.cpp"
+#include "sp_radiance_cache.cpp"
+#include "sp_path_guiding.cpp"
+#include "sp_accumulation.cpp"
+#include "sp_shading_cache.cpp"
+#include "sp_temporal.cpp"
 #include "simd_path_tracer.cpp"
+#include "sp_denoiser.cpp"
 #include "mesh_generation.cpp" // Used for sphere mesh
 
 #define MEMORY_ARENA_SIZE Megabytes(16)
@@ -66,6 +83,21 @@ void TestLoadMesh()
     TEST_ASSERT_GREATER_THAN_UINT(0, meshData.vertexCount);
 }
 
+void TestLoadModel()
+{
+    const char *modelName = "bunny.obj";
+    ModelData modelData = LoadModel(modelName, &memoryArena, g_AssetDir);
+    TEST_ASSERT_GREATER_THAN_UINT(0, modelData.meshCount);
+    TEST_ASSERT_GREATER_THAN_UINT(0, modelData.instanceCount);
+
+    // Check that every instance references a valid mesh
+    for (u32 i = 0; i < modelData.instanceCount; i++)
+    {
+        TEST_ASSERT_LESS_THAN_UINT(
+            modelData.meshCount, modelData.instances[i].mesh);
+    }
+}
+
 void TestBuildMeshMidphase()
 {
     MeshData meshData = CreateIcosahedronMesh(3, &memoryArena);
@@ -73,13 +105,25 @@ void TestBuildMeshMidphase()
             meshData.indices, meshData.indexCount);
     sp_BuildMeshMidphase(&mesh, &memoryArena, &memoryArena);
 
-    u32 leafCount = meshData.vertexCount / 3;
-    for (u32 i = 0; i < leafCount; i++)
+    // NOTE: Leaves store multiple triangles so check that every triangle was
+    // copied into the leaf ordered triangle data instead of searching the tree
+    u32 triangleCount = meshData.indexCount / 3;
+    TEST_ASSERT_EQUAL_UINT32(triangleCount, mesh.triangles.count);
+    for (u32 i = 0; i < triangleCount; i++)
     {
+        b32 found = false;
+        for (u32 j = 0; j < mesh.triangles.count; j++)
+        {
+            if (mesh.triangles.triangleIndices[j] == i)
+            {
+                found = true;
+                break;
+            }
+        }
+
         char msg[80];
-        snprintf(msg, sizeof(msg), "Cound not find leaf index %u", i);
-        TEST_ASSERT_TRUE_MESSAGE(
-            bvh_FindLeafIndex(mesh.midphaseTree.root, i), msg);
+        snprintf(msg, sizeof(msg), "Cound not find triangle index %u", i);
+        TEST_ASSERT_TRUE_MESSAGE(found, msg);
     }
 }
 
@@ -166,6 +210,7 @@ int main(int argc, char **argv)
 
     UNITY_BEGIN();
     RUN_TEST(TestLoadMesh);
+    RUN_TEST(TestLoadModel);
     RUN_TEST(TestBuildMeshMidphase);
     RUN_TEST(TestSimdPathTracer);
 
@@ -4,6 +4,7 @@
 
 #include "config.h" // Needed to enable BVH_SIMD_RAY_INTERSECT_AABB
 #include "platform.h"
+#include "intrinsics.h"
 #include "math_lib.h"
 #include "memory_pool.h"
 #include "bvh.h"
@@ -11,10 +12,17 @@
 #include "asset_loader/asset_loader.h"
 #include "mesh.h"
 #include "sp_metrics.h"
+#include "sp_sampler.h"
 #include "sp_scene.h"
 #include "sp_material_system.h"
+#include "sp_radiance_cache.h"
+#include "sp_path_guiding.h"
+#include "sp_accumulation.h"
+#include "sp_shading_cache.h"
 #include "tile.h"
 #include "simd_path_tracer.h"
+#include "sp_temporal.h"
+#include "sp_denoiser.h"
 
 #include "simd.h"
 #include "aabb.h"
@@ -23,9 +31,16 @@
 #include "memory_pool.cpp"
 #include "ray_intersection.cpp"
 #include "bvh.cpp"
+#include "sp_sampler.cpp"
 #include "sp_scene.cpp"
 #include "sp_material_system.cpp"
+#include "sp_radiance_cache.cpp"
+#include "sp_path_guiding.cpp"
+#include "sp_accumulation.cpp"
+#include "sp_shading_cache.cpp"
+#include "sp_temporal.cpp"
 #include "simd_path_tracer.cpp"
+#include "sp_denoiser.cpp"
 
 #include "mesh.h"
 #include "mesh_generation.cpp"
@@ -57,6 +57,13 @@ inline Aabb TransformAabb(
     return result;
 }
 
+inline f32 AabbSurfaceArea(vec3 min, vec3 max)
+{
+    vec3 d = max - min;
+    f32 result = 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    return result;
+}
+
 inline b32 AabbContainsPoint(vec3 min, vec3 max, vec3 p)
 {
     b32 result = true;
@@ -1,6 +1,3 @@
-// TODO: This should be a parameter of the tree structure for iteration
-#define BVH_STACK_SIZE 256
-
 inline bvh_Node *bvh_AllocateNode(MemoryPool *pool)
 {
     bvh_Node *node = (bvh_Node*)AllocateFromPool(pool, sizeof(bvh_Node));
@@ -48,11 +45,75 @@ void bvh_SortNodesByDistanceSq(vec3 p, bvh_NodeDistSqPair *nodes, u32 count)
     qsort(nodes, count, sizeof(nodes[0]), CompareNodeDistSqPair);
 }
 
+struct bvh_SahAreas
+{
+    f32 interior;
+    f32 leaf;
+};
+
+inline f32 bvh_ComputeSahCostFromAreas(bvh_SahAreas areas, f32 rootArea)
+{
+    f32 result = 0.0f;
+
+    // Avoid dividing by zero for degenerate trees (e.g. a single point)
+    if (rootArea > EPSILON)
+    {
+        result = (BVH_SAH_TRAVERSAL_COST * areas.interior +
+                     BVH_SAH_INTERSECTION_COST * areas.leaf) /
+                 rootArea;
+    }
+
+    return result;
+}
+
+internal void bvh_SumSurfaceAreas(bvh_Node *node, bvh_SahAreas *areas)
+{
+    f32 area = AabbSurfaceArea(node->min, node->max);
+    if (node->children[0] != NULL)
+    {
+        areas->interior += area;
+        for (u32 i = 0; i < BVH_CHILDREN_PER_NODE; ++i)
+        {
+            if (node->children[i] != NULL)
+            {
+                bvh_SumSurfaceAreas(node->children[i], areas);
+            }
+        }
+    }
+    else
+    {
+        areas->leaf += area;
+    }
+}
+
+// Computes the expected cost of intersecting a random ray with the tree using
+// the surface area heuristic, normalized by the surface area of the root node
+f32 bvh_ComputeSahCost(bvh_Tree *tree)
+{
+    f32 result = 0.0f;
+    if (tree->root != NULL)
+    {
+        bvh_SahAreas areas = {};
+        bvh_SumSurfaceAreas(tree->root, &areas);
+
+        f32 rootArea = AabbSurfaceArea(tree->root->min, tree->root->max);
+        result = bvh_ComputeSahCostFromAreas(areas, rootArea);
+    }
+
+    return result;
+}
+
 bvh_Tree bvh_CreateTree(
     MemoryArena *arena, vec3 *aabbMin, vec3 *aabbMax, u32 count)
 {
     bvh_Tree result = {};
 
+    if (count == 0)
+    {
+        // Nothing to build, leave root as NULL
+        return result;
+    }
+
     // TODO: Calculate number of nodes to allocate
     u32 nodeCapacity = count * 10;
     bvh_Node *nodeStorage = AllocateArray(arena, bvh_Node, nodeCapacity);
@@ -84,6 +145,7 @@ bvh_Tree bvh_CreateTree(
         node->children[2] = NULL;
         node->children[3] = NULL;
         node->leafIndex = leafIndex;
+        node->itemCount = 1;
 
         unmergedNodes[readIndex][leafIndex].node = node;
     }
@@ -195,10 +257,199 @@ bvh_Tree bvh_CreateTree(
     FreeFromMemoryArena(arena, unmergedNodes[0]);
 
     result.root = lastAllocatedNode;
+    result.leafCount = count;
+    result.buildCost = bvh_ComputeSahCost(&result);
 
     return result;
 }
 
+internal void bvh_RefitNode(bvh_Node *node, vec3 *aabbMin, vec3 *aabbMax,
+    bvh_SahAreas *areas)
+{
+    if (node->children[0] != NULL)
+    {
+        // Refit children first so that we can compute our bounds from them
+        bvh_RefitNode(node->children[0], aabbMin, aabbMax, areas);
+        node->min = node->children[0]->min;
+        node->max = node->children[0]->max;
+
+        for (u32 i = 1; i < BVH_CHILDREN_PER_NODE; ++i)
+        {
+            bvh_Node *child = node->children[i];
+            if (child != NULL)
+            {
+                bvh_RefitNode(child, aabbMin, aabbMax, areas);
+                node->min = Min(node->min, child->min);
+                node->max = Max(node->max, child->max);
+            }
+        }
+
+        areas->interior += AabbSurfaceArea(node->min, node->max);
+    }
+    else
+    {
+        node->min = aabbMin[node->leafIndex];
+        node->max = aabbMax[node->leafIndex];
+
+        areas->leaf += AabbSurfaceArea(node->min, node->max);
+    }
+}
+
+// Recomputes the bounds of every node in place after the leaf AABBs have
+// changed, aabbMin and aabbMax must contain the same number of entries that
+// the tree was built with. The topology of the tree is not changed so the
+// result indicates when the tree has degraded enough that it should be rebuilt
+// with bvh_CreateTree.
+bvh_RefitResult bvh_RefitTree(bvh_Tree *tree, vec3 *aabbMin, vec3 *aabbMax)
+{
+    bvh_RefitResult result = {};
+
+    if (tree->root != NULL)
+    {
+        bvh_SahAreas areas = {};
+        bvh_RefitNode(tree->root, aabbMin, aabbMax, &areas);
+
+        f32 rootArea = AabbSurfaceArea(tree->root->min, tree->root->max);
+        result.cost = bvh_ComputeSahCostFromAreas(areas, rootArea);
+        result.rebuildRequired =
+            result.cost > tree->buildCost * BVH_REFIT_REBUILD_THRESHOLD;
+    }
+
+    return result;
+}
+
+struct bvh_EvaluateCollapseResult
+{
+    u32 itemCount;
+    f32 cost;
+};
+
+inline f32 bvh_ComputeLeafCost(f32 area, u32 itemCount, u32 itemsPerTest)
+{
+    u32 testCount = (itemCount + itemsPerTest - 1) / itemsPerTest;
+    f32 result = BVH_SAH_INTERSECTION_COST * area * (f32)testCount;
+    return result;
+}
+
+// Computes the SAH cost of each subtree bottom up and marks nodes which should
+// become leaves by setting their itemCount, the children of marked nodes are
+// left in place so that their items can be gathered afterwards
+internal bvh_EvaluateCollapseResult bvh_EvaluateCollapse(
+    bvh_Node *node, u32 maxLeafSize, u32 itemsPerTest)
+{
+    bvh_EvaluateCollapseResult result = {};
+
+    f32 area = AabbSurfaceArea(node->min, node->max);
+    if (node->children[0] != NULL)
+    {
+        f32 childCost = 0.0f;
+        for (u32 i = 0; i < BVH_CHILDREN_PER_NODE; ++i)
+        {
+            if (node->children[i] != NULL)
+            {
+                bvh_EvaluateCollapseResult childResult = bvh_EvaluateCollapse(
+                    node->children[i], maxLeafSize, itemsPerTest);
+                result.itemCount += childResult.itemCount;
+                childCost += childResult.cost;
+            }
+        }
+
+        result.cost = BVH_SAH_TRAVERSAL_COST * area + childCost;
+
+        if (result.itemCount <= maxLeafSize)
+        {
+            f32 leafCost =
+                bvh_ComputeLeafCost(area, result.itemCount, itemsPerTest);
+            if (leafCost <= result.cost)
+            {
+                node->itemCount = result.itemCount;
+                result.cost = leafCost;
+            }
+        }
+    }
+    else
+    {
+        result.itemCount = node->itemCount;
+        result.cost = bvh_ComputeLeafCost(area, node->itemCount, itemsPerTest);
+    }
+
+    return result;
+}
+
+internal void bvh_GatherLeafItems(
+    MemoryPool *pool, bvh_Node *node, u32 *leafItems, u32 *leafItemCount)
+{
+    if (node->children[0] != NULL)
+    {
+        for (u32 i = 0; i < BVH_CHILDREN_PER_NODE; ++i)
+        {
+            bvh_Node *child = node->children[i];
+            if (child != NULL)
+            {
+                bvh_GatherLeafItems(pool, child, leafItems, leafItemCount);
+                FreeFromPool(pool, child);
+                node->children[i] = NULL;
+            }
+        }
+    }
+    else
+    {
+        // Nodes below a collapsed node are always leaves from bvh_CreateTree
+        Assert(node->itemCount == 1);
+        leafItems[(*leafItemCount)++] = node->leafIndex;
+    }
+}
+
+internal void bvh_CollapseNode(
+    MemoryPool *pool, bvh_Node *node, u32 *leafItems, u32 *leafItemCount)
+{
+    if (node->itemCount > 0)
+    {
+        u32 first = *leafItemCount;
+        bvh_GatherLeafItems(pool, node, leafItems, leafItemCount);
+
+        node->leafIndex = first;
+        node->itemCount = *leafItemCount - first;
+    }
+    else
+    {
+        for (u32 i = 0; i < BVH_CHILDREN_PER_NODE; ++i)
+        {
+            if (node->children[i] != NULL)
+            {
+                bvh_CollapseNode(
+                    pool, node->children[i], leafItems, leafItemCount);
+            }
+        }
+    }
+}
+
+// Collapses subtrees into a single leaf wherever testing all of their items
+// directly is cheaper than traversing them according to the SAH. Items are
+// assumed to be tested itemsPerTest at a time (e.g. SIMD lane count) and no
+// leaf will hold more than maxLeafSize items.
+//
+// leafItems must have space for tree->leafCount entries and receives the
+// original leaf index of every item, ordered so that the items of each leaf
+// are contiguous. The leafIndex of every leaf node becomes the offset of its
+// first item in leafItems.
+// NOTE: Collapsed trees can't be refitted with bvh_RefitTree
+void bvh_CollapseLeaves(
+    bvh_Tree *tree, u32 maxLeafSize, u32 itemsPerTest, u32 *leafItems)
+{
+    Assert(itemsPerTest > 0);
+
+    if (tree->root != NULL)
+    {
+        bvh_EvaluateCollapse(tree->root, maxLeafSize, itemsPerTest);
+
+        u32 leafItemCount = 0;
+        bvh_CollapseNode(
+            &tree->memoryPool, tree->root, leafItems, &leafItemCount);
+        Assert(leafItemCount == tree->leafCount);
+    }
+}
+
 // TODO: tmax
 bvh_IntersectRayResult bvh_IntersectRay(bvh_Tree *tree, vec3 rayOrigin,
     vec3 rayDirection, bvh_Node **intersectedNodes, u32 maxIntersections)
@@ -310,6 +561,75 @@ bvh_IntersectRayResult bvh_IntersectRay(bvh_Tree *tree, vec3 rayOrigin,
     return result;
 }
 
+// Starts a depth first traversal of the leaves intersected by the ray, unlike
+// bvh_IntersectRay the leaves are returned one at a time by
+// bvh_NextIntersectedLeaf so the caller can stop as soon as it finds what it
+// is looking for.
+void bvh_BeginRayTraversal(bvh_RayTraversal *traversal, bvh_Tree *tree,
+    vec3 rayOrigin, vec3 rayDirection)
+{
+    traversal->stackSize = 0;
+    traversal->rayOrigin = rayOrigin;
+    traversal->invRayDirection = Inverse(rayDirection);
+
+    bvh_Node *root = tree->root;
+    if (root != NULL)
+    {
+        u32 mask = simd_RayIntersectAabb4(&root->min, &root->max, rayOrigin,
+            traversal->invRayDirection);
+
+        // NOTE: We're only testing 1 box so its just checking if 0th bit is set
+        if ((mask & 0x1) == 0x1)
+        {
+            traversal->stack[0] = root;
+            traversal->stackSize = 1;
+        }
+    }
+}
+
+// Returns the next leaf intersected by the ray or NULL once the traversal is
+// complete
+bvh_Node *bvh_NextIntersectedLeaf(bvh_RayTraversal *traversal)
+{
+    bvh_Node *result = NULL;
+
+    while (traversal->stackSize > 0)
+    {
+        bvh_Node *node = traversal->stack[--traversal->stackSize];
+        if (node->children[0] == NULL)
+        {
+            result = node;
+            break;
+        }
+
+        vec3 boxMins[4];
+        vec3 boxMaxes[4];
+        u32 childCount = 0;
+        for (u32 i = 0; i < BVH_CHILDREN_PER_NODE; i++)
+        {
+            if (node->children[i] != NULL)
+            {
+                boxMins[i] = node->children[i]->min;
+                boxMaxes[i] = node->children[i]->max;
+                childCount++;
+            }
+        }
+
+        u32 mask = simd_RayIntersectAabb4(boxMins, boxMaxes,
+            traversal->rayOrigin, traversal->invRayDirection);
+        for (u32 i = 0; i < childCount; i++)
+        {
+            if ((mask & (1 << i)) != 0)
+            {
+                Assert(traversal->stackSize < BVH_STACK_SIZE);
+                traversal->stack[traversal->stackSize++] = node->children[i];
+            }
+        }
+    }
+
+    return result;
+}
+
 b32 bvh_FindLeafIndex(bvh_Node *node, u32 index)
 {
     b32 result = false;
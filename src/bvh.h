@@ -9,12 +9,42 @@ struct bvh_Node
     bvh_Node *children[BVH_CHILDREN_PER_NODE];
     // TODO: Do we need a childCount variable?
     u32 leafIndex;
+
+    // Number of items stored in a leaf node, always 1 unless the tree has been
+    // collapsed with bvh_CollapseLeaves
+    u32 itemCount;
 };
 
+// Relative costs of visiting an interior node and testing a leaf used by the
+// surface area heuristic
+#define BVH_SAH_TRAVERSAL_COST 1.0f
+#define BVH_SAH_INTERSECTION_COST 1.0f
+
+// Refitting keeps the topology of the tree, once the SAH cost after a refit
+// exceeds the cost of the tree when it was built by this factor the tree
+// should be rebuilt
+#define BVH_REFIT_REBUILD_THRESHOLD 1.5f
+
 struct bvh_Tree
 {
     bvh_Node *root;
     MemoryPool memoryPool;
+    u32 leafCount;
+
+    // SAH cost of the tree when it was built
+    f32 buildCost;
+};
+
+// TODO: This should be a parameter of the tree structure for iteration
+#define BVH_STACK_SIZE 256
+
+// State for walking the leaves intersected by a ray one at a time
+struct bvh_RayTraversal
+{
+    bvh_Node *stack[BVH_STACK_SIZE];
+    u32 stackSize;
+    vec3 rayOrigin;
+    vec3 invRayDirection;
 };
 
 struct bvh_IntersectRayResult
@@ -24,3 +54,9 @@ struct bvh_IntersectRayResult
     u32 aabbTestCount;
 };
 
+struct bvh_RefitResult
+{
+    // SAH cost of the tree after refitting
+    f32 cost;
+    b32 rebuildRequired;
+};
@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <cstring>
 
 internal b32 ParseCommandLineArgs(
@@ -13,3 +14,112 @@ internal b32 ParseCommandLineArgs(
     }
     return false;
 }
+
+// Options for rendering part of an image for distributed rendering, the
+// partial files written by each process are combined with merge_partials
+struct PartialRenderArgs
+{
+    const char *outputPath;
+    u32 firstSample;
+    u32 sampleCount; // 0 uses SAMPLES_PER_PIXEL
+    u32 tileSubsetIndex;
+    u32 tileSubsetCount;
+
+    // Progress is periodically written here if set, with resume the render
+    // continues from the samples completed in an existing checkpoint
+    const char *checkpointPath;
+    b32 resume;
+};
+
+// Parses a whole decimal number which fits in a u32, returns false for
+// anything else including empty strings, signs and trailing characters
+internal b32 ParseU32Arg(const char *arg, u32 *value)
+{
+    if (arg[0] < '0' || arg[0] > '9')
+    {
+        return false;
+    }
+
+    char *end = NULL;
+    unsigned long result = strtoul(arg, &end, 10);
+    if (*end != '\0' || result > U32_MAX)
+    {
+        return false;
+    }
+
+    *value = (u32)result;
+    return true;
+}
+
+// Parses --partial-output <path>, --sample-range <first> <count>,
+// --tile-subset <index> <count>, --checkpoint <path> and --resume from
+// anywhere in argv. outputPath is NULL if no partial render was requested.
+// Returns false if any option was invalid or is missing its arguments.
+internal b32 ParsePartialRenderArgs(
+    int argc, const char **argv, PartialRenderArgs *args)
+{
+    *args = {};
+    args->tileSubsetCount = 1;
+
+    b32 isValid = true;
+    for (int i = 1; i < argc; i++)
+    {
+        // NOTE: An option missing its arguments can only be the last one
+        int remaining = argc - i - 1;
+        if (strcmp(argv[i], "--partial-output") == 0)
+        {
+            if (remaining < 1)
+            {
+                isValid = false;
+                break;
+            }
+            args->outputPath = argv[i + 1];
+            i += 1;
+        }
+        else if (strcmp(argv[i], "--sample-range") == 0)
+        {
+            if (remaining < 2)
+            {
+                isValid = false;
+                break;
+            }
+            isValid = isValid &&
+                      ParseU32Arg(argv[i + 1], &args->firstSample) &&
+                      ParseU32Arg(argv[i + 2], &args->sampleCount) &&
+                      (args->sampleCount > 0);
+            i += 2;
+        }
+        else if (strcmp(argv[i], "--tile-subset") == 0)
+        {
+            if (remaining < 2)
+            {
+                isValid = false;
+                break;
+            }
+            isValid = isValid &&
+                      ParseU32Arg(argv[i + 1], &args->tileSubsetIndex) &&
+                      ParseU32Arg(argv[i + 2], &args->tileSubsetCount) &&
+                      (args->tileSubsetIndex < args->tileSubsetCount);
+            i += 2;
+        }
+        else if (strcmp(argv[i], "--checkpoint") == 0)
+        {
+            if (remaining < 1)
+            {
+                isValid = false;
+                break;
+            }
+            args->checkpointPath = argv[i + 1];
+            i += 1;
+        }
+        else if (strcmp(argv[i], "--resume") == 0)
+        {
+            args->resume = true;
+        }
+    }
+
+    // Can't resume without knowing where the checkpoint is
+    isValid = isValid && (!args->resume || args->checkpointPath != NULL);
+
+    return isValid;
+}
@@ -20,15 +20,98 @@
 
 #define MAX_THREADS 16
 
-#define MAX_BOUNCES 3
+// Maximum path length for the CPU path tracer, paths are normally terminated
+// much earlier by russian roulette
+#define MAX_BOUNCES 16
+
+// Number of bounces traced for every path before russian roulette starts
+// terminating paths based on their throughput
+#define RUSSIAN_ROULETTE_MIN_BOUNCES 3
 
 #define SAMPLES_PER_PIXEL 1024
 
+// Pixels stop sampling once the standard error of their mean is below this
+// fraction of the mean (set to 0 to always take SAMPLES_PER_PIXEL samples)
+#define ADAPTIVE_SAMPLING_MAX_RELATIVE_ERROR 0.02f
+
+// Samples taken for every pixel before checking for convergence
+#define ADAPTIVE_SAMPLING_MIN_SAMPLES 32
+
+// Use Owen scrambled Sobol points rather than white noise for the CPU path
+// tracer
+#define USE_SOBOL_SAMPLER 1
+
+// Cache the radiance leaving diffuse surfaces in a world space hash grid so
+// that paths can terminate after their first diffuse bounce, trades some bias
+// for much less noise in the indirect lighting
+#define USE_RADIANCE_CACHE 0
+
+// Size of the radiance cache grid cells in world units and the number of cells
+// in the hash table (must be a power of 2)
+#define RADIANCE_CACHE_CELL_SIZE 0.25f
+#define RADIANCE_CACHE_CAPACITY (1 << 18)
+
+// Learn the distribution of incident light over a few short training passes
+// and sample it alongside the BSDF, mostly helps interiors lit through small
+// openings
+#define USE_PATH_GUIDING 1
+
+// Number of training passes before the final render, the first pass takes 1
+// sample per pixel and each following pass takes twice as many
+#define PATH_GUIDING_TRAINING_PASSES 4
+
+// Write the AOV channels (albedo, normal, depth, material id, direct and
+// indirect radiance, variance and position) alongside the CPU path tracer
+// output
+#define OUTPUT_AOVS 1
+
+// Run the edge-avoiding a-trous denoiser over the CPU path tracer output once
+// rendering has finished, needs OUTPUT_AOVS to guide the filter
+#define ENABLE_DENOISER 1
+#define DENOISER_ITERATIONS 5
+
+// Trace every 2^PREVIEW_LEVELS'th pixel along x and y at 1 sample per pixel,
+// then every 2^(PREVIEW_LEVELS - 1)'th and so on before the full render. The
+// CPU path tracer restarts from the coarsest level whenever the camera moves.
+#define ENABLE_PREVIEW 1
+#define PREVIEW_LEVELS 2
+
+// Reproject the image of the previous view when the CPU path tracer restarts
+// after a camera move so that pixels which still see the same surface don't
+// start from zero, needs OUTPUT_AOVS for the first hit positions
+#define USE_TEMPORAL_REPROJECTION 1
+
+// Keep the compressed path vertices of the first few samples of each pixel so
+// that material edits (M cycles the albedo of the white material) are shaded
+// again without tracing any rays, as a preview until the view has been traced
+// again with the new material. Needs about 140MB per cached sample at the
+// default resolution.
+#define USE_SHADING_CACHE 0
+#define SHADING_CACHE_SAMPLES_PER_PIXEL 2
+
+// CPU time in whole milliseconds, summed over the worker threads, the CPU path
+// tracer may spend per displayed frame (0 for no limit). With a budget the
+// final render is traced in passes of FRAME_BUDGET_PASS_SAMPLES samples per
+// pixel so that no task holds a worker for much longer than a frame. Adaptive
+// sampling and the AOVs use the statistics of every pass traced so far.
+#define FRAME_BUDGET_MS 0
+#define FRAME_BUDGET_PASS_SAMPLES 8
+
+// Partial renders (main --partial-output) trace this many samples per pixel
+// between chances to checkpoint, and write a checkpoint at most once every
+// CHECKPOINT_INTERVAL seconds when --checkpoint is given
+#define CHECKPOINT_PASS_SAMPLES 16
+#define CHECKPOINT_INTERVAL 300.0
+
 #define APPLICATION_MEMORY_LIMIT Megabytes(512)
 
 // Use Moller-Trumbore algorithm (needed for proper UVs but also seems much faster)
 #define USE_MT_RAY_TRIANGLE_INTERSECT 1
 
+// Number of triangles tested at once for mesh intersection, 4 uses SSE, 8 uses
+// AVX (must be enabled in the compiler flags) and 1 is the scalar reference
+#define RAY_INTERSECT_TRIANGLES_SIMD_WIDTH 4
+
 #define RAY_TRACER_WIDTH (1024 / 1)
 #define RAY_TRACER_HEIGHT (768 / 1)
 
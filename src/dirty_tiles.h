@@ -0,0 +1,115 @@
+#pragma once
+
+#define DIRTY_TILES_MAX 4096
+
+// Which cells of a tile grid over an image have been written since they were
+// last uploaded to the GPU. Worker threads mark the tiles they finish and the
+// main thread collects them once per frame so that only the regions which
+// changed are copied.
+struct DirtyTiles
+{
+    volatile u32 flags[DIRTY_TILES_MAX];
+    u32 imageWidth;
+    u32 imageHeight;
+    u32 tileWidth;
+    u32 tileHeight;
+    u32 tileCountX;
+    u32 tileCountY;
+};
+
+inline void MarkAllTilesDirty(DirtyTiles *dirtyTiles)
+{
+    u32 tileCount = dirtyTiles->tileCountX * dirtyTiles->tileCountY;
+    for (u32 i = 0; i < tileCount; i++)
+    {
+        dirtyTiles->flags[i] = 1;
+    }
+}
+
+// Every tile starts dirty as nothing has been uploaded yet
+inline void InitializeDirtyTiles(DirtyTiles *dirtyTiles, u32 imageWidth,
+    u32 imageHeight, u32 tileWidth, u32 tileHeight)
+{
+    dirtyTiles->imageWidth = imageWidth;
+    dirtyTiles->imageHeight = imageHeight;
+    dirtyTiles->tileWidth = tileWidth;
+    dirtyTiles->tileHeight = tileHeight;
+    dirtyTiles->tileCountX = (imageWidth + tileWidth - 1) / tileWidth;
+    dirtyTiles->tileCountY = (imageHeight + tileHeight - 1) / tileHeight;
+    Assert(dirtyTiles->tileCountX * dirtyTiles->tileCountY <=
+           DIRTY_TILES_MAX);
+
+    MarkAllTilesDirty(dirtyTiles);
+}
+
+// Marks every grid cell overlapping the region, which may be any rectangle of
+// pixels (e.g. a tile clipped to a region of interest)
+inline void MarkTilesDirty(DirtyTiles *dirtyTiles, Tile region)
+{
+    u32 maxX = MinU32(region.maxX, dirtyTiles->imageWidth);
+    u32 maxY = MinU32(region.maxY, dirtyTiles->imageHeight);
+    if (region.minX < maxX && region.minY < maxY)
+    {
+        u32 minTileX = region.minX / dirtyTiles->tileWidth;
+        u32 minTileY = region.minY / dirtyTiles->tileHeight;
+        u32 maxTileX = (maxX - 1) / dirtyTiles->tileWidth;
+        u32 maxTileY = (maxY - 1) / dirtyTiles->tileHeight;
+        for (u32 tileY = minTileY; tileY <= maxTileY; tileY++)
+        {
+            for (u32 tileX = minTileX; tileX <= maxTileX; tileX++)
+            {
+                dirtyTiles->flags[tileX + tileY * dirtyTiles->tileCountX] = 1;
+            }
+        }
+    }
+}
+
+// Writes the pixel regions to upload to regions and clears their dirty flags,
+// returning the number of regions. Runs of dirty tiles along a row are merged
+// into a single region. Tiles which don't fit in maxRegions stay dirty for the
+// next call.
+inline u32 CollectDirtyTiles(
+    DirtyTiles *dirtyTiles, Tile *regions, u32 maxRegions)
+{
+    u32 count = 0;
+    for (u32 tileY = 0; tileY < dirtyTiles->tileCountY; tileY++)
+    {
+        b32 isRunActive = false;
+        for (u32 tileX = 0; tileX < dirtyTiles->tileCountX; tileX++)
+        {
+            // A new run needs space for another region
+            if (!isRunActive && count == maxRegions)
+            {
+                return count;
+            }
+
+            // NOTE: Cleared atomically so that a worker marking the tile again
+            // in between testing and clearing the flag is never lost
+            volatile u32 *flag =
+                dirtyTiles->flags + tileX + tileY * dirtyTiles->tileCountX;
+            b32 isDirty = (AtomicCompareExchange(flag, 0, 1) == 1);
+            if (isDirty)
+            {
+                u32 maxX = MinU32((tileX + 1) * dirtyTiles->tileWidth,
+                    dirtyTiles->imageWidth);
+                if (isRunActive)
+                {
+                    regions[count - 1].maxX = maxX;
+                }
+                else
+                {
+                    Tile region = {};
+                    region.minX = tileX * dirtyTiles->tileWidth;
+                    region.minY = tileY * dirtyTiles->tileHeight;
+                    region.maxX = maxX;
+                    region.maxY = MinU32((tileY + 1) * dirtyTiles->tileHeight,
+                        dirtyTiles->imageHeight);
+                    regions[count++] = region;
+                }
+            }
+            isRunActive = isDirty;
+        }
+    }
+
+    return count;
+}
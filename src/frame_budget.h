@@ -0,0 +1,66 @@
+#pragma once
+
+// CPU time the worker threads may spend on queued tasks for each displayed
+// frame, measured in cycles of the calibrated time stamp counter. Workers only
+// start a task while budget remains and charge the cycles it took once it
+// completes, so every thread can overshoot by up to one task. The overshoot is
+// paid back from the next frame so that the average stays on budget.
+struct FrameBudget
+{
+    volatile i64 cyclesRemaining;
+    i64 cyclesPerFrame; // 0 if there is no budget
+};
+
+inline FrameBudget CreateFrameBudget(f64 millisecondsPerFrame,
+    f64 cyclesPerSecond)
+{
+    FrameBudget result = {};
+    result.cyclesPerFrame =
+        (i64)(millisecondsPerFrame * 0.001 * cyclesPerSecond);
+    result.cyclesRemaining = result.cyclesPerFrame;
+
+    return result;
+}
+
+// Called once per frame by the main thread, budget left unused by the
+// previous frame is not carried over
+inline void RefillFrameBudget(FrameBudget *budget)
+{
+    if (budget->cyclesPerFrame > 0)
+    {
+        // NOTE: Added atomically as workers may be charging tasks in between
+        // reading the remaining budget and writing it
+        i64 remaining = budget->cyclesRemaining;
+        i64 refill =
+            budget->cyclesPerFrame - ((remaining > 0) ? remaining : 0);
+        AtomicExchangeAdd64(&budget->cyclesRemaining, refill);
+    }
+}
+
+inline b32 HasFrameBudget(FrameBudget *budget)
+{
+    b32 result =
+        (budget->cyclesPerFrame == 0) || (budget->cyclesRemaining > 0);
+    return result;
+}
+
+inline void ChargeFrameBudget(FrameBudget *budget, u64 cycles)
+{
+    if (budget->cyclesPerFrame > 0)
+    {
+        AtomicExchangeAdd64(&budget->cyclesRemaining, -(i64)cycles);
+    }
+}
+
+// Rate of the time stamp counter from two readings of it and of a wall clock
+inline f64 ComputeCyclesPerSecond(
+    u64 startCycles, u64 endCycles, f64 startSeconds, f64 endSeconds)
+{
+    f64 result = 0.0;
+    if (endSeconds > startSeconds && endCycles > startCycles)
+    {
+        result = (f64)(endCycles - startCycles) / (endSeconds - startSeconds);
+    }
+
+    return result;
+}
@@ -21,7 +21,7 @@ inline i64 AtomicExchangeAdd64(volatile i64 *addend, i64 value)
     i64 result = _InterlockedExchangeAdd64(addend, value);
 #elif defined(PLATFORM_LINUX)
     // TODO: Probably not the right memory model - https://gcc.gnu.org/wiki/Atomic/GCCMM/AtomicSync
-    i32 result = __atomic_fetch_add(addend, value, __ATOMIC_SEQ_CST);
+    i64 result = __atomic_fetch_add(addend, value, __ATOMIC_SEQ_CST);
 #else
 #error "UNSUPPORTED PLATFORM"
 #endif
@@ -39,3 +39,39 @@ inline void AtomicIncrement64(i64 *addend)
 #error "UNSUPPORTED PLATFORM"
 #endif
 }
+
+// Returns the value of *dest before the exchange, the exchange only happened
+// if this is equal to comparand
+inline u32 AtomicCompareExchange(
+    volatile u32 *dest, u32 exchange, u32 comparand)
+{
+#ifdef PLATFORM_WINDOWS
+    u32 result = (u32)_InterlockedCompareExchange(
+        (volatile long *)dest, (long)exchange, (long)comparand);
+#elif defined(PLATFORM_LINUX)
+    u32 result = __sync_val_compare_and_swap(dest, comparand, exchange);
+#else
+#error "UNSUPPORTED PLATFORM"
+#endif
+    return result;
+}
+
+inline void AtomicAddF32(volatile f32 *addend, f32 value)
+{
+    // No native atomic float add so retry until no other thread has modified
+    // the value between reading and writing it
+    volatile u32 *bits = (volatile u32 *)addend;
+    for (;;)
+    {
+        u32 expected = *bits;
+        f32 current = 0.0f;
+        CopyMemory(&current, &expected, sizeof(f32));
+        f32 sum = current + value;
+        u32 desired = 0;
+        CopyMemory(&desired, &sum, sizeof(f32));
+        if (AtomicCompareExchange(bits, desired, expected) == expected)
+        {
+            break;
+        }
+    }
+}
@@ -30,6 +30,30 @@ internal void AddEntity(Scene *scene, vec3 position, quat rotation, vec3 scale,
     }
 }
 
+// Adds an entity for every instance in the model, the instance transforms are
+// relative to the given model transform
+internal void AddModel(Scene *scene, u32 modelId, vec3 position,
+    quat rotation, vec3 scale, u32 material)
+{
+    Assert(modelId < scene->modelCount);
+    Model *model = scene->models + modelId;
+
+    for (u32 i = 0; i < model->instanceCount; ++i)
+    {
+        MeshInstance *instance = model->instances + i;
+
+        // NOTE: Assumes uniform scaling which AddEntity also requires
+        vec3 instancePosition =
+            position +
+            RotateVector(Hadamard(instance->position, scale), rotation);
+        quat instanceRotation = rotation * instance->rotation;
+        vec3 instanceScale = Hadamard(instance->scale, scale);
+
+        AddEntity(scene, instancePosition, instanceRotation, instanceScale,
+            model->firstMesh + instance->mesh, material);
+    }
+}
+
 // TODO: Derive radiance from material?
 internal void AddSphereLight(
     Scene *scene, vec3 center, vec3 radiance, f32 radius)
@@ -86,4 +110,11 @@ void GenerateScene(Scene *scene)
             AddEntity(scene, p, Quat(), Vec3(1), Mesh_Sphere, materials[x]);
         }
     }
+
+    // Place any imported models behind the grid of spheres
+    for (u32 i = 0; i < scene->modelCount; ++i)
+    {
+        vec3 p = Vec3(-4.0f + (f32)i * 4.0f, -4, -6);
+        AddModel(scene, i, p, Quat(), Vec3(1), Material_White);
+    }
 }
@@ -28,12 +28,11 @@ TODO (NEW):
     - FEAT: Better system for managing textures
 - Bugs:
     - FIXME: Random vector on hemi-sphere code is generating non-uniform terrible results
-    - SRGB conversion is inaccurate approximation
 - FEAT: Restore Environment/HDR lighting
 - FEAT: RAY support window resizing
 - FETA: Proper API for scene construction
 - FEAT: Proper support for multiple scenes to help with testing
-- FEAT: Image channels (separate direct and indirect lighting)
+- FEAT: Image channels (separate direct and indirect lighting) [x]
 - FEAT: Lights for rasterization
     - Sphere
     - Ambient term [x]
@@ -93,7 +92,6 @@ TODO (NEW):
     - Next event estimation
     - Surface Area heuristic acceleration structure
     - Improve acceleration structure construction performance
-    - FIXME: Avoid computing AABB from mesh vertices each time we add an object to our scene
     - TODO: Only generate acceleration structure for meshes used in the scene
 */
 /* TODO:
@@ -137,13 +135,13 @@ Usability
 - Resource definition from file
 
 Optimizations
-- [CPU] Multiple triangles per tree leaf node
+- [CPU] Multiple triangles per tree leaf node [x]
 - [CPU] SIMD
 - [CPU] Multi-core [X]
 - [RAS] Sample cube maps in shaders rather than equirectangular images [x]
 - [ALL] Startup time is too long! (building AABB trees for meshes most likely)
 - [CPU] Profiling! (What is our current cost per ray?) - Midphase is culprit (tree is too deep/unbalanced)
-- [CPU] Don't ray trace whole screen when using comparison view
+- [CPU] Don't ray trace whole screen when using comparison view [x]
 
 Analysis
 - AABB trees
@@ -170,6 +168,7 @@ Observability
 #include <windows.h>
 #elif defined(PLATFORM_LINUX)
 #include <unistd.h>
+#include <time.h>
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -202,6 +201,7 @@ typedef DebugFreeFileMemory(DebugFreeFileMemoryFunction);
 internal void* AllocateMemory(u64 size, u64 baseAddress = 0);
 internal void FreeMemory(void *p);
 internal DebugReadEntireFile(ReadEntireFile);
+internal b32 WriteEntireFile(const char *path, const void *data, u64 length);
 
 #include "math_lib.h"
 #include "mesh.h"
@@ -211,15 +211,24 @@ internal DebugReadEntireFile(ReadEntireFile);
 #include "debug.h"
 #include "intrinsics.h"
 #include "work_queue.h"
+#include "frame_budget.h"
 #include "tile.h"
+#include "dirty_tiles.h"
 #include "memory_pool.h"
 #include "bvh.h"
 #include "ray_intersection.h"
 #include "asset_loader/asset_loader.h"
+#include "sp_sampler.h"
 #include "sp_scene.h"
 #include "sp_material_system.h"
+#include "sp_radiance_cache.h"
+#include "sp_path_guiding.h"
+#include "sp_accumulation.h"
+#include "sp_shading_cache.h"
 #include "sp_metrics.h"
 #include "simd_path_tracer.h"
+#include "sp_temporal.h"
+#include "sp_denoiser.h"
 #include "simd.h"
 #include "aabb.h"
 #include "image.h"
@@ -235,18 +244,45 @@ internal DebugReadEntireFile(ReadEntireFile);
 #include "image.cpp"
 #include "memory_pool.cpp"
 #include "bvh.cpp"
+#include "sp_sampler.cpp"
 #include "sp_scene.cpp"
 #include "sp_material_system.cpp"
+#include "sp_radiance_cache.cpp"
+#include "sp_path_guiding.cpp"
+#include "sp_accumulation.cpp"
+#include "sp_shading_cache.cpp"
+#include "sp_temporal.cpp"
 #include "simd_path_tracer.cpp"
+#include "sp_denoiser.cpp"
 
 #if !LIVE_CODE_RELOADING_TEST_ENABLED
 #include "lib.cpp"
 #endif
 
+#if ENABLE_DENOISER && !OUTPUT_AOVS
+#error "ENABLE_DENOISER requires OUTPUT_AOVS"
+#endif
+
+#if USE_TEMPORAL_REPROJECTION && !OUTPUT_AOVS
+#error "USE_TEMPORAL_REPROJECTION requires OUTPUT_AOVS"
+#endif
+
+enum
+{
+    sp_TaskType_PathTrace,
+    sp_TaskType_Denoise,
+    sp_TaskType_Reshade,
+};
+
 struct sp_Task
 {
+    u32 type;
     sp_Context *context;
     Tile tile;
+
+    // Denoise tasks only
+    sp_Denoiser *denoiser;
+    u32 iteration;
 };
 
 global GLFWwindow *g_Window;
@@ -404,6 +440,25 @@ internal DebugReadEntireFile(ReadEntireFile)
 }
 #endif
 
+// NOTE: Uses the C runtime on both platforms as this is only needed for
+// writing out partial renders
+internal b32 WriteEntireFile(const char *path, const void *data, u64 length)
+{
+    b32 result = false;
+    FILE *file = fopen(path, "wb");
+    if (file != NULL)
+    {
+        result = (fwrite(data, 1, length, file) == length);
+        fclose(file);
+    }
+
+    if (!result)
+    {
+        LogMessage("Failed to write file %s", path);
+    }
+    return result;
+}
+
 #define KEY_HELPER(NAME)                                                       \
     case GLFW_KEY_##NAME:                                                      \
         return KEY_##NAME;
@@ -727,21 +782,46 @@ internal void CopyMeshDataToUploadBuffer(
 
 global sp_Metrics g_metricsBuffer[MAX_TILES];
 global volatile i32 g_metricsBufferLength;
+global FrameBudget g_frameBudget;
+global DirtyTiles g_dirtyTiles;
 
 internal void WorkerThread(WorkQueue *queue)
 {
     while (1)
     {
-        // If not empty
-        if (queue->head != queue->tail)
+        // If not empty and the frame budget allows starting another task
+        if (queue->head != queue->tail && HasFrameBudget(&g_frameBudget))
         {
+            u64 taskStart = __rdtsc();
+
             RandomNumberGenerator rng = {};
             rng.state = 0xF51C0E49;
 
             // Work to do
             sp_Metrics metrics = {};
             sp_Task *task = (sp_Task *)WorkQueuePop(queue, sizeof(sp_Task));
-            sp_PathTraceTile(task->context, task->tile, &rng, &metrics);
+            switch (task->type)
+            {
+                case sp_TaskType_PathTrace:
+                    sp_PathTraceTile(
+                        task->context, task->tile, &rng, &metrics);
+                    break;
+                case sp_TaskType_Denoise:
+                    sp_DenoiseTile(
+                        task->denoiser, task->tile, task->iteration);
+                    break;
+                case sp_TaskType_Reshade:
+                    sp_ReshadeTile(task->context, task->tile, &metrics);
+                    break;
+                default:
+                    InvalidCodePath();
+                    break;
+            }
+
+            ChargeFrameBudget(&g_frameBudget, __rdtsc() - taskStart);
+
+            // Pixels of the tile need to be uploaded again
+            MarkTilesDirty(&g_dirtyTiles, task->tile);
 
             u32 index = AtomicExchangeAdd(&g_metricsBufferLength, 1);
             g_metricsBuffer[index] = metrics;
@@ -816,45 +896,333 @@ internal ThreadPool CreateThreadPool(WorkQueue *queue)
     return pool;
 }
 
-internal void AddRayTracingWorkQueue(WorkQueue *workQueue, sp_Context *ctx)
+// Monotonic wall clock time in seconds, unlike glfwGetTime it doesn't need
+// GLFW to be initialized so headless partial renders can use it
+internal f64 GetWallClockSeconds()
+{
+    f64 result = 0.0;
+#ifdef PLATFORM_WINDOWS
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    result = (f64)counter.QuadPart / (f64)frequency.QuadPart;
+#elif defined(PLATFORM_LINUX)
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    result = (f64)time.tv_sec + (f64)time.tv_nsec * 1.0e-9;
+#endif
+    return result;
+}
+
+// Measures the rate of the time stamp counter against the wall clock, which
+// takes CALIBRATION_SECONDS
+#define CALIBRATION_SECONDS 0.1
+internal f64 CalibrateTimeStampCounter()
+{
+    f64 startSeconds = GetWallClockSeconds();
+    u64 startCycles = __rdtsc();
+#ifdef PLATFORM_WINDOWS
+    Sleep((DWORD)(CALIBRATION_SECONDS * 1000.0));
+#elif defined(PLATFORM_LINUX)
+    usleep((useconds_t)(CALIBRATION_SECONDS * 1000000.0));
+#endif
+    u64 endCycles = __rdtsc();
+    f64 endSeconds = GetWallClockSeconds();
+
+    f64 result = ComputeCyclesPerSecond(
+        startCycles, endCycles, startSeconds, endSeconds);
+    return result;
+}
+
+// The final pass traces every sample of the pixels in one go unless there is
+// a frame budget, it is then split into passes of FRAME_BUDGET_PASS_SAMPLES
+// which are summed in the accumulation buffer
+internal void ConfigureFinalPass(
+    sp_Context *ctx, sp_AccumulationBuffer *accumulationBuffer)
+{
+    ctx->samplesPerPixel = 0;
+#if FRAME_BUDGET_MS > 0
+    sp_ClearAccumulationBuffer(accumulationBuffer);
+    ctx->accumulationBuffer = accumulationBuffer;
+    ctx->firstSample = 0;
+    ctx->samplesPerPixel = FRAME_BUDGET_PASS_SAMPLES;
+#endif
+}
+
+// Only the pixels inside region are traced, the whole image if it is NULL.
+// Of the tiles covering the region only those in the given subset are queued,
+// by default that is every tile.
+internal void AddRayTracingWorkQueue(WorkQueue *workQueue, sp_Context *ctx,
+    Tile *region = NULL, u32 tileSubsetIndex = 0, u32 tileSubsetCount = 1)
 {
     Assert(workQueue->head == workQueue->tail);
 
     ImagePlane *imagePlane = ctx->camera->imagePlane;
 
+    Tile fullImage = {};
+    fullImage.maxX = imagePlane->width;
+    fullImage.maxY = imagePlane->height;
+
     // TODO: Don't need to compute and store and array for this, could just
     // store a queue of tile indices that the worker threads read from. They
     // can then construct the tile data for each index from just the image
     // dimensions and tile dimensions.
     Tile tiles[MAX_TILES];
-    u32 tileCount = ComputeTiles(imagePlane->width, imagePlane->height,
-        TILE_WIDTH, TILE_HEIGHT, tiles, ArrayCount(tiles));
+    u32 tileCount = ComputeTilesInRegion(imagePlane->width,
+        imagePlane->height, TILE_WIDTH, TILE_HEIGHT,
+        (region != NULL) ? *region : fullImage, tiles, ArrayCount(tiles));
 
     workQueue->tail = 0; // oof
+    g_metricsBufferLength = 0;
     for (u32 i = 0; i < tileCount; ++i)
     {
+        if (!IsTileInSubset(i, tileSubsetIndex, tileSubsetCount))
+        {
+            continue;
+        }
+
         sp_Task task = {};
+        task.type = sp_TaskType_PathTrace;
         task.context = ctx;
         task.tile = tiles[i];
-        g_metricsBufferLength = 0;
         WorkQueuePush(workQueue, &task, sizeof(task));
     }
 
     workQueue->head = 0; // ooof
 }
 
+// Queues a single denoiser iteration, every tile must have completed before
+// the next iteration is queued
+internal void AddDenoiserWorkQueue(
+    WorkQueue *workQueue, sp_Denoiser *denoiser, u32 iteration)
+{
+    Assert(workQueue->head == workQueue->tail);
+
+    ImagePlane *imagePlane = denoiser->imagePlane;
+
+    Tile tiles[MAX_TILES];
+    u32 tileCount = ComputeTiles(imagePlane->width, imagePlane->height,
+        TILE_WIDTH, TILE_HEIGHT, tiles, ArrayCount(tiles));
+
+    workQueue->tail = 0;
+    g_metricsBufferLength = 0;
+    for (u32 i = 0; i < tileCount; ++i)
+    {
+        sp_Task task = {};
+        task.type = sp_TaskType_Denoise;
+        task.tile = tiles[i];
+        task.denoiser = denoiser;
+        task.iteration = iteration;
+        WorkQueuePush(workQueue, &task, sizeof(task));
+    }
+
+    workQueue->head = 0;
+}
+
+// Queues the tiles covering region to be shaded again from the shading cache
+internal void AddReshadeWorkQueue(
+    WorkQueue *workQueue, sp_Context *ctx, Tile region)
+{
+    Assert(workQueue->head == workQueue->tail);
+
+    ImagePlane *imagePlane = ctx->camera->imagePlane;
+
+    Tile tiles[MAX_TILES];
+    u32 tileCount = ComputeTilesInRegion(imagePlane->width,
+        imagePlane->height, TILE_WIDTH, TILE_HEIGHT, region, tiles,
+        ArrayCount(tiles));
+
+    workQueue->tail = 0;
+    g_metricsBufferLength = 0;
+    for (u32 i = 0; i < tileCount; ++i)
+    {
+        sp_Task task = {};
+        task.type = sp_TaskType_Reshade;
+        task.context = ctx;
+        task.tile = tiles[i];
+        WorkQueuePush(workQueue, &task, sizeof(task));
+    }
+
+    workQueue->head = 0;
+}
+
+// Writes to a temporary file first so that a process killed mid write never
+// leaves a truncated checkpoint behind
+internal b32 SavePartialFile(const char *path, sp_AccumulationBuffer *buffer,
+    sp_PartialRenderRange range, void *fileData, u64 fileSize)
+{
+    char tempPath[512];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+
+    sp_WritePartialFile(buffer, range, fileData, fileSize);
+
+    b32 result = WriteEntireFile(tempPath, fileData, fileSize);
+    if (result)
+    {
+#ifdef PLATFORM_WINDOWS
+        // NOTE: rename doesn't replace existing files on windows
+        remove(path);
+#endif
+        result = (rename(tempPath, path) == 0);
+    }
+
+    return result;
+}
+
+// Traces the sample range and tile subset given on the command line into a
+// partial file for merge_partials rather than running interactively, blocks
+// until every queued tile has been traced. Samples are traced in passes of
+// CHECKPOINT_PASS_SAMPLES so that progress can be checkpointed between them.
+internal b32 RenderPartialImage(
+    WorkQueue *workQueue, sp_Context *ctx, PartialRenderArgs *args)
+{
+    ImagePlane *imagePlane = ctx->camera->imagePlane;
+
+    u64 accumulationMemorySize = sizeof(sp_AccumulationPixel) *
+                                 imagePlane->width * imagePlane->height;
+    MemoryArena accumulationArena = {};
+    InitializeMemoryArena(&accumulationArena,
+        AllocateMemory(accumulationMemorySize), accumulationMemorySize);
+
+    sp_AccumulationBuffer accumulationBuffer = {};
+    sp_InitializeAccumulationBuffer(&accumulationBuffer, &accumulationArena,
+        imagePlane->width, imagePlane->height);
+
+    sp_PartialRenderRange range = {};
+    range.firstSample = args->firstSample;
+    range.sampleCount =
+        (args->sampleCount > 0) ? args->sampleCount : SAMPLES_PER_PIXEL;
+    range.tileSubsetIndex = args->tileSubsetIndex;
+    range.tileSubsetCount = args->tileSubsetCount;
+
+    // Every process must trace exactly the same path for a given pixel and
+    // sample index for the merged result to match a single render. As the
+    // Sobol sampler has no state other than the sample index this also means
+    // a resumed render is identical to one that was never interrupted.
+    ctx->accumulationBuffer = &accumulationBuffer;
+    ctx->samplerType = sp_SamplerType_Sobol;
+    ctx->maxRelativeError = 0.0f;
+    ctx->radianceCache = NULL;
+    ctx->guidingField = NULL;
+    ctx->temporalHistory = NULL;
+    ctx->shadingCache = NULL;
+
+    u64 fileSize = sp_GetPartialFileSize(&accumulationBuffer);
+    void *fileData = AllocateMemory(fileSize);
+
+    u32 samplesCompleted = 0;
+    if (args->resume)
+    {
+        DebugReadFileResult checkpoint = ReadEntireFile(args->checkpointPath);
+        if (checkpoint.contents != NULL)
+        {
+            samplesCompleted = sp_LoadCheckpoint(&accumulationBuffer, range,
+                checkpoint.contents, checkpoint.length);
+            FreeMemory(checkpoint.contents);
+        }
+
+        if (samplesCompleted > 0)
+        {
+            LogMessage("Resuming from checkpoint %s with %u / %u samples",
+                args->checkpointPath, samplesCompleted, range.sampleCount);
+        }
+        else
+        {
+            LogMessage("No usable checkpoint at %s, starting from scratch",
+                args->checkpointPath);
+        }
+    }
+
+    LogMessage("Rendering samples %u to %u of tile subset %u / %u",
+        range.firstSample, range.firstSample + range.sampleCount,
+        range.tileSubsetIndex, range.tileSubsetCount);
+
+    f64 lastCheckpointTime = GetWallClockSeconds();
+    while (samplesCompleted < range.sampleCount)
+    {
+        u32 passSampleCount = MinU32(
+            CHECKPOINT_PASS_SAMPLES, range.sampleCount - samplesCompleted);
+        ctx->firstSample = range.firstSample + samplesCompleted;
+        ctx->samplesPerPixel = passSampleCount;
+
+        AddRayTracingWorkQueue(workQueue, ctx, NULL, range.tileSubsetIndex,
+            range.tileSubsetCount);
+        while (g_metricsBufferLength != (i32)workQueue->tail)
+        {
+#ifdef PLATFORM_WINDOWS
+            Sleep(10);
+#elif defined(PLATFORM_LINUX)
+            usleep(1000);
+#endif
+        }
+        samplesCompleted += passSampleCount;
+
+        if (args->checkpointPath != NULL &&
+            samplesCompleted < range.sampleCount &&
+            GetWallClockSeconds() - lastCheckpointTime >= CHECKPOINT_INTERVAL)
+        {
+            sp_PartialRenderRange completed = range;
+            completed.sampleCount = samplesCompleted;
+            if (SavePartialFile(args->checkpointPath, &accumulationBuffer,
+                    completed, fileData, fileSize))
+            {
+                LogMessage("Checkpoint written after %u / %u samples",
+                    samplesCompleted, range.sampleCount);
+            }
+            lastCheckpointTime = GetWallClockSeconds();
+        }
+    }
+
+    b32 result = SavePartialFile(
+        args->outputPath, &accumulationBuffer, range, fileData, fileSize);
+    if (result)
+    {
+        LogMessage("Partial render written to %s", args->outputPath);
+    }
+
+    return result;
+}
+
 struct SceneMeshData
 {
     MeshData meshes[MAX_MESHES];
+
+    Model models[MAX_MODELS];
+    u32 modelCount;
+    u32 importedMeshCount;
 };
 
+// Assigns mesh ids to each mesh in the model, the instance data is kept as is
+// since the instances reference meshes relative to Model::firstMesh
+internal void AddModelData(SceneMeshData *scene, ModelData modelData)
+{
+    if (scene->modelCount >= MAX_MODELS ||
+        scene->importedMeshCount + modelData.meshCount > MAX_IMPORTED_MESHES)
+    {
+        LogMessage("Insufficient space to add model with %u meshes",
+            modelData.meshCount);
+        return;
+    }
+
+    Model *model = scene->models + scene->modelCount++;
+    model->firstMesh = Mesh_FirstImported + scene->importedMeshCount;
+    model->instances = modelData.instances;
+    model->instanceCount = modelData.instanceCount;
+
+    for (u32 i = 0; i < modelData.meshCount; ++i)
+    {
+        scene->meshes[model->firstMesh + i] = modelData.meshes[i];
+    }
+    scene->importedMeshCount += modelData.meshCount;
+}
+
 internal void LoadMeshData(
     SceneMeshData *scene, MemoryArena *meshDataArena, const char *assetDir)
 {
     // FIXME: HACK to speed up startup time
-    //scene->meshes[Mesh_Bunny] = LoadMesh("bunny.obj", meshDataArena, assetDir);
-    //scene->meshes[Mesh_Monkey] =
-        //LoadMesh("monkey.obj", meshDataArena, assetDir);
+    //AddModelData(scene, LoadModel("bunny.obj", meshDataArena, assetDir));
+    //AddModelData(scene, LoadModel("monkey.obj", meshDataArena, assetDir));
     scene->meshes[Mesh_Plane] = CreatePlaneMesh(meshDataArena);
     scene->meshes[Mesh_Cube] = CreateCubeMesh(meshDataArena);
     scene->meshes[Mesh_Triangle] = CreateTriangleMeshData(meshDataArena);
@@ -1065,6 +1433,37 @@ internal void BuildPathTracerScene(
         sp_AddObjectToScene(scene, meshes[entity->mesh], entity->material,
             entity->position, entity->rotation, entity->scale);
     }
+
+    // Mirror the rasterizer lights so they can be sampled directly
+    LightData *lightData = entityScene->lightData;
+    for (u32 i = 0; i < lightData->sphereLightCount; i++)
+    {
+        SphereLightData *light = lightData->sphereLights + i;
+        sp_AddSphereLight(
+            scene, light->position, light->radius, light->radiance);
+    }
+
+    for (u32 i = 0; i < lightData->diskLightCount; i++)
+    {
+        DiskLightData *light = lightData->diskLights + i;
+        sp_AddDiskLight(scene, light->position, light->normal, light->radius,
+            light->radiance);
+    }
+}
+
+// Only updates object transforms, the objects must have been added with
+// BuildPathTracerScene beforehand
+internal void UpdatePathTracerSceneTransforms(
+    sp_Scene *scene, Scene *entityScene)
+{
+    Assert(scene->objectCount == entityScene->count);
+    for (u32 i = 0; i < entityScene->count; i++)
+    {
+        Entity *entity = entityScene->entities + i;
+
+        sp_SetObjectTransform(scene, i, entity->position, entity->rotation,
+            entity->scale);
+    }
 }
 
 internal void DebugDrawBvh(bvh_Node *node, DebugDrawingBuffer *debugDrawBuffer)
@@ -1090,8 +1489,13 @@ internal void CreatePathTracerMeshData(SceneMeshData *sceneMeshData,
     {
         meshes[i] = sp_CreateMeshFromMeshData(
                 sceneMeshData->meshes[i], meshDataArena, true);
-        sp_BuildMeshMidphase(
-            &meshes[i], accelerationStructureMemoryArena, tempArena);
+
+        // Skip unused imported mesh slots
+        if (meshes[i].indexCount > 0)
+        {
+            sp_BuildMeshMidphase(
+                &meshes[i], accelerationStructureMemoryArena, tempArena);
+        }
     }
 }
 
@@ -1201,31 +1605,14 @@ int main(int argc, char **argv)
     ParseCommandLineArgs(argc, (const char **)argv, &assetDir);
     LogMessage("Asset directoy set to %s", assetDir);
 
-    LogMessage("Compiled agist GLFW %i.%i.%i", GLFW_VERSION_MAJOR,
-           GLFW_VERSION_MINOR, GLFW_VERSION_REVISION);
-
-    i32 major, minor, revision;
-    glfwGetVersion(&major, &minor, &revision);
-    LogMessage("Running against GLFW %i.%i.%i", major, minor, revision);
-    LogMessage("%s", glfwGetVersionString());
-
-    glfwSetErrorCallback(GlfwErrorCallback);
-    if (!glfwInit())
+    PartialRenderArgs partialRenderArgs = {};
+    if (!ParsePartialRenderArgs(
+            argc, (const char **)argv, &partialRenderArgs))
     {
-        LogMessage("Failed to initialize GLFW!");
-        return -1;
+        LogMessage("Invalid partial render arguments");
+        return 1;
     }
 
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    g_Window = glfwCreateWindow(g_FramebufferWidth,
-        g_FramebufferHeight, "vk_cinematic", NULL, NULL);
-    Assert(g_Window != NULL);
-    GameInput input = {};
-    glfwSetWindowUserPointer(g_Window, &input);
-    glfwSetKeyCallback(g_Window, KeyCallback);
-    glfwSetMouseButtonCallback(g_Window, MouseButtonCallback);
-    glfwSetCursorPosCallback(g_Window, CursorPositionCallback);
-
     // Create memory arenas
     u32 applicationMemorySize = APPLICATION_MEMORY_LIMIT;
     MemoryArena applicationMemoryArena = {};
@@ -1252,7 +1639,9 @@ int main(int argc, char **argv)
     MemoryArena entityMemoryArena =
         SubAllocateArena(&applicationMemoryArena, entityMemorySize);
 
-    u32 imageDataMemorySize = Megabytes(256); // TODO: Config option
+    // NOTE: Includes the environment map sampling distribution which is
+    // roughly a quarter of the size of the HDRI
+    u32 imageDataMemorySize = Megabytes(320); // TODO: Config option
     MemoryArena imageDataArena =
         SubAllocateArena(&applicationMemoryArena, imageDataMemorySize);
 
@@ -1260,36 +1649,43 @@ int main(int argc, char **argv)
         applicationMemoryArena.size / 1024,
         applicationMemoryArena.capacity / 1024);
 
-    // Create Vulkan Renderer
-    VulkanRenderer renderer = {};
-    VulkanInit(&renderer, g_Window);
-
     // Create SIMD Path tracer
     sp_Context context = {};
     sp_MaterialSystem materialSystem = {};
     context.materialSystem = &materialSystem;
+    context.maxRelativeError = ADAPTIVE_SAMPLING_MAX_RELATIVE_ERROR;
+    context.minSamplesPerPixel = ADAPTIVE_SAMPLING_MIN_SAMPLES;
+#if USE_SOBOL_SAMPLER
+    context.samplerType = sp_SamplerType_Sobol;
+#endif
+
+#if USE_RADIANCE_CACHE
+    sp_RadianceCache radianceCache = {};
+    sp_InitializeRadianceCache(&radianceCache, &applicationMemoryArena,
+        RADIANCE_CACHE_CAPACITY, RADIANCE_CACHE_CELL_SIZE);
+    context.radianceCache = &radianceCache;
+#endif
+
+#if USE_PATH_GUIDING
+    sp_GuidingField guidingField = {};
+    context.guidingField = &guidingField;
+#endif
 
     // Load mesh data
     SceneMeshData sceneMeshData = {};
     LoadMeshData(&sceneMeshData, &meshDataArena, assetDir);
 
-    // Publish mesh data to vulkan renderer
-    UploadMeshDataToGpu(&renderer, &sceneMeshData);
-
-    // Publish mesh data to GPU path tracer
-    VulkanUploadComputeMeshData(&renderer);
-
     // Build mesh data for path tracer
     sp_Mesh meshes[MAX_MESHES];
     CreatePathTracerMeshData(&sceneMeshData, meshes, &meshDataArena,
         &accelerationStructureMemoryArena, &tempArena);
 
-    // FIXME: Hack to include this in scene/entity data
+    // Share the mesh bounds cached by the path tracer with the entity scene
     Aabb meshAabbs[MAX_MESHES] = {};
     for (u32 i = 0; i < MAX_MESHES; ++i)
     {
-        meshAabbs[i].min = meshes[i].midphaseTree.root->min;
-        meshAabbs[i].max = meshes[i].midphaseTree.root->max;
+        meshAabbs[i].min = meshes[i].aabbMin;
+        meshAabbs[i].max = meshes[i].aabbMax;
     }
 
     // Load image data
@@ -1300,19 +1696,9 @@ int main(int argc, char **argv)
 
     // Create checkerboard image
     HdrImage checkerBoardImage = CreateCheckerBoardImage(&imageDataArena);
-    UploadHdrImageToGPU(&renderer, checkerBoardImage, Image_CheckerBoard, 8);
     sp_RegisterTexture(&materialSystem, checkerBoardImage, Image_CheckerBoard);
-    sp_RegisterTexture(&materialSystem, hdri, Image_CubeMapTest);
-
-    // Create and upload test cube map
-    HdrCubeMap cubeMap = CreateCubeMap(hdri, &imageDataArena, 1024, 1024);
-    UploadCubeMapToGPU(&renderer, cubeMap, Image_CubeMapTest, 6, 1024, 1024);
-
-    // Create and upload irradiance cube map
-    HdrCubeMap irradianceCubeMap =
-        CreateIrradianceCubeMap(hdri, &imageDataArena, 32, 32);
-    UploadCubeMapToGPU(
-        &renderer, irradianceCubeMap, Image_IrradianceCubeMap, 7, 32, 32);
+    sp_RegisterTexture(
+        &materialSystem, hdri, Image_CubeMapTest, &imageDataArena);
 
     // Define materials, in the future this will come from file
     Material materialData[MAX_MATERIALS] = {};
@@ -1335,15 +1721,17 @@ int main(int argc, char **argv)
         materialData[i].roughness = roughness[i - Material_WhiteR10];
     }
 
-    // Publish material data to vulkan renderer
-    UploadMaterialDataToGpu(&renderer, materialData);
     UploadMaterialDataToPathTracer(&materialSystem, materialData);
 
     // Create scene
     Scene scene = {};
     scene.meshAabbs = meshAabbs;
-    scene.lightData =(LightData *)renderer.lightBuffer.data;
-    Assert(sizeof(LightData) <= LIGHT_BUFFER_SIZE);
+    scene.models = sceneMeshData.models;
+    scene.modelCount = sceneMeshData.modelCount;
+
+    // NOTE: Lights are copied into the renderer's light buffer once it has
+    // been created
+    scene.lightData = AllocateStruct(&entityMemoryArena, LightData);
 
     scene.entities = AllocateArray(&entityMemoryArena, Entity, MAX_ENTITIES);
     scene.max = MAX_ENTITIES;
@@ -1352,18 +1740,8 @@ int main(int argc, char **argv)
 #else
     GenerateScene(&scene);
 #endif
-    VulkanUploadComputeSceneBuffer(&renderer, scene);
-
-    g_Profiler.samples =
-        (ProfilerSample *)AllocateMemory(PROFILER_SAMPLE_BUFFER_SIZE);
-    ProfilerResults profilerResults = {};
-
-    DebugDrawingBuffer debugDrawBuffer = {};
-    debugDrawBuffer.vertices = (VertexPC *)renderer.debugVertexDataBuffer.data;
-    debugDrawBuffer.max = DEBUG_VERTEX_BUFFER_SIZE / sizeof(VertexPC);
 
     ImagePlane imagePlane = {};
-    imagePlane.pixels = (vec4 *)renderer.imageUploadBuffer.data;
     imagePlane.width = RAY_TRACER_WIDTH;
     imagePlane.height = RAY_TRACER_HEIGHT;
 
@@ -1375,12 +1753,177 @@ int main(int argc, char **argv)
     sp_InitializeScene(&pathTracerScene, &applicationMemoryArena);
     context.scene = &pathTracerScene;
 
+    BuildPathTracerScene(&pathTracerScene, &scene, meshes);
+    sp_BuildSceneBroadphase(&pathTracerScene);
+
+#if USE_PATH_GUIDING
+    sp_InitializeGuidingField(
+        &guidingField, &applicationMemoryArena, &pathTracerScene);
+#endif
+
     materialSystem.backgroundMaterialId = scene.backgroundMaterial;
 
     WorkQueue workQueue =
         CreateWorkQueue(&workQueueArena, sizeof(sp_Task), 1024);
     ThreadPool threadPool = CreateThreadPool(&workQueue);
 
+    // Partial renders for a render farm run headless, they return before a
+    // window or Vulkan device is needed
+    if (partialRenderArgs.outputPath != NULL)
+    {
+        imagePlane.pixels = (vec4 *)AllocateMemory(
+            sizeof(vec4) * imagePlane.width * imagePlane.height);
+
+        quat rotation = Quat(Vec3(0, 1, 0), g_camera.rotation.y) *
+                        Quat(Vec3(1, 0, 0), g_camera.rotation.x);
+        sp_ConfigureCamera(
+            &camera, &imagePlane, g_camera.position, rotation, 0.8f);
+
+        b32 success =
+            RenderPartialImage(&workQueue, &context, &partialRenderArgs);
+        return success ? 0 : 1;
+    }
+
+    LogMessage("Compiled agist GLFW %i.%i.%i", GLFW_VERSION_MAJOR,
+           GLFW_VERSION_MINOR, GLFW_VERSION_REVISION);
+
+    i32 major, minor, revision;
+    glfwGetVersion(&major, &minor, &revision);
+    LogMessage("Running against GLFW %i.%i.%i", major, minor, revision);
+    LogMessage("%s", glfwGetVersionString());
+
+    glfwSetErrorCallback(GlfwErrorCallback);
+    if (!glfwInit())
+    {
+        LogMessage("Failed to initialize GLFW!");
+        return -1;
+    }
+
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    g_Window = glfwCreateWindow(g_FramebufferWidth,
+        g_FramebufferHeight, "vk_cinematic", NULL, NULL);
+    Assert(g_Window != NULL);
+    GameInput input = {};
+    glfwSetWindowUserPointer(g_Window, &input);
+    glfwSetKeyCallback(g_Window, KeyCallback);
+    glfwSetMouseButtonCallback(g_Window, MouseButtonCallback);
+    glfwSetCursorPosCallback(g_Window, CursorPositionCallback);
+
+    // Create Vulkan Renderer
+    VulkanRenderer renderer = {};
+    VulkanInit(&renderer, g_Window);
+
+    // Publish mesh data to vulkan renderer
+    UploadMeshDataToGpu(&renderer, &sceneMeshData);
+
+    // Publish mesh data to GPU path tracer
+    VulkanUploadComputeMeshData(&renderer);
+
+    UploadHdrImageToGPU(&renderer, checkerBoardImage, Image_CheckerBoard, 8);
+
+    // Create and upload test cube map
+    HdrCubeMap cubeMap = CreateCubeMap(hdri, &imageDataArena, 1024, 1024);
+    UploadCubeMapToGPU(&renderer, cubeMap, Image_CubeMapTest, 6, 1024, 1024);
+
+    // Create and upload irradiance cube map
+    HdrCubeMap irradianceCubeMap =
+        CreateIrradianceCubeMap(hdri, &imageDataArena, 32, 32);
+    UploadCubeMapToGPU(
+        &renderer, irradianceCubeMap, Image_IrradianceCubeMap, 7, 32, 32);
+
+    // Publish material data to vulkan renderer
+    UploadMaterialDataToGpu(&renderer, materialData);
+
+    Assert(sizeof(LightData) <= LIGHT_BUFFER_SIZE);
+    CopyMemory(renderer.lightBuffer.data, scene.lightData, sizeof(LightData));
+    scene.lightData = (LightData *)renderer.lightBuffer.data;
+    VulkanUploadComputeSceneBuffer(&renderer, scene);
+
+    g_Profiler.samples =
+        (ProfilerSample *)AllocateMemory(PROFILER_SAMPLE_BUFFER_SIZE);
+    ProfilerResults profilerResults = {};
+
+    DebugDrawingBuffer debugDrawBuffer = {};
+    debugDrawBuffer.vertices = (VertexPC *)renderer.debugVertexDataBuffer.data;
+    debugDrawBuffer.max = DEBUG_VERTEX_BUFFER_SIZE / sizeof(VertexPC);
+
+    imagePlane.pixels = (vec4 *)renderer.imageUploadBuffer.data;
+
+    InitializeDirtyTiles(&g_dirtyTiles, imagePlane.width, imagePlane.height,
+        TILE_WIDTH, TILE_HEIGHT);
+
+#if OUTPUT_AOVS
+    // NOTE: Allocated separately from the application memory arena as these
+    // are 12MB each at the default resolution
+    for (u32 i = 0; i < SP_MAX_AOVS; i++)
+    {
+        imagePlane.aovs[i] = (vec4 *)AllocateMemory(
+            sizeof(vec4) * imagePlane.width * imagePlane.height);
+    }
+#endif
+
+#if ENABLE_DENOISER
+    u32 denoiserMemorySize =
+        2 * sizeof(vec4) * imagePlane.width * imagePlane.height;
+    MemoryArena denoiserArena = {};
+    InitializeMemoryArena(&denoiserArena, AllocateMemory(denoiserMemorySize),
+        denoiserMemorySize);
+
+    sp_Denoiser denoiser = {};
+    sp_InitializeDenoiser(
+        &denoiser, &imagePlane, &denoiserArena, DENOISER_ITERATIONS);
+#endif
+
+#if USE_TEMPORAL_REPROJECTION
+    u32 temporalHistoryMemorySize =
+        4 * sizeof(vec4) * imagePlane.width * imagePlane.height;
+    MemoryArena temporalHistoryArena = {};
+    InitializeMemoryArena(&temporalHistoryArena,
+        AllocateMemory(temporalHistoryMemorySize), temporalHistoryMemorySize);
+
+    sp_TemporalHistory temporalHistory = {};
+    sp_InitializeTemporalHistory(&temporalHistory, &temporalHistoryArena,
+        imagePlane.width, imagePlane.height);
+    context.temporalHistory = &temporalHistory;
+#endif
+
+#if USE_SHADING_CACHE
+    u64 shadingCacheMemorySize =
+        (sizeof(sp_CachedPath) * SHADING_CACHE_SAMPLES_PER_PIXEL +
+            sizeof(u32)) *
+        (u64)imagePlane.width * (u64)imagePlane.height;
+    MemoryArena shadingCacheArena = {};
+    InitializeMemoryArena(&shadingCacheArena,
+        AllocateMemory(shadingCacheMemorySize), shadingCacheMemorySize);
+
+    sp_ShadingCache shadingCache = {};
+    sp_InitializeShadingCache(&shadingCache, &shadingCacheArena,
+        imagePlane.width, imagePlane.height, SHADING_CACHE_SAMPLES_PER_PIXEL);
+    context.shadingCache = &shadingCache;
+#endif
+
+    // Sums the passes of the final render when it is split to fit the frame
+    // budget
+    sp_AccumulationBuffer progressiveBuffer = {};
+#if FRAME_BUDGET_MS > 0
+    u64 progressiveMemorySize =
+        (sizeof(sp_AccumulationPixel) + sizeof(sp_AccumulationPixelStats)) *
+        imagePlane.width * imagePlane.height;
+    MemoryArena progressiveArena = {};
+    InitializeMemoryArena(&progressiveArena,
+        AllocateMemory(progressiveMemorySize), progressiveMemorySize);
+    sp_InitializeAccumulationBuffer(&progressiveBuffer, &progressiveArena,
+        imagePlane.width, imagePlane.height);
+    sp_InitializeAccumulationStats(&progressiveBuffer, &progressiveArena);
+
+    // NOTE: Only set up after partial renders have returned, they are not
+    // interactive so must use every worker all of the time
+    f64 cyclesPerSecond = CalibrateTimeStampCounter();
+    LogMessage("Time stamp counter runs at %g cycles per second",
+        cyclesPerSecond);
+    g_frameBudget = CreateFrameBudget(FRAME_BUDGET_MS, cyclesPerSecond);
+#endif
+
     LogMessage("Start up time: %gs", glfwGetTime());
 
     vec3 lastCameraPosition = g_camera.position;
@@ -1389,7 +1932,19 @@ int main(int argc, char **argv)
     u32 maxDepth = 1;
     b32 drawTests = false;
     b32 isRayTracing = false;
+    u32 guidingPassesRemaining = 0;
+    u32 previewLevelsRemaining = 0;
+    u32 firstPassSamplesPerPixel = 0;
+    b32 renderRestartPending = false;
+    // Cleared whenever the scene or materials change, the image plane can
+    // then no longer be reprojected into the next view
+    b32 isTemporalHistoryValid = false;
+    b32 materialEditPending = false;
+    b32 isReshadePassQueued = false;
+    u32 lookDevAlbedoIndex = 0;
+    u32 denoiserIterationsQueued = 0;
     b32 showComparision = false;
+    Tile rayTracingRegion = {};
     b32 showDebugDrawing = true;
     f32 t = 0.0f;
     f64 rayTracingStartTime = 0.0;
@@ -1409,6 +1964,7 @@ int main(int argc, char **argv)
 
 
         f64 frameStart = glfwGetTime();
+        RefillFrameBudget(&g_frameBudget);
         InputBeginFrame(&input);
         glfwPollEvents();
 
@@ -1485,6 +2041,19 @@ int main(int argc, char **argv)
                         "Ray hits: %llu", total.values[sp_Metric_RayHitCount]);
                     LogMessage("Ray misses: %llu",
                         total.values[sp_Metric_RayMissCount]);
+                    LogMessage("Shadow rays traced: %llu",
+                        total.values[sp_Metric_ShadowRaysTraced]);
+                    LogMessage("Paths terminated by russian roulette: %llu",
+                        total.values[sp_Metric_PathsTerminatedByRoulette]);
+                    LogMessage("Paths terminated by radiance cache: %llu",
+                        total.values
+                            [sp_Metric_PathsTerminatedByRadianceCache]);
+                    LogMessage("Pixels converged early: %llu",
+                        total.values[sp_Metric_PixelsConverged]);
+                    LogMessage("Pixels reprojected: %llu",
+                        total.values[sp_Metric_PixelsReprojected]);
+                    LogMessage("Paths reshaded: %llu",
+                        total.values[sp_Metric_PathsReshaded]);
                     LogMessage("RayIntersectScene cycles elapsed: %llu",
                         total
                             .values[sp_Metric_CyclesElapsed_RayIntersectScene]);
@@ -1526,38 +2095,126 @@ int main(int argc, char **argv)
             }
         }
 
-        if (WasPressed(input.buttonStates[KEY_SPACE]))
+        // Passes completing while a restart is pending were cut short by
+        // cancellation so must not advance the schedule
+        b32 isPassComplete = isRayTracing && !renderRestartPending &&
+                             !materialEditPending &&
+                             g_metricsBufferLength == workQueue.tail;
+
+#if ENABLE_PREVIEW
+        // Once a preview level has been traced queue the next finer one, after
+        // the last level rendering continues at full resolution
+        if (isPassComplete && previewLevelsRemaining > 0)
         {
-            if (!isRayTracing)
+            previewLevelsRemaining--;
+            if (previewLevelsRemaining > 0)
             {
-                // TODO: Build path tracer scene
-                vec3 position = g_camera.position;
-                quat rotation = Quat(Vec3(0, 1, 0), g_camera.rotation.y) *
-                                Quat(Vec3(1, 0, 0), g_camera.rotation.x);
+                context.pixelStride = 1 << previewLevelsRemaining;
+            }
+            else
+            {
+                context.pixelStride = 1;
+                context.samplesPerPixel = firstPassSamplesPerPixel;
+                if (firstPassSamplesPerPixel == 0)
+                {
+                    ConfigureFinalPass(&context, &progressiveBuffer);
+                }
+            }
+            AddRayTracingWorkQueue(&workQueue, &context, &rayTracingRegion);
+            isPassComplete = false;
+        }
+#endif
 
-                sp_ConfigureCamera(
-                    &camera, &imagePlane, position, rotation, 0.8f);
+#if USE_PATH_GUIDING
+        // Once every tile of a training pass has been traced, update the
+        // guiding field and queue the next pass
+        if (isPassComplete && guidingPassesRemaining > 0)
+        {
+            sp_UpdateGuidingField(&guidingField);
+            LogMessage("Path guiding training pass %u complete",
+                guidingField.passCount);
 
+            guidingPassesRemaining--;
+            if (guidingPassesRemaining > 0)
+            {
+                context.samplesPerPixel *= 2;
+            }
+            else
+            {
+                ConfigureFinalPass(&context, &progressiveBuffer);
+            }
+            AddRayTracingWorkQueue(&workQueue, &context, &rayTracingRegion);
+            isPassComplete = false;
+        }
+#endif
+
+#if FRAME_BUDGET_MS > 0
+        // Keep queueing passes of the final render until every pixel has all
+        // of its samples, each tile shows the mean of the passes so far
+        if (isPassComplete && context.accumulationBuffer != NULL &&
+            context.firstSample + context.samplesPerPixel < SAMPLES_PER_PIXEL)
+        {
+            context.firstSample += context.samplesPerPixel;
+            context.samplesPerPixel =
+                MinU32(FRAME_BUDGET_PASS_SAMPLES,
+                    SAMPLES_PER_PIXEL - context.firstSample);
+            AddRayTracingWorkQueue(&workQueue, &context, &rayTracingRegion);
+            isPassComplete = false;
+        }
+#endif
+
+#if USE_SHADING_CACHE
+        // The reshaded paths are only a preview of a material edit, trace the
+        // view again with the new material so that the image converges
+        if (isPassComplete && isReshadePassQueued)
+        {
+            isReshadePassQueued = false;
+            ConfigureFinalPass(&context, &progressiveBuffer);
+            AddRayTracingWorkQueue(&workQueue, &context, &rayTracingRegion);
+            isPassComplete = false;
+        }
+#endif
+
+#if ENABLE_DENOISER
+        // Denoise once the final pass has been traced, each iteration reads
+        // the output of the previous one across tile boundaries so they are
+        // queued one at a time
+        if (isPassComplete && previewLevelsRemaining == 0 &&
+            guidingPassesRemaining == 0 &&
+            denoiserIterationsQueued < denoiser.iterationCount)
+        {
+            AddDenoiserWorkQueue(
+                &workQueue, &denoiser, denoiserIterationsQueued++);
+        }
+#endif
+
+        if (WasPressed(input.buttonStates[KEY_SPACE]))
+        {
+            if (!isRayTracing)
+            {
                 // Only allow submitting new work to the queue if it is empty
                 if (workQueue.head == workQueue.tail)
                 {
                     isRayTracing = true;
-                    ClearImagePlane(&imagePlane);
 
-                    // TODO: Switch to immediate mode API style
-                    pathTracerScene.objectCount = 0;
-                    ResetMemoryArena(&pathTracerScene.memoryArena);
+                    // Entities may have moved since the last time we path
+                    // traced so update the object transforms, this doesn't
+                    // touch any mesh data so the cost is proportional to the
+                    // number of entities
+                    UpdatePathTracerSceneTransforms(&pathTracerScene, &scene);
+                    sp_UpdateSceneBroadphase(&pathTracerScene);
 
-                    BuildPathTracerScene(&pathTracerScene, &scene, meshes);
-                    sp_BuildSceneBroadphase(&pathTracerScene);
-
-                    AddRayTracingWorkQueue(&workQueue, &context);
-                    rayTracingStartTime = glfwGetTime();
+                    renderRestartPending = true;
+                    isTemporalHistoryValid = false;
                 }
             }
             else
             {
                 isRayTracing = false;
+                renderRestartPending = false;
+                previewLevelsRemaining = 0;
+                guidingPassesRemaining = 0;
+                isReshadePassQueued = false;
             }
         }
 
@@ -1566,6 +2223,167 @@ int main(int argc, char **argv)
         {
             lastCameraPosition = g_camera.position;
             lastCameraRotation = g_camera.rotation;
+
+            // Start over for the new view, from the coarsest preview level
+            // when previews are enabled. Tiles still queued for the old view
+            // bail out early.
+            if (isRayTracing)
+            {
+                context.isCancelled = true;
+                renderRestartPending = true;
+            }
+        }
+
+        // Look-dev material edit, cycles the albedo of the white material
+        if (WasPressed(input.buttonStates[KEY_M]))
+        {
+            materialEditPending = true;
+
+            // The image traced so far was shaded with the old material so it
+            // must not be reprojected into the restarted render
+            isTemporalHistoryValid = false;
+            if (isRayTracing)
+            {
+                context.isCancelled = true;
+#if !USE_SHADING_CACHE
+                // Without cached paths the view has to be traced again
+                renderRestartPending = true;
+#endif
+            }
+        }
+
+        // Materials are only edited once no tile is reading them
+        if (materialEditPending && g_metricsBufferLength == workQueue.tail)
+        {
+            materialEditPending = false;
+            context.isCancelled = false;
+
+            vec3 lookDevAlbedos[] = {
+                Vec3(1), Vec3(0.8, 0.2, 0.2), Vec3(0.2, 0.8, 0.2),
+                Vec3(0.2, 0.2, 0.8)};
+            lookDevAlbedoIndex =
+                (lookDevAlbedoIndex + 1) % ArrayCount(lookDevAlbedos);
+            vec3 albedo = lookDevAlbedos[lookDevAlbedoIndex];
+
+            materialData[Material_White].baseColor = albedo;
+            UploadMaterialDataToGpu(&renderer, materialData);
+            sp_Material *material =
+                sp_FindMaterialById(&materialSystem, Material_White);
+            Assert(material != NULL);
+            material->albedo = albedo;
+
+            // Cached radiance and the history of the previous view were
+            // gathered with the old material
+            if (context.radianceCache != NULL)
+            {
+                sp_ResetRadianceCache(context.radianceCache);
+            }
+#if USE_TEMPORAL_REPROJECTION
+            sp_ClearTemporalHistory(&temporalHistory);
+#endif
+
+#if USE_SHADING_CACHE
+            // Shade the cached paths of the current view with the new
+            // material as an instant preview, the view is then traced again
+            // at full quality once the reshade pass completes. The preview
+            // levels and training passes left are dropped as the view and
+            // scene haven't changed. A pending restart traces the new view
+            // with the new material anyway.
+            if (isRayTracing && !renderRestartPending)
+            {
+                previewLevelsRemaining = 0;
+                guidingPassesRemaining = 0;
+                context.accumulationBuffer = NULL;
+                context.pixelStride = 1;
+                denoiserIterationsQueued = 0;
+                AddReshadeWorkQueue(&workQueue, &context, rayTracingRegion);
+                isReshadePassQueued = true;
+            }
+#endif
+        }
+
+        // Start path tracing from the current camera once the tiles queued
+        // for the previous view have finished or been cancelled
+        if (renderRestartPending && g_metricsBufferLength == workQueue.tail)
+        {
+            renderRestartPending = false;
+            isReshadePassQueued = false;
+            context.isCancelled = false;
+
+#if USE_TEMPORAL_REPROJECTION
+            // Keep the image of the previous view so that its samples can be
+            // reprojected into the new one, only valid if the camera is all
+            // that changed
+            if (isTemporalHistoryValid)
+            {
+                sp_StoreTemporalHistory(&temporalHistory, &camera);
+            }
+            else
+            {
+                sp_ClearTemporalHistory(&temporalHistory);
+            }
+#endif
+            isTemporalHistoryValid = true;
+
+            // TODO: Build path tracer scene
+            vec3 position = g_camera.position;
+            quat rotation = Quat(Vec3(0, 1, 0), g_camera.rotation.y) *
+                            Quat(Vec3(1, 0, 0), g_camera.rotation.x);
+
+            sp_ConfigureCamera(&camera, &imagePlane, position, rotation, 0.8f);
+            ClearImagePlane(&imagePlane);
+            MarkAllTilesDirty(&g_dirtyTiles);
+
+            // Passes of the final render of the previous view are discarded
+            context.accumulationBuffer = NULL;
+            context.firstSample = 0;
+            context.samplesPerPixel = 0;
+
+            // Cached radiance is only valid for the scene it was gathered
+            // from
+            if (context.radianceCache != NULL)
+            {
+                sp_ResetRadianceCache(context.radianceCache);
+            }
+
+            // Same for cached paths, which are also only valid for the view
+            if (context.shadingCache != NULL)
+            {
+                sp_ClearShadingCache(context.shadingCache);
+            }
+
+#if USE_PATH_GUIDING
+            // Guiding distribution is relearned from scratch as the scene may
+            // have changed
+            sp_ResetGuidingField(&guidingField, &pathTracerScene);
+            guidingPassesRemaining = PATH_GUIDING_TRAINING_PASSES;
+            context.samplesPerPixel = 1;
+#endif
+
+            // Only the right half of the CPU image is visible in the
+            // comparison view so don't trace the left half
+            rayTracingRegion = {};
+            rayTracingRegion.minX = showComparision ? imagePlane.width / 2 : 0;
+            rayTracingRegion.maxX = imagePlane.width;
+            rayTracingRegion.maxY = imagePlane.height;
+
+#if ENABLE_PREVIEW
+            // Coarse levels take a single sample for each pixel they trace
+            firstPassSamplesPerPixel = context.samplesPerPixel;
+            previewLevelsRemaining = PREVIEW_LEVELS;
+            context.pixelStride = 1 << PREVIEW_LEVELS;
+            context.samplesPerPixel = 1;
+#endif
+
+            // Straight to the final render without preview or training passes
+            if (context.samplesPerPixel == 0)
+            {
+                ConfigureFinalPass(&context, &progressiveBuffer);
+            }
+
+            denoiserIterationsQueued = 0;
+            AddRayTracingWorkQueue(&workQueue, &context, &rayTracingRegion);
+            rayTracingStartTime = glfwGetTime();
         }
 
         if (WasPressed(input.buttonStates[KEY_UP]))
@@ -1583,6 +2401,14 @@ int main(int argc, char **argv)
         if (WasPressed(input.buttonStates[KEY_F1]))
         {
             showComparision = !showComparision;
+
+            // The region being traced depends on which part of the image is
+            // visible, start over so that it covers the new one
+            if (isRayTracing)
+            {
+                context.isCancelled = true;
+                renderRestartPending = true;
+            }
         }
 
         if (WasPressed(input.buttonStates[KEY_F2]))
@@ -1604,8 +2430,12 @@ int main(int argc, char **argv)
         }
 #endif
 
-        VulkanCopyImageFromCPU(&renderer);
-        
+        // Only the tiles finished since the last frame are copied
+        Tile dirtyRegions[MAX_TILES];
+        u32 dirtyRegionCount =
+            CollectDirtyTiles(&g_dirtyTiles, dirtyRegions, MAX_TILES);
+        VulkanCopyImageFromCPU(&renderer, dirtyRegions, dirtyRegionCount);
+
 #if DRAW_ENTITY_AABBS
         DrawEntityAabbs(scene, &debugDrawBuffer);
 #endif
@@ -668,13 +668,35 @@ inline void AxisAngle(quat q, vec3 *axis, f32 *angle)
     *axis = q.v * invSinHalfAngle;
 }
 
+// Exact sRGB transfer functions (IEC 61966-2-1) rather than a 2.2 gamma
+inline f32 SrgbToLinear(f32 x)
+{
+    f32 result = (x <= 0.04045f) ? x / 12.92f
+                                 : Pow((x + 0.055f) / 1.055f, 2.4f);
+    return result;
+}
+
+inline f32 LinearToSrgb(f32 x)
+{
+    f32 result = (x <= 0.0031308f) ? x * 12.92f
+                                   : 1.055f * Pow(x, 1.0f / 2.4f) - 0.055f;
+    return result;
+}
+
 inline vec3 SrgbToLinear(vec3 v)
 {
     vec3 result;
-    result.x = Pow(v.x, 2.2f);
-    result.y = Pow(v.y, 2.2f);
-    result.z = Pow(v.z, 2.2f);
+    result.x = SrgbToLinear(v.x);
+    result.y = SrgbToLinear(v.y);
+    result.z = SrgbToLinear(v.z);
+
+    return result;
+}
 
+// Relative luminance of a linear Rec. 709 color
+inline f32 Luminance(vec3 color)
+{
+    f32 result = 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
     return result;
 }
 
@@ -927,33 +949,44 @@ inline f32 MinComponent(vec3 a)
     return result;
 }
 
-// FIXME: This is still not returning results which match a uniform
-// distribution, look into Shirly Concentric Mapping
+// Returns a direction uniformly distributed over the solid angle of the
+// hemisphere around normal, pdf is 1 / (2 * PI)
 inline vec3 RandomDirectionOnHemisphere(vec3 normal, RandomNumberGenerator *rng)
 {
-#if 1
-    // Generate random vector on unit sphere
-    f32 theta = PI * RandomUnilateral(rng); // 0 to PI range for sphere
-    f32 phi = PI * RandomBilateral(rng); // -PI to PI range for circle on XZ plane
-    vec3 dir = MapSphericalToCartesianCoordinates(Vec2(phi, theta));
+    // Uniform in solid angle means cos(theta) is uniformly distributed
+    f32 cosTheta = RandomUnilateral(rng);
+    f32 sinTheta = Sqrt(Max(0.0f, 1.0f - cosTheta * cosTheta));
+    f32 phi = 2.0f * PI * RandomUnilateral(rng);
+
+    // Basis maps the x axis onto the normal
+    mat4 basis = ChangeOfBasis(normal);
+    vec3 localDir = Vec3(cosTheta, sinTheta * Cos(phi), sinTheta * Sin(phi));
+    vec3 dir = Normalize(TransformVector(localDir, basis));
 
-    // Swap direction of vector if it is not in the top half half of the
-    // hemisphere relative to the normal
-    if (Dot(dir, normal) < 0.0f)
-    {
-        dir = -dir;
-    }
     return dir;
-#else
-    // Old method which generated pretty terrible results
-    vec3 offset =
-        Vec3(RandomBilateral(rng), RandomBilateral(rng), RandomBilateral(rng));
-    vec3 dir = Normalize(normal + offset);
-    if (Dot(dir, normal) < 0.0f)
-    {
-        dir = -dir;
-    }
+}
+
+// Maps a point in the unit square to a direction on the hemisphere around
+// normal distributed proportionally to the cosine of the angle with the
+// normal, pdf is cos(theta) / PI
+inline vec3 MapToCosineDirectionOnHemisphere(vec3 normal, vec2 u)
+{
+    // Malley's method, project uniformly distributed points on the unit disk
+    // up onto the hemisphere
+    f32 r = Sqrt(u.x);
+    f32 cosTheta = Sqrt(Max(0.0f, 1.0f - u.x));
+    f32 phi = 2.0f * PI * u.y;
+
+    mat4 basis = ChangeOfBasis(normal);
+    vec3 localDir = Vec3(cosTheta, r * Cos(phi), r * Sin(phi));
+    vec3 dir = Normalize(TransformVector(localDir, basis));
 
     return dir;
-#endif
+}
+
+inline vec3 RandomCosineDirectionOnHemisphere(
+    vec3 normal, RandomNumberGenerator *rng)
+{
+    vec2 u = Vec2(RandomUnilateral(rng), RandomUnilateral(rng));
+    return MapToCosineDirectionOnHemisphere(normal, u);
 }
@@ -66,6 +66,12 @@ inline f32 Pow(f32 x, f32 y)
     return result;
 }
 
+inline f32 Exp(f32 x)
+{
+    f32 result = expf(x);
+    return result;
+}
+
 inline f32 Sin(f32 x)
 {
     f32 result = sinf(x);
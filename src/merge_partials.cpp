@@ -0,0 +1,230 @@
+// Combines the partial files written by main --partial-output into the final
+// image. Usage:
+//
+//   merge_partials <output.pfm|output.ppm> <partial> [<partial> ...]
+//
+// The merged radiance is written as a little endian PFM (portable float map)
+// image. Since samples are accumulated in fixed point the result is identical
+// to rendering every sample range and tile in a single process. Outputs ending
+// in .ppm are written as an 8 bit sRGB preview tone mapped with ACES instead.
+#include <cstdarg>
+#include <cstring>
+
+#include "platform.h"
+#include "math_lib.h"
+#include "sp_accumulation.h"
+#include "sp_tone_mapping.h"
+
+#include "sp_accumulation.cpp"
+#include "sp_tone_mapping.cpp"
+
+internal DebugLogMessage(LogMessage_)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+    puts(buffer);
+}
+
+struct ReadFileResult
+{
+    void *contents;
+    u64 length;
+};
+
+// NOTE: Memory is never freed, the tool exits as soon as the files are merged
+internal ReadFileResult ReadEntireFile(const char *path)
+{
+    ReadFileResult result = {};
+
+    FILE *file = fopen(path, "rb");
+    if (file != NULL)
+    {
+        fseek(file, 0, SEEK_END);
+        long length = ftell(file);
+        fseek(file, 0, SEEK_SET);
+
+        if (length > 0)
+        {
+            result.contents = malloc(length);
+            result.length = (u64)length;
+            if (fread(result.contents, 1, length, file) != (size_t)length)
+            {
+                LogMessage("Failed to read file %s", path);
+                free(result.contents);
+                result.contents = NULL;
+                result.length = 0;
+            }
+        }
+        fclose(file);
+    }
+    else
+    {
+        LogMessage("Failed to open file %s", path);
+    }
+
+    return result;
+}
+
+// PFM stores rows from bottom to top, a negative scale marks the data as
+// little endian
+internal b32 WritePfm(const char *path, vec4 *pixels, u32 width, u32 height)
+{
+    b32 result = false;
+
+    FILE *file = fopen(path, "wb");
+    if (file != NULL)
+    {
+        fprintf(file, "PF\n%u %u\n-1.0\n", width, height);
+
+        result = true;
+        for (u32 y = 0; y < height; y++)
+        {
+            u32 row = height - 1 - y;
+            for (u32 x = 0; x < width; x++)
+            {
+                vec4 pixel = pixels[x + row * width];
+                if (fwrite(pixel.data, sizeof(f32), 3, file) != 3)
+                {
+                    result = false;
+                }
+            }
+        }
+        fclose(file);
+    }
+
+    if (!result)
+    {
+        LogMessage("Failed to write file %s", path);
+    }
+    return result;
+}
+
+// Binary PPM, the alpha channel of the display buffer is dropped
+internal b32 WritePpm(const char *path, sp_DisplayBuffer *image)
+{
+    Assert(image->format == sp_DisplayFormat_Rgba8);
+
+    b32 result = false;
+
+    FILE *file = fopen(path, "wb");
+    if (file != NULL)
+    {
+        fprintf(file, "P6\n%u %u\n255\n", image->width, image->height);
+
+        result = true;
+        u32 pixelCount = image->width * image->height;
+        for (u32 i = 0; i < pixelCount; i++)
+        {
+            u8 *pixel = (u8 *)image->pixels + i * 4;
+            if (fwrite(pixel, 1, 3, file) != 3)
+            {
+                result = false;
+            }
+        }
+        fclose(file);
+    }
+
+    if (!result)
+    {
+        LogMessage("Failed to write file %s", path);
+    }
+    return result;
+}
+
+internal b32 HasExtension(const char *path, const char *extension)
+{
+    size_t pathLength = strlen(path);
+    size_t extensionLength = strlen(extension);
+    b32 result =
+        (pathLength >= extensionLength) &&
+        (strcmp(path + pathLength - extensionLength, extension) == 0);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    LogMessage = &LogMessage_;
+
+    if (argc < 3)
+    {
+        LogMessage(
+            "Usage: merge_partials <output.pfm|output.ppm> <partial> ...");
+        return 1;
+    }
+
+    const char *outputPath = argv[1];
+
+    // Dimensions of the image are taken from the first partial, every other
+    // partial must match
+    ReadFileResult firstFile = ReadEntireFile(argv[2]);
+    sp_PartialFileHeader header = {};
+    if (!sp_ReadPartialFileHeader(
+            firstFile.contents, firstFile.length, &header))
+    {
+        LogMessage("%s is not a valid partial file", argv[2]);
+        return 1;
+    }
+
+    u32 pixelCount = header.width * header.height;
+    u64 memorySize = sizeof(sp_AccumulationPixel) * pixelCount;
+    MemoryArena arena = {};
+    InitializeMemoryArena(&arena, malloc(memorySize), memorySize);
+
+    sp_AccumulationBuffer buffer = {};
+    sp_InitializeAccumulationBuffer(
+        &buffer, &arena, header.width, header.height);
+
+    for (int i = 2; i < argc; i++)
+    {
+        ReadFileResult file =
+            (i == 2) ? firstFile : ReadEntireFile(argv[i]);
+        if (!sp_MergePartialFile(&buffer, file.contents, file.length))
+        {
+            LogMessage("Failed to merge %s, expected a %ux%u partial file",
+                argv[i], header.width, header.height);
+            return 1;
+        }
+
+        sp_PartialFileHeader fileHeader = {};
+        sp_ReadPartialFileHeader(file.contents, file.length, &fileHeader);
+        sp_PartialRenderRange range = fileHeader.range;
+        LogMessage("Merged %s, samples %u to %u of tile subset %u / %u",
+            argv[i], range.firstSample, range.firstSample + range.sampleCount,
+            range.tileSubsetIndex, range.tileSubsetCount);
+    }
+
+    if (HasExtension(outputPath, ".ppm"))
+    {
+        sp_ToneMapper toneMapper = {};
+        sp_InitializeToneMapper(&toneMapper, sp_ToneMapOperator_Aces, 1.0f);
+
+        sp_DisplayBuffer image = {};
+        image.width = header.width;
+        image.height = header.height;
+        image.format = sp_DisplayFormat_Rgba8;
+        image.pixels =
+            malloc(sp_GetDisplayPixelSize(image.format) * pixelCount);
+        sp_ToneMapAccumulationBuffer(&toneMapper, &buffer, &image);
+
+        if (!WritePpm(outputPath, &image))
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        vec4 *pixels = (vec4 *)malloc(sizeof(vec4) * pixelCount);
+        sp_ResolveAccumulationBuffer(&buffer, pixels);
+
+        if (!WritePfm(outputPath, pixels, header.width, header.height))
+        {
+            return 1;
+        }
+    }
+
+    LogMessage("Merged image written to %s", outputPath);
+    return 0;
+}
@@ -2,28 +2,18 @@
 
 #define MESH_PATH "broken"
 
-internal MeshData LoadMesh(
-    const char *path, MemoryArena *arena, const char *assetDir)
+// NOTE: aiProcess_FindInstances merges duplicate meshes so that nodes which
+// reference identical geometry end up sharing a single mesh index
+#define MESH_IMPORT_FLAGS                                                      \
+    (aiProcess_CalcTangentSpace | aiProcess_Triangulate |                      \
+        aiProcess_JoinIdenticalVertices | aiProcess_SortByPType |              \
+        aiProcess_ImproveCacheLocality | aiProcess_GenNormals |                \
+        aiProcess_FindInstances)
+
+internal MeshData ConvertAiMesh(aiMesh *mesh, MemoryArena *arena)
 {
     MeshData result = {};
 
-    char fullPath[256];
-    snprintf(fullPath, sizeof(fullPath), "%s/%s", assetDir, path);
-
-    const struct aiScene *scene = aiImportFile(fullPath,
-        aiProcess_CalcTangentSpace | aiProcess_Triangulate |
-            aiProcess_JoinIdenticalVertices | aiProcess_SortByPType |
-            aiProcess_ImproveCacheLocality);
-
-    if (!scene)
-    {
-        LogMessage("Mesh import failed!\n%s\n", aiGetErrorString());
-        return result;
-    }
-
-    Assert(scene->mNumMeshes > 0);
-    aiMesh *mesh = scene->mMeshes[0];
-
     VertexPNT *vertices = AllocateArray(arena, VertexPNT, mesh->mNumVertices);
     u32 indexCount = mesh->mNumFaces * 3; // We only support triangles
     u32 *indices = AllocateArray(arena, u32, indexCount);
@@ -31,6 +21,9 @@ internal MeshData LoadMesh(
     // NOTE: mesh->mVertices is always present
     Assert(mesh->mNormals);
 
+    // Texture coordinates are optional, only the first channel is used
+    aiVector3D *textureCoords = mesh->mTextureCoords[0];
+
     for (u32 vertexIndex = 0; vertexIndex < mesh->mNumVertices; ++vertexIndex)
     {
         VertexPNT *vertex = vertices + vertexIndex;
@@ -41,6 +34,16 @@ internal MeshData LoadMesh(
         vertex->normal.x = mesh->mNormals[vertexIndex].x;
         vertex->normal.y = mesh->mNormals[vertexIndex].y;
         vertex->normal.z = mesh->mNormals[vertexIndex].z;
+
+        if (textureCoords != NULL)
+        {
+            vertex->textureCoord.x = textureCoords[vertexIndex].x;
+            vertex->textureCoord.y = textureCoords[vertexIndex].y;
+        }
+        else
+        {
+            vertex->textureCoord = Vec2(0, 0);
+        }
     }
 
     for (u32 triangleIndex = 0; triangleIndex < mesh->mNumFaces; ++triangleIndex)
@@ -56,6 +59,120 @@ internal MeshData LoadMesh(
     result.vertexCount = mesh->mNumVertices;
     result.indexCount = indexCount;
 
+    return result;
+}
+
+internal MeshData LoadMesh(
+    const char *path, MemoryArena *arena, const char *assetDir)
+{
+    MeshData result = {};
+
+    char fullPath[256];
+    snprintf(fullPath, sizeof(fullPath), "%s/%s", assetDir, path);
+
+    const struct aiScene *scene = aiImportFile(fullPath, MESH_IMPORT_FLAGS);
+
+    if (!scene)
+    {
+        LogMessage("Mesh import failed!\n%s\n", aiGetErrorString());
+        return result;
+    }
+
+    Assert(scene->mNumMeshes > 0);
+    result = ConvertAiMesh(scene->mMeshes[0], arena);
+
+    aiReleaseImport(scene);
+
+    return result;
+}
+
+internal u32 CountNodeMeshReferences(aiNode *node)
+{
+    u32 result = node->mNumMeshes;
+    for (u32 i = 0; i < node->mNumChildren; ++i)
+    {
+        result += CountNodeMeshReferences(node->mChildren[i]);
+    }
+
+    return result;
+}
+
+internal MeshInstance CreateMeshInstance(aiMatrix4x4 transform, u32 mesh)
+{
+    aiVector3D scaling;
+    aiQuaternion rotation;
+    aiVector3D position;
+    transform.Decompose(scaling, rotation, position);
+
+    // TODO: Support non-uniform scaling in the ray tracer
+    f32 scale = Max(scaling.x, Max(scaling.y, scaling.z));
+    if (scaling.x != scaling.y || scaling.x != scaling.z)
+    {
+        LogMessage("Non-uniform node scale [%g, %g, %g] replaced with %g",
+            scaling.x, scaling.y, scaling.z, scale);
+    }
+
+    MeshInstance result = {};
+    result.mesh = mesh;
+    result.position = Vec3(position.x, position.y, position.z);
+    result.rotation = Vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+    result.scale = Vec3(scale);
+
+    return result;
+}
+
+internal void AddNodeInstances(ModelData *model, aiNode *node,
+    aiMatrix4x4 parentTransform, u32 maxInstances)
+{
+    aiMatrix4x4 transform = parentTransform * node->mTransformation;
+
+    for (u32 i = 0; i < node->mNumMeshes; ++i)
+    {
+        Assert(model->instanceCount < maxInstances);
+        model->instances[model->instanceCount++] =
+            CreateMeshInstance(transform, node->mMeshes[i]);
+    }
+
+    for (u32 i = 0; i < node->mNumChildren; ++i)
+    {
+        AddNodeInstances(model, node->mChildren[i], transform, maxInstances);
+    }
+}
+
+// Imports every mesh in the file along with the node hierarchy. Each node
+// reference to a mesh becomes a MeshInstance with its world transform, the
+// vertex data itself is only stored once per unique mesh.
+internal ModelData LoadModel(
+    const char *path, MemoryArena *arena, const char *assetDir)
+{
+    ModelData result = {};
+
+    char fullPath[256];
+    snprintf(fullPath, sizeof(fullPath), "%s/%s", assetDir, path);
+
+    const struct aiScene *scene = aiImportFile(fullPath, MESH_IMPORT_FLAGS);
+
+    if (!scene)
+    {
+        LogMessage("Model import failed!\n%s\n", aiGetErrorString());
+        return result;
+    }
+
+    result.meshes = AllocateArray(arena, MeshData, scene->mNumMeshes);
+    for (u32 meshIndex = 0; meshIndex < scene->mNumMeshes; ++meshIndex)
+    {
+        result.meshes[meshIndex] =
+            ConvertAiMesh(scene->mMeshes[meshIndex], arena);
+    }
+    result.meshCount = scene->mNumMeshes;
+
+    u32 maxInstances = CountNodeMeshReferences(scene->mRootNode);
+    result.instances = AllocateArray(arena, MeshInstance, maxInstances);
+    AddNodeInstances(&result, scene->mRootNode, aiMatrix4x4(), maxInstances);
+
+    LogMessage("Loaded model %s with %u meshes and %u instances", path,
+        result.meshCount, result.instanceCount);
+
     aiReleaseImport(scene);
 
     return result;
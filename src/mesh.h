@@ -30,6 +30,28 @@ struct MeshData
     u32 indexCount;
 };
 
+// Placement of a mesh within a model, imported from the model's node hierarchy
+struct MeshInstance
+{
+    u32 mesh;
+    vec3 position;
+    quat rotation;
+    vec3 scale;
+};
+
+// All of the meshes and node instances imported from a single model file,
+// instances reference meshes by index so shared meshes are only stored once
+struct ModelData
+{
+    MeshData *meshes;
+    u32 meshCount;
+    MeshInstance *instances;
+    u32 instanceCount;
+};
+
+// Number of mesh ids reserved for meshes imported from model files
+#define MAX_IMPORTED_MESHES 64
+
 enum
 {
     //Mesh_Bunny, // HACK to speed up startup time
@@ -39,7 +61,8 @@ enum
     Mesh_Triangle,
     Mesh_Sphere,
     Mesh_Disk,
-    MAX_MESHES,
+    Mesh_FirstImported,
+    MAX_MESHES = Mesh_FirstImported + MAX_IMPORTED_MESHES,
 };
 
 enum
@@ -198,3 +198,319 @@ inline RayIntersectTriangleResult RayIntersectTriangle(vec3 rayOrigin,
     return RayIntersectTriangleSlow(rayOrigin, rayDirection, a, b, c, tmin);
 #endif
 }
+
+// Scalar reference for RayIntersectTriangles4 and RayIntersectTriangles8.
+// Tests count triangles starting at first and returns the nearest hit closer
+// than tmax, back facing triangles are culled to match RayIntersectTriangleMT.
+internal RayIntersectTrianglesResult RayIntersectTrianglesScalar(
+    TriangleBatch triangles, u32 first, u32 count, vec3 rayOrigin,
+    vec3 rayDirection, f32 tmax = F32_MAX)
+{
+    RayIntersectTrianglesResult result = {};
+    result.t = -1.0f;
+    result.index = U32_MAX;
+
+    f32 nearestT = tmax;
+    for (u32 i = first; i < first + count; ++i)
+    {
+        vec3 a = Vec3(triangles.vertex[0][i], triangles.vertex[1][i],
+            triangles.vertex[2][i]);
+        vec3 e1 = Vec3(triangles.edge1[0][i], triangles.edge1[1][i],
+            triangles.edge1[2][i]);
+        vec3 e2 = Vec3(triangles.edge2[0][i], triangles.edge2[1][i],
+            triangles.edge2[2][i]);
+
+        vec3 T = rayOrigin - a;
+        vec3 p = Cross(rayDirection, e2);
+        vec3 q = Cross(T, e1);
+
+        // NOTE: Dot(p, e1) == -Dot(rayDirection, Cross(e1, e2)) so a positive
+        // determinant means the triangle is front facing, no need to compute
+        // the normal for the back face test
+        f32 det = Dot(p, e1);
+        if (det > 0.0f)
+        {
+            f32 invDet = 1.0f / det;
+            f32 u = Dot(p, T) * invDet;
+            f32 v = Dot(q, rayDirection) * invDet;
+            f32 t = Dot(q, e2) * invDet;
+
+            if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f &&
+                t < nearestT)
+            {
+                nearestT = t;
+                result.t = t;
+                result.uv = Vec2(u, v);
+                result.index = i;
+            }
+        }
+    }
+
+    return result;
+}
+
+// SSE version of RayIntersectTrianglesScalar which tests 4 triangles at a time
+internal RayIntersectTrianglesResult RayIntersectTriangles4(
+    TriangleBatch triangles, u32 first, u32 count, vec3 rayOrigin,
+    vec3 rayDirection, f32 tmax = F32_MAX)
+{
+    // clang-format off
+    __m128 ox = _mm_set1_ps(rayOrigin.x);
+    __m128 oy = _mm_set1_ps(rayOrigin.y);
+    __m128 oz = _mm_set1_ps(rayOrigin.z);
+    __m128 dx = _mm_set1_ps(rayDirection.x);
+    __m128 dy = _mm_set1_ps(rayDirection.y);
+    __m128 dz = _mm_set1_ps(rayDirection.z);
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+
+    // NOTE: Triangle indices are tracked as floats so that they can be
+    // selected with the same masks as t, u and v. This is exact for up to
+    // 2^24 triangles.
+    __m128 laneOffsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    __m128 end = _mm_set1_ps((f32)count);
+
+    __m128 nearestT = _mm_set1_ps(tmax);
+    __m128 nearestU = zero;
+    __m128 nearestV = zero;
+    __m128 nearestIndex = _mm_set1_ps(-1.0f);
+
+    for (u32 i = 0; i < count; i += 4)
+    {
+        u32 offset = first + i;
+        __m128 ax = _mm_loadu_ps(triangles.vertex[0] + offset);
+        __m128 ay = _mm_loadu_ps(triangles.vertex[1] + offset);
+        __m128 az = _mm_loadu_ps(triangles.vertex[2] + offset);
+        __m128 e1x = _mm_loadu_ps(triangles.edge1[0] + offset);
+        __m128 e1y = _mm_loadu_ps(triangles.edge1[1] + offset);
+        __m128 e1z = _mm_loadu_ps(triangles.edge1[2] + offset);
+        __m128 e2x = _mm_loadu_ps(triangles.edge2[0] + offset);
+        __m128 e2y = _mm_loadu_ps(triangles.edge2[1] + offset);
+        __m128 e2z = _mm_loadu_ps(triangles.edge2[2] + offset);
+
+        // T = rayOrigin - a
+        __m128 tx = _mm_sub_ps(ox, ax);
+        __m128 ty = _mm_sub_ps(oy, ay);
+        __m128 tz = _mm_sub_ps(oz, az);
+
+        // p = Cross(rayDirection, e2)
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+        // q = Cross(T, e1)
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, e1x),
+                                           _mm_mul_ps(py, e1y)),
+                                _mm_mul_ps(pz, e1z));
+        __m128 invDet = _mm_div_ps(one, det);
+
+        __m128 u = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, tx),
+                                         _mm_mul_ps(py, ty)),
+                              _mm_mul_ps(pz, tz));
+        __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, dx),
+                                         _mm_mul_ps(qy, dy)),
+                              _mm_mul_ps(qz, dz));
+        __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, e2x),
+                                         _mm_mul_ps(qy, e2y)),
+                              _mm_mul_ps(qz, e2z));
+        u = _mm_mul_ps(u, invDet);
+        v = _mm_mul_ps(v, invDet);
+        t = _mm_mul_ps(t, invDet);
+
+        // Ignore lanes past the end of the range
+        __m128 index = _mm_add_ps(_mm_set1_ps((f32)i), laneOffsets);
+        __m128 hit = _mm_cmplt_ps(index, end);
+        hit = _mm_and_ps(hit, _mm_cmpgt_ps(det, zero));
+        hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+        hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+        hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+        hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, zero));
+        hit = _mm_and_ps(hit, _mm_cmplt_ps(t, nearestT));
+
+        nearestT = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, nearestT));
+        nearestU = _mm_or_ps(_mm_and_ps(hit, u), _mm_andnot_ps(hit, nearestU));
+        nearestV = _mm_or_ps(_mm_and_ps(hit, v), _mm_andnot_ps(hit, nearestV));
+        nearestIndex = _mm_or_ps(
+            _mm_and_ps(hit, index), _mm_andnot_ps(hit, nearestIndex));
+    }
+    // clang-format on
+
+    f32 tValues[4];
+    f32 uValues[4];
+    f32 vValues[4];
+    f32 indices[4];
+    _mm_storeu_ps(tValues, nearestT);
+    _mm_storeu_ps(uValues, nearestU);
+    _mm_storeu_ps(vValues, nearestV);
+    _mm_storeu_ps(indices, nearestIndex);
+
+    RayIntersectTrianglesResult result = {};
+    result.t = -1.0f;
+    result.index = U32_MAX;
+
+    // Take the nearest hit across all lanes
+    for (u32 lane = 0; lane < 4; ++lane)
+    {
+        if (indices[lane] >= 0.0f &&
+            (tValues[lane] < result.t || result.t < 0.0f))
+        {
+            result.t = tValues[lane];
+            result.uv = Vec2(uValues[lane], vValues[lane]);
+            result.index = first + (u32)indices[lane];
+        }
+    }
+
+    return result;
+}
+
+#if RAY_INTERSECT_TRIANGLES_SIMD_WIDTH == 8
+#ifndef __AVX__
+#error "RAY_INTERSECT_TRIANGLES_SIMD_WIDTH of 8 requires AVX"
+#endif
+
+// AVX version of RayIntersectTrianglesScalar which tests 8 triangles at a time
+internal RayIntersectTrianglesResult RayIntersectTriangles8(
+    TriangleBatch triangles, u32 first, u32 count, vec3 rayOrigin,
+    vec3 rayDirection, f32 tmax = F32_MAX)
+{
+    // clang-format off
+    __m256 ox = _mm256_set1_ps(rayOrigin.x);
+    __m256 oy = _mm256_set1_ps(rayOrigin.y);
+    __m256 oz = _mm256_set1_ps(rayOrigin.z);
+    __m256 dx = _mm256_set1_ps(rayDirection.x);
+    __m256 dy = _mm256_set1_ps(rayDirection.y);
+    __m256 dz = _mm256_set1_ps(rayDirection.z);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+
+    // NOTE: Triangle indices are tracked as floats, see RayIntersectTriangles4
+    __m256 laneOffsets =
+        _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    __m256 end = _mm256_set1_ps((f32)count);
+
+    __m256 nearestT = _mm256_set1_ps(tmax);
+    __m256 nearestU = zero;
+    __m256 nearestV = zero;
+    __m256 nearestIndex = _mm256_set1_ps(-1.0f);
+
+    for (u32 i = 0; i < count; i += 8)
+    {
+        u32 offset = first + i;
+        __m256 ax = _mm256_loadu_ps(triangles.vertex[0] + offset);
+        __m256 ay = _mm256_loadu_ps(triangles.vertex[1] + offset);
+        __m256 az = _mm256_loadu_ps(triangles.vertex[2] + offset);
+        __m256 e1x = _mm256_loadu_ps(triangles.edge1[0] + offset);
+        __m256 e1y = _mm256_loadu_ps(triangles.edge1[1] + offset);
+        __m256 e1z = _mm256_loadu_ps(triangles.edge1[2] + offset);
+        __m256 e2x = _mm256_loadu_ps(triangles.edge2[0] + offset);
+        __m256 e2y = _mm256_loadu_ps(triangles.edge2[1] + offset);
+        __m256 e2z = _mm256_loadu_ps(triangles.edge2[2] + offset);
+
+        // T = rayOrigin - a
+        __m256 tx = _mm256_sub_ps(ox, ax);
+        __m256 ty = _mm256_sub_ps(oy, ay);
+        __m256 tz = _mm256_sub_ps(oz, az);
+
+        // p = Cross(rayDirection, e2)
+        __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z),
+                                  _mm256_mul_ps(dz, e2y));
+        __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x),
+                                  _mm256_mul_ps(dx, e2z));
+        __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y),
+                                  _mm256_mul_ps(dy, e2x));
+
+        // q = Cross(T, e1)
+        __m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z),
+                                  _mm256_mul_ps(tz, e1y));
+        __m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x),
+                                  _mm256_mul_ps(tx, e1z));
+        __m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y),
+                                  _mm256_mul_ps(ty, e1x));
+
+        __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, e1x),
+                                                 _mm256_mul_ps(py, e1y)),
+                                   _mm256_mul_ps(pz, e1z));
+        __m256 invDet = _mm256_div_ps(one, det);
+
+        __m256 u = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, tx),
+                                               _mm256_mul_ps(py, ty)),
+                                 _mm256_mul_ps(pz, tz));
+        __m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(qx, dx),
+                                               _mm256_mul_ps(qy, dy)),
+                                 _mm256_mul_ps(qz, dz));
+        __m256 t = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(qx, e2x),
+                                               _mm256_mul_ps(qy, e2y)),
+                                 _mm256_mul_ps(qz, e2z));
+        u = _mm256_mul_ps(u, invDet);
+        v = _mm256_mul_ps(v, invDet);
+        t = _mm256_mul_ps(t, invDet);
+
+        // Ignore lanes past the end of the range
+        __m256 index = _mm256_add_ps(_mm256_set1_ps((f32)i), laneOffsets);
+        __m256 hit = _mm256_cmp_ps(index, end, _CMP_LT_OQ);
+        hit = _mm256_and_ps(hit, _mm256_cmp_ps(det, zero, _CMP_GT_OQ));
+        hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+        hit = _mm256_and_ps(hit, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+        hit = _mm256_and_ps(
+            hit, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+        hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+        hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, nearestT, _CMP_LT_OQ));
+
+        nearestT = _mm256_blendv_ps(nearestT, t, hit);
+        nearestU = _mm256_blendv_ps(nearestU, u, hit);
+        nearestV = _mm256_blendv_ps(nearestV, v, hit);
+        nearestIndex = _mm256_blendv_ps(nearestIndex, index, hit);
+    }
+    // clang-format on
+
+    f32 tValues[8];
+    f32 uValues[8];
+    f32 vValues[8];
+    f32 indices[8];
+    _mm256_storeu_ps(tValues, nearestT);
+    _mm256_storeu_ps(uValues, nearestU);
+    _mm256_storeu_ps(vValues, nearestV);
+    _mm256_storeu_ps(indices, nearestIndex);
+
+    RayIntersectTrianglesResult result = {};
+    result.t = -1.0f;
+    result.index = U32_MAX;
+
+    // Take the nearest hit across all lanes
+    for (u32 lane = 0; lane < 8; ++lane)
+    {
+        if (indices[lane] >= 0.0f &&
+            (tValues[lane] < result.t || result.t < 0.0f))
+        {
+            result.t = tValues[lane];
+            result.uv = Vec2(uValues[lane], vValues[lane]);
+            result.index = first + (u32)indices[lane];
+        }
+    }
+
+    return result;
+}
+#endif
+
+// Finds the nearest front facing triangle hit by the ray out of count
+// triangles starting at first. The batch arrays must have
+// RAY_INTERSECT_TRIANGLES_PADDING entries after the last triangle.
+inline RayIntersectTrianglesResult RayIntersectTriangles(
+    TriangleBatch triangles, u32 first, u32 count, vec3 rayOrigin,
+    vec3 rayDirection, f32 tmax = F32_MAX)
+{
+#if RAY_INTERSECT_TRIANGLES_WIDTH == 8
+    return RayIntersectTriangles8(
+        triangles, first, count, rayOrigin, rayDirection, tmax);
+#elif RAY_INTERSECT_TRIANGLES_WIDTH == 4
+    return RayIntersectTriangles4(
+        triangles, first, count, rayOrigin, rayDirection, tmax);
+#else
+    return RayIntersectTrianglesScalar(
+        triangles, first, count, rayOrigin, rayDirection, tmax);
+#endif
+}
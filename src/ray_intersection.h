@@ -6,3 +6,34 @@ struct RayIntersectTriangleResult
     vec2 uv;
     vec3 normal;
 };
+
+// Triangles stored as SoA with precomputed edges so that one ray can be tested
+// against several triangles at once. Each array holds one component for every
+// triangle, indexed by axis.
+struct TriangleBatch
+{
+    f32 *vertex[3]; // a
+    f32 *edge1[3];  // b - a
+    f32 *edge2[3];  // c - a
+};
+
+// Number of triangles tested per iteration by RayIntersectTriangles, selected
+// by RAY_INTERSECT_TRIANGLES_SIMD_WIDTH (defaults to 4-wide SSE)
+#if RAY_INTERSECT_TRIANGLES_SIMD_WIDTH == 8
+#define RAY_INTERSECT_TRIANGLES_WIDTH 8
+#elif RAY_INTERSECT_TRIANGLES_SIMD_WIDTH == 1
+#define RAY_INTERSECT_TRIANGLES_WIDTH 1
+#else
+#define RAY_INTERSECT_TRIANGLES_WIDTH 4
+#endif
+
+// Arrays passed to RayIntersectTriangles must have this many entries of
+// padding after the last triangle so that SIMD loads stay in bounds
+#define RAY_INTERSECT_TRIANGLES_PADDING (RAY_INTERSECT_TRIANGLES_WIDTH - 1)
+
+struct RayIntersectTrianglesResult
+{
+    f32 t;
+    vec2 uv;
+    u32 index; // U32_MAX if no triangle was hit
+};
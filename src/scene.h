@@ -1,6 +1,7 @@
 #pragma once
 
 #include "aabb.h"
+#include "mesh.h"
 
 // TODO: Find a better place for this!
 // NOTE: Needs to be kept in sync with shaders
@@ -49,6 +50,17 @@ struct Entity
 
 #define MAX_ENTITIES 1024
 
+#define MAX_MODELS 8
+
+// Model whose meshes have been assigned the contiguous range of mesh ids
+// starting at firstMesh
+struct Model
+{
+    MeshInstance *instances;
+    u32 instanceCount;
+    u32 firstMesh;
+};
+
 struct Scene
 {
     Entity *entities;
@@ -59,4 +71,7 @@ struct Scene
 
     Aabb *meshAabbs;
     LightData *lightData;
+
+    Model *models;
+    u32 modelCount;
 };
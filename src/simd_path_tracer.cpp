@@ -104,6 +104,302 @@ f32 GeometrySmith(vec3 N, vec3 V, vec3 L, f32 roughness)
     return ggx1 * ggx2;
 }
 
+// Power heuristic with beta = 2 from Veach's thesis
+inline f32 PowerHeuristic(f32 pdfA, f32 pdfB)
+{
+    f32 a2 = pdfA * pdfA;
+    f32 b2 = pdfB * pdfB;
+    f32 result = (a2 + b2) > 0.0f ? a2 / (a2 + b2) : 0.0f;
+    return result;
+}
+
+// Smith masking function for the GGX distribution, used for visible normal
+// sampling. Note that this is the exact form rather than the Schlick
+// approximation used by GeometrySmith.
+inline f32 SmithMaskingGGX(f32 NdotV, f32 alpha)
+{
+    f32 a2 = alpha * alpha;
+    f32 result = 2.0f * NdotV /
+                 (NdotV + Sqrt(a2 + (1.0f - a2) * NdotV * NdotV));
+    return result;
+}
+
+// Chance of sampling the specular lobe rather than the diffuse lobe, based on
+// an estimate of how much each lobe reflects for the view direction
+internal f32 ComputeSpecularProbability(
+    sp_MaterialOutput materialOutput, vec3 N, vec3 V)
+{
+    f32 NdotV = Dot(N, V);
+    if (NdotV <= 0.0f)
+    {
+        // Visible normal sampling is undefined for directions below the
+        // surface, fall back to the diffuse lobe
+        return 0.0f;
+    }
+
+    vec3 F = FresnelSchlick(NdotV, Vec3(0.04f));
+    vec3 diffuse = Hadamard(Vec3(1) - F, materialOutput.albedo);
+
+    f32 specularWeight = (F.x + F.y + F.z) / 3.0f;
+    f32 diffuseWeight = (diffuse.x + diffuse.y + diffuse.z) / 3.0f;
+
+    f32 result = specularWeight / (specularWeight + diffuseWeight);
+    result = Clamp(
+        result, SP_MIN_LOBE_PROBABILITY, 1.0f - SP_MIN_LOBE_PROBABILITY);
+
+    return result;
+}
+
+// Solid angle pdf of SampleBsdf generating L, combines the pdfs of both lobes
+// weighted by the chance of each lobe being selected
+f32 ComputeBsdfPdf(sp_MaterialOutput materialOutput, vec3 N, vec3 V, vec3 L)
+{
+    f32 NdotL = Dot(N, L);
+    if (NdotL <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    f32 diffusePdf = NdotL / PI;
+
+    f32 specularProbability = ComputeSpecularProbability(materialOutput, N, V);
+    f32 specularPdf = 0.0f;
+    if (specularProbability > 0.0f)
+    {
+        // Pdf of the visible normal distribution is G1(V) * D(H) * V.H / N.V,
+        // the reflection jacobian 1 / (4 * V.H) cancels the V.H term
+        f32 roughness = Max(materialOutput.roughness, SP_MIN_ROUGHNESS);
+        f32 alpha = roughness * roughness;
+        f32 NdotV = Dot(N, V);
+        vec3 H = Normalize(L + V);
+        f32 D = DistributionGGX(N, H, roughness);
+        specularPdf = SmithMaskingGGX(NdotV, alpha) * D / (4.0f * NdotV);
+    }
+
+    f32 result = specularProbability * specularPdf +
+                 (1.0f - specularProbability) * diffusePdf;
+    return result;
+}
+
+// Samples a GGX visible normal for the view direction and reflects V about it.
+// From "Sampling the GGX Distribution of Visible Normals" by Eric Heitz.
+internal vec3 SampleGGXReflection(vec3 N, vec3 V, f32 alpha, vec2 u)
+{
+    // Transform view direction into a local space with the normal along z
+    mat4 basis = ChangeOfBasis(N);
+    vec3 T1 = basis.columns[1].xyz;
+    vec3 T2 = basis.columns[2].xyz;
+    vec3 Ve = Vec3(Dot(V, T1), Dot(V, T2), Dot(V, N));
+
+    // Stretch view direction to the hemisphere configuration
+    vec3 Vh = Normalize(Vec3(alpha * Ve.x, alpha * Ve.y, Ve.z));
+
+    // Orthonormal basis around the stretched view direction
+    f32 lengthSq = Vh.x * Vh.x + Vh.y * Vh.y;
+    vec3 B1 = lengthSq > 0.0f
+                  ? Vec3(-Vh.y, Vh.x, 0.0f) * (1.0f / Sqrt(lengthSq))
+                  : Vec3(1, 0, 0);
+    vec3 B2 = Cross(Vh, B1);
+
+    // Sample the projected area of the hemisphere
+    f32 r = Sqrt(u.x);
+    f32 phi = 2.0f * PI * u.y;
+    f32 t1 = r * Cos(phi);
+    f32 t2 = r * Sin(phi);
+    f32 s = 0.5f * (1.0f + Vh.z);
+    t2 = (1.0f - s) * Sqrt(Max(0.0f, 1.0f - t1 * t1)) + s * t2;
+
+    // Reproject onto the hemisphere and unstretch
+    vec3 Nh = B1 * t1 + B2 * t2 +
+              Vh * Sqrt(Max(0.0f, 1.0f - t1 * t1 - t2 * t2));
+    vec3 Ne = Normalize(Vec3(alpha * Nh.x, alpha * Nh.y, Max(0.0f, Nh.z)));
+
+    vec3 H = T1 * Ne.x + T2 * Ne.y + N * Ne.z;
+    vec3 L = H * (2.0f * Dot(V, H)) - V;
+
+    return L;
+}
+
+// Picks either the diffuse or specular lobe and samples a direction from it,
+// the returned pdf accounts for both lobes so it is also valid for MIS
+sp_BsdfSample SampleBsdf(
+    sp_MaterialOutput materialOutput, vec3 N, vec3 V, sp_Sampler *sampler)
+{
+    sp_BsdfSample result = {};
+
+    f32 specularProbability = ComputeSpecularProbability(materialOutput, N, V);
+    f32 lobeSelection = sp_Next1D(sampler);
+    vec2 u = sp_Next2D(sampler);
+    if (lobeSelection < specularProbability)
+    {
+        f32 roughness = Max(materialOutput.roughness, SP_MIN_ROUGHNESS);
+        result.direction = SampleGGXReflection(N, V, roughness * roughness, u);
+    }
+    else
+    {
+        result.direction = MapToCosineDirectionOnHemisphere(N, u);
+    }
+
+    // Reflected directions can end up below the surface
+    result.pdf = ComputeBsdfPdf(materialOutput, N, V, result.direction);
+
+    return result;
+}
+
+// Solid angle pdf of SampleGuidedBsdf generating L. Falls back to the BSDF pdf
+// if the vertex is not guided, i.e. guidingCellIndex is U32_MAX.
+f32 ComputeScatterPdf(sp_MaterialOutput materialOutput, vec3 N, vec3 V,
+    vec3 L, sp_GuidingField *guidingField, u32 guidingCellIndex)
+{
+    f32 result = ComputeBsdfPdf(materialOutput, N, V, L);
+    if (guidingCellIndex != U32_MAX && Dot(N, L) > 0.0f)
+    {
+        f32 guidingPdf =
+            sp_ComputeGuidingPdf(guidingField, guidingCellIndex, L);
+        result = Lerp(guidingPdf, result, SP_GUIDING_BSDF_SAMPLING_FRACTION);
+    }
+
+    return result;
+}
+
+// One-sample MIS between the BSDF and the guiding distribution, the returned
+// pdf is the mixture of both so the estimator stays unbiased no matter how
+// poorly the guiding distribution has been trained
+sp_BsdfSample SampleGuidedBsdf(sp_MaterialOutput materialOutput, vec3 N,
+    vec3 V, sp_GuidingField *guidingField, u32 guidingCellIndex,
+    sp_Sampler *sampler)
+{
+    sp_BsdfSample result = {};
+
+    f32 strategySelection = sp_Next1D(sampler);
+    if (strategySelection < SP_GUIDING_BSDF_SAMPLING_FRACTION)
+    {
+        result = SampleBsdf(materialOutput, N, V, sampler);
+    }
+    else
+    {
+        sp_GuidingSample guidingSample = sp_SampleGuidingField(
+            guidingField, guidingCellIndex, sp_Next2D(sampler));
+        result.direction = guidingSample.direction;
+        result.pdf = guidingSample.pdf;
+    }
+
+    // Directions below the surface end the path
+    if (result.pdf > 0.0f)
+    {
+        result.pdf = ComputeScatterPdf(materialOutput, N, V, result.direction,
+            guidingField, guidingCellIndex);
+    }
+
+    return result;
+}
+
+// Returns the BRDF value for light arriving from L and leaving along V, does
+// not include the cosine term
+vec3 EvaluateBrdf(sp_MaterialOutput materialOutput, vec3 N, vec3 V, vec3 L)
+{
+    vec3 H = Normalize(L + V);
+
+    vec3 F0 = Vec3(0.04f);
+    vec3 F = FresnelSchlick(Max(Dot(H, V), 0.0f), F0);
+
+    vec3 kS = F;
+    vec3 kD = Vec3(1) - kS;
+
+    f32 oneOverPI = 1.0f / PI;
+
+    f32 roughness = Max(materialOutput.roughness, SP_MIN_ROUGHNESS);
+    f32 NDF = DistributionGGX(N, H, roughness);
+    f32 G   = GeometrySmith(N, V, L, roughness);
+
+    vec3 numerator = NDF * G * F;
+    f32 denominator =
+        4.0f * Max(Dot(N, V), 0.0f) * Max(Dot(N, L), 0.0f) + 0.0001f;
+    vec3 specular = numerator * (1.0f / denominator);
+
+    vec3 albedo = materialOutput.albedo;
+
+    vec3 result = Hadamard(kD, albedo) * oneOverPI + specular;
+    return result;
+}
+
+internal sp_MaterialOutput EvaluateVertexMaterial(
+    sp_MaterialSystem *materialSystem, sp_PathVertex *vertex)
+{
+    sp_MaterialOutput materialOutput = {};
+    sp_Material *material =
+        sp_FindMaterialById(materialSystem, vertex->materialId);
+    if (material != NULL)
+    {
+        materialOutput = sp_EvaluateMaterial(materialSystem, material, vertex);
+    }
+    else
+    {
+        // No material, set emission color to magenta for debuggging
+        materialOutput.emission = Vec3(1, 0, 1);
+    }
+
+    return materialOutput;
+}
+
+// Radiance leaving the vertex along outgoingDir due to its emission and its
+// light samples. Light arriving along incomingDir is not included.
+vec3 ComputeDirectRadianceForVertex(
+    sp_PathVertex *vertex, sp_MaterialOutput materialOutput)
+{
+    if (vertex->isLight)
+    {
+        // Path terminates on a light, emission is already MIS weighted
+        return vertex->lightEmission;
+    }
+
+    vec3 N = vertex->normal;
+    vec3 V = vertex->outgoingDir;
+
+    vec3 radiance = materialOutput.emission;
+
+    // Light arriving from the next event estimation samples
+    f32 lightCosine = Max(0.0, Dot(N, vertex->lightDir));
+    if (lightCosine > 0.0f)
+    {
+        vec3 brdf = EvaluateBrdf(materialOutput, N, V, vertex->lightDir);
+        radiance += Hadamard(brdf, vertex->lightRadiance) * lightCosine;
+    }
+
+    f32 environmentCosine = Max(0.0, Dot(N, vertex->environmentDir));
+    if (environmentCosine > 0.0f)
+    {
+        vec3 brdf = EvaluateBrdf(materialOutput, N, V, vertex->environmentDir);
+        radiance +=
+            Hadamard(brdf, vertex->environmentRadiance) * environmentCosine;
+    }
+
+    return radiance;
+}
+
+// Factor applied to radiance arriving along incomingDir to get the radiance
+// it contributes along outgoingDir, i.e. brdf * cosine / pdf
+vec3 ComputeBsdfWeightForVertex(
+    sp_PathVertex *vertex, sp_MaterialOutput materialOutput)
+{
+    vec3 result = {};
+    if (!vertex->isLight && vertex->incomingPdf > 0.0f)
+    {
+        vec3 N = vertex->normal;
+        vec3 V = vertex->outgoingDir;
+        vec3 L = vertex->incomingDir;
+
+        f32 cosine = Max(0.0, Dot(N, L));
+        vec3 brdf = EvaluateBrdf(materialOutput, N, V, L);
+        result = brdf * (cosine / vertex->incomingPdf);
+    }
+
+    return result;
+}
+
+// Evaluates a stored path backwards from its last vertex. sp_PathTraceTile
+// accumulates the same terms forwards as it traces so that the path length is
+// not limited by storage.
 vec3 ComputeRadianceForPath(
     sp_PathVertex *path, u32 pathLength, sp_MaterialSystem *materialSystem)
 {
@@ -112,26 +408,12 @@ vec3 ComputeRadianceForPath(
     {
         sp_PathVertex *vertex = path + i;
 
-        // Fetch values out of path vertex
-        vec3 incomingDir = vertex->incomingDir;
-        vec3 normal = vertex->normal;
-        u32 materialId = vertex->materialId;
-
-        // Set surface albedo and emission from material
         sp_MaterialOutput materialOutput = {};
-        sp_Material *material = sp_FindMaterialById(materialSystem, materialId);
-        if (material != NULL)
+        if (!vertex->isLight)
         {
-            materialOutput =
-                sp_EvaluateMaterial(materialSystem, material, vertex);
-        }
-        else
-        {
-            // No material, set emission color to magenta for debuggging
-            materialOutput.emission = Vec3(1, 0, 1);
+            materialOutput = EvaluateVertexMaterial(materialSystem, vertex);
         }
 
-        f32 cosine = Max(0.0, Dot(normal, incomingDir));
         vec3 incomingRadiance = radiance;
 
 #if RADIANCE_CLAMP
@@ -139,39 +421,523 @@ vec3 ComputeRadianceForPath(
             Clamp(incomingRadiance, Vec3(0), Vec3(RADIANCE_CLAMP));
 #endif
 
-        vec3 L = incomingDir;
-        vec3 N = normal;
-        vec3 V = vertex->outgoingDir;
-        vec3 H = Normalize(L + V);
+        radiance = ComputeDirectRadianceForVertex(vertex, materialOutput) +
+                   Hadamard(ComputeBsdfWeightForVertex(vertex, materialOutput),
+                       incomingRadiance);
+    }
 
-        vec3 specularColor = Vec3(1);
+    return radiance;
+}
 
-        vec3 F0 = Vec3(0.04f);
-        vec3 F = FresnelSchlick(Max(Dot(H, V), 0.0f), F0);
+// Radiance arriving at an earlier vertex of the path, i.e. what the path
+// gathered after reaching it with the throughput up to the vertex divided back
+// out
+internal vec3 ComputeRadianceGatheredAfterVertex(
+    vec3 pathRadiance, vec3 radianceBefore, vec3 throughput)
+{
+    vec3 gathered = pathRadiance - radianceBefore;
+    vec3 result = {};
+    for (u32 i = 0; i < 3; i++)
+    {
+        if (throughput.data[i] > 0.0f)
+        {
+            result.data[i] = gathered.data[i] / throughput.data[i];
+        }
+    }
 
-        vec3 kS = F;
-        vec3 kD = Vec3(1) - kS;
+    return result;
+}
+
+// Scattering event recorded into the guiding field once the path is complete
+struct sp_GuidingVertex
+{
+    u32 cellIndex;
+    vec3 direction;
+    f32 pdf;
+    vec3 throughput; // Including the BSDF weight of the vertex
+    vec3 radianceBefore;
+};
+
+struct sp_TracePathResult
+{
+    vec3 radiance;
+    u32 pathLength;
+
+    // First hit data for the AOVs
+    vec3 albedo;
+    vec3 normal;
+    f32 depth;
+    u32 materialId;
+    vec3 directRadiance; // Included in radiance
+
+    // Only written when one of the SP_DEBUG_* visualizations is enabled
+    vec4 debugColor;
+};
+
+// Traces a single path through the scene, accumulating radiance forwards
+// weighted by the path throughput. Once the path is longer than
+// RUSSIAN_ROULETTE_MIN_BOUNCES it is terminated with a probability based on
+// its throughput so that dark paths stop early.
+//
+// The vertices of the path are compressed into cachedPath when it is not NULL
+// so that the path can be shaded again with ComputeRadianceForPath.
+sp_TracePathResult sp_TracePath(sp_Context *ctx, vec3 rayOrigin,
+    vec3 rayDirection, u32 maxBounces, sp_Sampler *sampler,
+    sp_Metrics *metrics, sp_CachedPath *cachedPath = NULL)
+{
+    sp_MaterialSystem *materialSystem = ctx->materialSystem;
+
+    sp_TracePathResult pathResult = {};
+    pathResult.debugColor = Vec4(0, 0, 0, 1);
+
+    vec3 throughput = Vec3(1);
+    f32 prevBsdfPdf = 0.0f;
+
+    // First vertex of the path which maps to a radiance cache cell, the
+    // radiance the rest of the path gathers is added to the cell once the
+    // path has been traced
+    sp_RadianceCache *radianceCache = ctx->radianceCache;
+    b32 prevVertexIsDiffuse = false;
+    u32 cacheCellIndex = U32_MAX;
+    vec3 cacheCellThroughput = {};
+    vec3 cacheCellRadianceBefore = {};
+
+    sp_GuidingField *guidingField = ctx->guidingField;
+    sp_GuidingVertex guidingVertices[SP_GUIDING_MAX_PATH_VERTICES];
+    u32 guidingVertexCount = 0;
+
+    // Once the cached path is full the radiance gathered by the rest of the
+    // path is cached as a single light vertex
+    b32 isCachedPathFull = false;
+    vec3 cachedTailThroughput = {};
+    vec3 cachedTailRadianceBefore = {};
+
+    for (u32 bounce = 0; bounce < maxBounces; bounce++)
+    {
+        u32 dimension = SP_SAMPLER_CAMERA_DIMENSIONS +
+                        bounce * SP_SAMPLER_DIMENSIONS_PER_BOUNCE;
+        sp_SetSamplerDimension(sampler, dimension);
+
+        // Trace ray through scene
+        sp_RayIntersectSceneResult result = sp_RayIntersectScene(
+            ctx->scene, rayOrigin, rayDirection, metrics);
 
-        f32 oneOverPI = 1.0f / PI;
+        metrics->values[sp_Metric_RaysTraced]++;
 
-        f32 roughness = materialOutput.roughness;
-        f32 NDF = DistributionGGX(N, H, roughness);       
-        f32 G   = GeometrySmith(N, V, L, roughness);
+        sp_PathVertex vertex = {};
+        pathResult.pathLength++;
 
-        vec3 numerator = NDF * G * F;
-        f32 denominator =
-            4.0f * Max(Dot(N, V), 0.0f) * Max(Dot(N, L), 0.0f) + 0.0001f;
-        vec3 specular = numerator * (1.0f / denominator);
+        if (cachedPath != NULL && !isCachedPathFull &&
+            cachedPath->vertexCount == SP_SHADING_CACHE_MAX_PATH_VERTICES - 1)
+        {
+            isCachedPathFull = true;
+            cachedTailThroughput = throughput;
+            cachedTailRadianceBefore = pathResult.radiance;
+        }
+        b32 isVertexCached = (cachedPath != NULL && !isCachedPathFull);
 
-        vec3 albedo = materialOutput.albedo;
+#if SP_DEBUG_BROADPHASE_INTERSECTION_COUNT
+        {
+            // TODO: Constant for max broadphase intersections?
+            f32 t = (f32)result.broadphaseIntersectionCount / 8.0f;
+            pathResult.debugColor =
+                Lerp(Vec4(0, 1, 0, 1), Vec4(1, 0, 0, 1), t);
+        }
+#endif
+#if SP_DEBUG_MIDPHASE_INTERSECTION_COUNT
+        {
+            // TODO: Constant for max midphase intersections?
+            f32 t = (f32)result.midphaseIntersectionCount / 128.0f;
+            vec4 color = Lerp(Vec4(0, 1, 0, 1), Vec4(1, 0, 0, 1), t);
+            pathResult.debugColor = (result.midphaseIntersectionCount != 0)
+                                        ? color
+                                        : Vec4(0, 0, 0, 1);
+        }
+#endif
 
-        radiance =
-            materialOutput.emission +
-            Hadamard(Hadamard(kD, albedo) * oneOverPI + specular, incomingRadiance) *
-                cosine;
+        // Analytic lights are not part of the broadphase so they are tested
+        // separately against the nearest hit
+        f32 sceneT = result.t > 0.0f ? result.t : F32_MAX;
+        sp_RayIntersectLightsResult lightResult = sp_RayIntersectLights(
+            ctx->scene, rayOrigin, rayDirection, sceneT);
+
+        if (lightResult.lightIndex != U32_MAX)
+        {
+            sp_Light *light = ctx->scene->lights + lightResult.lightIndex;
+
+            // Camera rays have no light sample to balance against
+            f32 weight = 1.0f;
+            if (bounce > 0)
+            {
+                f32 lightPdf = sp_ComputeLightPdf(ctx->scene,
+                    lightResult.lightIndex, rayOrigin, rayDirection,
+                    lightResult.t);
+                weight = PowerHeuristic(prevBsdfPdf, lightPdf);
+            }
+
+            vertex.isLight = true;
+            vertex.lightEmission = light->radiance * weight;
+            vertex.outgoingDir = -rayDirection;
+
+            if (bounce == 0)
+            {
+                pathResult.depth = lightResult.t;
+                pathResult.materialId = U32_MAX;
+            }
+
+            metrics->values[sp_Metric_RayHitCount]++;
+        }
+        else if (result.t > 0.0f)
+        {
+            vertex.materialId = result.materialId;
+            vertex.worldPosition = rayOrigin + rayDirection * result.t;
+            vertex.outgoingDir = -rayDirection;
+            vertex.normal = result.normal;
+            vertex.uv = result.uv;
+
+            // Count ray hit for metrics
+            metrics->values[sp_Metric_RayHitCount]++;
+        }
+        else
+        {
+            vertex.materialId = materialSystem->backgroundMaterialId;
+            vertex.outgoingDir = -rayDirection;
+
+            if (bounce == 0)
+            {
+                pathResult.materialId = vertex.materialId;
+            }
+
+            // Balance against the environment sample taken at the previous
+            // vertex, camera rays have none
+            f32 environmentPdf = 0.0f;
+            if (bounce > 0)
+            {
+                environmentPdf = sp_ComputeEnvironmentPdf(materialSystem,
+                    materialSystem->backgroundMaterialId, rayDirection);
+            }
+
+            if (environmentPdf > 0.0f)
+            {
+                f32 weight = PowerHeuristic(prevBsdfPdf, environmentPdf);
+
+                sp_MaterialOutput materialOutput =
+                    EvaluateVertexMaterial(materialSystem, &vertex);
+                vertex.isLight = true;
+                vertex.lightEmission = materialOutput.emission * weight;
+            }
+
+            // Count ray miss for metrics
+            metrics->values[sp_Metric_RayMissCount]++;
+        }
+
+        // Terminal vertices only contribute their emission
+        if (vertex.isLight || result.t <= 0.0f)
+        {
+            sp_MaterialOutput materialOutput = {};
+            if (!vertex.isLight)
+            {
+                materialOutput =
+                    EvaluateVertexMaterial(materialSystem, &vertex);
+            }
+
+            vec3 contribution = Hadamard(throughput,
+                ComputeDirectRadianceForVertex(&vertex, materialOutput));
+#if RADIANCE_CLAMP
+            if (bounce > 0)
+            {
+                contribution =
+                    Clamp(contribution, Vec3(0), Vec3(RADIANCE_CLAMP));
+            }
+#endif
+            pathResult.radiance += contribution;
+
+            // Emitters seen by the camera or by the BSDF sample of the first
+            // hit are direct lighting
+            if (bounce <= 1)
+            {
+                pathResult.directRadiance += contribution;
+            }
+
+            if (isVertexCached)
+            {
+                sp_AddCachedVertex(cachedPath, &vertex);
+            }
+
+            // FIXME: Don't want to have a break in this loop, going to
+            // make it much harder to convert to SIMD
+            break;
+        }
+
+        // Move new ray origin out of hit surface with a small offset in the
+        // direction of the surface normal to prevent self intersection
+        // TODO: Make this a configurable constant
+        f32 bias = 0.0001f;
+        rayOrigin = vertex.worldPosition + result.normal * bias;
+
+        // Material is needed up front to importance sample the BSDF
+        sp_MaterialOutput materialOutput =
+            EvaluateVertexMaterial(materialSystem, &vertex);
+        vec3 V = vertex.outgoingDir;
+
+        if (bounce == 0)
+        {
+            pathResult.albedo = materialOutput.albedo;
+            pathResult.normal = result.normal;
+            pathResult.depth = result.t;
+            pathResult.materialId = vertex.materialId;
+        }
+
+        b32 isDiffuse =
+            (materialOutput.roughness >= SP_RADIANCE_CACHE_MIN_ROUGHNESS);
+        if (radianceCache != NULL && prevVertexIsDiffuse && isDiffuse)
+        {
+            // Always drawn so that the sampler dimensions used by the rest of
+            // the bounce don't depend on the state of the cache
+            f32 trainingSample = sp_Next1D(sampler);
+
+            u32 cellIndex = sp_FindRadianceCacheCell(
+                radianceCache, vertex.worldPosition, result.normal);
+            if (cellIndex != U32_MAX)
+            {
+                // Terminate into the cache, except for a fraction of paths
+                // which keep refining the cell. Paths being stored in the
+                // shading cache never terminate as the cached radiance
+                // includes the materials of the vertices it was gathered
+                // from, which a material edit would not update.
+                sp_RadianceCacheLookupResult lookup =
+                    sp_LookupRadianceCache(radianceCache, cellIndex);
+                if (lookup.isValid && cachedPath == NULL &&
+                    trainingSample >= SP_RADIANCE_CACHE_TRAINING_FRACTION)
+                {
+                    vec3 contribution = Hadamard(throughput, lookup.radiance);
+#if RADIANCE_CLAMP
+                    contribution =
+                        Clamp(contribution, Vec3(0), Vec3(RADIANCE_CLAMP));
+#endif
+                    pathResult.radiance += contribution;
+                    metrics->values
+                        [sp_Metric_PathsTerminatedByRadianceCache]++;
+                    break;
+                }
+
+                if (cacheCellIndex == U32_MAX)
+                {
+                    cacheCellIndex = cellIndex;
+                    cacheCellThroughput = throughput;
+                    cacheCellRadianceBefore = pathResult.radiance;
+                }
+            }
+        }
+        prevVertexIsDiffuse = isDiffuse;
+
+        // Cells are trained as soon as guiding is enabled but they are only
+        // sampled once they have seen enough samples in earlier passes
+        u32 trainingCellIndex = U32_MAX;
+        u32 guidingCellIndex = U32_MAX;
+        if (guidingField != NULL &&
+            materialOutput.roughness >= SP_GUIDING_MIN_ROUGHNESS)
+        {
+            trainingCellIndex =
+                sp_FindGuidingCell(guidingField, vertex.worldPosition);
+            if (sp_CanSampleGuidingCell(guidingField, trainingCellIndex))
+            {
+                guidingCellIndex = trainingCellIndex;
+            }
+        }
+
+        // Next event estimation, sample a light directly and weight it
+        // against the chance of the BSDF sample finding the same light
+        sp_LightSample lightSample =
+            sp_SampleLight(ctx->scene, rayOrigin, sampler);
+        if (lightSample.pdf > 0.0f &&
+            Dot(result.normal, lightSample.direction) > 0.0f)
+        {
+            metrics->values[sp_Metric_ShadowRaysTraced]++;
+            if (!sp_RayOccluded(ctx->scene, rayOrigin, lightSample.direction,
+                    lightSample.distance))
+            {
+                f32 bsdfPdf = ComputeScatterPdf(materialOutput,
+                    result.normal, V, lightSample.direction, guidingField,
+                    guidingCellIndex);
+                f32 weight = PowerHeuristic(lightSample.pdf, bsdfPdf);
+
+                vertex.lightDir = lightSample.direction;
+                vertex.lightRadiance =
+                    lightSample.radiance * (weight / lightSample.pdf);
+            }
+        }
+
+        // Same again for the environment map, this is where most of the
+        // light comes from for sun lit HDRIs
+        sp_EnvironmentSample environmentSample = sp_SampleEnvironment(
+            materialSystem, materialSystem->backgroundMaterialId, sampler);
+        if (environmentSample.pdf > 0.0f &&
+            Dot(result.normal, environmentSample.direction) > 0.0f)
+        {
+            metrics->values[sp_Metric_ShadowRaysTraced]++;
+            if (!sp_RayOccluded(
+                    ctx->scene, rayOrigin, environmentSample.direction))
+            {
+                f32 bsdfPdf = ComputeScatterPdf(materialOutput,
+                    result.normal, V, environmentSample.direction,
+                    guidingField, guidingCellIndex);
+                f32 weight = PowerHeuristic(environmentSample.pdf, bsdfPdf);
+
+                vertex.environmentDir = environmentSample.direction;
+                vertex.environmentRadiance = environmentSample.radiance *
+                                             (weight / environmentSample.pdf);
+            }
+        }
+
+        // Importance sample the BSDF to pick the direction of the next ray,
+        // mixed with the guiding distribution where one has been learned
+        sp_BsdfSample bsdfSample =
+            (guidingCellIndex != U32_MAX)
+                ? SampleGuidedBsdf(materialOutput, result.normal, V,
+                      guidingField, guidingCellIndex, sampler)
+                : SampleBsdf(materialOutput, result.normal, V, sampler);
+        vertex.incomingDir = bsdfSample.direction;
+        vertex.incomingPdf = bsdfSample.pdf;
+
+#if SP_DEBUG_COSINE
+        pathResult.debugColor =
+            Vec4(Vec3(Max(0.0, Dot(result.normal, bsdfSample.direction))), 1);
+#endif
+
+#if SP_DEBUG_SURFACE_NORMAL
+        pathResult.debugColor = Vec4(result.normal * 0.5f + Vec3(0.5f), 1);
+#endif
+
+        vec3 contribution = Hadamard(
+            throughput, ComputeDirectRadianceForVertex(&vertex, materialOutput));
+#if RADIANCE_CLAMP
+        if (bounce > 0)
+        {
+            contribution = Clamp(contribution, Vec3(0), Vec3(RADIANCE_CLAMP));
+        }
+#endif
+        pathResult.radiance += contribution;
+
+        // Direct lighting is kept as a separate term, the emission and light
+        // samples of the first hit plus the emission of the vertex its BSDF
+        // sample finds. Light sampled at the second vertex has already
+        // bounced once so it is part of the indirect lighting.
+        if (bounce == 0)
+        {
+            pathResult.directRadiance += contribution;
+        }
+        else if (bounce == 1)
+        {
+            vec3 emission = Hadamard(throughput, materialOutput.emission);
+#if RADIANCE_CLAMP
+            emission = Clamp(emission, Vec3(0), Vec3(RADIANCE_CLAMP));
+#endif
+            pathResult.directRadiance += emission;
+        }
+
+        sp_CachedVertex *cachedVertex =
+            isVertexCached ? sp_AddCachedVertex(cachedPath, &vertex) : NULL;
+
+        // Sampled direction ended up below the surface so nothing further
+        // along the path can contribute
+        if (bsdfSample.pdf <= 0.0f)
+        {
+            break;
+        }
+
+        throughput = Hadamard(
+            throughput, ComputeBsdfWeightForVertex(&vertex, materialOutput));
+
+        // Russian roulette, the surviving paths are weighted up so that the
+        // estimate stays unbiased
+        if (bounce + 1 >= RUSSIAN_ROULETTE_MIN_BOUNCES)
+        {
+            f32 survivalProbability = Min(
+                MaxComponent(throughput), SP_RUSSIAN_ROULETTE_MAX_SURVIVAL);
+            if (sp_Next1D(sampler) >= survivalProbability)
+            {
+                metrics->values[sp_Metric_PathsTerminatedByRoulette]++;
+                break;
+            }
+
+            throughput = throughput * (1.0f / survivalProbability);
+
+            // Shading the cached path again has to weight up the survivors
+            // in the same way
+            if (cachedVertex != NULL)
+            {
+                cachedVertex->incomingPdf *= survivalProbability;
+            }
+        }
+
+        if (trainingCellIndex != U32_MAX &&
+            guidingVertexCount < SP_GUIDING_MAX_PATH_VERTICES)
+        {
+            sp_GuidingVertex *guidingVertex =
+                guidingVertices + guidingVertexCount++;
+            guidingVertex->cellIndex = trainingCellIndex;
+            guidingVertex->direction = bsdfSample.direction;
+            guidingVertex->pdf = bsdfSample.pdf;
+            guidingVertex->throughput = throughput;
+            guidingVertex->radianceBefore = pathResult.radiance;
+        }
+
+        prevBsdfPdf = bsdfSample.pdf;
+        rayDirection = bsdfSample.direction;
     }
 
-    return radiance;
+    if (isCachedPathFull)
+    {
+        vec3 radiance = ComputeRadianceGatheredAfterVertex(pathResult.radiance,
+            cachedTailRadianceBefore, cachedTailThroughput);
+        sp_AddCachedPathTail(cachedPath, radiance);
+    }
+
+    if (cacheCellIndex != U32_MAX)
+    {
+        vec3 radiance = ComputeRadianceGatheredAfterVertex(pathResult.radiance,
+            cacheCellRadianceBefore, cacheCellThroughput);
+        sp_AddRadianceCacheSample(radianceCache, cacheCellIndex, radiance);
+    }
+
+    // Train the guiding field with the radiance arriving at each vertex from
+    // the direction that was sampled
+    for (u32 i = 0; i < guidingVertexCount; i++)
+    {
+        sp_GuidingVertex *guidingVertex = guidingVertices + i;
+        vec3 incidentRadiance =
+            ComputeRadianceGatheredAfterVertex(pathResult.radiance,
+                guidingVertex->radianceBefore, guidingVertex->throughput);
+        sp_RecordGuidingSample(ctx->guidingField, guidingVertex->cellIndex,
+            guidingVertex->direction,
+            Luminance(incidentRadiance) / guidingVertex->pdf);
+    }
+
+    return pathResult;
+}
+
+// Statistics of the luminance of every sample accumulated for the pixel so
+// far, which covers all of the passes of a render split across frames
+internal sp_RunningStats GetAccumulatedRunningStats(
+    sp_AccumulationBuffer *buffer, u32 pixelIndex)
+{
+    sp_RunningStats result = {};
+    u64 count = buffer->pixels[pixelIndex].sampleCount;
+    if (count > 0)
+    {
+        // NOTE: The sum of squared differences is recovered from the sums in
+        // double precision as the samples of earlier passes are gone
+        sp_AccumulationPixelStats *stats = buffer->stats + pixelIndex;
+        f64 mean = stats->luminanceSum / (f64)count;
+        f64 m2 = stats->luminanceSquaredSum - stats->luminanceSum * mean;
+
+        result.count = (u32)count;
+        result.mean = (f32)mean;
+        result.m2 = (m2 > 0.0) ? (f32)m2 : 0.0f;
+    }
+
+    return result;
 }
 
 // TODO: Actual SIMD!
@@ -183,7 +949,6 @@ void sp_PathTraceTile(
     sp_Camera *camera = ctx->camera;
     ImagePlane *imagePlane = camera->imagePlane;
     vec4 *pixels = imagePlane->pixels;
-    sp_MaterialSystem *materialSystem = ctx->materialSystem;
 
     u32 minX = tile.minX;
     u32 minY = tile.minY;
@@ -191,8 +956,28 @@ void sp_PathTraceTile(
     u32 maxY = MinU32(tile.maxY, imagePlane->height);
 
     // TODO: Expose these via parameter!
-    u32 sampleCount = SAMPLES_PER_PIXEL;
-    u32 bounceCount = 3; // TODO: Use MAX_BOUNCES constant
+    u32 sampleCount =
+        (ctx->samplesPerPixel > 0) ? ctx->samplesPerPixel : SAMPLES_PER_PIXEL;
+    u32 bounceCount = MAX_BOUNCES;
+
+    u32 minSamples = ctx->minSamplesPerPixel;
+
+    u32 stride = MaxU32(ctx->pixelStride, 1);
+
+    // Accumulated samples would be attributed to the wrong pixels
+    sp_AccumulationBuffer *accumulationBuffer = ctx->accumulationBuffer;
+    Assert(stride == 1 || accumulationBuffer == NULL);
+
+    // Adaptive sampling and the AOVs cover every pass accumulated so far
+    // rather than only this one
+    b32 hasAccumulatedStats =
+        (accumulationBuffer != NULL && accumulationBuffer->stats != NULL);
+
+    // Preview levels are not cached, their pixels keep the paths of the last
+    // full resolution pass which traced them
+    sp_ShadingCache *shadingCache = (stride == 1) ? ctx->shadingCache : NULL;
+
+    sp_Sampler sampler = sp_CreateSampler(ctx->samplerType, rng);
 
 #if (SP_DEBUG_BROADPHASE_INTERSECTION_COUNT || SP_DEBUG_SURFACE_NORMAL ||      \
      SP_DEBUG_MIDPHASE_INTERSECTION_COUNT || SP_DEBUG_COSINE)
@@ -205,21 +990,65 @@ void sp_PathTraceTile(
     sampleCount = 1;
 #endif
 
-    for (u32 y = minY; y < maxY; y++)
+    for (u32 y = minY; y < maxY; y += stride)
     {
-        for (u32 x = minX; x < maxX; x++)
+        if (ctx->isCancelled)
+        {
+            break;
+        }
+
+        for (u32 x = minX; x < maxX; x += stride)
         {
             vec4 color = Vec4(0, 0, 0, 1);
 
             // Multiple samples per pixel
             vec3 totalRadiance = {};
-            for (u32 sample = 0; sample < sampleCount; sample++)
+            u32 samplesTaken = 0;
+
+            // AOVs which can be filtered are averaged like the radiance, the
+            // rest are taken from the first sample
+            vec3 totalAlbedo = {};
+            vec3 totalNormal = {};
+            vec3 totalDirectRadiance = {};
+            f32 depth = 0.0f;
+            u32 materialId = 0;
+            vec4 position = {};
+            vec3 normal = {};
+
+            // Statistics of the sample luminance for adaptive sampling
+            sp_RunningStats stats = {};
+
+            u32 pixelIndex = x + y * imagePlane->width;
+
+            // Pixels which converged in an earlier pass keep the result they
+            // were given then
+            if (hasAccumulatedStats && ctx->maxRelativeError > 0.0f)
+            {
+                stats = GetAccumulatedRunningStats(
+                    accumulationBuffer, pixelIndex);
+                if (sp_HasConverged(
+                        &stats, ctx->maxRelativeError, minSamples))
+                {
+                    continue;
+                }
+            }
+
+            if (shadingCache != NULL)
             {
+                sp_ResetShadingCachePixel(shadingCache, pixelIndex);
+            }
+
+            u32 firstSample = ctx->firstSample;
+            for (u32 sample = firstSample; sample < firstSample + sampleCount;
+                 sample++)
+            {
+                sp_StartPixelSample(&sampler, x, y, sample);
+
                 // Offset pixel position by 0.5 to sample from center
                 vec2 pixelPosition = Vec2((f32)x, (f32)y) + Vec2(0.5);
-                pixelPosition +=
-                    Vec2(camera->halfPixelWidth * RandomBilateral(rng),
-                        camera->halfPixelHeight * RandomBilateral(rng));
+                vec2 jitter = sp_Next2D(&sampler) * 2.0f - Vec2(1.0f);
+                pixelPosition += Vec2(camera->halfPixelWidth * jitter.x,
+                    camera->halfPixelHeight * jitter.y);
 
                 // Calculate position on film plane that ray passes through
                 vec3 filmP = {};
@@ -229,114 +1058,171 @@ void sp_PathTraceTile(
                 vec3 rayOrigin = camera->position;
                 vec3 rayDirection = Normalize(filmP - camera->position);
 
-                // TODO: Allocate from temp arena
-                sp_PathVertex path[4] = {};
-                u32 pathLength = 0;
+                sp_CachedPath *cachedPath =
+                    (shadingCache != NULL)
+                        ? sp_AddCachedPath(shadingCache, pixelIndex)
+                        : NULL;
 
-                for (u32 bounce = 0; bounce < bounceCount; bounce++)
+                sp_TracePathResult pathResult = sp_TracePath(ctx, rayOrigin,
+                    rayDirection, bounceCount, &sampler, metrics, cachedPath);
+                totalRadiance += pathResult.radiance;
+                samplesTaken++;
+                if (accumulationBuffer != NULL)
                 {
-                    // Trace ray through scene
-                    sp_RayIntersectSceneResult result = sp_RayIntersectScene(
-                        ctx->scene, rayOrigin, rayDirection, metrics);
-
-                    metrics->values[sp_Metric_RaysTraced]++;
-
-                    // Allocate path vertex
-                    sp_PathVertex *pathVertex = path + pathLength++;
-
-#if SP_DEBUG_BROADPHASE_INTERSECTION_COUNT
-                    {
-                        // TODO: Constant for max broadphase intersections?
-                        f32 t = (f32)result.broadphaseIntersectionCount / 8.0f;
-                        color = Lerp(Vec4(0, 1, 0, 1), Vec4(1, 0, 0, 1), t);
-                        //color = (result.broadphaseIntersectionCount != 0)
-                                    //? color
-                                    //: Vec4(0, 0, 0, 1);
-                    }
-#endif
-#if SP_DEBUG_MIDPHASE_INTERSECTION_COUNT
+                    sp_AddAccumulationSample(
+                        accumulationBuffer, pixelIndex, pathResult.radiance);
+                    if (hasAccumulatedStats)
                     {
-                        // TODO: Constant for max midphase intersections?
-                        f32 t = (f32)result.midphaseIntersectionCount / 128.0f;
-                        color = Lerp(Vec4(0, 1, 0, 1), Vec4(1, 0, 0, 1), t);
-                        color = (result.midphaseIntersectionCount != 0)
-                                    ? color
-                                    : Vec4(0, 0, 0, 1);
+                        sp_AddAccumulationStats(accumulationBuffer,
+                            pixelIndex, Luminance(pathResult.radiance),
+                            pathResult.albedo, pathResult.normal,
+                            pathResult.directRadiance);
                     }
-#endif
+                }
+                color = pathResult.debugColor;
 
-                    if (result.t > 0.0f)
+                totalAlbedo += pathResult.albedo;
+                totalNormal += pathResult.normal;
+                totalDirectRadiance += pathResult.directRadiance;
+                if (sample == firstSample)
+                {
+                    depth = pathResult.depth;
+                    materialId = pathResult.materialId;
+                    normal = pathResult.normal;
+                    if (depth > 0.0f)
                     {
-                        pathVertex->materialId = result.materialId;
-                        pathVertex->worldPosition = rayOrigin + rayDirection * result.t;
-                        pathVertex->outgoingDir = -rayDirection;
-                        pathVertex->normal = result.normal;
-                        pathVertex->uv = result.uv;
-
-                        // FIXME: This is generating terrible results that are not uniform!
-                        // Compute random direction on hemi-sphere around
-                        // result.normal
-                        vec3 dir = RandomDirectionOnHemisphere(result.normal, rng);
-                        pathVertex->incomingDir = dir;
-
-                        // Move new ray origin out of hit surface with a small
-                        // offset in the direction of the surface normal to prevent
-                        // self intersection
-                        // TODO: Make this a configurable constant
-                        f32 bias = 0.0001f;
-                        rayOrigin = pathVertex->worldPosition + result.normal * bias;
-                        rayDirection = dir;
-
-                        // Count ray hit for metrics
-                        metrics->values[sp_Metric_RayHitCount]++;
+                        position =
+                            Vec4(rayOrigin + rayDirection * depth, 1.0f);
+                    }
+                }
 
-#if SP_DEBUG_COSINE
-                        color = Vec4(Vec3(Max(0.0, Dot(result.normal, rayDirection))), 1);
-                        //color = Dot(result.normal, dir) < 0.0f ? Vec4(1, 0, 0, 1) : Vec4(0, 0, 0, 1);
-#endif
+                // Record number of paths traced for tile
+                metrics->values[sp_Metric_PathsTraced]++;
 
-#if SP_DEBUG_SURFACE_NORMAL
-                        color = Vec4(result.normal * 0.5f + Vec3(0.5f), 1);
+#if SP_DEBUG_PATH_LENGTH
+                color = Vec4(
+                    (f32)pathResult.pathLength / (f32)bounceCount, 0, 0, 1);
 #endif
-                    }
-                    else
-                    {
-                        pathVertex->materialId =
-                            materialSystem->backgroundMaterialId;
-                        pathVertex->outgoingDir = -rayDirection;
-
-                        // Count ray miss for metrics
-                        metrics->values[sp_Metric_RayMissCount]++;
 
-                        // FIXME: Don't want to have a break in this loop, going to
-                        // make it much harder to convert to SIMD
-                        break;
-                    }
+                // Stop sampling the pixel once its estimate has converged,
+                // the time saved goes to the tiles still in the work queue
+                sp_AddSample(&stats, Luminance(pathResult.radiance));
+                if (hasAccumulatedStats)
+                {
+                    stats = GetAccumulatedRunningStats(
+                        accumulationBuffer, pixelIndex);
+                }
+                if (ctx->maxRelativeError > 0.0f &&
+                    sp_HasConverged(&stats, ctx->maxRelativeError, minSamples))
+                {
+                    metrics->values[sp_Metric_PixelsConverged]++;
+                    break;
                 }
+            }
 
-                // Compute lighting for single path by calculating incoming
-                // radiance using the rendering equation
-                vec3 radiance = ComputeRadianceForPath(
-                        path, pathLength, materialSystem);
-                totalRadiance += radiance * (1.0f / (f32)sampleCount);
+            totalRadiance = totalRadiance * (1.0f / (f32)samplesTaken);
 
-                // Record number of paths traced for tile
-                metrics->values[sp_Metric_PathsTraced]++;
+            // Estimate from every sample of the pixel, which includes the
+            // earlier passes of a final render split across frames
+            vec3 pixelRadiance = totalRadiance;
+            f32 pixelSampleCount = (f32)samplesTaken;
+            if (accumulationBuffer != NULL)
+            {
+                pixelRadiance =
+                    sp_ResolveAccumulationPixel(accumulationBuffer, pixelIndex);
+                pixelSampleCount =
+                    (f32)accumulationBuffer->pixels[pixelIndex].sampleCount;
+            }
 
+            // Weight in the samples of the previous view which saw the same
+            // surface through this pixel. Blended after resolving so that the
+            // accumulation buffer only ever holds samples of this view. The
+            // history never outweighs the samples of this view so that it
+            // can't dominate pixels which have converged.
+            if (ctx->temporalHistory != NULL && position.w > 0.0f)
+            {
+                sp_TemporalSample history = sp_LookupTemporalHistory(
+                    ctx->temporalHistory, position.xyz, normal);
+                if (history.sampleCount > 0.0f)
+                {
+                    f32 historyWeight =
+                        Min(history.sampleCount, pixelSampleCount);
+                    pixelRadiance =
+                        (pixelRadiance * pixelSampleCount +
+                            history.radiance * historyWeight) *
+                        (1.0f / (pixelSampleCount + historyWeight));
+                    pixelSampleCount += historyWeight;
+                    metrics->values[sp_Metric_PixelsReprojected]++;
+                }
+            }
 
-#if SP_DEBUG_PATH_LENGTH
-                color = Vec4((f32)pathLength / (f32)bounceCount, 0, 0, 1);
-#endif
+            if (ctx->temporalHistory != NULL)
+            {
+                sp_RecordTracedRadiance(ctx->temporalHistory, pixelIndex,
+                    pixelRadiance, pixelSampleCount);
             }
 
 #if !(SP_DEBUG_BROADPHASE_INTERSECTION_COUNT || SP_DEBUG_SURFACE_NORMAL ||     \
       SP_DEBUG_MIDPHASE_INTERSECTION_COUNT || SP_DEBUG_PATH_LENGTH ||          \
       SP_DEBUG_COSINE)
-            color = Vec4(totalRadiance, 1);
+            color = Vec4(pixelRadiance, 1);
 #endif
 
             // Write final pixel value
-            pixels[x + y * imagePlane->width] = color;
+            pixels[pixelIndex] = color;
+
+            // Nearest neighbour upsampling for preview levels, finer levels
+            // overwrite the block later
+            if (stride > 1)
+            {
+                u32 blockMaxX = MinU32(x + stride, maxX);
+                u32 blockMaxY = MinU32(y + stride, maxY);
+                for (u32 blockY = y; blockY < blockMaxY; blockY++)
+                {
+                    for (u32 blockX = x; blockX < blockMaxX; blockX++)
+                    {
+                        pixels[blockX + blockY * imagePlane->width] = color;
+                    }
+                }
+            }
+
+            f32 invSamplesTaken = 1.0f / (f32)samplesTaken;
+            vec3 meanAlbedo = totalAlbedo * invSamplesTaken;
+            vec3 meanNormal = totalNormal * invSamplesTaken;
+            vec3 directRadiance = totalDirectRadiance * invSamplesTaken;
+            if (hasAccumulatedStats)
+            {
+                sp_AccumulationPixelStats *accumulated =
+                    accumulationBuffer->stats + pixelIndex;
+                f32 invSampleCount = 1.0f /
+                    (f32)accumulationBuffer->pixels[pixelIndex].sampleCount;
+                meanAlbedo = accumulated->albedoSum * invSampleCount;
+                meanNormal = accumulated->normalSum * invSampleCount;
+                directRadiance =
+                    accumulated->directRadianceSum * invSampleCount;
+            }
+
+            // NOTE: Indirect radiance is whatever the displayed radiance
+            // doesn't get from direct light so that the two always add up
+            vec4 aovs[SP_MAX_AOVS];
+            aovs[sp_Aov_Albedo] = Vec4(meanAlbedo, 1);
+            aovs[sp_Aov_Normal] = Vec4(meanNormal, 1);
+            aovs[sp_Aov_Depth] = Vec4(depth, 0, 0, 1);
+            aovs[sp_Aov_MaterialId] = Vec4((f32)materialId, 0, 0, 1);
+            aovs[sp_Aov_DirectRadiance] = Vec4(directRadiance, 1);
+            aovs[sp_Aov_IndirectRadiance] =
+                Vec4(pixelRadiance - directRadiance, 1);
+            aovs[sp_Aov_Variance] = Vec4(sp_GetVariance(&stats) /
+                pixelSampleCount, pixelSampleCount, 0, 1);
+            aovs[sp_Aov_Position] = position;
+
+            for (u32 i = 0; i < SP_MAX_AOVS; i++)
+            {
+                if (imagePlane->aovs[i] != NULL)
+                {
+                    imagePlane->aovs[i][pixelIndex] = aovs[i];
+                }
+            }
         }
     }
 
@@ -344,3 +1230,93 @@ void sp_PathTraceTile(
     metrics->values[sp_Metric_CyclesElapsed] = __rdtsc() - start;
 }
 
+// Shades the paths cached for the pixels of the tile again with the current
+// material parameters without tracing any rays, only valid while the camera,
+// scene and lights are the same as when the paths were traced. Pixels without
+// cached paths are left untouched. The radiance, albedo and variance AOVs are
+// updated for the denoiser, the direct and indirect radiance AOVs are not.
+//
+// NOTE: The radiance a path gathers past its last cached vertex is stored as
+// it was traced, so edits to materials only hit that deep into a path are not
+// reflected and albedo edits are not reproduced exactly for long paths.
+void sp_ReshadeTile(sp_Context *ctx, Tile tile, sp_Metrics *metrics)
+{
+    u64 start = __rdtsc();
+
+    sp_ShadingCache *cache = ctx->shadingCache;
+    Assert(cache != NULL);
+
+    ImagePlane *imagePlane = ctx->camera->imagePlane;
+    Assert(imagePlane->width == cache->width &&
+           imagePlane->height == cache->height);
+    sp_MaterialSystem *materialSystem = ctx->materialSystem;
+
+    u32 maxX = MinU32(tile.maxX, imagePlane->width);
+    u32 maxY = MinU32(tile.maxY, imagePlane->height);
+
+    for (u32 y = tile.minY; y < maxY; y++)
+    {
+        for (u32 x = tile.minX; x < maxX; x++)
+        {
+            u32 pixelIndex = x + y * imagePlane->width;
+            u32 pathCount = cache->pathCounts[pixelIndex];
+            if (pathCount == 0)
+            {
+                continue;
+            }
+
+            vec3 totalRadiance = {};
+            vec3 totalAlbedo = {};
+            sp_RunningStats stats = {};
+            for (u32 i = 0; i < pathCount; i++)
+            {
+                sp_CachedPath *path =
+                    cache->paths + pixelIndex * cache->samplesPerPixel + i;
+
+                sp_PathVertex vertices[SP_SHADING_CACHE_MAX_PATH_VERTICES];
+                u32 vertexCount = sp_DecompressCachedPath(path, vertices);
+
+                vec3 radiance = ComputeRadianceForPath(
+                    vertices, vertexCount, materialSystem);
+                totalRadiance += radiance;
+                sp_AddSample(&stats, Luminance(radiance));
+
+                // Matches the albedo sp_TracePath reports for the first hit
+                if (vertexCount > 0 && !vertices[0].isLight &&
+                    vertices[0].materialId !=
+                        materialSystem->backgroundMaterialId)
+                {
+                    totalAlbedo +=
+                        EvaluateVertexMaterial(materialSystem, vertices)
+                            .albedo;
+                }
+
+                metrics->values[sp_Metric_PathsReshaded]++;
+            }
+
+            f32 sampleCount = (f32)pathCount;
+            vec3 meanRadiance = totalRadiance * (1.0f / sampleCount);
+            imagePlane->pixels[pixelIndex] = Vec4(meanRadiance, 1);
+
+            if (ctx->temporalHistory != NULL)
+            {
+                sp_RecordTracedRadiance(ctx->temporalHistory, pixelIndex,
+                    meanRadiance, sampleCount);
+            }
+
+            if (imagePlane->aovs[sp_Aov_Albedo] != NULL)
+            {
+                imagePlane->aovs[sp_Aov_Albedo][pixelIndex] =
+                    Vec4(totalAlbedo * (1.0f / sampleCount), 1);
+            }
+
+            if (imagePlane->aovs[sp_Aov_Variance] != NULL)
+            {
+                imagePlane->aovs[sp_Aov_Variance][pixelIndex] = Vec4(
+                    sp_GetVariance(&stats) / sampleCount, sampleCount, 0, 1);
+            }
+        }
+    }
+
+    metrics->values[sp_Metric_CyclesElapsed] = __rdtsc() - start;
+}
@@ -1,10 +1,59 @@
 #pragma once
 
+// Roughness is clamped to this when evaluating and sampling the GGX lobe as a
+// perfectly smooth surface would need a delta distribution
+#define SP_MIN_ROUGHNESS 0.05f
+
+// Lower bound on the chance of picking either BSDF lobe when sampling so that
+// neither lobe is starved of samples
+#define SP_MIN_LOBE_PROBABILITY 0.1f
+
+// Upper bound on the chance of a path surviving russian roulette so that
+// paths with a throughput of 1 still terminate eventually
+#define SP_RUSSIAN_ROULETTE_MAX_SURVIVAL 0.95f
+
+// Arbitrary output variables, extra image channels written alongside the
+// radiance for denoising and compositing
+enum
+{
+    // Albedo of the first surface hit
+    sp_Aov_Albedo,
+
+    // World space shading normal of the first surface hit
+    sp_Aov_Normal,
+
+    // Distance along the camera ray to the first hit, 0 if nothing was hit
+    sp_Aov_Depth,
+
+    // Material id of the first hit in x, U32_MAX if an analytic light was hit
+    sp_Aov_MaterialId,
+
+    // Emission seen by the camera and light arriving at the first hit
+    // straight from an emitter
+    sp_Aov_DirectRadiance,
+
+    // Everything else, i.e. radiance minus the direct radiance
+    sp_Aov_IndirectRadiance,
+
+    // Variance of the pixel mean luminance in x, 0 with a single sample, and
+    // the number of samples the pixel holds in y
+    sp_Aov_Variance,
+
+    // World space position of the first hit, w is 0 if nothing was hit
+    sp_Aov_Position,
+
+    SP_MAX_AOVS,
+};
+
 struct ImagePlane
 {
     vec4 *pixels;
     u32 width;
     u32 height;
+
+    // Optional AOV channels of width * height pixels, NULL if the channel is
+    // not wanted
+    vec4 *aovs[SP_MAX_AOVS];
 };
 
 struct Basis
@@ -31,6 +80,12 @@ struct sp_Camera
 
 };
 
+struct sp_BsdfSample
+{
+    vec3 direction;
+    f32 pdf; // Solid angle pdf, 0 if no valid direction could be generated
+};
+
 struct sp_Context
 {
     // Camera
@@ -42,11 +97,113 @@ struct sp_Context
     // Material data
     sp_MaterialSystem *materialSystem;
 
+    // Adaptive sampling, a pixel stops receiving samples once the standard
+    // error of its mean luminance relative to the mean drops below
+    // maxRelativeError. Every pixel gets SAMPLES_PER_PIXEL samples if this is
+    // 0.
+    f32 maxRelativeError;
+    u32 minSamplesPerPixel;
+
+    // Which sp_SamplerType to use for random decisions, the default is white
+    // noise from the RandomNumberGenerator passed to sp_PathTraceTile
+    u32 samplerType;
+
+    // Optional cache of the radiance leaving diffuse surfaces, paths
+    // terminate into it after their first diffuse bounce once it has enough
+    // samples. Disabled if NULL.
+    sp_RadianceCache *radianceCache;
+
+    // Optional learned distribution of incident radiance which is sampled
+    // alongside the BSDF, samples are recorded into it for the next pass.
+    // Disabled if NULL.
+    sp_GuidingField *guidingField;
+
+    // Overrides SAMPLES_PER_PIXEL if non-zero, used for the short training
+    // passes of the guiding field
+    u32 samplesPerPixel;
+
+    // Index of the first sample traced for each pixel. Distributed renders
+    // split the samples of each pixel into ranges traced by separate
+    // processes, the Sobol sampler keeps each range deterministic.
+    u32 firstSample;
+
+    // Optional running sums of every sample traced, pixels are written as the
+    // mean of the buffer rather than of the current pass when set. Adaptive
+    // sampling, the radiance cache and path guiding make the result depend
+    // on the order tiles are traced in so they must be disabled for partial
+    // renders which are to be merged.
+    sp_AccumulationBuffer *accumulationBuffer;
+
+    // Preview levels only trace every pixelStride'th pixel along x and y and
+    // fill the block of pixels it stands in for, 0 or 1 traces every pixel
+    u32 pixelStride;
+
+    // Set when the traced view is no longer wanted, tiles stop at the next
+    // row leaving the rest of their pixels untouched
+    volatile b32 isCancelled;
+
+    // Optional image of a previous view which is reprojected into this one,
+    // pixels start from the history samples which pass the disocclusion and
+    // normal tests. Disabled if NULL.
+    struct sp_TemporalHistory *temporalHistory;
+
+    // Optional store of the path vertices of the first samples of each pixel
+    // traced at full resolution, sp_ReshadeTile evaluates them again after
+    // material parameters have changed. Disabled if NULL.
+    sp_ShadingCache *shadingCache;
+
     // Texture data
 };
 
+// Running mean and variance of a stream of samples using Welford's algorithm,
+// which is numerically stable and doesn't need to store the samples
+struct sp_RunningStats
+{
+    u32 count;
+    f32 mean;
+    f32 m2; // Sum of squared differences from the mean
+};
+
+inline void sp_AddSample(sp_RunningStats *stats, f32 x)
+{
+    stats->count++;
+    f32 delta = x - stats->mean;
+    stats->mean += delta / (f32)stats->count;
+    stats->m2 += delta * (x - stats->mean);
+}
+
+inline f32 sp_GetVariance(sp_RunningStats *stats)
+{
+    f32 result =
+        (stats->count > 1) ? stats->m2 / (f32)(stats->count - 1) : 0.0f;
+    return result;
+}
+
+// True once the standard error of the mean is within maxRelativeError of the
+// mean. At least 2 samples are always required for a variance estimate.
+inline b32 sp_HasConverged(
+    sp_RunningStats *stats, f32 maxRelativeError, u32 minSamples)
+{
+    b32 result = false;
+    if (stats->count >= MaxU32(minSamples, 2))
+    {
+        f32 standardError = Sqrt(sp_GetVariance(stats) / (f32)stats->count);
+        result = (standardError <= maxRelativeError * stats->mean);
+    }
+
+    return result;
+}
+
 inline void ClearImagePlane(ImagePlane *imagePlane)
 {
-    ClearToZero(imagePlane->pixels,
-        sizeof(vec4) * imagePlane->width * imagePlane->height);
+    u32 length = sizeof(vec4) * imagePlane->width * imagePlane->height;
+    ClearToZero(imagePlane->pixels, length);
+
+    for (u32 i = 0; i < SP_MAX_AOVS; i++)
+    {
+        if (imagePlane->aovs[i] != NULL)
+        {
+            ClearToZero(imagePlane->aovs[i], length);
+        }
+    }
 }
@@ -0,0 +1,233 @@
+void sp_InitializeAccumulationBuffer(sp_AccumulationBuffer *buffer,
+    MemoryArena *arena, u32 width, u32 height)
+{
+    buffer->pixels = AllocateArray(arena, sp_AccumulationPixel, width * height);
+    buffer->stats = NULL;
+    buffer->width = width;
+    buffer->height = height;
+    ClearToZero(
+        buffer->pixels, sizeof(sp_AccumulationPixel) * width * height);
+}
+
+// Adds per pixel stats to a buffer which was just initialized
+void sp_InitializeAccumulationStats(
+    sp_AccumulationBuffer *buffer, MemoryArena *arena)
+{
+    u32 pixelCount = buffer->width * buffer->height;
+    buffer->stats =
+        AllocateArray(arena, sp_AccumulationPixelStats, pixelCount);
+    ClearToZero(
+        buffer->stats, sizeof(sp_AccumulationPixelStats) * pixelCount);
+}
+
+void sp_ClearAccumulationBuffer(sp_AccumulationBuffer *buffer)
+{
+    u32 pixelCount = buffer->width * buffer->height;
+    ClearToZero(buffer->pixels, sizeof(sp_AccumulationPixel) * pixelCount);
+    if (buffer->stats != NULL)
+    {
+        ClearToZero(
+            buffer->stats, sizeof(sp_AccumulationPixelStats) * pixelCount);
+    }
+}
+
+// Adds the AOVs and luminance of a sample to the stats of the pixel, the
+// radiance itself is added with sp_AddAccumulationSample
+void sp_AddAccumulationStats(sp_AccumulationBuffer *buffer, u32 pixelIndex,
+    f32 luminance, vec3 albedo, vec3 normal, vec3 directRadiance)
+{
+    Assert(buffer->stats != NULL);
+    Assert(pixelIndex < buffer->width * buffer->height);
+    sp_AccumulationPixelStats *stats = buffer->stats + pixelIndex;
+
+    stats->luminanceSum += (f64)luminance;
+    stats->luminanceSquaredSum += (f64)luminance * (f64)luminance;
+    stats->albedoSum += albedo;
+    stats->normalSum += normal;
+    stats->directRadianceSum += directRadiance;
+}
+
+// NOTE: Not thread safe, tiles never share pixels so each pixel is only
+// written by one worker at a time
+void sp_AddAccumulationSample(
+    sp_AccumulationBuffer *buffer, u32 pixelIndex, vec3 radiance)
+{
+    Assert(pixelIndex < buffer->width * buffer->height);
+    sp_AccumulationPixel *pixel = buffer->pixels + pixelIndex;
+
+    for (u32 i = 0; i < 3; i++)
+    {
+        f32 value = Min(Max(radiance.data[i], 0.0f),
+            SP_ACCUMULATION_MAX_RADIANCE);
+        // NOTE: Rounded to the nearest step rather than truncated, which
+        // would bias every sample down by up to a whole step
+        pixel->radiance[i] +=
+            (i64)Round(value * SP_ACCUMULATION_FIXED_POINT_SCALE);
+    }
+    pixel->sampleCount++;
+}
+
+// Mean radiance of the pixel, black if it has no samples
+vec3 sp_ResolveAccumulationPixel(sp_AccumulationBuffer *buffer, u32 pixelIndex)
+{
+    Assert(pixelIndex < buffer->width * buffer->height);
+    sp_AccumulationPixel *pixel = buffer->pixels + pixelIndex;
+
+    vec3 result = {};
+    if (pixel->sampleCount > 0)
+    {
+        // NOTE: Divide in double precision as the sums quickly exceed the
+        // 24 bits of precision a float has
+        f64 scale = 1.0 / ((f64)pixel->sampleCount *
+                              (f64)SP_ACCUMULATION_FIXED_POINT_SCALE);
+        for (u32 i = 0; i < 3; i++)
+        {
+            result.data[i] = (f32)((f64)pixel->radiance[i] * scale);
+        }
+    }
+
+    return result;
+}
+
+void sp_ResolveAccumulationBuffer(sp_AccumulationBuffer *buffer, vec4 *pixels)
+{
+    u32 pixelCount = buffer->width * buffer->height;
+    for (u32 i = 0; i < pixelCount; i++)
+    {
+        pixels[i] = Vec4(sp_ResolveAccumulationPixel(buffer, i), 1);
+    }
+}
+
+void sp_MergeAccumulationBuffers(
+    sp_AccumulationBuffer *dst, sp_AccumulationBuffer *src)
+{
+    Assert(dst->width == src->width && dst->height == src->height);
+
+    u32 pixelCount = dst->width * dst->height;
+    for (u32 i = 0; i < pixelCount; i++)
+    {
+        for (u32 j = 0; j < 3; j++)
+        {
+            dst->pixels[i].radiance[j] += src->pixels[i].radiance[j];
+        }
+        dst->pixels[i].sampleCount += src->pixels[i].sampleCount;
+    }
+}
+
+u64 sp_GetPartialFileSize(sp_AccumulationBuffer *buffer)
+{
+    u64 result = sizeof(sp_PartialFileHeader) +
+                 sizeof(sp_AccumulationPixel) * (u64)buffer->width *
+                     (u64)buffer->height;
+    return result;
+}
+
+// Writes the buffer in the partial file format, dst must be at least
+// sp_GetPartialFileSize bytes. Returns the number of bytes written.
+u64 sp_WritePartialFile(sp_AccumulationBuffer *buffer,
+    sp_PartialRenderRange range, void *dst, u64 dstLength)
+{
+    u64 length = sp_GetPartialFileSize(buffer);
+    Assert(dstLength >= length);
+
+    sp_PartialFileHeader header = {};
+    header.magic = SP_PARTIAL_FILE_MAGIC;
+    header.version = SP_PARTIAL_FILE_VERSION;
+    header.width = buffer->width;
+    header.height = buffer->height;
+    header.range = range;
+
+    u8 *cursor = (u8 *)dst;
+    CopyMemory(cursor, &header, sizeof(header));
+    cursor += sizeof(header);
+
+    u32 pixelCount = buffer->width * buffer->height;
+    CopyMemory(cursor, buffer->pixels,
+        SafeTruncateU64ToU32(sizeof(sp_AccumulationPixel) * pixelCount));
+
+    return length;
+}
+
+// Validates the header of a partial file, returns false if the data is not a
+// partial file that this version can read
+b32 sp_ReadPartialFileHeader(
+    const void *data, u64 length, sp_PartialFileHeader *header)
+{
+    b32 result = false;
+    if (length >= sizeof(sp_PartialFileHeader))
+    {
+        CopyMemory(header, data, sizeof(sp_PartialFileHeader));
+        if (header->magic == SP_PARTIAL_FILE_MAGIC &&
+            header->version == SP_PARTIAL_FILE_VERSION)
+        {
+            u64 expectedLength = sizeof(sp_PartialFileHeader) +
+                                 sizeof(sp_AccumulationPixel) *
+                                     (u64)header->width * (u64)header->height;
+            result = (length == expectedLength);
+        }
+    }
+
+    return result;
+}
+
+// Adds the samples stored in a partial file to the buffer. Returns false
+// without modifying the buffer if the file is invalid or its dimensions don't
+// match the buffer.
+b32 sp_MergePartialFile(
+    sp_AccumulationBuffer *buffer, const void *data, u64 length)
+{
+    b32 result = false;
+
+    sp_PartialFileHeader header = {};
+    if (sp_ReadPartialFileHeader(data, length, &header) &&
+        header.width == buffer->width && header.height == buffer->height)
+    {
+        const u8 *cursor = (const u8 *)data + sizeof(sp_PartialFileHeader);
+
+        u32 pixelCount = buffer->width * buffer->height;
+        for (u32 i = 0; i < pixelCount; i++)
+        {
+            // NOTE: Copied out as the file data may not be aligned
+            sp_AccumulationPixel pixel;
+            CopyMemory(&pixel, cursor, sizeof(pixel));
+            cursor += sizeof(pixel);
+
+            for (u32 j = 0; j < 3; j++)
+            {
+                buffer->pixels[i].radiance[j] += pixel.radiance[j];
+            }
+            buffer->pixels[i].sampleCount += pixel.sampleCount;
+        }
+
+        result = true;
+    }
+
+    return result;
+}
+
+// Replaces the contents of the buffer with a checkpoint of the given render.
+// Returns the number of samples of the range which were completed when the
+// checkpoint was written, 0 with the buffer cleared if the checkpoint is
+// invalid or belongs to a different render.
+u32 sp_LoadCheckpoint(sp_AccumulationBuffer *buffer,
+    sp_PartialRenderRange range, const void *data, u64 length)
+{
+    sp_ClearAccumulationBuffer(buffer);
+
+    u32 result = 0;
+    sp_PartialFileHeader header = {};
+    if (sp_ReadPartialFileHeader(data, length, &header))
+    {
+        sp_PartialRenderRange completed = header.range;
+        if (completed.firstSample == range.firstSample &&
+            completed.sampleCount <= range.sampleCount &&
+            completed.tileSubsetIndex == range.tileSubsetIndex &&
+            completed.tileSubsetCount == range.tileSubsetCount &&
+            sp_MergePartialFile(buffer, data, length))
+        {
+            result = completed.sampleCount;
+        }
+    }
+
+    return result;
+}
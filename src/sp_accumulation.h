@@ -0,0 +1,64 @@
+#pragma once
+
+// Radiance is accumulated in fixed point so that the sum is independent of the
+// order samples are added in, partial renders of different sample ranges can
+// then be merged into exactly the image a single render would produce
+#define SP_ACCUMULATION_FIXED_POINT_SCALE 65536.0f
+
+// Samples are clamped to this so that the fixed point sum can't overflow
+#define SP_ACCUMULATION_MAX_RADIANCE 1.0e9f
+
+#define SP_PARTIAL_FILE_MAGIC 0x43415053 // "SPAC"
+
+// Version 3 rounds samples to the nearest fixed point step, partials of older
+// versions were truncated and can't be merged with them exactly
+#define SP_PARTIAL_FILE_VERSION 3
+
+struct sp_AccumulationPixel
+{
+    i64 radiance[3];
+    u64 sampleCount;
+};
+
+// Sums a displayed render needs on top of the radiance for adaptive sampling
+// and its AOVs to cover every pass. Never written to partial files.
+struct sp_AccumulationPixelStats
+{
+    f64 luminanceSum;
+    f64 luminanceSquaredSum;
+    vec3 albedoSum;
+    vec3 normalSum;
+    vec3 directRadianceSum;
+};
+
+// Per pixel sums of every sample traced so far, unlike the image plane which
+// only holds the result of the last pass
+struct sp_AccumulationBuffer
+{
+    sp_AccumulationPixel *pixels;
+    sp_AccumulationPixelStats *stats; // Optional, NULL if not needed
+    u32 width;
+    u32 height;
+};
+
+// Which samples of which tiles have been accumulated into a partial file
+struct sp_PartialRenderRange
+{
+    u32 firstSample;
+    u32 sampleCount;
+    u32 tileSubsetIndex;
+    u32 tileSubsetCount;
+};
+
+// Partial files are this header followed by width * height
+// sp_AccumulationPixels. Pixels outside of the tiles a render was assigned
+// have a sample count of 0. Checkpoints of a long render use the same format,
+// their range covers the samples completed so far.
+struct sp_PartialFileHeader
+{
+    u32 magic;
+    u32 version;
+    u32 width;
+    u32 height;
+    sp_PartialRenderRange range;
+};
@@ -0,0 +1,205 @@
+void sp_InitializeDenoiser(sp_Denoiser *denoiser, ImagePlane *imagePlane,
+    MemoryArena *arena, u32 iterationCount)
+{
+    // First iteration reads the pixels which the last iteration overwrites
+    Assert(iterationCount >= 2);
+    Assert(iterationCount <= SP_DENOISER_MAX_ITERATIONS);
+
+    // AOVs needed to guide the filter
+    Assert(imagePlane->aovs[sp_Aov_Albedo] != NULL);
+    Assert(imagePlane->aovs[sp_Aov_Normal] != NULL);
+    Assert(imagePlane->aovs[sp_Aov_Depth] != NULL);
+    Assert(imagePlane->aovs[sp_Aov_Variance] != NULL);
+
+    denoiser->imagePlane = imagePlane;
+    denoiser->iterationCount = iterationCount;
+
+    u32 pixelCount = imagePlane->width * imagePlane->height;
+    denoiser->buffers[0] = AllocateArray(arena, vec4, pixelCount);
+    denoiser->buffers[1] = AllocateArray(arena, vec4, pixelCount);
+}
+
+inline vec3 sp_GetDemodulationAlbedo(vec3 albedo)
+{
+    vec3 result;
+    for (u32 i = 0; i < 3; i++)
+    {
+        result.data[i] =
+            (albedo.data[i] >= SP_DENOISER_MIN_ALBEDO) ? albedo.data[i] : 1.0f;
+    }
+
+    return result;
+}
+
+// Demodulated radiance and variance of a pixel as read by an iteration
+inline vec4 sp_LoadDenoiserSample(
+    sp_Denoiser *denoiser, u32 iteration, u32 pixelIndex)
+{
+    vec4 result;
+    if (iteration == 0)
+    {
+        ImagePlane *imagePlane = denoiser->imagePlane;
+        vec3 albedo = sp_GetDemodulationAlbedo(
+            imagePlane->aovs[sp_Aov_Albedo][pixelIndex].xyz);
+        vec3 radiance = imagePlane->pixels[pixelIndex].xyz;
+        f32 variance = imagePlane->aovs[sp_Aov_Variance][pixelIndex].x;
+
+        // Variance is of the luminance so it scales with the square of the
+        // albedo luminance
+        f32 albedoLuminance = Luminance(albedo);
+        result = Vec4(Vec3(radiance.x / albedo.x, radiance.y / albedo.y,
+                          radiance.z / albedo.z),
+            variance / (albedoLuminance * albedoLuminance));
+    }
+    else
+    {
+        result = denoiser->buffers[(iteration - 1) & 1][pixelIndex];
+    }
+
+    return result;
+}
+
+// Variance blurred with a 3x3 gaussian, the variance of single pixels is too
+// noisy to drive the luminance edge stopping function directly
+internal f32 sp_ComputeFilteredVariance(
+    sp_Denoiser *denoiser, u32 iteration, i32 x, i32 y)
+{
+    ImagePlane *imagePlane = denoiser->imagePlane;
+    f32 kernel[3] = {0.25f, 0.5f, 0.25f};
+
+    f32 sum = 0.0f;
+    f32 totalWeight = 0.0f;
+    for (i32 dy = -1; dy <= 1; dy++)
+    {
+        for (i32 dx = -1; dx <= 1; dx++)
+        {
+            i32 qx = x + dx;
+            i32 qy = y + dy;
+            if (qx < 0 || qy < 0 || qx >= (i32)imagePlane->width ||
+                qy >= (i32)imagePlane->height)
+            {
+                continue;
+            }
+
+            f32 weight = kernel[dx + 1] * kernel[dy + 1];
+            u32 q = (u32)qx + (u32)qy * imagePlane->width;
+            sum += weight * sp_LoadDenoiserSample(denoiser, iteration, q).w;
+            totalWeight += weight;
+        }
+    }
+
+    return sum / totalWeight;
+}
+
+// Runs a single a-trous iteration over the tile. Every tile of an iteration
+// must be complete before the next iteration starts as it reads pixels
+// outside of its tile.
+void sp_DenoiseTile(sp_Denoiser *denoiser, Tile tile, u32 iteration)
+{
+    Assert(iteration < denoiser->iterationCount);
+
+    ImagePlane *imagePlane = denoiser->imagePlane;
+    vec4 *normals = imagePlane->aovs[sp_Aov_Normal];
+    vec4 *depths = imagePlane->aovs[sp_Aov_Depth];
+    vec4 *output = denoiser->buffers[iteration & 1];
+    b32 isLastIteration = (iteration == denoiser->iterationCount - 1);
+
+    u32 maxX = MinU32(tile.maxX, imagePlane->width);
+    u32 maxY = MinU32(tile.maxY, imagePlane->height);
+
+    // B3 spline kernel, taps are spread further apart with each iteration
+    f32 kernel[5] = {
+        1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+    i32 step = 1 << iteration;
+
+    for (u32 y = tile.minY; y < maxY; y++)
+    {
+        for (u32 x = tile.minX; x < maxX; x++)
+        {
+            u32 p = x + y * imagePlane->width;
+            vec4 center = sp_LoadDenoiserSample(denoiser, iteration, p);
+            vec3 normal = normals[p].xyz;
+            f32 depth = depths[p].x;
+
+            vec4 result = center;
+
+            // Nothing was hit so there is no geometry to guide the filter
+            if (depth > 0.0f)
+            {
+                f32 luminance = Luminance(center.xyz);
+                f32 variance =
+                    sp_ComputeFilteredVariance(denoiser, iteration, x, y);
+                f32 luminanceScale =
+                    1.0f /
+                    (SP_DENOISER_SIGMA_LUMINANCE * Sqrt(Max(variance, 0.0f)) +
+                        EPSILON);
+                f32 depthScale =
+                    1.0f / (SP_DENOISER_SIGMA_DEPTH * depth * (f32)step +
+                               EPSILON);
+
+                // Accumulates w * radiance in xyz and w^2 * variance in w
+                __m128 sum = _mm_setzero_ps();
+                f32 totalWeight = 0.0f;
+
+                for (i32 dy = -2; dy <= 2; dy++)
+                {
+                    for (i32 dx = -2; dx <= 2; dx++)
+                    {
+                        i32 qx = (i32)x + dx * step;
+                        i32 qy = (i32)y + dy * step;
+                        if (qx < 0 || qy < 0 || qx >= (i32)imagePlane->width ||
+                            qy >= (i32)imagePlane->height)
+                        {
+                            continue;
+                        }
+
+                        u32 q = (u32)qx + (u32)qy * imagePlane->width;
+                        f32 sampleDepth = depths[q].x;
+                        if (sampleDepth <= 0.0f)
+                        {
+                            continue;
+                        }
+
+                        vec4 sample =
+                            sp_LoadDenoiserSample(denoiser, iteration, q);
+
+                        // Edge stopping functions
+                        f32 normalWeight = Pow(
+                            Max(0.0f, Dot(normal, normals[q].xyz)),
+                            SP_DENOISER_SIGMA_NORMAL);
+                        f32 depthWeight =
+                            Exp(-Abs(depth - sampleDepth) * depthScale);
+                        f32 luminanceWeight =
+                            Exp(-Abs(luminance - Luminance(sample.xyz)) *
+                                luminanceScale);
+
+                        f32 weight = kernel[dx + 2] * kernel[dy + 2] *
+                                     normalWeight * depthWeight *
+                                     luminanceWeight;
+
+                        __m128 weights = _mm_setr_ps(
+                            weight, weight, weight, weight * weight);
+                        sum = _mm_add_ps(sum,
+                            _mm_mul_ps(weights, _mm_loadu_ps(sample.data)));
+                        totalWeight += weight;
+                    }
+                }
+
+                // Center pixel always contributes so totalWeight > 0
+                __m128 scale = _mm_setr_ps(1.0f / totalWeight,
+                    1.0f / totalWeight, 1.0f / totalWeight,
+                    1.0f / (totalWeight * totalWeight));
+                _mm_storeu_ps(result.data, _mm_mul_ps(sum, scale));
+            }
+
+            output[p] = result;
+
+            if (isLastIteration)
+            {
+                vec3 albedo = sp_GetDemodulationAlbedo(
+                    imagePlane->aovs[sp_Aov_Albedo][p].xyz);
+                imagePlane->pixels[p] = Vec4(Hadamard(result.xyz, albedo), 1);
+            }
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// Maximum number of a-trous iterations, the filter footprint doubles with each
+// one so 5 iterations already cover a 125 x 125 pixel neighbourhood
+#define SP_DENOISER_MAX_ITERATIONS 8
+
+// Edge stopping parameters, see "Spatiotemporal Variance-Guided Filtering" by
+// Schied et al. Larger values filter more aggressively across edges.
+#define SP_DENOISER_SIGMA_LUMINANCE 4.0f
+#define SP_DENOISER_SIGMA_NORMAL 128.0f // Exponent, larger is stricter
+#define SP_DENOISER_SIGMA_DEPTH 0.02f   // Relative depth difference per pixel
+
+// Albedo below this is treated as 1 when demodulating so that black surfaces
+// don't divide by zero
+#define SP_DENOISER_MIN_ALBEDO 0.01f
+
+// Edge-avoiding a-trous wavelet filter for the CPU path tracer output, guided
+// by the albedo, normal, depth and variance AOVs of the image plane. The
+// radiance is divided by the albedo before filtering so that texture detail
+// is preserved and multiplied back in by the last iteration, which writes the
+// result over the image plane pixels.
+struct sp_Denoiser
+{
+    ImagePlane *imagePlane;
+
+    // Ping pong buffers of the demodulated radiance in xyz and its variance
+    // in w
+    vec4 *buffers[2];
+
+    u32 iterationCount;
+};
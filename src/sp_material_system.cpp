@@ -42,8 +42,156 @@ HdrImage *sp_FindTexture(sp_MaterialSystem *materialSystem, u32 id)
     return result;
 }
 
-b32 sp_RegisterTexture(
-    sp_MaterialSystem *materialSystem, HdrImage image, u32 id)
+sp_ImageDistribution *sp_FindImageDistribution(
+    sp_MaterialSystem *materialSystem, u32 id)
+{
+    sp_ImageDistribution *result = NULL;
+    for (u32 i = 0; i < materialSystem->imageCount; i++)
+    {
+        if (materialSystem->imageKeys[i] == id)
+        {
+            // Only images registered with an arena have a distribution
+            sp_ImageDistribution *distribution =
+                materialSystem->imageDistributions + i;
+            if (distribution->marginalCdf != NULL)
+            {
+                result = distribution;
+            }
+            break;
+        }
+    }
+
+    return result;
+}
+
+sp_ImageDistribution sp_BuildImageDistribution(
+    HdrImage image, MemoryArena *arena)
+{
+    sp_ImageDistribution result = {};
+    result.width = image.width;
+    result.height = image.height;
+    result.marginalCdf = AllocateArray(arena, f32, image.height + 1);
+    result.conditionalCdf =
+        AllocateArray(arena, f32, (image.width + 1) * image.height);
+
+    // NOTE: Sums are accumulated in double precision as a 4k image has
+    // millions of pixels
+    f64 total = 0.0;
+    result.marginalCdf[0] = 0.0f;
+    for (u32 y = 0; y < image.height; y++)
+    {
+        f32 *cdf = result.conditionalCdf + y * (image.width + 1);
+        cdf[0] = 0.0f;
+
+        f64 rowTotal = 0.0;
+        for (u32 x = 0; x < image.width; x++)
+        {
+            vec3 color = GetPixel(image, x, y).xyz;
+            rowTotal += Max(Luminance(color), 0.0f);
+            cdf[x + 1] = (f32)rowTotal;
+        }
+
+        for (u32 x = 1; x <= image.width; x++)
+        {
+            // Rows which are completely black will never be selected by the
+            // marginal CDF but still need to be valid
+            cdf[x] = (rowTotal > 0.0) ? (f32)(cdf[x] / rowTotal)
+                                      : (f32)x / (f32)image.width;
+        }
+
+        total += rowTotal;
+        result.marginalCdf[y + 1] = (f32)total;
+    }
+
+    for (u32 y = 1; y <= image.height; y++)
+    {
+        result.marginalCdf[y] = (total > 0.0)
+                                    ? (f32)(result.marginalCdf[y] / total)
+                                    : (f32)y / (f32)image.height;
+    }
+
+    // Guard against rounding so that sampling always terminates in range
+    result.marginalCdf[image.height] = 1.0f;
+
+    return result;
+}
+
+// Returns the index i such that cdf[i] <= u < cdf[i + 1], cdf has count + 1
+// entries. Intervals with zero probability are never returned.
+internal u32 sp_FindCdfInterval(f32 *cdf, u32 count, f32 u)
+{
+    u32 first = 0;
+    u32 last = count;
+    while (first + 1 < last)
+    {
+        u32 middle = (first + last) / 2;
+        if (cdf[middle] <= u)
+        {
+            first = middle;
+        }
+        else
+        {
+            last = middle;
+        }
+    }
+
+    return first;
+}
+
+// Maps two uniform random numbers to a position in image UV space (v
+// increasing down the image). The returned pdf is with respect to UV area.
+vec2 sp_SampleImageDistribution(
+    sp_ImageDistribution *distribution, f32 u, f32 v, f32 *pdf)
+{
+    // Keep random numbers below 1 so they fall within the last interval
+    f32 oneMinusEpsilon = 0.99999994f;
+    u = Min(u, oneMinusEpsilon);
+    v = Min(v, oneMinusEpsilon);
+
+    u32 width = distribution->width;
+    u32 height = distribution->height;
+
+    f32 *marginalCdf = distribution->marginalCdf;
+    u32 y = sp_FindCdfInterval(marginalCdf, height, v);
+    f32 marginalP = marginalCdf[y + 1] - marginalCdf[y];
+
+    f32 *cdf = distribution->conditionalCdf + y * (width + 1);
+    u32 x = sp_FindCdfInterval(cdf, width, u);
+    f32 conditionalP = cdf[x + 1] - cdf[x];
+
+    // Reuse the position within the interval to place the sample within the
+    // pixel
+    f32 dx = Min((u - cdf[x]) / conditionalP, oneMinusEpsilon);
+    f32 dy = Min((v - marginalCdf[y]) / marginalP, oneMinusEpsilon);
+
+    *pdf = marginalP * conditionalP * (f32)(width * height);
+
+    vec2 uv = Vec2(((f32)x + dx) / (f32)width, ((f32)y + dy) / (f32)height);
+    return uv;
+}
+
+f32 sp_ComputeImageDistributionPdf(
+    sp_ImageDistribution *distribution, vec2 uv)
+{
+    u32 width = distribution->width;
+    u32 height = distribution->height;
+
+    u32 x = MinU32((u32)(Max(uv.x, 0.0f) * (f32)width), width - 1);
+    u32 y = MinU32((u32)(Max(uv.y, 0.0f) * (f32)height), height - 1);
+
+    f32 *marginalCdf = distribution->marginalCdf;
+    f32 *cdf = distribution->conditionalCdf + y * (width + 1);
+
+    f32 pdf = (marginalCdf[y + 1] - marginalCdf[y]) * (cdf[x + 1] - cdf[x]) *
+              (f32)(width * height);
+
+    return pdf;
+}
+
+// If an arena is provided a luminance distribution is also built for the
+// image so that it can be importance sampled as an environment map
+b32 sp_RegisterTexture(sp_MaterialSystem *materialSystem, HdrImage image,
+    u32 id, MemoryArena *arena = NULL)
 {
     b32 result = false;
     if (materialSystem->imageCount < SP_MAX_IMAGES)
@@ -51,6 +199,14 @@ b32 sp_RegisterTexture(
         u32 index = materialSystem->imageCount++;
         materialSystem->imageKeys[index] = id;
         materialSystem->images[index] = image;
+
+        sp_ImageDistribution distribution = {};
+        if (arena != NULL)
+        {
+            distribution = sp_BuildImageDistribution(image, arena);
+        }
+        materialSystem->imageDistributions[index] = distribution;
+
         result = true;
     }
     return result;
@@ -103,3 +259,70 @@ sp_MaterialOutput sp_EvaluateMaterial(sp_MaterialSystem *materialSystem,
 
     return output;
 }
+
+// Importance samples a direction towards the emission texture of the given
+// (background) material. Returns a pdf of 0 if the material has no emission
+// texture registered with a distribution.
+sp_EnvironmentSample sp_SampleEnvironment(sp_MaterialSystem *materialSystem,
+    u32 materialId, sp_Sampler *sampler)
+{
+    sp_EnvironmentSample result = {};
+
+    sp_Material *material = sp_FindMaterialById(materialSystem, materialId);
+    if (material == NULL)
+    {
+        return result;
+    }
+
+    sp_ImageDistribution *distribution =
+        sp_FindImageDistribution(materialSystem, material->emissionTexture);
+    if (distribution == NULL)
+    {
+        return result;
+    }
+
+    f32 uvPdf = 0.0f;
+    vec2 u = sp_Next2D(sampler);
+    vec2 uv = sp_SampleImageDistribution(distribution, u.x, u.y, &uvPdf);
+
+    // Undo the Y flip applied by sp_EvaluateMaterial
+    vec2 sphereCoords =
+        MapEquirectangularToSphereCoordinates(Vec2(uv.x, 1.0f - uv.y));
+    result.direction = MapSphericalToCartesianCoordinates(sphereCoords);
+    result.pdf = uvPdf * SP_ENVIRONMENT_UV_TO_SOLID_ANGLE;
+
+    // Evaluate through the material so the radiance matches what a BSDF
+    // sample escaping in the same direction would see
+    sp_PathVertex vertex = {};
+    vertex.outgoingDir = -result.direction;
+    result.radiance =
+        sp_EvaluateMaterial(materialSystem, material, &vertex).emission;
+
+    return result;
+}
+
+// Solid angle pdf of sp_SampleEnvironment generating the given direction, 0 if
+// the environment is not importance sampled
+f32 sp_ComputeEnvironmentPdf(
+    sp_MaterialSystem *materialSystem, u32 materialId, vec3 direction)
+{
+    f32 result = 0.0f;
+
+    sp_Material *material = sp_FindMaterialById(materialSystem, materialId);
+    if (material != NULL)
+    {
+        sp_ImageDistribution *distribution =
+            sp_FindImageDistribution(materialSystem, material->emissionTexture);
+        if (distribution != NULL)
+        {
+            vec2 sphereCoords = ToSphericalCoordinates(direction);
+            vec2 uv = MapToEquirectangular(sphereCoords);
+            uv.y = 1.0f - uv.y;
+
+            result = sp_ComputeImageDistributionPdf(distribution, uv) *
+                     SP_ENVIRONMENT_UV_TO_SOLID_ANGLE;
+        }
+    }
+
+    return result;
+}
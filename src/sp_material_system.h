@@ -27,6 +27,48 @@ struct sp_PathVertex
     vec3 incomingDir;
     vec3 normal;
     vec2 uv;
+
+    // Solid angle pdf of sampling incomingDir
+    f32 incomingPdf;
+
+    // Next event estimation sample, lightRadiance already accounts for
+    // visibility, the MIS weight and the light sample pdf
+    vec3 lightDir;
+    vec3 lightRadiance;
+
+    // Environment map sample, weighted the same way as the light sample
+    vec3 environmentDir;
+    vec3 environmentRadiance;
+
+    // Set when the path ends on an analytic light rather than a surface,
+    // lightEmission already includes the MIS weight
+    b32 isLight;
+    vec3 lightEmission;
+};
+
+// Piecewise constant 2D distribution over the pixels of an image proportional
+// to their luminance. Stored as a marginal CDF over the rows and a conditional
+// CDF for the pixels within each row.
+struct sp_ImageDistribution
+{
+    f32 *marginalCdf; // height + 1 entries
+    f32 *conditionalCdf; // (width + 1) * height entries
+    u32 width;
+    u32 height;
+};
+
+// NOTE: The equirectangular mapping used by sp_EvaluateMaterial is equal area
+// as v is linear in the cosine of the inclination, so every unit of UV area
+// covers 4 PI steradians
+#define SP_ENVIRONMENT_UV_TO_SOLID_ANGLE (1.0f / (4.0f * PI))
+
+struct sp_EnvironmentSample
+{
+    vec3 direction;
+    vec3 radiance;
+
+    // Solid angle pdf, 0 if the environment can't be importance sampled
+    f32 pdf;
 };
 
 #define SP_MAX_MATERIALS 32
@@ -40,6 +82,7 @@ struct sp_MaterialSystem
 
     u32 imageKeys[SP_MAX_IMAGES];
     HdrImage images[SP_MAX_IMAGES];
+    sp_ImageDistribution imageDistributions[SP_MAX_IMAGES];
     u32 imageCount;
 
     u32 backgroundMaterialId;
@@ -17,6 +17,26 @@ enum
     // Number of rays which hit nothing
     sp_Metric_RayMissCount,
 
+    // Number of occlusion rays traced for next event estimation
+    sp_Metric_ShadowRaysTraced,
+
+    // Number of paths terminated early by russian roulette
+    sp_Metric_PathsTerminatedByRoulette,
+
+    // Number of paths terminated early by looking up the radiance cache
+    sp_Metric_PathsTerminatedByRadianceCache,
+
+    // Number of pixels which stopped sampling early as their estimate had
+    // converged
+    sp_Metric_PixelsConverged,
+
+    // Number of pixels which started from samples reprojected from the
+    // previous view
+    sp_Metric_PixelsReprojected,
+
+    // Number of cached paths shaded again by sp_ReshadeTile
+    sp_Metric_PathsReshaded,
+
     // Total number of cycles spent in sp_RayIntersectScene
     sp_Metric_CyclesElapsed_RayIntersectScene,
 
@@ -0,0 +1,350 @@
+// Maps a direction to the cylindrical (cos theta, phi) parameterization used
+// by the directional quadtrees, both components are in [0, 1)
+inline vec2 sp_DirectionToGuidingCoordinates(vec3 direction)
+{
+    f32 cosTheta = Clamp(direction.z, -1.0f, 1.0f);
+    f32 phi = Atan2(direction.y, direction.x);
+    if (phi < 0.0f)
+    {
+        phi += 2.0f * PI;
+    }
+
+    vec2 result = Vec2((cosTheta + 1.0f) * 0.5f, phi / (2.0f * PI));
+    result.x = Min(result.x, 1.0f - EPSILON);
+    result.y = Min(result.y, 1.0f - EPSILON);
+    return result;
+}
+
+inline vec3 sp_GuidingCoordinatesToDirection(vec2 p)
+{
+    f32 cosTheta = 2.0f * p.x - 1.0f;
+    f32 sinTheta = Sqrt(Max(0.0f, 1.0f - cosTheta * cosTheta));
+    f32 phi = 2.0f * PI * p.y;
+    vec3 result = Vec3(sinTheta * Cos(phi), sinTheta * Sin(phi), cosTheta);
+    return result;
+}
+
+inline void sp_ResetGuidingQuadTree(sp_GuidingQuadTree *tree)
+{
+    ClearToZero(tree, sizeof(*tree));
+    tree->nodeCount = 1;
+}
+
+inline f32 sp_GetGuidingNodeTotal(sp_GuidingQuadTreeNode *node)
+{
+    f32 result = node->sums[0] + node->sums[1] + node->sums[2] + node->sums[3];
+    return result;
+}
+
+inline b32 sp_IsGuidingQuadTreeValid(sp_GuidingQuadTree *tree)
+{
+    b32 result = tree->sampleCount >= SP_GUIDING_MIN_SAMPLES &&
+                 sp_GetGuidingNodeTotal(tree->nodes) > 0.0f;
+    return result;
+}
+
+// Adds value to every quadrant containing p on the way down to the leaf. Safe
+// to call from multiple threads.
+void sp_RecordGuidingQuadTreeSample(
+    sp_GuidingQuadTree *tree, vec2 p, f32 value)
+{
+    u32 nodeIndex = 0;
+    for (;;)
+    {
+        sp_GuidingQuadTreeNode *node = tree->nodes + nodeIndex;
+
+        u32 x = (p.x >= 0.5f) ? 1 : 0;
+        u32 y = (p.y >= 0.5f) ? 1 : 0;
+        u32 quadrant = x + 2 * y;
+        AtomicAddF32(&node->sums[quadrant], value);
+
+        nodeIndex = node->children[quadrant];
+        if (nodeIndex == 0)
+        {
+            break;
+        }
+
+        // Transform p into the space of the child quadrant
+        p.x = p.x * 2.0f - (f32)x;
+        p.y = p.y * 2.0f - (f32)y;
+    }
+
+    AtomicExchangeAdd(&tree->sampleCount, 1);
+}
+
+// Pdf over the unit square of sp_SampleGuidingQuadTree generating p
+f32 sp_ComputeGuidingQuadTreePdf(sp_GuidingQuadTree *tree, vec2 p)
+{
+    f32 pdf = 1.0f;
+    u32 nodeIndex = 0;
+    for (;;)
+    {
+        sp_GuidingQuadTreeNode *node = tree->nodes + nodeIndex;
+
+        f32 total = sp_GetGuidingNodeTotal(node);
+        if (total <= 0.0f)
+        {
+            pdf = 0.0f;
+            break;
+        }
+
+        u32 x = (p.x >= 0.5f) ? 1 : 0;
+        u32 y = (p.y >= 0.5f) ? 1 : 0;
+        u32 quadrant = x + 2 * y;
+
+        // Each quadrant covers a quarter of the area of its parent
+        pdf *= 4.0f * node->sums[quadrant] / total;
+
+        nodeIndex = node->children[quadrant];
+        if (nodeIndex == 0 || pdf <= 0.0f)
+        {
+            break;
+        }
+
+        p.x = p.x * 2.0f - (f32)x;
+        p.y = p.y * 2.0f - (f32)y;
+    }
+
+    return pdf;
+}
+
+// Picks a quadrant proportional to its energy at every level, first choosing
+// the column and then the row so that u can be rescaled and reused by the
+// next level. The point is uniformly distributed within the leaf.
+vec2 sp_SampleGuidingQuadTree(sp_GuidingQuadTree *tree, vec2 u)
+{
+    vec2 origin = Vec2(0, 0);
+    f32 size = 1.0f;
+
+    u32 nodeIndex = 0;
+    for (;;)
+    {
+        sp_GuidingQuadTreeNode *node = tree->nodes + nodeIndex;
+        f32 *sums = (f32 *)node->sums;
+
+        f32 total = sp_GetGuidingNodeTotal(node);
+        Assert(total > 0.0f);
+
+        u32 x = 0;
+        f32 leftProbability = (sums[0] + sums[2]) / total;
+        if (u.x < leftProbability)
+        {
+            u.x = u.x / leftProbability;
+        }
+        else
+        {
+            x = 1;
+            u.x = (u.x - leftProbability) / (1.0f - leftProbability);
+        }
+
+        u32 y = 0;
+        f32 columnTotal = sums[x] + sums[x + 2];
+        f32 bottomProbability = sums[x] / columnTotal;
+        if (u.y < bottomProbability)
+        {
+            u.y = u.y / bottomProbability;
+        }
+        else
+        {
+            y = 1;
+            u.y = (u.y - bottomProbability) / (1.0f - bottomProbability);
+        }
+
+        // Rescaling loses precision so keep u inside [0, 1)
+        u.x = Min(u.x, 1.0f - EPSILON);
+        u.y = Min(u.y, 1.0f - EPSILON);
+
+        size *= 0.5f;
+        origin.x += (f32)x * size;
+        origin.y += (f32)y * size;
+
+        nodeIndex = node->children[x + 2 * y];
+        if (nodeIndex == 0)
+        {
+            break;
+        }
+    }
+
+    vec2 result = origin + u * size;
+    return result;
+}
+
+// Builds an empty tree for the next training pass, quadrants of src holding
+// more than SP_GUIDING_SUBDIVISION_THRESHOLD of its energy are subdivided and
+// subtrees holding less are collapsed. Nodes are processed in breadth first
+// order so that the node budget is spent on the coarsest quadrants first.
+internal void sp_RefineGuidingQuadTree(
+    sp_GuidingQuadTree *dst, sp_GuidingQuadTree *src)
+{
+    sp_ResetGuidingQuadTree(dst);
+
+    f32 total = sp_GetGuidingNodeTotal(src->nodes);
+    if (total <= 0.0f)
+    {
+        return;
+    }
+
+    // Node of src which each node of dst was built from, 0 if the quadrant
+    // was a leaf in src in which case its energy is spread evenly
+    u32 srcNodes[SP_GUIDING_MAX_NODES] = {};
+    f32 energies[SP_GUIDING_MAX_NODES][4] = {};
+    u32 depths[SP_GUIDING_MAX_NODES] = {};
+
+    for (u32 i = 0; i < 4; i++)
+    {
+        energies[0][i] = src->nodes[0].sums[i];
+    }
+    depths[0] = 1;
+
+    for (u32 nodeIndex = 0; nodeIndex < dst->nodeCount; nodeIndex++)
+    {
+        if (depths[nodeIndex] >= SP_GUIDING_MAX_DEPTH)
+        {
+            continue;
+        }
+
+        for (u32 quadrant = 0; quadrant < 4; quadrant++)
+        {
+            f32 energy = energies[nodeIndex][quadrant];
+            if (energy / total <= SP_GUIDING_SUBDIVISION_THRESHOLD ||
+                dst->nodeCount >= SP_GUIDING_MAX_NODES)
+            {
+                continue;
+            }
+
+            u32 childIndex = dst->nodeCount++;
+            dst->nodes[nodeIndex].children[quadrant] = (u16)childIndex;
+            depths[childIndex] = depths[nodeIndex] + 1;
+
+            // Root is never a child so 0 means no matching src node
+            u32 srcIndex = srcNodes[nodeIndex];
+            u32 srcChild = (nodeIndex == 0 || srcIndex != 0)
+                               ? src->nodes[srcIndex].children[quadrant]
+                               : 0;
+            srcNodes[childIndex] = srcChild;
+            for (u32 i = 0; i < 4; i++)
+            {
+                energies[childIndex][i] = (srcChild != 0)
+                                              ? src->nodes[srcChild].sums[i]
+                                              : energy * 0.25f;
+            }
+        }
+    }
+}
+
+// Recomputes the grid bounds from the scene and clears all learned
+// distributions, must be called whenever the scene changes
+void sp_ResetGuidingField(sp_GuidingField *field, sp_Scene *scene)
+{
+    vec3 aabbMin = Vec3(0);
+    vec3 aabbMax = Vec3(0);
+    for (u32 i = 0; i < scene->objectCount; i++)
+    {
+        aabbMin = (i > 0) ? Min(aabbMin, scene->aabbMin[i]) : scene->aabbMin[i];
+        aabbMax = (i > 0) ? Max(aabbMax, scene->aabbMax[i]) : scene->aabbMax[i];
+    }
+
+    field->aabbMin = aabbMin;
+    field->aabbMax = aabbMax;
+    field->passCount = 0;
+
+    u32 cellCount = SP_GUIDING_GRID_RESOLUTION * SP_GUIDING_GRID_RESOLUTION *
+                    SP_GUIDING_GRID_RESOLUTION;
+    for (u32 i = 0; i < cellCount; i++)
+    {
+        sp_ResetGuidingQuadTree(&field->cells[i].sampling);
+        sp_ResetGuidingQuadTree(&field->cells[i].training);
+    }
+}
+
+void sp_InitializeGuidingField(
+    sp_GuidingField *field, MemoryArena *arena, sp_Scene *scene)
+{
+    u32 cellCount = SP_GUIDING_GRID_RESOLUTION * SP_GUIDING_GRID_RESOLUTION *
+                    SP_GUIDING_GRID_RESOLUTION;
+    field->cells = AllocateArray(arena, sp_GuidingCell, cellCount);
+    sp_ResetGuidingField(field, scene);
+}
+
+// Points outside of the scene AABB are clamped to the nearest cell
+u32 sp_FindGuidingCell(sp_GuidingField *field, vec3 position)
+{
+    vec3 extents = field->aabbMax - field->aabbMin;
+
+    u32 coords[3] = {};
+    for (u32 axis = 0; axis < 3; axis++)
+    {
+        f32 t = (extents.data[axis] > 0.0f)
+                    ? (position.data[axis] - field->aabbMin.data[axis]) /
+                          extents.data[axis]
+                    : 0.0f;
+        i32 coord = (i32)(t * SP_GUIDING_GRID_RESOLUTION);
+        coords[axis] =
+            (u32)Clamp(coord, 0, (i32)SP_GUIDING_GRID_RESOLUTION - 1);
+    }
+
+    u32 result = coords[0] + coords[1] * SP_GUIDING_GRID_RESOLUTION +
+                 coords[2] * SP_GUIDING_GRID_RESOLUTION *
+                     SP_GUIDING_GRID_RESOLUTION;
+    return result;
+}
+
+// False until enough samples have been recorded in the cell during previous
+// passes
+inline b32 sp_CanSampleGuidingCell(sp_GuidingField *field, u32 cellIndex)
+{
+    return sp_IsGuidingQuadTreeValid(&field->cells[cellIndex].sampling);
+}
+
+sp_GuidingSample sp_SampleGuidingField(
+    sp_GuidingField *field, u32 cellIndex, vec2 u)
+{
+    sp_GuidingQuadTree *tree = &field->cells[cellIndex].sampling;
+    Assert(sp_IsGuidingQuadTreeValid(tree));
+
+    vec2 p = sp_SampleGuidingQuadTree(tree, u);
+
+    sp_GuidingSample result = {};
+    result.direction = sp_GuidingCoordinatesToDirection(p);
+    result.pdf = sp_ComputeGuidingQuadTreePdf(tree, p) / (4.0f * PI);
+    return result;
+}
+
+f32 sp_ComputeGuidingPdf(sp_GuidingField *field, u32 cellIndex, vec3 direction)
+{
+    sp_GuidingQuadTree *tree = &field->cells[cellIndex].sampling;
+    vec2 p = sp_DirectionToGuidingCoordinates(direction);
+    f32 result = sp_ComputeGuidingQuadTreePdf(tree, p) / (4.0f * PI);
+    return result;
+}
+
+// Records an estimate of the incident radiance arriving from direction divided
+// by the pdf it was sampled with. Safe to call from multiple threads.
+void sp_RecordGuidingSample(
+    sp_GuidingField *field, u32 cellIndex, vec3 direction, f32 value)
+{
+    sp_GuidingQuadTree *tree = &field->cells[cellIndex].training;
+    vec2 p = sp_DirectionToGuidingCoordinates(direction);
+    sp_RecordGuidingQuadTreeSample(tree, p, value);
+}
+
+// Called between passes, the trees trained during the last pass become the
+// sampling trees and refined copies of them are trained next. Cells which
+// received no samples keep their previous distribution.
+// NOTE: Not thread safe, must not be called while tiles are being traced
+void sp_UpdateGuidingField(sp_GuidingField *field)
+{
+    u32 cellCount = SP_GUIDING_GRID_RESOLUTION * SP_GUIDING_GRID_RESOLUTION *
+                    SP_GUIDING_GRID_RESOLUTION;
+    for (u32 i = 0; i < cellCount; i++)
+    {
+        sp_GuidingCell *cell = field->cells + i;
+        if (cell->training.sampleCount > 0)
+        {
+            cell->sampling = cell->training;
+            sp_RefineGuidingQuadTree(&cell->training, &cell->sampling);
+        }
+    }
+
+    field->passCount++;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+// Number of grid cells along each axis of the scene AABB, every cell holds its
+// own directional distribution
+#define SP_GUIDING_GRID_RESOLUTION 16
+
+// Maximum number of nodes in a directional quadtree, including the root
+#define SP_GUIDING_MAX_NODES 64
+
+// Maximum depth of a directional quadtree, the smallest quadrant covers
+// 1 / 4^depth of the sphere
+#define SP_GUIDING_MAX_DEPTH 8
+
+// Quadrants holding more than this fraction of the energy of their tree are
+// subdivided when the tree is refined after a training pass
+#define SP_GUIDING_SUBDIVISION_THRESHOLD 0.01f
+
+// Minimum number of samples recorded in a cell before it is used for sampling
+#define SP_GUIDING_MIN_SAMPLES 32
+
+// Chance of sampling the BSDF rather than the guiding distribution, keeps
+// glossy lobes and directions the guiding distribution has not seen covered
+#define SP_GUIDING_BSDF_SAMPLING_FRACTION 0.5f
+
+// Surfaces smoother than this only sample their BSDF, the guiding
+// distribution is too coarse to help with narrow lobes
+#define SP_GUIDING_MIN_ROUGHNESS 0.3f
+
+// Number of vertices per path which are recorded for training
+#define SP_GUIDING_MAX_PATH_VERTICES 16
+
+// Node of a quadtree over the cylindrical (cos theta, phi) parameterization of
+// the sphere, which is area preserving so the pdf over the unit square only
+// differs from the solid angle pdf by a factor of 4 PI. Quadrants are indexed
+// as x + 2 * y.
+struct sp_GuidingQuadTreeNode
+{
+    volatile f32 sums[4]; // Energy recorded in each quadrant
+    u16 children[4];      // Index of the child node, 0 if a leaf
+};
+
+struct sp_GuidingQuadTree
+{
+    sp_GuidingQuadTreeNode nodes[SP_GUIDING_MAX_NODES];
+    u32 nodeCount;
+    volatile i32 sampleCount;
+};
+
+// The sampling tree is only read while tiles are being traced, samples are
+// recorded into the training tree which replaces it after each pass
+struct sp_GuidingCell
+{
+    sp_GuidingQuadTree sampling;
+    sp_GuidingQuadTree training;
+};
+
+// Spatial-directional radiance distribution learned from previous passes, from
+// "Practical Path Guiding for Efficient Light-Transport Simulation" by Muller
+// et al. but with a uniform grid rather than an adaptive binary tree for the
+// spatial subdivision.
+struct sp_GuidingField
+{
+    sp_GuidingCell *cells;
+    vec3 aabbMin;
+    vec3 aabbMax;
+    u32 passCount; // Number of training passes completed
+};
+
+struct sp_GuidingSample
+{
+    vec3 direction;
+    f32 pdf; // Solid angle pdf
+};
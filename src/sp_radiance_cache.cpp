@@ -0,0 +1,124 @@
+void sp_InitializeRadianceCache(
+    sp_RadianceCache *cache, MemoryArena *arena, u32 capacity, f32 cellSize)
+{
+    // Capacity must be a power of 2 so the hash can be masked
+    Assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    Assert(cellSize > 0.0f);
+
+    cache->cells = AllocateArray(arena, sp_RadianceCacheCell, capacity);
+    cache->capacity = capacity;
+    cache->cellSize = cellSize;
+    ClearToZero(cache->cells, sizeof(sp_RadianceCacheCell) * capacity);
+}
+
+// NOTE: Not thread safe, must not be called while tiles are being traced
+void sp_ResetRadianceCache(sp_RadianceCache *cache)
+{
+    ClearToZero(cache->cells, sizeof(sp_RadianceCacheCell) * cache->capacity);
+}
+
+// NOTE: The key doubles as the checksum for the cell, two grid cells which
+// hash to the same key will share an entry. With 32 bit keys this is rare
+// enough to ignore.
+internal u32 sp_ComputeRadianceCacheKey(
+    sp_RadianceCache *cache, vec3 position, vec3 normal)
+{
+    f32 invCellSize = 1.0f / cache->cellSize;
+    i32 x = (i32)Floor(position.x * invCellSize);
+    i32 y = (i32)Floor(position.y * invCellSize);
+    i32 z = (i32)Floor(position.z * invCellSize);
+
+    // Dominant axis of the normal, keeps the two sides of thin walls and the
+    // faces meeting at corners in separate cells
+    vec3 a = Abs(normal);
+    u32 axis = (a.x > a.y && a.x > a.z) ? 0 : (a.y > a.z ? 1 : 2);
+    u32 side = (normal.data[axis] < 0.0f) ? 1 : 0;
+
+    u32 key = sp_HashU32(axis * 2 + side);
+    key = sp_HashCombine(key, (u32)x);
+    key = sp_HashCombine(key, (u32)y);
+    key = sp_HashCombine(key, (u32)z);
+
+    // 0 marks an unused cell
+    return (key != 0) ? key : 1;
+}
+
+// Returns the index of the cell for the given surface point, inserting it if
+// it doesn't exist yet. Safe to call from multiple threads. Returns U32_MAX if
+// no free cell could be found.
+u32 sp_FindRadianceCacheCell(
+    sp_RadianceCache *cache, vec3 position, vec3 normal)
+{
+    u32 key = sp_ComputeRadianceCacheKey(cache, position, normal);
+    u32 mask = cache->capacity - 1;
+
+    u32 result = U32_MAX;
+    for (u32 probe = 0; probe < SP_RADIANCE_CACHE_MAX_PROBES; probe++)
+    {
+        u32 index = (key + probe) & mask;
+        sp_RadianceCacheCell *cell = cache->cells + index;
+
+        u32 cellKey = cell->key;
+        if (cellKey == 0)
+        {
+            // Claim the cell, another thread may have beaten us to it
+            cellKey = AtomicCompareExchange(&cell->key, key, 0);
+            if (cellKey == 0)
+            {
+                result = index;
+                break;
+            }
+        }
+
+        if (cellKey == key)
+        {
+            result = index;
+            break;
+        }
+    }
+
+    return result;
+}
+
+void sp_AddRadianceCacheSample(
+    sp_RadianceCache *cache, u32 cellIndex, vec3 radiance)
+{
+    Assert(cellIndex < cache->capacity);
+    sp_RadianceCacheCell *cell = cache->cells + cellIndex;
+
+    for (u32 i = 0; i < 3; i++)
+    {
+        f32 value = Max(radiance.data[i], 0.0f);
+        AtomicExchangeAdd64(&cell->radiance[i],
+            (i64)(value * SP_RADIANCE_CACHE_FIXED_POINT_SCALE));
+    }
+
+    // NOTE: Count is incremented last so that readers never see a sample
+    // count for radiance which hasn't been added yet
+    AtomicExchangeAdd(&cell->sampleCount, 1);
+}
+
+sp_RadianceCacheLookupResult sp_LookupRadianceCache(
+    sp_RadianceCache *cache, u32 cellIndex)
+{
+    Assert(cellIndex < cache->capacity);
+    sp_RadianceCacheCell *cell = cache->cells + cellIndex;
+
+    sp_RadianceCacheLookupResult result = {};
+
+    // NOTE: Other threads may add samples while we read the cell so the sum
+    // may include a few more samples than the count, this is negligible once
+    // the cell has SP_RADIANCE_CACHE_MIN_SAMPLES
+    i32 sampleCount = cell->sampleCount;
+    if (sampleCount >= SP_RADIANCE_CACHE_MIN_SAMPLES)
+    {
+        f32 scale =
+            1.0f / ((f32)sampleCount * SP_RADIANCE_CACHE_FIXED_POINT_SCALE);
+        result.radiance = Vec3((f32)cell->radiance[0], (f32)cell->radiance[1],
+                              (f32)cell->radiance[2]) *
+                          scale;
+        result.isValid = true;
+    }
+
+    return result;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+// Paths only terminate into a cell once it holds at least this many samples,
+// with fewer the cached value is noisier than tracing the rest of the path
+#define SP_RADIANCE_CACHE_MIN_SAMPLES 16
+
+// Fraction of the paths reaching a usable cell which are still traced in full
+// so that the cell keeps being refined as rendering progresses
+#define SP_RADIANCE_CACHE_TRAINING_FRACTION 0.125f
+
+// Number of cells probed for a key before giving up on a full table
+#define SP_RADIANCE_CACHE_MAX_PROBES 8
+
+// Radiance is accumulated in fixed point so that concurrent tile workers can
+// add samples to the same cell with atomic adds
+#define SP_RADIANCE_CACHE_FIXED_POINT_SCALE 65536.0f
+
+// Only surfaces at least this rough are cached, their outgoing radiance is
+// close enough to view independent to be shared by every path hitting a cell
+#define SP_RADIANCE_CACHE_MIN_ROUGHNESS 0.6f
+
+struct sp_RadianceCacheCell
+{
+    volatile u32 key; // 0 if the cell is unused
+    volatile i32 sampleCount;
+    volatile i64 radiance[3];
+};
+
+// World space cache of the radiance leaving diffuse surfaces, stored as a hash
+// table of grid cells keyed by the quantized position and the dominant axis of
+// the surface normal. Cells are never evicted so the cache must be reset
+// whenever the scene changes.
+struct sp_RadianceCache
+{
+    sp_RadianceCacheCell *cells;
+    u32 capacity; // Must be a power of 2
+    f32 cellSize;
+};
+
+struct sp_RadianceCacheLookupResult
+{
+    vec3 radiance;
+    b32 isValid; // False until the cell has SP_RADIANCE_CACHE_MIN_SAMPLES
+};
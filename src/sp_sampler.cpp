@@ -0,0 +1,150 @@
+// Implementation of the scrambled Sobol sampler is based on "Practical
+// Hash-based Owen Scrambling" by Brent Burley. Only the first two Sobol
+// dimensions are used, higher dimensions are created by padding, i.e. each
+// dimension shuffles the sample index with a different seed.
+
+inline u32 sp_ReverseBits(u32 x)
+{
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00FF00FF) << 8) | ((x & 0xFF00FF00) >> 8);
+    x = ((x & 0x0F0F0F0F) << 4) | ((x & 0xF0F0F0F0) >> 4);
+    x = ((x & 0x33333333) << 2) | ((x & 0xCCCCCCCC) >> 2);
+    x = ((x & 0x55555555) << 1) | ((x & 0xAAAAAAAA) >> 1);
+    return x;
+}
+
+// Integer hash from "Hash Functions for GPU Rendering" (PCG)
+inline u32 sp_HashU32(u32 x)
+{
+    u32 state = x * 747796405u + 2891336453u;
+    u32 word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+inline u32 sp_HashCombine(u32 seed, u32 x)
+{
+    return sp_HashU32(seed ^ (x + 0x9E3779B9u + (seed << 6) + (seed >> 2)));
+}
+
+// Sobol sequence for dimensions 0 and 1, result is a 0.32 fixed point value
+internal u32 sp_Sobol(u32 index, u32 dimension)
+{
+    Assert(dimension < 2);
+
+    u32 result = 0;
+    if (dimension == 0)
+    {
+        // Van der Corput sequence
+        result = sp_ReverseBits(index);
+    }
+    else
+    {
+        // Primitive polynomial x + 1
+        u32 v = 1u << 31;
+        for (u32 i = 0; index != 0; i++, index >>= 1)
+        {
+            if (index & 1)
+            {
+                result ^= v;
+            }
+            v ^= v >> 1;
+        }
+    }
+
+    return result;
+}
+
+// Owen scrambling applied to the bits of x, the higher bits of the result
+// only depend on the higher bits of x which keeps the sequence stratified
+inline u32 sp_NestedUniformScramble(u32 x, u32 seed)
+{
+    // Laine-Karras permutation operates from the low bits upwards
+    x = sp_ReverseBits(x);
+    x += seed;
+    x ^= x * 0x6C50B47Cu;
+    x ^= x * 0xB82F1E52u;
+    x ^= x * 0xC7AFE638u;
+    x ^= x * 0x8D22F6E6u;
+    x = sp_ReverseBits(x);
+
+    return x;
+}
+
+inline f32 sp_FixedPointToFloat(u32 x)
+{
+    // Only use the top 24 bits so the result is always less than 1
+    f32 result = (f32)(x >> 8) * (1.0f / 16777216.0f);
+    return result;
+}
+
+internal vec2 sp_SobolSample2D(u32 index, u32 seed)
+{
+    // Shuffle the order of the points so that each dimension is decorrelated
+    u32 shuffledIndex =
+        sp_NestedUniformScramble(index, sp_HashCombine(seed, 0));
+
+    u32 x = sp_Sobol(shuffledIndex, 0);
+    u32 y = sp_Sobol(shuffledIndex, 1);
+    x = sp_NestedUniformScramble(x, sp_HashCombine(seed, 1));
+    y = sp_NestedUniformScramble(y, sp_HashCombine(seed, 2));
+
+    vec2 result = Vec2(sp_FixedPointToFloat(x), sp_FixedPointToFloat(y));
+    return result;
+}
+
+sp_Sampler sp_CreateSampler(u32 type, RandomNumberGenerator *rng)
+{
+    sp_Sampler sampler = {};
+    sampler.type = type;
+    sampler.rng = rng;
+
+    return sampler;
+}
+
+// Must be called before generating the values for each sample of a pixel
+void sp_StartPixelSample(sp_Sampler *sampler, u32 x, u32 y, u32 sampleIndex)
+{
+    sampler->seed = sp_HashCombine(sp_HashU32(x), y);
+    sampler->sampleIndex = sampleIndex;
+    sampler->dimension = 0;
+}
+
+inline void sp_SetSamplerDimension(sp_Sampler *sampler, u32 dimension)
+{
+    sampler->dimension = dimension;
+}
+
+vec2 sp_Next2D(sp_Sampler *sampler)
+{
+    vec2 result = {};
+    if (sampler->type == sp_SamplerType_Sobol)
+    {
+        u32 seed = sp_HashCombine(sampler->seed, sampler->dimension);
+        result = sp_SobolSample2D(sampler->sampleIndex, seed);
+    }
+    else
+    {
+        result.x = RandomUnilateral(sampler->rng);
+        result.y = RandomUnilateral(sampler->rng);
+    }
+
+    sampler->dimension++;
+
+    return result;
+}
+
+f32 sp_Next1D(sp_Sampler *sampler)
+{
+    f32 result = 0.0f;
+    if (sampler->type == sp_SamplerType_Sobol)
+    {
+        result = sp_Next2D(sampler).x;
+    }
+    else
+    {
+        result = RandomUnilateral(sampler->rng);
+        sampler->dimension++;
+    }
+
+    return result;
+}
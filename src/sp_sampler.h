@@ -0,0 +1,29 @@
+#pragma once
+
+enum
+{
+    // White noise from XorShift32, used by the unit tests as it has no
+    // structure that tests could accidentally depend on
+    sp_SamplerType_Random,
+
+    // Owen scrambled Sobol sequence, padded per dimension
+    sp_SamplerType_Sobol,
+};
+
+// Dimensions are assigned up front for each bounce so that the same decision
+// always uses the same dimension of the sequence regardless of which earlier
+// branches were taken
+#define SP_SAMPLER_CAMERA_DIMENSIONS 1
+#define SP_SAMPLER_DIMENSIONS_PER_BOUNCE 8
+
+// Source of sample values for all random decisions made by the path tracer.
+// Every call to sp_Next1D or sp_Next2D consumes one dimension.
+struct sp_Sampler
+{
+    u32 type;
+    RandomNumberGenerator *rng;
+
+    u32 seed; // Per pixel
+    u32 sampleIndex;
+    u32 dimension;
+};
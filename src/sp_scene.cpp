@@ -1,7 +1,30 @@
 void sp_InitializeScene(sp_Scene *scene, MemoryArena *arena)
 {
     // FIXME: What do we set this to?
-    scene->memoryArena = SubAllocateArena(arena, Kilobytes(512));
+    // NOTE: Needs to be large enough for a broadphase tree containing
+    // SP_SCENE_MAX_OBJECTS leaves
+    scene->memoryArena = SubAllocateArena(arena, Megabytes(1));
+}
+
+// Copy of ComputeAabb from aabb.h but for VertexPNT type
+inline Aabb ComputeAabb(VertexPNT *vertices, u32 vertexCount)
+{
+    Assert(vertices != NULL);
+    Assert(vertexCount > 0);
+
+    Aabb result = {};
+    result.min = vertices[0].position;
+    result.max = vertices[0].position;
+
+    // Build AABB by taking the min and max value of each component of the
+    // input vertices
+    for (u32 i = 1; i < vertexCount; ++i)
+    {
+        result.min = Min(result.min, vertices[i].position);
+        result.max = Max(result.max, vertices[i].position);
+    }
+
+    return result;
 }
 
 // FIXME: What do we do with the memory!?!??!
@@ -15,6 +38,13 @@ sp_Mesh sp_CreateMesh(VertexPNT *vertices, u32 vertexCount, u32 *indices,
     result.indexCount = indexCount;
     result.useSmoothShading = useSmoothShading;
 
+    if (vertexCount > 0)
+    {
+        Aabb aabb = ComputeAabb(vertices, vertexCount);
+        result.aabbMin = aabb.min;
+        result.aabbMax = aabb.max;
+    }
+
     return result;
 }
 
@@ -51,41 +81,64 @@ void sp_BuildMeshMidphase(
 
     // Build BVH tree
     mesh->midphaseTree = bvh_CreateTree(arena, aabbMin, aabbMax, triangleCount);
-}
-
-// Copy of ComputeAabb from aabb.h but for VertexPNT type
-inline Aabb ComputeAabb(VertexPNT *vertices, u32 vertexCount)
-{
-    Assert(vertices != NULL);
-    Assert(vertexCount > 0);
 
-    Aabb result = {};
-    result.min = vertices[0].position;
-    result.max = vertices[0].position;
-
-    // Build AABB by taking the min and max value of each component of the
-    // input vertices
-    for (u32 i = 1; i < vertexCount; ++i)
+    // Merge subtrees into leaves containing multiple triangles where the SAH
+    // says it is cheaper to test them all at once than to traverse them
+    u32 *leafTriangles = AllocateArray(tempArena, u32, triangleCount);
+    bvh_CollapseLeaves(&mesh->midphaseTree, SP_MAX_TRIANGLES_PER_LEAF,
+        RAY_INTERSECT_TRIANGLES_WIDTH, leafTriangles);
+
+    // Copy triangle vertices and precomputed edges into SoA storage in leaf
+    // order
+    sp_MeshTriangles *triangles = &mesh->triangles;
+    u32 capacity = triangleCount + RAY_INTERSECT_TRIANGLES_PADDING;
+    for (u32 axis = 0; axis < 3; ++axis)
     {
-        result.min = Min(result.min, vertices[i].position);
-        result.max = Max(result.max, vertices[i].position);
+        triangles->batch.vertex[axis] = AllocateArray(arena, f32, capacity);
+        triangles->batch.edge1[axis] = AllocateArray(arena, f32, capacity);
+        triangles->batch.edge2[axis] = AllocateArray(arena, f32, capacity);
+        ClearToZero(triangles->batch.vertex[axis], sizeof(f32) * capacity);
+        ClearToZero(triangles->batch.edge1[axis], sizeof(f32) * capacity);
+        ClearToZero(triangles->batch.edge2[axis], sizeof(f32) * capacity);
     }
+    triangles->triangleIndices = AllocateArray(arena, u32, triangleCount);
+    triangles->count = triangleCount;
 
-    return result;
+    for (u32 i = 0; i < triangleCount; ++i)
+    {
+        u32 triangleIndex = leafTriangles[i];
+        triangles->triangleIndices[i] = triangleIndex;
+
+        vec3 a = mesh->vertices[mesh->indices[triangleIndex * 3 + 0]].position;
+        vec3 b = mesh->vertices[mesh->indices[triangleIndex * 3 + 1]].position;
+        vec3 c = mesh->vertices[mesh->indices[triangleIndex * 3 + 2]].position;
+        vec3 e1 = b - a;
+        vec3 e2 = c - a;
+
+        for (u32 axis = 0; axis < 3; ++axis)
+        {
+            triangles->batch.vertex[axis][i] = a.data[axis];
+            triangles->batch.edge1[axis][i] = e1.data[axis];
+            triangles->batch.edge2[axis][i] = e2.data[axis];
+        }
+    }
 }
 
-void sp_AddObjectToScene(sp_Scene *scene, sp_Mesh mesh, u32 material,
-    vec3 position, quat orientation, vec3 scale)
+// Updates the model matrices and world space AABB for an object from the
+// cached local bounds of its mesh. Moving an object doesn't touch its mesh
+// data, the broadphase must be updated with sp_UpdateSceneBroadphase
+// afterwards.
+void sp_SetObjectTransform(sp_Scene *scene, u32 index, vec3 position,
+    quat orientation, vec3 scale)
 {
+    Assert(index < scene->objectCount);
+    sp_Mesh *mesh = scene->meshes + index;
+
     // TODO: Do we want to add padding to AABBs to handle 0 length vector
     // components
-    // FIXME: Avoid computing this for every object, should take as input
-    // Compute AABB for mesh
-    Aabb aabb = ComputeAabb(mesh.vertices, mesh.vertexCount);
-
     // Transform AABB
-    Aabb transformedAabb =
-        TransformAabb(aabb.min, aabb.max, position, orientation, scale);
+    Aabb transformedAabb = TransformAabb(
+        mesh->aabbMin, mesh->aabbMax, position, orientation, scale);
 
     // Compute model matrix
     mat4 modelMatrix= Translate(position) * Rotate(orientation) * Scale(scale);
@@ -95,10 +148,6 @@ void sp_AddObjectToScene(sp_Scene *scene, sp_Mesh mesh, u32 material,
                           Rotate(Conjugate(orientation)) *
                           Translate(-position);
 
-    // Compute object index
-    Assert(scene->objectCount < SP_SCENE_MAX_OBJECTS);
-    u32 index = scene->objectCount++;
-
     // Store AABB
     scene->aabbMin[index] = transformedAabb.min;
     scene->aabbMax[index] = transformedAabb.max;
@@ -108,22 +157,58 @@ void sp_AddObjectToScene(sp_Scene *scene, sp_Mesh mesh, u32 material,
 
     // Store model matrix
     scene->modelMatrices[index] = modelMatrix;
+}
+
+u32 sp_AddObjectToScene(sp_Scene *scene, sp_Mesh mesh, u32 material,
+    vec3 position, quat orientation, vec3 scale)
+{
+    // Compute object index
+    Assert(scene->objectCount < SP_SCENE_MAX_OBJECTS);
+    u32 index = scene->objectCount++;
 
     // Store mesh
     scene->meshes[index] = mesh;
 
     // Store material
     scene->materials[index] = material;
+
+    sp_SetObjectTransform(scene, index, position, orientation, scale);
+
+    return index;
 }
 
+// NOTE: Only depends on the cached object AABBs so the cost is proportional to
+// the number of objects in the scene rather than the amount of mesh data
 void sp_BuildSceneBroadphase(sp_Scene *scene)
 {
-    // TODO: Not very memory efficient
+    // Broadphase tree is the only thing allocated from the scene arena
+    ResetMemoryArena(&scene->memoryArena);
+
     scene->broadphaseTree =
         bvh_CreateTree(&scene->memoryArena, scene->aabbMin,
             scene->aabbMax, scene->objectCount);
 }
 
+// Refits the existing broadphase tree to the current object AABBs, the tree
+// is only rebuilt if it doesn't exist yet or its quality has degraded too far
+// for refitting to be worthwhile.
+void sp_UpdateSceneBroadphase(sp_Scene *scene)
+{
+    b32 rebuildRequired = true;
+    if (scene->broadphaseTree.root != NULL &&
+        scene->broadphaseTree.leafCount == scene->objectCount)
+    {
+        bvh_RefitResult refitResult = bvh_RefitTree(
+            &scene->broadphaseTree, scene->aabbMin, scene->aabbMax);
+        rebuildRequired = refitResult.rebuildRequired;
+    }
+
+    if (rebuildRequired)
+    {
+        sp_BuildSceneBroadphase(scene);
+    }
+}
+
 sp_RayIntersectMeshResult sp_RayIntersectMesh(
     sp_Mesh mesh, vec3 rayOrigin, vec3 rayDirection, sp_Metrics *metrics)
 {
@@ -157,11 +242,39 @@ sp_RayIntersectMeshResult sp_RayIntersectMesh(
     // TODO: What do we do if the errorOccurred flag is set?
     Assert(!midphaseResult.errorOccurred);
 
+    // Only the nearest hit is tracked while testing the leaves, attributes are
+    // computed once for the winning triangle afterwards
+    RayIntersectTrianglesResult nearestHit = {};
+    nearestHit.t = -1.0f;
+    nearestHit.index = U32_MAX;
+
     // Process each midphase intersection
     for (u32 i = 0; i < midphaseResult.count; ++i)
+    {
+        bvh_Node *leaf = intersectedNodes[i];
+
+        // Only accept hits closer than the nearest one found so far
+        f32 tmax = nearestHit.index != U32_MAX ? nearestHit.t : F32_MAX;
+
+        u64 triangleIntersectStart = __rdtsc();
+
+        RayIntersectTrianglesResult hit =
+            RayIntersectTriangles(mesh.triangles.batch, leaf->leafIndex,
+                leaf->itemCount, rayOrigin, rayDirection, tmax);
+
+        metrics->values[sp_Metric_CyclesElapsed_RayIntersectTriangle] +=
+            __rdtsc() - triangleIntersectStart;
+
+        if (hit.index != U32_MAX)
+        {
+            nearestHit = hit;
+        }
+    }
+
+    if (nearestHit.index != U32_MAX)
     {
         // Fetch triangle index
-        u32 triangleIndex = intersectedNodes[i]->leafIndex;
+        u32 triangleIndex = mesh.triangles.triangleIndices[nearestHit.index];
 
         // Compute vertex indices
         u32 indices[3];
@@ -175,44 +288,27 @@ sp_RayIntersectMeshResult sp_RayIntersectMesh(
         vertices[1] = mesh.vertices[indices[1]];
         vertices[2] = mesh.vertices[indices[2]];
 
-        u64 triangleIntersectStart = __rdtsc();
+        f32 u = nearestHit.uv.x;
+        f32 v = nearestHit.uv.y;
 
-        // Perform ray intersect triangle test
-        RayIntersectTriangleResult triangleIntersect =
-            RayIntersectTriangle(rayOrigin, rayDirection, vertices[0].position,
-                vertices[1].position, vertices[2].position);
+        nearestTriangleIntersection.t = nearestHit.t;
+        nearestTriangleIntersection.normal = Normalize(
+            Cross(vertices[1].position - vertices[0].position,
+                vertices[2].position - vertices[0].position));
 
-        metrics->values[sp_Metric_CyclesElapsed_RayIntersectTriangle] +=
-            __rdtsc() - triangleIntersectStart;
+        // Compute UVs from barycentric coordinates
+        f32 w = 1.0f - u - v;
+        nearestTriangleIntersection.uv = vertices[0].textureCoord * w +
+                                         vertices[1].textureCoord * u +
+                                         vertices[2].textureCoord * v;
 
-        // Process triangle intersection result if intersection found
-        if (triangleIntersect.t > 0.0f)
+        if (mesh.useSmoothShading)
         {
-            // Take the closest result (smallest t value)
-            if (triangleIntersect.t < nearestTriangleIntersection.t ||
-                nearestTriangleIntersection.t < 0.0f)
-            {
-                nearestTriangleIntersection = triangleIntersect;
-
-                // Compute UVs from barycentric coordinates
-                f32 w =
-                    1.0f - triangleIntersect.uv.x - triangleIntersect.uv.y;
-                vec2 uv =
-                    vertices[0].textureCoord * w +
-                    vertices[1].textureCoord * triangleIntersect.uv.x +
-                    vertices[2].textureCoord * triangleIntersect.uv.y;
-
-                if (mesh.useSmoothShading)
-                {
-                    // Compute smooth normal by interpolating the 3 vertex
-                    // normals using barycentric coordinates
-                    nearestTriangleIntersection.normal = Normalize(
-                        vertices[0].normal * w +
-                        vertices[1].normal * triangleIntersect.uv.x +
-                        vertices[2].normal * triangleIntersect.uv.y);
-                }
-                nearestTriangleIntersection.uv = uv;
-            }
+            // Compute smooth normal by interpolating the 3 vertex normals
+            // using barycentric coordinates
+            nearestTriangleIntersection.normal =
+                Normalize(vertices[0].normal * w + vertices[1].normal * u +
+                          vertices[2].normal * v);
         }
     }
 
@@ -235,35 +331,38 @@ sp_RayIntersectSceneResult sp_RayIntersectScene(
     sp_RayIntersectSceneResult result = {};
     result.t = -1.0f;
 
-    // TODO: What should be the upper limit on the number of broadphase
-    // intersections? Should there even be a fixed limit?
-    bvh_Node *intersectedNodes[32] = {};
+#if SP_DEBUG_MIDPHASE_INTERSECTION_COUNT
+    u32 midphaseIntersectionCount = 0;
+#endif
 
-    // Record CPU timestamp before we perform broadphase intersection test
+    // NOTE: Objects are visited one at a time with a depth first traversal
+    // of the broadphase tree rather than collecting every intersected leaf
+    // into a fixed size buffer first, a ray can cross the bounds of any
+    // number of the SP_SCENE_MAX_OBJECTS objects
     u64 broadphaseStart = __rdtsc();
 
-    // Intersect the ray against our broadphase tree first to quickly get a
-    // list of potential mesh intersections
-    bvh_IntersectRayResult broadphaseResult =
-        bvh_IntersectRay(&scene->broadphaseTree, rayOrigin,
-            rayDirection, intersectedNodes, ArrayCount(intersectedNodes));
+    bvh_RayTraversal traversal;
+    bvh_BeginRayTraversal(
+        &traversal, &scene->broadphaseTree, rayOrigin, rayDirection);
+    bvh_Node *leaf = bvh_NextIntersectedLeaf(&traversal);
 
     // Compute number of cycles spent in broadphase BVH test and add to total
     metrics->values[sp_Metric_CyclesElapsed_RayIntersectBroadphase] +=
         __rdtsc() - broadphaseStart;
 
-    // TODO: What do we do if the errorOccurred flag is set?
-    Assert(!broadphaseResult.errorOccurred);
-
-#if SP_DEBUG_MIDPHASE_INTERSECTION_COUNT
-    u32 midphaseIntersectionCount = 0;
+#if SP_DEBUG_BROADPHASE_INTERSECTION_COUNT
+    u32 broadphaseIntersectionCount = 0;
 #endif
 
     // Process each broadphase intersection
-    for (u32 i = 0; i < broadphaseResult.count; ++i)
+    while (leaf != NULL)
     {
+#if SP_DEBUG_BROADPHASE_INTERSECTION_COUNT
+        broadphaseIntersectionCount++;
+#endif
+
         // Fetch data for scene object
-        u32 objectIndex = intersectedNodes[i]->leafIndex;
+        u32 objectIndex = leaf->leafIndex;
         mat4 invModelMatrix = scene->invModelMatrices[objectIndex];
         mat4 modelMatrix = scene->modelMatrices[objectIndex];
         sp_Mesh mesh = scene->meshes[objectIndex];
@@ -321,10 +420,15 @@ sp_RayIntersectSceneResult sp_RayIntersectScene(
                 // TODO: Store other properties for the intersection
             }
         }
+
+        broadphaseStart = __rdtsc();
+        leaf = bvh_NextIntersectedLeaf(&traversal);
+        metrics->values[sp_Metric_CyclesElapsed_RayIntersectBroadphase] +=
+            __rdtsc() - broadphaseStart;
     }
 
 #if SP_DEBUG_BROADPHASE_INTERSECTION_COUNT
-    result.broadphaseIntersectionCount = broadphaseResult.count;
+    result.broadphaseIntersectionCount = broadphaseIntersectionCount;
 #endif
 
 #if SP_DEBUG_MIDPHASE_INTERSECTION_COUNT
@@ -338,3 +442,279 @@ sp_RayIntersectSceneResult sp_RayIntersectScene(
     return result;
 }
 
+internal b32 sp_RayOccludedMesh(
+    sp_Mesh *mesh, vec3 rayOrigin, vec3 rayDirection, f32 tmax)
+{
+    b32 result = false;
+
+    bvh_RayTraversal traversal;
+    bvh_BeginRayTraversal(
+        &traversal, &mesh->midphaseTree, rayOrigin, rayDirection);
+
+    bvh_Node *leaf = bvh_NextIntersectedLeaf(&traversal);
+    while (leaf != NULL)
+    {
+        RayIntersectTrianglesResult hit =
+            RayIntersectTriangles(mesh->triangles.batch, leaf->leafIndex,
+                leaf->itemCount, rayOrigin, rayDirection, tmax);
+        if (hit.index != U32_MAX)
+        {
+            result = true;
+            break;
+        }
+
+        leaf = bvh_NextIntersectedLeaf(&traversal);
+    }
+
+    return result;
+}
+
+// Returns true if anything in the scene is hit by the ray closer than tmax.
+// This is much cheaper than sp_RayIntersectScene as it returns on the first
+// hit found rather than the closest and doesn't compute any surface
+// attributes, use it for shadow and visibility rays.
+b32 sp_RayOccluded(
+    sp_Scene *scene, vec3 rayOrigin, vec3 rayDirection, f32 tmax = F32_MAX)
+{
+    b32 result = false;
+
+    bvh_RayTraversal traversal;
+    bvh_BeginRayTraversal(
+        &traversal, &scene->broadphaseTree, rayOrigin, rayDirection);
+
+    bvh_Node *leaf = bvh_NextIntersectedLeaf(&traversal);
+    while (leaf != NULL)
+    {
+        u32 objectIndex = leaf->leafIndex;
+        mat4 invModelMatrix = scene->invModelMatrices[objectIndex];
+
+        // NOTE: The local ray direction is deliberately not normalized so that
+        // t values in mesh space are the same as in world space and tmax can
+        // be used as is
+        vec3 localRayOrigin = TransformPoint(rayOrigin, invModelMatrix);
+        vec3 localRayDirection = TransformVector(rayDirection, invModelMatrix);
+
+        if (sp_RayOccludedMesh(scene->meshes + objectIndex, localRayOrigin,
+                localRayDirection, tmax))
+        {
+            result = true;
+            break;
+        }
+
+        leaf = bvh_NextIntersectedLeaf(&traversal);
+    }
+
+    return result;
+}
+
+u32 sp_AddSphereLight(
+    sp_Scene *scene, vec3 position, f32 radius, vec3 radiance)
+{
+    Assert(scene->lightCount < SP_SCENE_MAX_LIGHTS);
+    u32 index = scene->lightCount++;
+
+    sp_Light *light = scene->lights + index;
+    *light = {};
+    light->type = sp_LightType_Sphere;
+    light->position = position;
+    light->radiance = radiance;
+    light->radius = radius;
+
+    return index;
+}
+
+u32 sp_AddDiskLight(
+    sp_Scene *scene, vec3 position, vec3 normal, f32 radius, vec3 radiance)
+{
+    Assert(scene->lightCount < SP_SCENE_MAX_LIGHTS);
+    u32 index = scene->lightCount++;
+
+    sp_Light *light = scene->lights + index;
+    *light = {};
+    light->type = sp_LightType_Disk;
+    light->position = position;
+    light->normal = Normalize(normal);
+    light->radiance = radiance;
+    light->radius = radius;
+
+    return index;
+}
+
+// Returns F32_MAX if the ray does not hit the emitting side of the disk
+internal f32 sp_RayIntersectDiskLight(
+    sp_Light *light, vec3 rayOrigin, vec3 rayDirection)
+{
+    f32 t = F32_MAX;
+
+    f32 denom = Dot(rayDirection, light->normal);
+    if (denom < 0.0f)
+    {
+        f32 planeT = Dot(light->position - rayOrigin, light->normal) / denom;
+        vec3 offset = rayOrigin + rayDirection * planeT - light->position;
+        if (planeT > 0.0f &&
+            LengthSq(offset) <= light->radius * light->radius)
+        {
+            t = planeT;
+        }
+    }
+
+    return t;
+}
+
+// Finds the closest light hit by the ray which is nearer than tmax
+sp_RayIntersectLightsResult sp_RayIntersectLights(
+    sp_Scene *scene, vec3 rayOrigin, vec3 rayDirection, f32 tmax = F32_MAX)
+{
+    sp_RayIntersectLightsResult result = {};
+    result.t = tmax;
+    result.lightIndex = U32_MAX;
+
+    for (u32 i = 0; i < scene->lightCount; i++)
+    {
+        sp_Light *light = scene->lights + i;
+
+        f32 t = F32_MAX;
+        if (light->type == sp_LightType_Sphere)
+        {
+            t = RayIntersectSphere(
+                light->position, light->radius, rayOrigin, rayDirection);
+        }
+        else if (light->type == sp_LightType_Disk)
+        {
+            t = sp_RayIntersectDiskLight(light, rayOrigin, rayDirection);
+        }
+        else
+        {
+            InvalidCodePath();
+        }
+
+        if (t > 0.0f && t < result.t)
+        {
+            result.t = t;
+            result.lightIndex = i;
+        }
+    }
+
+    return result;
+}
+
+// Solid angle pdf of sp_SampleLight generating a direction from p which hits
+// the given light at distance t. Used to compute MIS weights for BSDF samples
+// which hit a light.
+f32 sp_ComputeLightPdf(
+    sp_Scene *scene, u32 lightIndex, vec3 p, vec3 direction, f32 t)
+{
+    Assert(lightIndex < scene->lightCount);
+    sp_Light *light = scene->lights + lightIndex;
+
+    f32 pdf = 0.0f;
+    if (light->type == sp_LightType_Sphere)
+    {
+        // Uniform sampling of the cone subtended by the sphere
+        f32 distSq = LengthSq(light->position - p);
+        f32 radiusSq = light->radius * light->radius;
+        if (distSq > radiusSq)
+        {
+            f32 cosThetaMax = Sqrt(1.0f - radiusSq / distSq);
+            pdf = 1.0f / (2.0f * PI * (1.0f - cosThetaMax));
+        }
+    }
+    else if (light->type == sp_LightType_Disk)
+    {
+        // Uniform sampling of the disk area converted to solid angle
+        f32 cosine = -Dot(direction, light->normal);
+        if (cosine > 0.0f)
+        {
+            f32 area = PI * light->radius * light->radius;
+            pdf = (t * t) / (cosine * area);
+        }
+    }
+    else
+    {
+        InvalidCodePath();
+    }
+
+    // Lights are selected uniformly
+    pdf *= 1.0f / (f32)scene->lightCount;
+
+    return pdf;
+}
+
+// Picks a light uniformly and samples a direction towards it from p. Does not
+// test visibility, use sp_RayOccluded for that.
+sp_LightSample sp_SampleLight(sp_Scene *scene, vec3 p, sp_Sampler *sampler)
+{
+    sp_LightSample result = {};
+    if (scene->lightCount == 0)
+    {
+        return result;
+    }
+
+    u32 lightIndex = (u32)(sp_Next1D(sampler) * (f32)scene->lightCount);
+    lightIndex = MinU32(lightIndex, scene->lightCount - 1);
+    sp_Light *light = scene->lights + lightIndex;
+
+    vec2 uv = sp_Next2D(sampler);
+    f32 u = uv.x;
+    f32 phi = 2.0f * PI * uv.y;
+
+    if (light->type == sp_LightType_Sphere)
+    {
+        vec3 toCenter = light->position - p;
+        f32 distSq = LengthSq(toCenter);
+        f32 radiusSq = light->radius * light->radius;
+        if (distSq <= radiusSq)
+        {
+            // Inside the light, no valid sample
+            return result;
+        }
+
+        // Sample a direction uniformly within the cone subtended by the sphere
+        f32 dist = Sqrt(distSq);
+        f32 cosThetaMax = Sqrt(1.0f - radiusSq / distSq);
+        f32 cosTheta = 1.0f - u * (1.0f - cosThetaMax);
+        f32 sinTheta = Sqrt(Max(0.0f, 1.0f - cosTheta * cosTheta));
+
+        mat4 basis = ChangeOfBasis(toCenter * (1.0f / dist));
+        vec3 localDir = Vec3(cosTheta, sinTheta * Cos(phi), sinTheta * Sin(phi));
+        result.direction = TransformVector(localDir, basis);
+
+        // Distance to the near side of the sphere along the sampled direction
+        f32 perpDistSq = distSq * sinTheta * sinTheta;
+        result.distance =
+            dist * cosTheta - Sqrt(Max(0.0f, radiusSq - perpDistSq));
+        result.pdf = 1.0f / (2.0f * PI * (1.0f - cosThetaMax));
+    }
+    else if (light->type == sp_LightType_Disk)
+    {
+        // Sample a point uniformly on the disk
+        mat4 basis = ChangeOfBasis(light->normal);
+        f32 r = light->radius * Sqrt(u);
+        vec3 localPoint = Vec3(0.0f, r * Cos(phi), r * Sin(phi));
+        vec3 lightP = light->position + TransformVector(localPoint, basis);
+
+        vec3 toLight = lightP - p;
+        f32 dist = Length(toLight);
+        vec3 direction = toLight * (1.0f / dist);
+        f32 cosine = -Dot(direction, light->normal);
+        if (cosine <= 0.0f)
+        {
+            // Back side of the light doesn't emit
+            return result;
+        }
+
+        f32 area = PI * light->radius * light->radius;
+        result.direction = direction;
+        result.distance = dist;
+        result.pdf = (dist * dist) / (cosine * area);
+    }
+    else
+    {
+        InvalidCodePath();
+    }
+
+    result.radiance = light->radiance;
+    result.pdf *= 1.0f / (f32)scene->lightCount;
+
+    return result;
+}
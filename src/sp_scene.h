@@ -1,5 +1,22 @@
 #pragma once
 
+// Maximum number of triangles stored in a single midphase leaf node, the
+// actual leaf size is chosen per subtree using the SAH when the tree is built
+#define SP_MAX_TRIANGLES_PER_LEAF 8
+
+// Triangles of the mesh reordered so that the triangles of each midphase leaf
+// are contiguous, stored as a TriangleBatch so that a whole leaf can be tested
+// with RayIntersectTriangles
+struct sp_MeshTriangles
+{
+    // Arrays are padded by RAY_INTERSECT_TRIANGLES_PADDING entries
+    TriangleBatch batch;
+
+    // Index of the triangle in the mesh index buffer
+    u32 *triangleIndices;
+    u32 count;
+};
+
 struct sp_Mesh
 {
     VertexPNT *vertices; // Where dis memory at?
@@ -7,12 +24,37 @@ struct sp_Mesh
     u32 vertexCount;
     u32 indexCount;
 
+    // Local space bounds of the mesh vertices, cached so that objects can be
+    // added or moved without touching the vertex data
+    vec3 aabbMin;
+    vec3 aabbMax;
+
     bvh_Tree midphaseTree;
+    sp_MeshTriangles triangles;
     b32 useSmoothShading;
 };
 
+enum
+{
+    sp_LightType_Sphere,
+    sp_LightType_Disk,
+};
+
+// Analytic light source which is sampled directly by the path tracer for next
+// event estimation. Lights are not part of the broadphase so they are only
+// visible to camera and BSDF rays, they never occlude other lights.
+struct sp_Light
+{
+    u32 type;
+    vec3 position;
+    vec3 normal; // Disk lights only emit on the side the normal points to
+    vec3 radiance;
+    f32 radius;
+};
+
 // TODO: Switch to dynamic arrays in the future
-#define SP_SCENE_MAX_OBJECTS 32
+#define SP_SCENE_MAX_OBJECTS 1024
+#define SP_SCENE_MAX_LIGHTS 32
 struct sp_Scene
 {
     // TODO: We could build the AABB arrays in temp memory in BuildBroadphaseTree
@@ -26,6 +68,9 @@ struct sp_Scene
 
     MemoryArena memoryArena;
     bvh_Tree broadphaseTree;
+
+    sp_Light lights[SP_SCENE_MAX_LIGHTS];
+    u32 lightCount;
 };
 
 struct sp_RayIntersectMeshResult
@@ -51,3 +96,20 @@ struct sp_RayIntersectSceneResult
     u32 midphaseIntersectionCount;
 #endif
 };
+
+struct sp_RayIntersectLightsResult
+{
+    f32 t;
+    u32 lightIndex; // U32_MAX if no light was hit
+};
+
+struct sp_LightSample
+{
+    vec3 direction;
+    f32 distance;
+    vec3 radiance;
+
+    // Solid angle pdf of the sample including the probability of selecting
+    // the light, 0 if no valid sample could be generated
+    f32 pdf;
+};
@@ -0,0 +1,241 @@
+// Directions which are not set, e.g. lightDir when no light was sampled, are
+// stored as this so that they decode back to a zero vector. Encoded components
+// are limited to 65534 so it can't collide with a real direction.
+#define SP_CACHED_ZERO_DIRECTION U32_MAX
+
+#define SP_SHARED_EXPONENT_MANTISSA_BITS 9
+#define SP_SHARED_EXPONENT_BIAS 15
+
+internal u32 EncodeOctahedral(vec3 v)
+{
+    u32 result = SP_CACHED_ZERO_DIRECTION;
+
+    f32 length = Abs(v.x) + Abs(v.y) + Abs(v.z);
+    if (length > 0.0f)
+    {
+        f32 x = v.x / length;
+        f32 y = v.y / length;
+
+        // Lower hemisphere is folded over the diagonals of the square
+        if (v.z < 0.0f)
+        {
+            f32 foldedX = (1.0f - Abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            f32 foldedY = (1.0f - Abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = foldedX;
+            y = foldedY;
+        }
+
+        u32 u = (u32)Round((Clamp(x, -1.0f, 1.0f) * 0.5f + 0.5f) * 65534.0f);
+        u32 w = (u32)Round((Clamp(y, -1.0f, 1.0f) * 0.5f + 0.5f) * 65534.0f);
+        result = u | (w << 16);
+    }
+
+    return result;
+}
+
+internal vec3 DecodeOctahedral(u32 encoded)
+{
+    vec3 result = {};
+    if (encoded != SP_CACHED_ZERO_DIRECTION)
+    {
+        f32 x = (f32)(encoded & 0xFFFF) / 65534.0f * 2.0f - 1.0f;
+        f32 y = (f32)(encoded >> 16) / 65534.0f * 2.0f - 1.0f;
+        f32 z = 1.0f - Abs(x) - Abs(y);
+        if (z < 0.0f)
+        {
+            f32 unfoldedX = (1.0f - Abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            f32 unfoldedY = (1.0f - Abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = unfoldedX;
+            y = unfoldedY;
+        }
+
+        result = Normalize(Vec3(x, y, z));
+    }
+
+    return result;
+}
+
+// RGB9E5, three 9 bit mantissas sharing a 5 bit exponent. Negative values are
+// clamped to 0 and values above SP_SHADING_CACHE_MAX_RADIANCE to the maximum.
+internal u32 EncodeSharedExponent(vec3 c)
+{
+    f32 r = Clamp(c.x, 0.0f, SP_SHADING_CACHE_MAX_RADIANCE);
+    f32 g = Clamp(c.y, 0.0f, SP_SHADING_CACHE_MAX_RADIANCE);
+    f32 b = Clamp(c.z, 0.0f, SP_SHADING_CACHE_MAX_RADIANCE);
+
+    u32 result = 0;
+    f32 maxComponent = Max(r, Max(g, b));
+    if (maxComponent > 0.0f)
+    {
+        i32 exponent = 0;
+        frexpf(maxComponent, &exponent);
+        exponent = Max(exponent, -SP_SHARED_EXPONENT_BIAS);
+
+        u32 maxMantissa = (1 << SP_SHARED_EXPONENT_MANTISSA_BITS) - 1;
+        f32 scale = ldexpf(1.0f, SP_SHARED_EXPONENT_MANTISSA_BITS - exponent);
+
+        // Rounding can carry into the next exponent
+        if ((u32)(maxComponent * scale + 0.5f) > maxMantissa)
+        {
+            exponent++;
+            scale *= 0.5f;
+        }
+
+        u32 rm = MinU32((u32)(r * scale + 0.5f), maxMantissa);
+        u32 gm = MinU32((u32)(g * scale + 0.5f), maxMantissa);
+        u32 bm = MinU32((u32)(b * scale + 0.5f), maxMantissa);
+        u32 biasedExponent = (u32)(exponent + SP_SHARED_EXPONENT_BIAS);
+        result = rm | (gm << 9) | (bm << 18) | (biasedExponent << 27);
+    }
+
+    return result;
+}
+
+internal vec3 DecodeSharedExponent(u32 encoded)
+{
+    i32 exponent = (i32)(encoded >> 27) - SP_SHARED_EXPONENT_BIAS;
+    f32 scale = ldexpf(1.0f, exponent - SP_SHARED_EXPONENT_MANTISSA_BITS);
+
+    vec3 result = Vec3((f32)(encoded & 0x1FF), (f32)((encoded >> 9) & 0x1FF),
+                      (f32)((encoded >> 18) & 0x1FF)) *
+                  scale;
+    return result;
+}
+
+sp_CachedVertex sp_CompressPathVertex(sp_PathVertex *vertex)
+{
+    sp_CachedVertex result = {};
+    if (vertex->isLight)
+    {
+        // Only the emission is needed to shade a light vertex
+        result.materialId = U32_MAX;
+        result.normal = SP_CACHED_ZERO_DIRECTION;
+        result.outgoingDir = EncodeOctahedral(vertex->outgoingDir);
+        result.incomingDir = SP_CACHED_ZERO_DIRECTION;
+        result.lightDir = SP_CACHED_ZERO_DIRECTION;
+        result.environmentDir = SP_CACHED_ZERO_DIRECTION;
+        result.lightRadiance = EncodeSharedExponent(vertex->lightEmission);
+    }
+    else
+    {
+        result.materialId = vertex->materialId;
+        result.normal = EncodeOctahedral(vertex->normal);
+        result.outgoingDir = EncodeOctahedral(vertex->outgoingDir);
+        result.incomingDir = EncodeOctahedral(vertex->incomingDir);
+        result.lightDir = EncodeOctahedral(vertex->lightDir);
+        result.environmentDir = EncodeOctahedral(vertex->environmentDir);
+        result.uv = vertex->uv;
+        result.incomingPdf = vertex->incomingPdf;
+        result.lightRadiance = EncodeSharedExponent(vertex->lightRadiance);
+        result.environmentRadiance =
+            EncodeSharedExponent(vertex->environmentRadiance);
+    }
+
+    return result;
+}
+
+sp_PathVertex sp_DecompressPathVertex(sp_CachedVertex *vertex)
+{
+    sp_PathVertex result = {};
+    result.outgoingDir = DecodeOctahedral(vertex->outgoingDir);
+    if (vertex->materialId == U32_MAX)
+    {
+        result.isLight = true;
+        result.lightEmission = DecodeSharedExponent(vertex->lightRadiance);
+    }
+    else
+    {
+        result.materialId = vertex->materialId;
+        result.normal = DecodeOctahedral(vertex->normal);
+        result.incomingDir = DecodeOctahedral(vertex->incomingDir);
+        result.lightDir = DecodeOctahedral(vertex->lightDir);
+        result.environmentDir = DecodeOctahedral(vertex->environmentDir);
+        result.uv = vertex->uv;
+        result.incomingPdf = vertex->incomingPdf;
+        result.lightRadiance = DecodeSharedExponent(vertex->lightRadiance);
+        result.environmentRadiance =
+            DecodeSharedExponent(vertex->environmentRadiance);
+    }
+
+    return result;
+}
+
+void sp_ClearShadingCache(sp_ShadingCache *cache)
+{
+    ClearToZero(cache->pathCounts, sizeof(u32) * cache->width * cache->height);
+}
+
+void sp_InitializeShadingCache(sp_ShadingCache *cache, MemoryArena *arena,
+    u32 width, u32 height, u32 samplesPerPixel)
+{
+    u32 pixelCount = width * height;
+    cache->paths =
+        AllocateArray(arena, sp_CachedPath, pixelCount * samplesPerPixel);
+    cache->pathCounts = AllocateArray(arena, u32, pixelCount);
+    cache->width = width;
+    cache->height = height;
+    cache->samplesPerPixel = samplesPerPixel;
+
+    sp_ClearShadingCache(cache);
+}
+
+// NOTE: Not thread safe, tiles never share pixels so each pixel is only
+// written by one worker at a time
+void sp_ResetShadingCachePixel(sp_ShadingCache *cache, u32 pixelIndex)
+{
+    Assert(pixelIndex < cache->width * cache->height);
+    cache->pathCounts[pixelIndex] = 0;
+}
+
+// Returns NULL once the pixel already holds samplesPerPixel paths
+sp_CachedPath *sp_AddCachedPath(sp_ShadingCache *cache, u32 pixelIndex)
+{
+    Assert(pixelIndex < cache->width * cache->height);
+
+    sp_CachedPath *result = NULL;
+    u32 count = cache->pathCounts[pixelIndex];
+    if (count < cache->samplesPerPixel)
+    {
+        result = cache->paths + pixelIndex * cache->samplesPerPixel + count;
+        result->vertexCount = 0;
+        cache->pathCounts[pixelIndex] = count + 1;
+    }
+
+    return result;
+}
+
+// Returns NULL if only the slot for the tail of the path is left, the caller
+// must then finish the path with sp_AddCachedPathTail
+sp_CachedVertex *sp_AddCachedVertex(sp_CachedPath *path, sp_PathVertex *vertex)
+{
+    sp_CachedVertex *result = NULL;
+    if (path->vertexCount < SP_SHADING_CACHE_MAX_PATH_VERTICES - 1)
+    {
+        result = path->vertices + path->vertexCount++;
+        *result = sp_CompressPathVertex(vertex);
+    }
+
+    return result;
+}
+
+// Radiance gathered by the vertices which didn't fit is stored as a light
+// vertex, it keeps the materials the path was traced with
+void sp_AddCachedPathTail(sp_CachedPath *path, vec3 radiance)
+{
+    Assert(path->vertexCount == SP_SHADING_CACHE_MAX_PATH_VERTICES - 1);
+
+    sp_PathVertex vertex = {};
+    vertex.isLight = true;
+    vertex.lightEmission = radiance;
+    path->vertices[path->vertexCount++] = sp_CompressPathVertex(&vertex);
+}
+
+u32 sp_DecompressCachedPath(sp_CachedPath *path, sp_PathVertex *vertices)
+{
+    for (u32 i = 0; i < path->vertexCount; i++)
+    {
+        vertices[i] = sp_DecompressPathVertex(path->vertices + i);
+    }
+
+    return path->vertexCount;
+}
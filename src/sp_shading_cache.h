@@ -0,0 +1,45 @@
+#pragma once
+
+// Vertices stored for each cached path, the last slot is reserved for the
+// radiance gathered by the rest of a path which is longer than this. That
+// radiance keeps the materials the path was traced with.
+#define SP_SHADING_CACHE_MAX_PATH_VERTICES 4
+
+// Largest radiance the shared exponent encoding can represent
+#define SP_SHADING_CACHE_MAX_RADIANCE 65408.0f
+
+// Compressed sp_PathVertex, holds everything the shading stage needs to
+// evaluate the path again with different material parameters. Directions are
+// octahedral encoded and radiance uses a shared exponent, the world position
+// is dropped as materials don't depend on it.
+struct sp_CachedVertex
+{
+    u32 materialId; // U32_MAX for light vertices
+    u32 normal;
+    u32 outgoingDir;
+    u32 incomingDir;
+    u32 lightDir;
+    u32 environmentDir;
+    vec2 uv;
+    f32 incomingPdf; // Includes the russian roulette survival probability
+    u32 lightRadiance; // Emission of light vertices
+    u32 environmentRadiance;
+};
+
+struct sp_CachedPath
+{
+    sp_CachedVertex vertices[SP_SHADING_CACHE_MAX_PATH_VERTICES];
+    u32 vertexCount;
+};
+
+// Path vertices of the first samplesPerPixel samples traced for each pixel.
+// When only material parameters change the image can be shaded again from
+// these without tracing a single ray.
+struct sp_ShadingCache
+{
+    sp_CachedPath *paths;
+    u32 *pathCounts; // Per pixel
+    u32 width;
+    u32 height;
+    u32 samplesPerPixel;
+};
@@ -0,0 +1,118 @@
+void sp_InitializeTemporalHistory(
+    sp_TemporalHistory *history, MemoryArena *arena, u32 width, u32 height)
+{
+    u32 pixelCount = width * height;
+    history->radiance = AllocateArray(arena, vec4, pixelCount);
+    history->positions = AllocateArray(arena, vec4, pixelCount);
+    history->normals = AllocateArray(arena, vec4, pixelCount);
+    history->tracedRadiance = AllocateArray(arena, vec4, pixelCount);
+    history->width = width;
+    history->height = height;
+
+    // No valid history until the first image is stored
+    ClearToZero(history->positions, sizeof(vec4) * pixelCount);
+    ClearToZero(history->tracedRadiance, sizeof(vec4) * pixelCount);
+}
+
+// Called by sp_PathTraceTile and sp_ReshadeTile for every pixel they write,
+// the image plane can't be used as the history as the denoiser overwrites it
+void sp_RecordTracedRadiance(sp_TemporalHistory *history, u32 pixelIndex,
+    vec3 radiance, f32 sampleCount)
+{
+    Assert(pixelIndex < history->width * history->height);
+    history->tracedRadiance[pixelIndex] = Vec4(radiance, sampleCount);
+}
+
+// Keeps the radiance traced from the camera so that it can be reprojected
+// into the next view, must be called before the camera is reconfigured. Needs
+// the position and normal AOVs.
+void sp_StoreTemporalHistory(sp_TemporalHistory *history, sp_Camera *camera)
+{
+    ImagePlane *imagePlane = camera->imagePlane;
+    Assert(imagePlane->width == history->width &&
+           imagePlane->height == history->height);
+    Assert(imagePlane->aovs[sp_Aov_Position] != NULL);
+    Assert(imagePlane->aovs[sp_Aov_Normal] != NULL);
+
+    history->camera = *camera;
+
+    // NOTE: Pixels which are not traced again before the next view is stored
+    // are left with a sample count of 0 so that they are never reprojected
+    u32 pixelCount = history->width * history->height;
+    for (u32 i = 0; i < pixelCount; i++)
+    {
+        vec4 traced = history->tracedRadiance[i];
+        f32 sampleCount = Min(traced.w, SP_TEMPORAL_MAX_HISTORY_SAMPLES);
+        history->radiance[i] = Vec4(traced.xyz, sampleCount);
+        history->tracedRadiance[i] = Vec4(0, 0, 0, 0);
+    }
+
+    u32 length = sizeof(vec4) * pixelCount;
+    CopyMemory(history->positions, imagePlane->aovs[sp_Aov_Position], length);
+    CopyMemory(history->normals, imagePlane->aovs[sp_Aov_Normal], length);
+}
+
+// Drops the history and the radiance traced so far so that nothing is
+// reprojected into the next view, for when the scene or materials changed
+void sp_ClearTemporalHistory(sp_TemporalHistory *history)
+{
+    u32 length = sizeof(vec4) * history->width * history->height;
+    ClearToZero(history->radiance, length);
+    ClearToZero(history->positions, length);
+    ClearToZero(history->tracedRadiance, length);
+}
+
+// Finds the history pixel which saw the given first hit of the new view.
+// Returns a sample count of 0 if the point was not visible in the history or
+// failed the disocclusion or normal tests.
+sp_TemporalSample sp_LookupTemporalHistory(
+    sp_TemporalHistory *history, vec3 position, vec3 normal)
+{
+    sp_TemporalSample result = {};
+
+    // Project onto the film plane of the history camera, inverse of
+    // sp_CalculateFilmPositions
+    sp_Camera *camera = &history->camera;
+    vec3 d = position - camera->position;
+    f32 z = Dot(d, camera->basis.forward);
+    if (z <= 0.0f)
+    {
+        return result;
+    }
+
+    f32 filmDistance =
+        Dot(camera->filmCenter - camera->position, camera->basis.forward);
+    vec3 filmP = d * (filmDistance / z) + camera->position - camera->filmCenter;
+
+    f32 fx = Dot(filmP, camera->basis.right) / camera->halfFilmWidth;
+    f32 fy = Dot(filmP, camera->basis.up) / camera->halfFilmHeight;
+    f32 px = (fx * 0.5f + 0.5f) * (f32)history->width;
+    f32 py = (1.0f - (fy * 0.5f + 0.5f)) * (f32)history->height;
+    if (px < 0.0f || py < 0.0f || px >= (f32)history->width ||
+        py >= (f32)history->height)
+    {
+        return result;
+    }
+
+    u32 pixelIndex = (u32)px + (u32)py * history->width;
+    vec4 historyPosition = history->positions[pixelIndex];
+    vec3 historyNormal = history->normals[pixelIndex].xyz;
+    if (historyPosition.w == 0.0f)
+    {
+        return result;
+    }
+
+    // Reject if a different surface was seen through the pixel
+    f32 planeDistance = Abs(Dot(historyPosition.xyz - position, normal));
+    if (planeDistance > SP_TEMPORAL_MAX_PLANE_DISTANCE * z ||
+        Dot(historyNormal, normal) < SP_TEMPORAL_MIN_NORMAL_DOT)
+    {
+        return result;
+    }
+
+    vec4 radiance = history->radiance[pixelIndex];
+    result.radiance = radiance.xyz;
+    result.sampleCount = radiance.w;
+
+    return result;
+}
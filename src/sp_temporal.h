@@ -0,0 +1,42 @@
+#pragma once
+
+// History samples are capped to this many per pixel so that radiance which is
+// wrongly reprojected, e.g. view dependent reflections, fades out as new
+// samples are traced
+#define SP_TEMPORAL_MAX_HISTORY_SAMPLES 64.0f
+
+// Disocclusion test, the history hit must be within this fraction of the
+// distance to the camera from the plane of the new hit
+#define SP_TEMPORAL_MAX_PLANE_DISTANCE 0.01f
+
+// Normal mismatch test, cosine of the largest angle allowed between the
+// history normal and the new normal
+#define SP_TEMPORAL_MIN_NORMAL_DOT 0.9f
+
+// Image traced from a previous view along with the first hits of its pixels,
+// reprojected into the new view by sp_PathTraceTile so that pixels start from
+// the samples which are still valid rather than from zero
+struct sp_TemporalHistory
+{
+    // Copy of the camera the history was traced from, the camera used for
+    // the new view is usually reconfigured in place
+    sp_Camera camera;
+
+    vec4 *radiance;  // Sample count in w
+    vec4 *positions; // World space first hit, w is 0 if nothing was hit
+    vec4 *normals;
+
+    // Radiance of the view being traced before it is denoised, with the
+    // number of samples it is the mean of in w. Becomes the history radiance
+    // when the view is stored.
+    vec4 *tracedRadiance;
+
+    u32 width;
+    u32 height;
+};
+
+struct sp_TemporalSample
+{
+    vec3 radiance;
+    f32 sampleCount; // 0 if the history was rejected
+};
@@ -0,0 +1,276 @@
+#define SP_HALF_ONE 0x3C00
+
+void sp_InitializeToneMapper(
+    sp_ToneMapper *toneMapper, u32 toneMapOperator, f32 exposure)
+{
+    toneMapper->exposure = exposure;
+    toneMapper->toneMapOperator = toneMapOperator;
+}
+
+// Tone maps one channel of 4 pixels at once, the result is in [0, 1]
+internal __m128 ToneMap(sp_ToneMapper *toneMapper, __m128 radiance)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+
+    // NOTE: Max returns its second operand when either is NaN so NaNs become
+    // black here, infinities become NaN below and are clamped to 1 by min
+    __m128 x = _mm_mul_ps(radiance, _mm_set1_ps(toneMapper->exposure));
+    x = _mm_max_ps(x, _mm_setzero_ps());
+
+    switch (toneMapper->toneMapOperator)
+    {
+        case sp_ToneMapOperator_Clamp:
+            break;
+        case sp_ToneMapOperator_Reinhard:
+            x = _mm_div_ps(x, _mm_add_ps(one, x));
+            break;
+        case sp_ToneMapOperator_Aces:
+        {
+            // x(ax + b) / (x(cx + d) + e)
+            __m128 numerator = _mm_mul_ps(x,
+                _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.51f)),
+                    _mm_set1_ps(0.03f)));
+            __m128 denominator = _mm_add_ps(
+                _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.43f)),
+                                  _mm_set1_ps(0.59f))),
+                _mm_set1_ps(0.14f));
+            x = _mm_div_ps(numerator, denominator);
+            break;
+        }
+        default:
+            InvalidCodePath();
+            break;
+    }
+
+    x = _mm_min_ps(x, one);
+    return x;
+}
+
+// log2(x) of positive normal values, the exponent plus the atanh series of
+// the mantissa moved into [sqrt(0.5), sqrt(2)]
+internal __m128 Log2(__m128 x)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+
+    __m128i bits = _mm_castps_si128(x);
+    __m128 exponent = _mm_cvtepi32_ps(
+        _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    __m128 mantissa = _mm_castsi128_ps(
+        _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x7FFFFF)),
+            _mm_castps_si128(one)));
+
+    __m128 isLarge = _mm_cmpgt_ps(mantissa, _mm_set1_ps(1.41421356f));
+    mantissa = _mm_mul_ps(mantissa,
+        _mm_or_ps(_mm_and_ps(isLarge, _mm_set1_ps(0.5f)),
+            _mm_andnot_ps(isLarge, one)));
+    exponent = _mm_add_ps(exponent, _mm_and_ps(isLarge, one));
+
+    // ln(m) = 2 atanh(t) with t = (m - 1) / (m + 1), |t| <= 0.172 so the
+    // series is accurate to about 3e-8 after 4 terms
+    __m128 t = _mm_div_ps(
+        _mm_sub_ps(mantissa, one), _mm_add_ps(mantissa, one));
+    __m128 t2 = _mm_mul_ps(t, t);
+    __m128 series = _mm_add_ps(_mm_set1_ps(2.0f / 5.0f),
+        _mm_mul_ps(t2, _mm_set1_ps(2.0f / 7.0f)));
+    series = _mm_add_ps(_mm_set1_ps(2.0f / 3.0f), _mm_mul_ps(t2, series));
+    series = _mm_add_ps(_mm_set1_ps(2.0f), _mm_mul_ps(t2, series));
+    __m128 ln = _mm_mul_ps(t, series);
+
+    __m128 result =
+        _mm_add_ps(exponent, _mm_mul_ps(ln, _mm_set1_ps(1.44269504f)));
+    return result;
+}
+
+// 2^x for x in [-126, 127], the integer part goes into the exponent and the
+// rest is a Taylor series of e^(f ln 2) with |f| <= 0.5
+internal __m128 Exp2(__m128 x)
+{
+    __m128i n = _mm_cvtps_epi32(x);
+    __m128 f = _mm_sub_ps(x, _mm_cvtepi32_ps(n));
+    __m128 z = _mm_mul_ps(f, _mm_set1_ps(0.69314718f));
+
+    __m128 series = _mm_set1_ps(1.0f / 5040.0f);
+    series = _mm_add_ps(_mm_set1_ps(1.0f / 720.0f), _mm_mul_ps(z, series));
+    series = _mm_add_ps(_mm_set1_ps(1.0f / 120.0f), _mm_mul_ps(z, series));
+    series = _mm_add_ps(_mm_set1_ps(1.0f / 24.0f), _mm_mul_ps(z, series));
+    series = _mm_add_ps(_mm_set1_ps(1.0f / 6.0f), _mm_mul_ps(z, series));
+    series = _mm_add_ps(_mm_set1_ps(0.5f), _mm_mul_ps(z, series));
+    series = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(z, series));
+    series = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(z, series));
+
+    __m128 scale = _mm_castsi128_ps(
+        _mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+    __m128 result = _mm_mul_ps(series, scale);
+    return result;
+}
+
+// Exact sRGB curve for values in [0, 1], within about 1e-6 of the scalar
+// LinearToSrgb which is well below the precision of either display format
+internal __m128 LinearToSrgb(__m128 x)
+{
+    __m128 threshold = _mm_set1_ps(0.0031308f);
+    __m128 isLinear = _mm_cmple_ps(x, threshold);
+
+    __m128 linear = _mm_mul_ps(x, _mm_set1_ps(12.92f));
+
+    // NOTE: Clamped so that zero never reaches log2, those lanes are linear
+    __m128 power = Exp2(_mm_mul_ps(
+        Log2(_mm_max_ps(x, threshold)), _mm_set1_ps(1.0f / 2.4f)));
+    __m128 curve = _mm_sub_ps(
+        _mm_mul_ps(power, _mm_set1_ps(1.055f)), _mm_set1_ps(0.055f));
+
+    __m128 result = _mm_or_ps(
+        _mm_and_ps(isLinear, linear), _mm_andnot_ps(isLinear, curve));
+    return result;
+}
+
+// Nearest 8 bit code of the sRGB encoding of x in [0, 1], one per 32 bit lane.
+// Only values within about 1e-6 of the midpoint between two codes can round
+// the other way than with the exact curve.
+internal __m128i EncodeSrgb8(__m128 x)
+{
+    __m128 code = _mm_add_ps(
+        _mm_mul_ps(LinearToSrgb(x), _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f));
+    __m128i result = _mm_cvttps_epi32(code);
+    return result;
+}
+
+// IEEE 754 half float of x in [0, 1] rounded to nearest even, one per 32 bit
+// lane
+// NOTE: Only handles values in [0, 1], i.e. no overflow, infinities or NaNs
+internal __m128i EncodeHalf(__m128 x)
+{
+#if defined(__F16C__) || defined(__AVX2__)
+    __m128i result = _mm_unpacklo_epi16(
+        _mm_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT), _mm_setzero_si128());
+#else
+    __m128i bits = _mm_castps_si128(x);
+
+    // Subnormal below 2^-14, adding 0.5 lines the multiples of 2^-24 up with
+    // the bottom of the float mantissa and lets the FPU do the rounding
+    __m128i subnormal = _mm_sub_epi32(
+        _mm_castps_si128(_mm_add_ps(x, _mm_set1_ps(0.5f))),
+        _mm_castps_si128(_mm_set1_ps(0.5f)));
+
+    // Rebias the exponent from 127 to 15 and round to nearest even, a carry
+    // into the exponent is still correct
+    __m128i odd = _mm_and_si128(_mm_srli_epi32(bits, 13), _mm_set1_epi32(1));
+    __m128i normal =
+        _mm_add_epi32(bits, _mm_set1_epi32(0xFFF - ((127 - 15) << 23)));
+    normal = _mm_srli_epi32(_mm_add_epi32(normal, odd), 13);
+
+    __m128i isSubnormal = _mm_cmplt_epi32(bits, _mm_set1_epi32(113 << 23));
+    __m128i result = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal),
+        _mm_andnot_si128(isSubnormal, normal));
+#endif
+    return result;
+}
+
+// Tone maps and encodes up to 4 consecutive pixels given as one register per
+// channel, lanes past count are ignored
+internal void WriteDisplayPixels(sp_ToneMapper *toneMapper, __m128 r,
+    __m128 g, __m128 b, sp_DisplayBuffer *dst, u32 pixelIndex, u32 count)
+{
+    Assert(count > 0 && count <= 4);
+
+    r = ToneMap(toneMapper, r);
+    g = ToneMap(toneMapper, g);
+    b = ToneMap(toneMapper, b);
+
+    // Pixels packed in the layout of the display buffer
+    __m128i packed[2];
+    if (dst->format == sp_DisplayFormat_Rgba8)
+    {
+        __m128i rg = _mm_or_si128(
+            EncodeSrgb8(r), _mm_slli_epi32(EncodeSrgb8(g), 8));
+        __m128i ba = _mm_or_si128(_mm_slli_epi32(EncodeSrgb8(b), 16),
+            _mm_set1_epi32((i32)0xFF000000));
+        packed[0] = _mm_or_si128(rg, ba);
+        packed[1] = _mm_setzero_si128();
+    }
+    else
+    {
+        Assert(dst->format == sp_DisplayFormat_Rgba16f);
+        __m128i rg = _mm_or_si128(EncodeHalf(LinearToSrgb(r)),
+            _mm_slli_epi32(EncodeHalf(LinearToSrgb(g)), 16));
+        __m128i ba = _mm_or_si128(EncodeHalf(LinearToSrgb(b)),
+            _mm_set1_epi32(SP_HALF_ONE << 16));
+        packed[0] = _mm_unpacklo_epi32(rg, ba);
+        packed[1] = _mm_unpackhi_epi32(rg, ba);
+    }
+
+    u32 pixelSize = sp_GetDisplayPixelSize(dst->format);
+    u8 *pixels = (u8 *)dst->pixels + pixelIndex * pixelSize;
+    if (count == 4)
+    {
+        _mm_storeu_si128((__m128i *)pixels, packed[0]);
+        if (pixelSize == 8)
+        {
+            _mm_storeu_si128((__m128i *)(pixels + 16), packed[1]);
+        }
+    }
+    else
+    {
+        // NOTE: Nothing can be written past the last pixel of the image
+        CopyMemory(pixels, packed, count * pixelSize);
+    }
+}
+
+// Pixels of the image plane or any other width * height linear radiance
+// image, tone mapped 4 at a time with one register per channel
+void sp_ToneMapImage(
+    sp_ToneMapper *toneMapper, vec4 *pixels, sp_DisplayBuffer *dst)
+{
+    u32 pixelCount = dst->width * dst->height;
+    for (u32 i = 0; i < pixelCount; i += 4)
+    {
+        u32 count = MinU32(pixelCount - i, 4);
+
+        // NOTE: The last pixels are padded with black so that nothing is
+        // read past the end of the image
+        vec4 *src = pixels + i;
+        vec4 padded[4] = {};
+        if (count < 4)
+        {
+            CopyMemory(padded, src, count * sizeof(vec4));
+            src = padded;
+        }
+
+        __m128 r = _mm_loadu_ps(src[0].data);
+        __m128 g = _mm_loadu_ps(src[1].data);
+        __m128 b = _mm_loadu_ps(src[2].data);
+        __m128 a = _mm_loadu_ps(src[3].data);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+
+        WriteDisplayPixels(toneMapper, r, g, b, dst, i, count);
+    }
+}
+
+// Resolves the mean of every pixel straight into the display buffer without
+// going through a full precision image
+void sp_ToneMapAccumulationBuffer(sp_ToneMapper *toneMapper,
+    sp_AccumulationBuffer *buffer, sp_DisplayBuffer *dst)
+{
+    Assert(buffer->width == dst->width && buffer->height == dst->height);
+
+    u32 pixelCount = dst->width * dst->height;
+    for (u32 i = 0; i < pixelCount; i += 4)
+    {
+        u32 count = MinU32(pixelCount - i, 4);
+
+        vec3 radiance[4] = {};
+        for (u32 j = 0; j < count; j++)
+        {
+            radiance[j] = sp_ResolveAccumulationPixel(buffer, i + j);
+        }
+
+        __m128 r = _mm_setr_ps(
+            radiance[0].x, radiance[1].x, radiance[2].x, radiance[3].x);
+        __m128 g = _mm_setr_ps(
+            radiance[0].y, radiance[1].y, radiance[2].y, radiance[3].y);
+        __m128 b = _mm_setr_ps(
+            radiance[0].z, radiance[1].z, radiance[2].z, radiance[3].z);
+
+        WriteDisplayPixels(toneMapper, r, g, b, dst, i, count);
+    }
+}
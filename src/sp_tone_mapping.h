@@ -0,0 +1,45 @@
+#pragma once
+
+enum
+{
+    // Radiance is only clamped to [0, 1]
+    sp_ToneMapOperator_Clamp,
+
+    // x / (1 + x) per channel, matches post_processing.frag.glsl
+    sp_ToneMapOperator_Reinhard,
+
+    // Krzysztof Narkowicz's fit of the ACES filmic curve
+    sp_ToneMapOperator_Aces,
+};
+
+enum
+{
+    // 8 bits per channel, 4 bytes per pixel
+    sp_DisplayFormat_Rgba8,
+
+    // IEEE 754 half floats, 8 bytes per pixel
+    sp_DisplayFormat_Rgba16f,
+};
+
+// Converts linear radiance into sRGB encoded display values
+struct sp_ToneMapper
+{
+    f32 exposure;
+    u32 toneMapOperator;
+};
+
+// Tone mapped and sRGB encoded image ready to be displayed or written out,
+// alpha is always 1
+struct sp_DisplayBuffer
+{
+    void *pixels;
+    u32 width;
+    u32 height;
+    u32 format;
+};
+
+inline u32 sp_GetDisplayPixelSize(u32 format)
+{
+    u32 result = (format == sp_DisplayFormat_Rgba16f) ? 8 : 4;
+    return result;
+}
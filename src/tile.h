@@ -40,3 +40,54 @@ inline u32 ComputeTiles(u32 totalWidth, u32 totalHeight, u32 tileWidth,
     u32 totalTileCount = MinU32(tileCountY * tileCountX, maxTiles);
     return totalTileCount;
 }
+
+// Same as ComputeTiles but only generates the tiles which intersect the
+// region, clipped to it, so that only the pixels of interest are traced.
+// Tiles stay aligned to the full image grid so a pixel ends up in the same
+// tile whatever the region is.
+inline u32 ComputeTilesInRegion(u32 totalWidth, u32 totalHeight,
+    u32 tileWidth, u32 tileHeight, Tile region, Tile *tiles, u32 maxTiles)
+{
+    u32 minX = region.minX;
+    u32 minY = region.minY;
+    u32 maxX = MinU32(region.maxX, totalWidth);
+    u32 maxY = MinU32(region.maxY, totalHeight);
+    if (minX >= maxX || minY >= maxY)
+    {
+        return 0;
+    }
+
+    u32 count = 0;
+    for (u32 tileY = minY / tileHeight; tileY <= (maxY - 1) / tileHeight;
+         ++tileY)
+    {
+        for (u32 tileX = minX / tileWidth; tileX <= (maxX - 1) / tileWidth;
+             ++tileX)
+        {
+            if (count >= maxTiles)
+            {
+                return count;
+            }
+
+            Tile tile;
+            tile.minX = MaxU32(tileX * tileWidth, minX);
+            tile.minY = MaxU32(tileY * tileHeight, minY);
+            tile.maxX = MinU32((tileX + 1) * tileWidth, maxX);
+            tile.maxY = MinU32((tileY + 1) * tileHeight, maxY);
+
+            tiles[count++] = tile;
+        }
+    }
+
+    return count;
+}
+
+// Distributed renders split the tiles of the image between processes, tiles
+// are interleaved rather than split into contiguous blocks so that each
+// process gets a similar share of the expensive parts of the image
+inline b32 IsTileInSubset(u32 tileIndex, u32 subsetIndex, u32 subsetCount)
+{
+    Assert(subsetIndex < subsetCount);
+    b32 result = (tileIndex % subsetCount == subsetIndex);
+    return result;
+}
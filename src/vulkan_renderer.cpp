@@ -387,21 +387,67 @@ internal VkPipelineLayout VulkanCreatePipelineLayout(VkDevice device,
     return layout;
 }
 
-internal void VulkanCopyImageFromCPU(VulkanRenderer *renderer)
+// Copies the regions of the CPU ray tracer image which have changed, the rest
+// of the image keeps what was uploaded before
+internal void VulkanCopyImageFromCPU(
+    VulkanRenderer *renderer, Tile *regions, u32 regionCount)
 {
+    if (regionCount == 0)
+    {
+        return;
+    }
+
     u32 width = RAY_TRACER_WIDTH;
-    u32 height = RAY_TRACER_HEIGHT;
+    VkImage image = renderer->images[Image_CpuRayTracer].handle;
 
-    VulkanTransitionImageLayout(renderer->images[Image_CpuRayTracer].handle,
-        VK_IMAGE_LAYOUT_UNDEFINED,
+    VulkanTransitionImageLayout(image,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, renderer->device,
         renderer->commandPool, renderer->graphicsQueue);
 
-    VulkanCopyBufferToImage(renderer->device, renderer->commandPool,
-        renderer->graphicsQueue, renderer->imageUploadBuffer.handle,
-        renderer->images[Image_CpuRayTracer].handle, width, height, 0);
+    VkCommandBuffer commandBuffer = VulkanBeginSingleTimeCommands(
+        renderer->device, renderer->commandPool);
+
+    // Regions are recorded in batches to bound the stack space used
+    VkBufferImageCopy imageCopies[64];
+    u32 regionIndex = 0;
+    while (regionIndex < regionCount)
+    {
+        u32 batchCount =
+            MinU32(regionCount - regionIndex, ArrayCount(imageCopies));
+        for (u32 i = 0; i < batchCount; i++)
+        {
+            Tile region = regions[regionIndex + i];
+            Assert(region.maxX <= width);
+            Assert(region.maxY <= RAY_TRACER_HEIGHT);
+
+            VkBufferImageCopy imageCopy = {};
+            imageCopy.bufferOffset =
+                sizeof(vec4) * ((u64)region.minY * width + region.minX);
+            imageCopy.bufferRowLength = width;
+            imageCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            imageCopy.imageSubresource.mipLevel = 0;
+            imageCopy.imageSubresource.baseArrayLayer = 0;
+            imageCopy.imageSubresource.layerCount = 1;
+            imageCopy.imageOffset.x = (i32)region.minX;
+            imageCopy.imageOffset.y = (i32)region.minY;
+            imageCopy.imageExtent.width = region.maxX - region.minX;
+            imageCopy.imageExtent.height = region.maxY - region.minY;
+            imageCopy.imageExtent.depth = 1;
+            imageCopies[i] = imageCopy;
+        }
+
+        vkCmdCopyBufferToImage(commandBuffer,
+            renderer->imageUploadBuffer.handle, image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, batchCount, imageCopies);
+
+        regionIndex += batchCount;
+    }
 
-    VulkanTransitionImageLayout(renderer->images[Image_CpuRayTracer].handle,
+    VulkanEndSingleTimeCommands(commandBuffer, renderer->device,
+        renderer->commandPool, renderer->graphicsQueue);
+
+    VulkanTransitionImageLayout(image,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, renderer->device,
         renderer->commandPool, renderer->graphicsQueue);
@@ -1162,6 +1208,13 @@ internal void VulkanInit(VulkanRenderer *renderer, GLFWwindow *window)
         VulkanTransitionImageLayout(renderer->images[Image_CpuRayTracer].handle,
             VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
             renderer->device, renderer->commandPool, renderer->graphicsQueue);
+
+        // NOTE: Kept in the shader read layout in between uploads, which only
+        // copy the regions that changed
+        VulkanTransitionImageLayout(renderer->images[Image_CpuRayTracer].handle,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, renderer->device,
+            renderer->commandPool, renderer->graphicsQueue);
     }
 
     // Create image for compute shader
@@ -291,6 +291,194 @@ void TestBvh()
     TEST_ASSERT_TRUE(result2.errorOccurred);
 }
 
+void TestRefitBvh()
+{
+    // Given a BVH of a grid of 4x4 AABBs
+    vec3 aabbMin[16] = {};
+    vec3 aabbMax[16] = {};
+
+    GenerateAabbGrid4x4(aabbMin, aabbMax, ArrayCount(aabbMin));
+
+    bvh_Tree worldBvh =
+        bvh_CreateTree(&memoryArena, aabbMin, aabbMax, ArrayCount(aabbMin));
+
+    // When we move every AABB up slightly and refit the tree
+    for (u32 i = 0; i < ArrayCount(aabbMin); ++i)
+    {
+        aabbMin[i] += Vec3(0, 1, 0);
+        aabbMax[i] += Vec3(0, 1, 0);
+    }
+
+    bvh_RefitResult result = bvh_RefitTree(&worldBvh, aabbMin, aabbMax);
+
+    // Then the root node bounds are updated and all child nodes are still
+    // contained within their parents
+    AssertWithinVec3(EPSILON, Vec3(-10.5f, 0.5f, -10.5f), worldBvh.root->min);
+    AssertWithinVec3(EPSILON, Vec3(10.5f, 1.5f, 10.5f), worldBvh.root->max);
+    TEST_ASSERT_TRUE(
+        CheckNodeAabbContainsChildNodeAabbsRecursive(worldBvh.root));
+
+    // And the tree doesn't need to be rebuilt
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, worldBvh.buildCost, result.cost);
+    TEST_ASSERT_FALSE(result.rebuildRequired);
+}
+
+void TestRefitBvhRequiresRebuild()
+{
+    // Given a BVH of a grid of 4x4 AABBs
+    vec3 aabbMin[16] = {};
+    vec3 aabbMax[16] = {};
+
+    GenerateAabbGrid4x4(aabbMin, aabbMax, ArrayCount(aabbMin));
+
+    bvh_Tree worldBvh =
+        bvh_CreateTree(&memoryArena, aabbMin, aabbMax, ArrayCount(aabbMin));
+
+    // When we mirror every other AABB through the origin, so that siblings in
+    // the tree end up on opposite sides of the grid, and refit
+    for (u32 i = 0; i < ArrayCount(aabbMin); i += 2)
+    {
+        vec3 min = aabbMin[i];
+        aabbMin[i] = -aabbMax[i];
+        aabbMax[i] = -min;
+    }
+
+    bvh_RefitResult result = bvh_RefitTree(&worldBvh, aabbMin, aabbMax);
+
+    // Then the tree quality has degraded enough that it should be rebuilt
+    TEST_ASSERT_TRUE(
+        CheckNodeAabbContainsChildNodeAabbsRecursive(worldBvh.root));
+    TEST_ASSERT_TRUE(result.cost > worldBvh.buildCost);
+    TEST_ASSERT_TRUE(result.rebuildRequired);
+}
+
+void TestCreateEmptyBvh()
+{
+    // When we build a BVH with no AABBs
+    bvh_Tree tree = bvh_CreateTree(&memoryArena, NULL, NULL, 0);
+
+    // Then the tree has no root node
+    TEST_ASSERT_NULL(tree.root);
+    TEST_ASSERT_EQUAL_UINT32(0, tree.leafCount);
+
+    // And refitting it does nothing
+    bvh_RefitResult result = bvh_RefitTree(&tree, NULL, NULL);
+    TEST_ASSERT_FALSE(result.rebuildRequired);
+}
+
+u32 CheckCollapsedLeavesRecursive(
+    bvh_Node *node, u32 *leafItems, vec3 *aabbMin, vec3 *aabbMax)
+{
+    u32 itemCount = 0;
+    if (node->children[0] != NULL)
+    {
+        for (u32 i = 0; i < BVH_CHILDREN_PER_NODE; ++i)
+        {
+            if (node->children[i] != NULL)
+            {
+                itemCount += CheckCollapsedLeavesRecursive(
+                    node->children[i], leafItems, aabbMin, aabbMax);
+            }
+        }
+    }
+    else
+    {
+        // Check that the leaf bounds contain all of its items
+        for (u32 i = 0; i < node->itemCount; ++i)
+        {
+            u32 item = leafItems[node->leafIndex + i];
+            TEST_ASSERT_TRUE(AabbContainsPoint(node->min, node->max,
+                aabbMin[item]));
+            TEST_ASSERT_TRUE(AabbContainsPoint(node->min, node->max,
+                aabbMax[item]));
+        }
+        itemCount = node->itemCount;
+    }
+
+    return itemCount;
+}
+
+void TestCollapseBvhLeaves()
+{
+    // Given a BVH of a grid of 4x4 AABBs
+    vec3 aabbMin[16] = {};
+    vec3 aabbMax[16] = {};
+
+    GenerateAabbGrid4x4(aabbMin, aabbMax, ArrayCount(aabbMin));
+
+    bvh_Tree worldBvh =
+        bvh_CreateTree(&memoryArena, aabbMin, aabbMax, ArrayCount(aabbMin));
+
+    // When we collapse its leaves into groups of up to 4 items
+    u32 leafItems[16] = {};
+    bvh_CollapseLeaves(&worldBvh, 4, 4, leafItems);
+
+    // Then every item is stored in exactly one leaf
+    u32 itemCounts[16] = {};
+    for (u32 i = 0; i < ArrayCount(leafItems); ++i)
+    {
+        TEST_ASSERT_LESS_THAN_UINT32(16, leafItems[i]);
+        itemCounts[leafItems[i]]++;
+    }
+    for (u32 i = 0; i < ArrayCount(itemCounts); ++i)
+    {
+        TEST_ASSERT_EQUAL_UINT32(1, itemCounts[i]);
+    }
+
+    // And leaves contain multiple items which are within their bounds
+    TEST_ASSERT_EQUAL_UINT32(16, CheckCollapsedLeavesRecursive(
+        worldBvh.root, leafItems, aabbMin, aabbMax));
+    TEST_ASSERT_EQUAL_UINT32(4, worldBvh.root->children[0]->itemCount);
+
+    // And a ray through one of the grid rows returns the leaves to test
+    bvh_Node *intersectedNodes[4];
+    bvh_IntersectRayResult result = bvh_IntersectRay(&worldBvh,
+        Vec3(-20, 0, -10), Vec3(1, 0, 0), intersectedNodes, 4);
+    TEST_ASSERT_FALSE(result.errorOccurred);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, result.count);
+}
+
+void TestRayTraversalMatchesIntersectRay()
+{
+    // Given a BVH of a grid of 4x4 AABBs
+    vec3 aabbMin[16] = {};
+    vec3 aabbMax[16] = {};
+
+    GenerateAabbGrid4x4(aabbMin, aabbMax, ArrayCount(aabbMin));
+
+    bvh_Tree worldBvh =
+        bvh_CreateTree(&memoryArena, aabbMin, aabbMax, ArrayCount(aabbMin));
+
+    vec3 rayOrigin = Vec3(-20, 0, -10);
+    vec3 rayDirection = Vec3(1, 0, 0);
+
+    bvh_Node *intersectedNodes[16];
+    bvh_IntersectRayResult expected = bvh_IntersectRay(&worldBvh, rayOrigin,
+        rayDirection, intersectedNodes, ArrayCount(intersectedNodes));
+
+    // When we traverse the leaves intersected by a ray one at a time
+    bvh_RayTraversal traversal;
+    bvh_BeginRayTraversal(&traversal, &worldBvh, rayOrigin, rayDirection);
+
+    u32 count = 0;
+    bvh_Node *leaf = bvh_NextIntersectedLeaf(&traversal);
+    while (leaf != NULL)
+    {
+        // Then we visit the same leaves as bvh_IntersectRay
+        b32 found = false;
+        for (u32 i = 0; i < expected.count; ++i)
+        {
+            found |= (intersectedNodes[i] == leaf);
+        }
+        TEST_ASSERT_TRUE(found);
+
+        count++;
+        leaf = bvh_NextIntersectedLeaf(&traversal);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(expected.count, count);
+}
+
 int main()
 {
     InitializeMemoryArena(
@@ -305,6 +493,11 @@ int main()
     RUN_TEST(TestBvhAllLeavesReachable);
     RUN_TEST(TestBvhIntermediateNodesContainChildNodes);
     RUN_TEST(TestBvhRayIntersectGrid);
+    RUN_TEST(TestRefitBvh);
+    RUN_TEST(TestRefitBvhRequiresRebuild);
+    RUN_TEST(TestCreateEmptyBvh);
+    RUN_TEST(TestCollapseBvhLeaves);
+    RUN_TEST(TestRayTraversalMatchesIntersectRay);
 
     free(memoryArena.base);
 
@@ -1,6 +1,7 @@
 #include "unity.h"
 
 #include "platform.h"
+#include "intrinsics.h"
 #include "math_lib.h"
 #include "tile.h"
 #include "memory_pool.h"
@@ -9,9 +10,17 @@
 #include "asset_loader/asset_loader.h"
 #include "image.h"
 #include "mesh.h"
+#include "sp_sampler.h"
 #include "sp_scene.h"
 #include "sp_material_system.h"
+#include "sp_radiance_cache.h"
+#include "sp_path_guiding.h"
+#include "sp_accumulation.h"
+#include "sp_shading_cache.h"
+#include "sp_tone_mapping.h"
 #include "simd_path_tracer.h"
+#include "sp_temporal.h"
+#include "sp_denoiser.h"
 #include "sp_metrics.h"
 
 #include "simd.h"
@@ -19,18 +28,33 @@
 
 #include "custom_assertions.h"
 
+#ifdef PLATFORM_LINUX
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 #include "memory_pool.cpp"
 #include "ray_intersection.cpp"
 
 #define SAMPLES_PER_PIXEL 1
+#define MAX_BOUNCES 3
+#define RUSSIAN_ROULETTE_MIN_BOUNCES 3
 
 // Include cpp file for faster unity build
 #include "bvh.cpp"
+#include "sp_sampler.cpp"
 #include "sp_scene.cpp"
 #include "sp_material_system.cpp"
+#include "sp_radiance_cache.cpp"
+#include "sp_path_guiding.cpp"
+#include "sp_accumulation.cpp"
+#include "sp_shading_cache.cpp"
+#include "sp_tone_mapping.cpp"
+#include "sp_temporal.cpp"
 #include "simd_path_tracer.cpp"
+#include "sp_denoiser.cpp"
 
-#define MEMORY_ARENA_SIZE Megabytes(1)
+#define MEMORY_ARENA_SIZE Megabytes(16)
 
 MemoryArena memoryArena;
 
@@ -46,6 +70,106 @@ void tearDown(void)
     // clean stuff up here
 }
 
+// Unit quad in the XY plane facing +Z, the tests scale and place it to build
+// their scenes out of planes
+global VertexPNT g_QuadVertices[] = {
+    {Vec3(-1, -1, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+    {Vec3(1, -1, 0), Vec3(0, 0, 1), Vec2(1, 0)},
+    {Vec3(1, 1, 0), Vec3(0, 0, 1), Vec2(1, 1)},
+    {Vec3(-1, 1, 0), Vec3(0, 0, 1), Vec2(0, 1)},
+};
+
+global u32 g_QuadIndices[] = { 0, 1, 2, 2, 3, 0 };
+
+// Camera, scene, materials and context shared by the path tracer tests.
+// Must not be copied as the context points into it.
+struct TestScene
+{
+    ImagePlane imagePlane;
+    sp_Camera camera;
+    sp_Scene scene;
+    sp_Mesh quad;
+    sp_MaterialSystem materialSystem;
+    sp_Context ctx;
+};
+
+internal void InitializeTestScene(TestScene *test)
+{
+    *test = {};
+    sp_InitializeScene(&test->scene, &memoryArena);
+
+    test->quad = sp_CreateMesh(g_QuadVertices, ArrayCount(g_QuadVertices),
+        g_QuadIndices, ArrayCount(g_QuadIndices));
+    MemoryArena bvhNodeArena = SubAllocateArena(&memoryArena, Kilobytes(4));
+    MemoryArena tempArena = SubAllocateArena(&memoryArena, Kilobytes(8));
+    sp_BuildMeshMidphase(&test->quad, &bvhNodeArena, &tempArena);
+
+    test->ctx.camera = &test->camera;
+    test->ctx.scene = &test->scene;
+    test->ctx.materialSystem = &test->materialSystem;
+}
+
+// Camera at position looking down -Z onto an image plane of width * height
+// pixels
+internal void ConfigureTestCamera(TestScene *test, vec4 *pixels, u32 width,
+    u32 height, vec3 position, f32 filmDistance)
+{
+    test->imagePlane.pixels = pixels;
+    test->imagePlane.width = width;
+    test->imagePlane.height = height;
+    sp_ConfigureCamera(&test->camera, &test->imagePlane, position, Quat(),
+        filmDistance);
+}
+
+// Untextured material, id 0 is the background material
+internal void RegisterTestMaterial(TestScene *test, u32 materialId,
+    vec3 albedo, vec3 emission, f32 roughness)
+{
+    sp_Material material = {};
+    material.albedo = albedo;
+    material.emission = emission;
+    material.albedoTexture = U32_MAX;
+    material.emissionTexture = U32_MAX;
+    material.roughness = roughness;
+    sp_RegisterMaterial(&test->materialSystem, material, materialId);
+}
+
+// Rough plane filling the 8x4 image lit by a small sphere light, which gives
+// every pixel a noisy estimate. Returns the material id of the plane.
+internal u32 CreateLitPlaneScene(TestScene *test, vec4 *pixels)
+{
+    InitializeTestScene(test);
+    ConfigureTestCamera(test, pixels, 8, 4, Vec3(0, 0, 1), 0.5f);
+
+    u32 materialId = 1;
+    sp_AddObjectToScene(
+        &test->scene, test->quad, materialId, Vec3(0), Quat(), Vec3(100));
+    sp_AddSphereLight(&test->scene, Vec3(0.5, 0.5, 0.5), 0.1f, Vec3(20));
+    sp_BuildSceneBroadphase(&test->scene);
+
+    RegisterTestMaterial(test, 0, Vec3(0), Vec3(0.1), 0.0f);
+    RegisterTestMaterial(test, materialId, Vec3(0.8), Vec3(0), 0.5f);
+
+    test->ctx.samplerType = sp_SamplerType_Sobol;
+    return materialId;
+}
+
+// Two facing emissive diffuse planes at z = -1 and z = 1, a path starting
+// between them only escapes through their edges
+internal void CreateFacingPlanesScene(TestScene *test, f32 planeScale)
+{
+    InitializeTestScene(test);
+
+    u32 materialId = 1;
+    sp_AddObjectToScene(&test->scene, test->quad, materialId, Vec3(0, 0, -1),
+        Quat(), Vec3(planeScale));
+    sp_AddObjectToScene(&test->scene, test->quad, materialId, Vec3(0, 0, 1),
+        Quat(Vec3(0, 1, 0), PI), Vec3(planeScale));
+    sp_BuildSceneBroadphase(&test->scene);
+
+    RegisterTestMaterial(test, materialId, Vec3(0.5), Vec3(1), 1.0f);
+}
+
 void TestPathTraceSingleColor()
 {
     // Given a context
@@ -134,145 +258,1506 @@ void TestPathTraceTile()
     }
 }
 
-void TestConfigureCamera()
+void TestPathTraceTilePreview()
+{
+    // Given a context which only traces every other pixel
+    vec4 pixels[36] = {};
+    ImagePlane imagePlane = {};
+    imagePlane.pixels = pixels;
+    imagePlane.width = 6;
+    imagePlane.height = 6;
+
+    sp_Camera camera = {};
+    camera.imagePlane = &imagePlane;
+
+    sp_Scene scene = {};
+
+    sp_MaterialSystem materialSystem = {};
+
+    sp_Context ctx = {};
+    ctx.camera = &camera;
+    ctx.scene = &scene;
+    ctx.materialSystem = &materialSystem;
+    ctx.pixelStride = 2;
+
+    RandomNumberGenerator rng = {};
+
+    sp_Metrics metrics = {};
+
+    // When we path trace a tile
+    Tile tile = {};
+    tile.maxX = 5;
+    tile.maxY = 3;
+    sp_PathTraceTile(&ctx, tile, &rng, &metrics);
+
+    // Then only a quarter of the pixels are traced, rounded up
+    TEST_ASSERT_EQUAL_UINT64(3 * 2, metrics.values[sp_Metric_PathsTraced]);
+
+    // And every pixel of the tile is filled from the traced pixels
+    for (u32 y = 0; y < imagePlane.height; y++)
+    {
+        for (u32 x = 0; x < imagePlane.width; x++)
+        {
+            b32 isInTile = (x < tile.maxX && y < tile.maxY);
+            vec4 expected = isInTile ? Vec4(1, 0, 1, 1) : Vec4(0);
+            AssertWithinVec4(EPSILON, expected, pixels[x + y * 6]);
+        }
+    }
+}
+
+void TestPathTraceTileCancelled()
+{
+    // Given a context for a view which is no longer wanted
+    vec4 pixels[16] = {};
+    ImagePlane imagePlane = {};
+    imagePlane.pixels = pixels;
+    imagePlane.width = 4;
+    imagePlane.height = 4;
+
+    sp_Camera camera = {};
+    camera.imagePlane = &imagePlane;
+
+    sp_Scene scene = {};
+
+    sp_MaterialSystem materialSystem = {};
+
+    sp_Context ctx = {};
+    ctx.camera = &camera;
+    ctx.scene = &scene;
+    ctx.materialSystem = &materialSystem;
+    ctx.isCancelled = true;
+
+    RandomNumberGenerator rng = {};
+
+    sp_Metrics metrics = {};
+
+    // When we path trace a tile
+    Tile tile = {};
+    tile.maxX = 4;
+    tile.maxY = 4;
+    sp_PathTraceTile(&ctx, tile, &rng, &metrics);
+
+    // Then no paths are traced and the pixels are left untouched
+    TEST_ASSERT_EQUAL_UINT64(0, metrics.values[sp_Metric_PathsTraced]);
+    for (u32 i = 0; i < 16; i++)
+    {
+        AssertWithinVec4(EPSILON, Vec4(0), pixels[i]);
+    }
+}
+
+void TestTemporalReprojection()
+{
+    // Given an image of a diffuse plane lit by a white background
+    vec4 pixels[64] = {};
+    vec4 aovs[SP_MAX_AOVS][64] = {};
+    TestScene test;
+    InitializeTestScene(&test);
+    ConfigureTestCamera(&test, pixels, 8, 8, Vec3(0, 0, 1), 1.0f);
+    for (u32 i = 0; i < SP_MAX_AOVS; i++)
+    {
+        test.imagePlane.aovs[i] = aovs[i];
+    }
+
+    u32 materialId = 1;
+    sp_AddObjectToScene(
+        &test.scene, test.quad, materialId, Vec3(0), Quat(), Vec3(100));
+    sp_BuildSceneBroadphase(&test.scene);
+
+    RegisterTestMaterial(&test, 0, Vec3(0), Vec3(1), 0.0f);
+    RegisterTestMaterial(&test, materialId, Vec3(0.5), Vec3(0), 1.0f);
+
+    RandomNumberGenerator rng = { 0x1234567 };
+    sp_Metrics metrics = {};
+
+    Tile tile = {};
+    tile.maxX = 8;
+    tile.maxY = 8;
+
+    sp_TemporalHistory history = {};
+    sp_InitializeTemporalHistory(&history, &memoryArena, 8, 8);
+    test.ctx.temporalHistory = &history;
+    test.ctx.samplesPerPixel = 8;
+    sp_PathTraceTile(&test.ctx, tile, &rng, &metrics);
+    TEST_ASSERT_EQUAL_UINT64(0, metrics.values[sp_Metric_PixelsReprojected]);
+
+    // And the displayed pixel is overwritten, e.g. by the denoiser
+    u32 pixelIndex = 5 + 2 * 8;
+    vec3 tracedRadiance = pixels[pixelIndex].xyz;
+    pixels[pixelIndex] = Vec4(100, 100, 100, 1);
+
+    sp_StoreTemporalHistory(&history, &test.camera);
+
+    // Then a point on the plane maps back to the pixel which saw it, with
+    // the radiance that was traced rather than the displayed one
+    vec3 position = aovs[sp_Aov_Position][pixelIndex].xyz;
+    sp_TemporalSample sample =
+        sp_LookupTemporalHistory(&history, position, Vec3(0, 0, 1));
+    TEST_ASSERT_EQUAL_FLOAT(8.0f, sample.sampleCount);
+    AssertWithinVec3(EPSILON, tracedRadiance, sample.radiance);
+
+    // And surfaces that weren't visible or face another way are rejected
+    TEST_ASSERT_EQUAL_FLOAT(0.0f,
+        sp_LookupTemporalHistory(&history, position + Vec3(0, 0, 0.5),
+            Vec3(0, 0, 1)).sampleCount);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f,
+        sp_LookupTemporalHistory(&history, position, Vec3(1, 0, 0))
+            .sampleCount);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f,
+        sp_LookupTemporalHistory(&history, Vec3(0, 0, 2), Vec3(0, 0, 1))
+            .sampleCount);
+
+    // When the camera moves slightly and the image is traced again with a
+    // single sample into an accumulation buffer, as the passes of a final
+    // render are
+    ConfigureTestCamera(&test, pixels, 8, 8, Vec3(0.05, 0, 1), 1.0f);
+    test.ctx.samplesPerPixel = 1;
+    ClearImagePlane(&test.imagePlane);
+    sp_AccumulationBuffer accumulationBuffer = {};
+    sp_InitializeAccumulationBuffer(&accumulationBuffer, &memoryArena, 8, 8);
+    test.ctx.accumulationBuffer = &accumulationBuffer;
+    metrics = {};
+    sp_PathTraceTile(&test.ctx, tile, &rng, &metrics);
+
+    // Then most pixels start from the previous samples, which are weighted
+    // no more than the new ones
+    TEST_ASSERT_TRUE(metrics.values[sp_Metric_PixelsReprojected] >= 48);
+    TEST_ASSERT_EQUAL_FLOAT(2.0f, aovs[sp_Aov_Variance][pixelIndex].y);
+
+    // And the displayed pixel blends the history with the accumulated samples
+    sample = sp_LookupTemporalHistory(&history,
+        aovs[sp_Aov_Position][pixelIndex].xyz,
+        aovs[sp_Aov_Normal][pixelIndex].xyz);
+    TEST_ASSERT_EQUAL_FLOAT(8.0f, sample.sampleCount);
+    vec3 expected = (sp_ResolveAccumulationPixel(
+                         &accumulationBuffer, pixelIndex) +
+                        sample.radiance) *
+                    0.5f;
+    AssertWithinVec3(EPSILON, expected, pixels[pixelIndex].xyz);
+    TEST_ASSERT_EQUAL_UINT64(
+        1, accumulationBuffer.pixels[pixelIndex].sampleCount);
+
+    // When the history is cleared, as it is after the scene changes
+    sp_ClearTemporalHistory(&history);
+    ClearImagePlane(&test.imagePlane);
+    metrics = {};
+    sp_PathTraceTile(&test.ctx, tile, &rng, &metrics);
+
+    // Then nothing is reprojected
+    TEST_ASSERT_EQUAL_UINT64(0, metrics.values[sp_Metric_PixelsReprojected]);
+}
+
+// Traces the samples and tiles of the range into a new accumulation buffer
+// and writes it to path as a partial file, like a render farm process would
+internal b32 RenderPartialFile(sp_Context *ctx, Tile *tiles, u32 tileCount,
+    sp_PartialRenderRange range, const char *path)
+{
+    ImagePlane *imagePlane = ctx->camera->imagePlane;
+    sp_AccumulationBuffer buffer = {};
+    sp_InitializeAccumulationBuffer(
+        &buffer, &memoryArena, imagePlane->width, imagePlane->height);
+
+    ctx->accumulationBuffer = &buffer;
+    ctx->firstSample = range.firstSample;
+    ctx->samplesPerPixel = range.sampleCount;
+
+    RandomNumberGenerator rng = { 0x1234567 };
+    sp_Metrics metrics = {};
+    for (u32 i = 0; i < tileCount; i++)
+    {
+        if (IsTileInSubset(i, range.tileSubsetIndex, range.tileSubsetCount))
+        {
+            sp_PathTraceTile(ctx, tiles[i], &rng, &metrics);
+        }
+    }
+
+    u64 fileSize = sp_GetPartialFileSize(&buffer);
+    u8 *fileData = AllocateArray(&memoryArena, u8, fileSize);
+    sp_WritePartialFile(&buffer, range, fileData, fileSize);
+
+    b32 result = false;
+    FILE *file = fopen(path, "wb");
+    if (file != NULL)
+    {
+        result = (fwrite(fileData, 1, fileSize, file) == fileSize);
+        fclose(file);
+    }
+
+    return result;
+}
+
+void TestPartialRenderMerge()
+{
+    // Given a rough plane lit by a small sphere light
+    vec4 pixels[32] = {};
+    TestScene test;
+    CreateLitPlaneScene(&test, pixels);
+    u32 width = test.imagePlane.width;
+    u32 height = test.imagePlane.height;
+
+    Tile tiles[2];
+    u32 tileCount =
+        ComputeTiles(width, height, 4, 4, tiles, ArrayCount(tiles));
+    TEST_ASSERT_EQUAL_UINT32(2, tileCount);
+
+    RandomNumberGenerator rng = { 0x1234567 };
+    sp_Metrics metrics = {};
+
+    // And a reference render of 4 samples per pixel in a single process
+    sp_AccumulationBuffer reference = {};
+    sp_InitializeAccumulationBuffer(&reference, &memoryArena, width, height);
+    test.ctx.accumulationBuffer = &reference;
+    test.ctx.samplesPerPixel = 4;
+    for (u32 i = 0; i < tileCount; i++)
+    {
+        sp_PathTraceTile(&test.ctx, tiles[i], &rng, &metrics);
+    }
+    vec4 expectedPixels[32];
+    CopyMemory(expectedPixels, pixels, sizeof(pixels));
+
+    // When the same samples are split between 4 child processes by sample
+    // range and tile subset, each writing a partial file to disk
+    u64 fileSize = sp_GetPartialFileSize(&reference);
+    char paths[4][64];
+#ifdef PLATFORM_LINUX
+    pid_t children[4];
+    fflush(stdout);
+#endif
+    for (u32 process = 0; process < 4; process++)
+    {
+        snprintf(paths[process], sizeof(paths[process]),
+            "test_partial_%u.bin", process);
+
+        sp_PartialRenderRange range = {};
+        range.firstSample = (process / 2) * 2;
+        range.sampleCount = 2;
+        range.tileSubsetIndex = process % 2;
+        range.tileSubsetCount = 2;
+
+#ifdef PLATFORM_LINUX
+        children[process] = fork();
+        TEST_ASSERT_TRUE(children[process] >= 0);
+        if (children[process] == 0)
+        {
+            // NOTE: _exit so that the child doesn't flush the test runner's
+            // output a second time
+            b32 success = RenderPartialFile(
+                &test.ctx, tiles, tileCount, range, paths[process]);
+            _exit(success ? 0 : 1);
+        }
+#else
+        // TODO: Launch separate processes on Windows, the partials are still
+        // only exchanged through files on disk
+        TEST_ASSERT_TRUE(RenderPartialFile(
+            &test.ctx, tiles, tileCount, range, paths[process]));
+#endif
+    }
+
+#ifdef PLATFORM_LINUX
+    for (u32 process = 0; process < 4; process++)
+    {
+        int status = 0;
+        TEST_ASSERT_EQUAL_INT(
+            children[process], waitpid(children[process], &status, 0));
+        TEST_ASSERT_TRUE(WIFEXITED(status));
+        TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(status));
+    }
+#endif
+
+    // And the partial files are read back and merged
+    sp_AccumulationBuffer merged = {};
+    sp_InitializeAccumulationBuffer(&merged, &memoryArena, width, height);
+    u8 *fileData = AllocateArray(&memoryArena, u8, fileSize);
+    for (u32 process = 0; process < 4; process++)
+    {
+        FILE *file = fopen(paths[process], "rb");
+        TEST_ASSERT_NOT_NULL(file);
+        u64 bytesRead = fread(fileData, 1, fileSize, file);
+        fclose(file);
+        remove(paths[process]);
+
+        TEST_ASSERT_EQUAL_UINT64(fileSize, bytesRead);
+        TEST_ASSERT_TRUE(sp_MergePartialFile(&merged, fileData, fileSize));
+    }
+
+    // Then the merged image is bit identical to the reference render
+    TEST_ASSERT_EQUAL_MEMORY(reference.pixels, merged.pixels,
+        sizeof(sp_AccumulationPixel) * width * height);
+
+    vec4 mergedPixels[32];
+    sp_ResolveAccumulationBuffer(&merged, mergedPixels);
+    TEST_ASSERT_EQUAL_MEMORY(
+        expectedPixels, mergedPixels, sizeof(expectedPixels));
+
+    // And the pixels are not all the same, which would make the test trivial
+    TEST_ASSERT_TRUE(expectedPixels[0].x != expectedPixels[9].x);
+}
+
+void TestAccumulationRounding()
+{
+    // Given many samples of a value just below a whole fixed point step
+    sp_AccumulationBuffer buffer = {};
+    sp_InitializeAccumulationBuffer(&buffer, &memoryArena, 1, 1);
+
+    f32 step = 1.0f / SP_ACCUMULATION_FIXED_POINT_SCALE;
+    for (u32 i = 0; i < 1000; i++)
+    {
+        sp_AddAccumulationSample(&buffer, 0, Vec3(0.75f * step));
+    }
+
+    // Then the mean is within half a step of the value rather than
+    // truncated to 0
+    vec3 mean = sp_ResolveAccumulationPixel(&buffer, 0);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f * step, 0.75f * step, mean.x);
+}
+
+void TestMergePartialFileInvalid()
+{
+    sp_AccumulationBuffer buffer = {};
+    sp_InitializeAccumulationBuffer(&buffer, &memoryArena, 4, 4);
+
+    sp_AccumulationBuffer other = {};
+    sp_InitializeAccumulationBuffer(&other, &memoryArena, 2, 2);
+    sp_AddAccumulationSample(&other, 0, Vec3(1));
+
+    u64 fileSize = sp_GetPartialFileSize(&other);
+    u8 *file = AllocateArray(&memoryArena, u8, fileSize);
+    sp_PartialRenderRange range = {};
+    sp_WritePartialFile(&other, range, file, fileSize);
+
+    // Partials with different dimensions are rejected
+    TEST_ASSERT_FALSE(sp_MergePartialFile(&buffer, file, fileSize));
+
+    // As are truncated files and files with a bad header
+    TEST_ASSERT_FALSE(sp_MergePartialFile(&other, file, fileSize - 1));
+    file[0] = 0;
+    TEST_ASSERT_FALSE(sp_MergePartialFile(&other, file, fileSize));
+
+    // And the buffer is left untouched
+    AssertWithinVec3(EPSILON, Vec3(1), sp_ResolveAccumulationPixel(&other, 0));
+    TEST_ASSERT_EQUAL_UINT64(1, other.pixels[0].sampleCount);
+}
+
+void TestLoadCheckpoint()
+{
+    sp_AccumulationBuffer buffer = {};
+    sp_InitializeAccumulationBuffer(&buffer, &memoryArena, 2, 2);
+    sp_AddAccumulationSample(&buffer, 3, Vec3(2));
+    sp_AddAccumulationSample(&buffer, 3, Vec3(4));
+
+    // Given a checkpoint written after 2 of the 8 samples of the render
+    sp_PartialRenderRange range = {};
+    range.firstSample = 8;
+    range.sampleCount = 8;
+    range.tileSubsetIndex = 1;
+    range.tileSubsetCount = 3;
+
+    sp_PartialRenderRange completed = range;
+    completed.sampleCount = 2;
+
+    u64 fileSize = sp_GetPartialFileSize(&buffer);
+    u8 *file = AllocateArray(&memoryArena, u8, fileSize);
+    sp_WritePartialFile(&buffer, completed, file, fileSize);
+
+    // When the checkpoint is loaded into a buffer holding other samples
+    sp_AccumulationBuffer resumed = {};
+    sp_InitializeAccumulationBuffer(&resumed, &memoryArena, 2, 2);
+    sp_AddAccumulationSample(&resumed, 0, Vec3(1));
+    u32 samplesCompleted = sp_LoadCheckpoint(&resumed, range, file, fileSize);
+
+    // Then the render continues after the completed samples
+    TEST_ASSERT_EQUAL_UINT32(2, samplesCompleted);
+
+    // And the buffer holds exactly what was checkpointed
+    TEST_ASSERT_EQUAL_MEMORY(buffer.pixels, resumed.pixels,
+        sizeof(sp_AccumulationPixel) * 4);
+
+    // And checkpoints of a different render are ignored
+    range.tileSubsetIndex = 2;
+    TEST_ASSERT_EQUAL_UINT32(
+        0, sp_LoadCheckpoint(&resumed, range, file, fileSize));
+    TEST_ASSERT_EQUAL_UINT64(0, resumed.pixels[3].sampleCount);
+}
+
+void TestShadingCacheCompressVertex()
+{
+    // Given a vertex with a light sample but no environment sample
+    sp_PathVertex vertex = {};
+    vertex.materialId = 3;
+    vertex.normal = Normalize(Vec3(0.2, -0.9, 0.1));
+    vertex.outgoingDir = Normalize(Vec3(-0.5, 0.5, -0.7));
+    vertex.incomingDir = Vec3(0, 0, -1);
+    vertex.uv = Vec2(2.5, -0.25);
+    vertex.incomingPdf = 0.75f;
+    vertex.lightDir = Normalize(Vec3(1, 1, 1));
+    vertex.lightRadiance = Vec3(12.0, 0.5, 0.0);
+
+    // When it is compressed and decompressed
+    sp_CachedVertex cached = sp_CompressPathVertex(&vertex);
+    sp_PathVertex result = sp_DecompressPathVertex(&cached);
+
+    // Then directions and radiance are within the precision of the encoding
+    TEST_ASSERT_EQUAL_UINT32(vertex.materialId, result.materialId);
+    TEST_ASSERT_FALSE(result.isLight);
+    AssertWithinVec3(0.001f, vertex.normal, result.normal);
+    AssertWithinVec3(0.001f, vertex.outgoingDir, result.outgoingDir);
+    AssertWithinVec3(0.001f, vertex.incomingDir, result.incomingDir);
+    AssertWithinVec3(0.001f, vertex.lightDir, result.lightDir);
+    AssertWithinVec3(0.03f, vertex.lightRadiance, result.lightRadiance);
+    TEST_ASSERT_EQUAL_FLOAT(vertex.uv.x, result.uv.x);
+    TEST_ASSERT_EQUAL_FLOAT(vertex.uv.y, result.uv.y);
+    TEST_ASSERT_EQUAL_FLOAT(vertex.incomingPdf, result.incomingPdf);
+
+    // And the missing environment sample stays empty
+    AssertWithinVec3(0.0f, Vec3(0), result.environmentDir);
+    AssertWithinVec3(0.0f, Vec3(0), result.environmentRadiance);
+
+    // And light vertices keep their emission
+    sp_PathVertex light = {};
+    light.isLight = true;
+    light.lightEmission = Vec3(0.001, 100, 4);
+    cached = sp_CompressPathVertex(&light);
+    result = sp_DecompressPathVertex(&cached);
+    TEST_ASSERT_TRUE(result.isLight);
+    AssertWithinVec3(0.2f, light.lightEmission, result.lightEmission);
+}
+
+void TestReshadeTile()
+{
+    // Given a rough plane lit by a small sphere light
+    vec4 pixels[32] = {};
+    TestScene test;
+    u32 materialId = CreateLitPlaneScene(&test, pixels);
+
+    sp_ShadingCache shadingCache = {};
+    sp_InitializeShadingCache(&shadingCache, &memoryArena,
+        test.imagePlane.width, test.imagePlane.height, 2);
+    test.ctx.samplesPerPixel = 2;
+    test.ctx.shadingCache = &shadingCache;
+
+    Tile tile = {};
+    tile.maxX = test.imagePlane.width;
+    tile.maxY = test.imagePlane.height;
+
+    RandomNumberGenerator rng = { 0x1234567 };
+    sp_Metrics metrics = {};
+
+    // When the image is traced with the shading cache enabled
+    sp_PathTraceTile(&test.ctx, tile, &rng, &metrics);
+    vec4 tracedPixels[32];
+    CopyMemory(tracedPixels, pixels, sizeof(pixels));
+
+    // Then shading the cached paths again gives the same image
+    ClearToZero(pixels, sizeof(pixels));
+    sp_ReshadeTile(&test.ctx, tile, &metrics);
+    for (u32 i = 0; i < ArrayCount(pixels); i++)
+    {
+        AssertWithinVec4(0.01f, tracedPixels[i], pixels[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT64(64, metrics.values[sp_Metric_PathsReshaded]);
+
+    // When the albedo of the plane is edited and the cached paths are shaded
+    // again
+    sp_FindMaterialById(&test.materialSystem, materialId)->albedo = Vec3(0.4);
+    sp_ReshadeTile(&test.ctx, tile, &metrics);
+    vec4 reshadedPixels[32];
+    CopyMemory(reshadedPixels, pixels, sizeof(pixels));
+
+    // Then the image matches tracing the scene with the new albedo, the
+    // sampled directions don't depend on the albedo
+    test.ctx.shadingCache = NULL;
+    sp_PathTraceTile(&test.ctx, tile, &rng, &metrics);
+    for (u32 i = 0; i < ArrayCount(pixels); i++)
+    {
+        AssertWithinVec4(0.01f, pixels[i], reshadedPixels[i]);
+    }
+
+    // And the edit made a difference
+    TEST_ASSERT_TRUE(reshadedPixels[9].x < tracedPixels[9].x * 0.9f);
+}
+
+void TestToneMapSrgbEncoding()
+{
+    // Given the linear value at the center of every 8 bit sRGB code
+    vec4 pixels[256];
+    for (u32 i = 0; i < 256; i++)
+    {
+        pixels[i] = Vec4(Vec3(SrgbToLinear((f32)i / 255.0f)), 1);
+    }
+
+    // When they are tone mapped without changing them
+    sp_ToneMapper toneMapper = {};
+    sp_InitializeToneMapper(&toneMapper, sp_ToneMapOperator_Clamp, 1.0f);
+
+    u8 displayPixels[256 * 4];
+    sp_DisplayBuffer dst = {};
+    dst.pixels = displayPixels;
+    dst.width = 256;
+    dst.height = 1;
+    dst.format = sp_DisplayFormat_Rgba8;
+    sp_ToneMapImage(&toneMapper, pixels, &dst);
+
+    // Then each one encodes to its own code
+    for (u32 i = 0; i < 256; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(i, displayPixels[i * 4]);
+        TEST_ASSERT_EQUAL_UINT8(i, displayPixels[i * 4 + 2]);
+        TEST_ASSERT_EQUAL_UINT8(255, displayPixels[i * 4 + 3]);
+    }
+
+    // And the exact curve round trips, unlike a 2.2 gamma
+    TEST_ASSERT_FLOAT_WITHIN(1.0e-5f, 0.5f, LinearToSrgb(SrgbToLinear(0.5f)));
+    TEST_ASSERT_FLOAT_WITHIN(1.0e-6f, 0.0031308f * 12.92f,
+        LinearToSrgb(0.0031308f));
+}
+
+void TestToneMapAccumulationBuffer()
+{
+    // Given an accumulation buffer with a bright, an empty and a very bright
+    // pixel
+    sp_AccumulationBuffer buffer = {};
+    sp_InitializeAccumulationBuffer(&buffer, &memoryArena, 3, 1);
+    sp_AddAccumulationSample(&buffer, 0, Vec3(2, 4, 6));
+    sp_AddAccumulationSample(&buffer, 0, Vec3(4, 2, 0));
+    sp_AddAccumulationSample(&buffer, 2, Vec3(1.0e6f));
+
+    // When it is tone mapped with Reinhard into an 8 bit display buffer
+    sp_ToneMapper toneMapper = {};
+    sp_InitializeToneMapper(&toneMapper, sp_ToneMapOperator_Reinhard, 1.0f);
+
+    u8 displayPixels[3 * 4];
+    sp_DisplayBuffer dst = {};
+    dst.pixels = displayPixels;
+    dst.width = 3;
+    dst.height = 1;
+    dst.format = sp_DisplayFormat_Rgba8;
+    sp_ToneMapAccumulationBuffer(&toneMapper, &buffer, &dst);
+
+    // Then the mean of 3 maps to 3 / (1 + 3) before sRGB encoding
+    u8 expected = (u8)(LinearToSrgb(0.75f) * 255.0f + 0.5f);
+    TEST_ASSERT_EQUAL_UINT8(expected, displayPixels[0]);
+    TEST_ASSERT_EQUAL_UINT8(expected, displayPixels[1]);
+    TEST_ASSERT_EQUAL_UINT8(expected, displayPixels[2]);
+
+    // And pixels without samples are black
+    TEST_ASSERT_EQUAL_UINT8(0, displayPixels[4]);
+    TEST_ASSERT_EQUAL_UINT8(255, displayPixels[7]);
+
+    // And very bright pixels saturate
+    TEST_ASSERT_EQUAL_UINT8(255, displayPixels[8]);
+}
+
+void TestToneMapHalf()
+{
+    vec4 pixels[2] = {Vec4(1, 0, 0.5f, 1), Vec4(100, 0.0f, 0.0f, 1)};
+
+    sp_ToneMapper toneMapper = {};
+    sp_InitializeToneMapper(&toneMapper, sp_ToneMapOperator_Clamp, 1.0f);
+
+    u16 displayPixels[2 * 4];
+    sp_DisplayBuffer dst = {};
+    dst.pixels = displayPixels;
+    dst.width = 2;
+    dst.height = 1;
+    dst.format = sp_DisplayFormat_Rgba16f;
+    sp_ToneMapImage(&toneMapper, pixels, &dst);
+
+    TEST_ASSERT_EQUAL_HEX16(0x3C00, displayPixels[0]);
+    TEST_ASSERT_EQUAL_HEX16(0x0000, displayPixels[1]);
+
+    // sRGB encoding of 0.5 is 0.73536, i.e. 2^-1 * (1 + 482 / 1024)
+    TEST_ASSERT_EQUAL_HEX16(0x39E2, displayPixels[2]);
+    TEST_ASSERT_EQUAL_HEX16(0x3C00, displayPixels[3]);
+
+    // ACES saturates bright values to 1
+    sp_InitializeToneMapper(&toneMapper, sp_ToneMapOperator_Aces, 1.0f);
+    sp_ToneMapImage(&toneMapper, pixels, &dst);
+    TEST_ASSERT_EQUAL_HEX16(0x3C00, displayPixels[4]);
+    TEST_ASSERT_EQUAL_HEX16(0x0000, displayPixels[5]);
+}
+
+void TestPathTraceTileAovs()
+{
+    // Given a diffuse plane in front of the camera lit by a white background
+    vec4 pixels[4] = {};
+    vec4 aovs[SP_MAX_AOVS][4] = {};
+    TestScene test;
+    InitializeTestScene(&test);
+
+    // Long film distance keeps the camera rays close to the view axis
+    ConfigureTestCamera(&test, pixels, 2, 2, Vec3(0, 0, 1), 4.0f);
+    for (u32 i = 0; i < SP_MAX_AOVS; i++)
+    {
+        test.imagePlane.aovs[i] = aovs[i];
+    }
+
+    u32 materialId = 1;
+    sp_AddObjectToScene(
+        &test.scene, test.quad, materialId, Vec3(0), Quat(), Vec3(100));
+    sp_BuildSceneBroadphase(&test.scene);
+
+    vec3 albedo = Vec3(0.5, 0.25, 0.125);
+    RegisterTestMaterial(&test, 0, Vec3(0), Vec3(1), 0.0f);
+    RegisterTestMaterial(&test, materialId, albedo, Vec3(0), 1.0f);
+
+    RandomNumberGenerator rng = { 0x1234567 };
+    sp_Metrics metrics = {};
+
+    // When we path trace the image
+    Tile tile = {};
+    tile.maxX = 2;
+    tile.maxY = 2;
+    sp_PathTraceTile(&test.ctx, tile, &rng, &metrics);
+
+    // Then the AOVs describe the first hit for every pixel
+    for (u32 i = 0; i < 4; i++)
+    {
+        AssertWithinVec3(EPSILON, albedo, aovs[sp_Aov_Albedo][i].xyz);
+        AssertWithinVec3(EPSILON, Vec3(0, 0, 1), aovs[sp_Aov_Normal][i].xyz);
+        TEST_ASSERT_FLOAT_WITHIN(0.1f, 1.0f, aovs[sp_Aov_Depth][i].x);
+        TEST_ASSERT_EQUAL_FLOAT(
+            (f32)materialId, aovs[sp_Aov_MaterialId][i].x);
+
+        // And as nothing else is in the scene all of the light is direct
+        AssertWithinVec3(
+            1e-5f, pixels[i].xyz, aovs[sp_Aov_DirectRadiance][i].xyz);
+        AssertWithinVec3(
+            1e-5f, Vec3(0), aovs[sp_Aov_IndirectRadiance][i].xyz);
+    }
+}
+
+void TestPathTraceTileAdaptiveSamplingAcrossPasses()
+{
+    // Given a diffuse plane lit by a white background
+    vec4 pixels[4] = {};
+    vec4 aovs[SP_MAX_AOVS][4] = {};
+    TestScene test;
+    InitializeTestScene(&test);
+    ConfigureTestCamera(&test, pixels, 2, 2, Vec3(0, 0, 1), 4.0f);
+    for (u32 i = 0; i < SP_MAX_AOVS; i++)
+    {
+        test.imagePlane.aovs[i] = aovs[i];
+    }
+
+    u32 materialId = 1;
+    sp_AddObjectToScene(
+        &test.scene, test.quad, materialId, Vec3(0), Quat(), Vec3(100));
+    sp_BuildSceneBroadphase(&test.scene);
+
+    vec3 albedo = Vec3(0.5, 0.25, 0.125);
+    RegisterTestMaterial(&test, 0, Vec3(0), Vec3(1), 0.0f);
+    RegisterTestMaterial(&test, materialId, albedo, Vec3(0), 1.0f);
+
+    // And a render split into passes which are shorter than the minimum
+    // sample count of adaptive sampling
+    sp_AccumulationBuffer accumulationBuffer = {};
+    sp_InitializeAccumulationBuffer(&accumulationBuffer, &memoryArena, 2, 2);
+    sp_InitializeAccumulationStats(&accumulationBuffer, &memoryArena);
+    test.ctx.accumulationBuffer = &accumulationBuffer;
+    test.ctx.samplesPerPixel = 8;
+    test.ctx.maxRelativeError = 0.5f;
+    test.ctx.minSamplesPerPixel = 12;
+
+    RandomNumberGenerator rng = { 0x1234567 };
+    sp_Metrics metrics = {};
+    Tile tile = {};
+    tile.maxX = 2;
+    tile.maxY = 2;
+
+    // When we path trace two passes
+    for (u32 pass = 0; pass < 2; pass++)
+    {
+        test.ctx.firstSample = pass * 8;
+        sp_PathTraceTile(&test.ctx, tile, &rng, &metrics);
+    }
+
+    // Then every pixel converges as soon as the samples of both passes reach
+    // the minimum sample count
+    TEST_ASSERT_EQUAL_UINT64(4, metrics.values[sp_Metric_PixelsConverged]);
+    for (u32 i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT64(
+            12, accumulationBuffer.pixels[i].sampleCount);
+
+        // And the AOVs are resolved from every pass with the direct and
+        // indirect radiance adding up to the displayed pixel
+        AssertWithinVec3(EPSILON, albedo, aovs[sp_Aov_Albedo][i].xyz);
+        AssertWithinVec3(1e-5f, pixels[i].xyz,
+            aovs[sp_Aov_DirectRadiance][i].xyz +
+                aovs[sp_Aov_IndirectRadiance][i].xyz);
+    }
+
+    // When we path trace another pass
+    test.ctx.firstSample = 16;
+    sp_PathTraceTile(&test.ctx, tile, &rng, &metrics);
+
+    // Then the converged pixels are not sampled again
+    for (u32 i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT64(
+            12, accumulationBuffer.pixels[i].sampleCount);
+    }
+}
+
+void TestDenoiser()
+{
+    // Given a noisy image of two surfaces meeting at a hard edge
+    u32 width = 16;
+    u32 height = 16;
+    vec4 pixels[16 * 16] = {};
+    vec4 aovs[SP_MAX_AOVS][16 * 16] = {};
+    ImagePlane imagePlane = {};
+    imagePlane.pixels = pixels;
+    imagePlane.width = width;
+    imagePlane.height = height;
+    for (u32 i = 0; i < SP_MAX_AOVS; i++)
+    {
+        imagePlane.aovs[i] = aovs[i];
+    }
+
+    RandomNumberGenerator rng = { 0x1234567 };
+    f32 noise = 0.25f;
+    for (u32 y = 0; y < height; y++)
+    {
+        for (u32 x = 0; x < width; x++)
+        {
+            u32 i = x + y * width;
+            b32 isLeft = (x < width / 2);
+            f32 radiance = isLeft ? 0.5f : 2.0f;
+            f32 noisyRadiance =
+                radiance * (1.0f + RandomBilateral(&rng) * noise);
+
+            pixels[i] = Vec4(Vec3(noisyRadiance), 1);
+            aovs[sp_Aov_Albedo][i] = Vec4(Vec3(0.5f), 1);
+            aovs[sp_Aov_Normal][i] =
+                isLeft ? Vec4(0, 0, 1, 1) : Vec4(1, 0, 0, 1);
+            aovs[sp_Aov_Depth][i] = Vec4(1, 0, 0, 1);
+
+            // Variance of a uniform distribution
+            f32 stdDev = radiance * noise / Sqrt(3.0f);
+            aovs[sp_Aov_Variance][i] = Vec4(stdDev * stdDev, 0, 0, 1);
+        }
+    }
+
+    // When it is denoised one iteration at a time split into tiles
+    sp_Denoiser denoiser = {};
+    sp_InitializeDenoiser(&denoiser, &imagePlane, &memoryArena, 3);
+
+    Tile tiles[4];
+    u32 tileCount =
+        ComputeTiles(width, height, 8, 8, tiles, ArrayCount(tiles));
+    for (u32 iteration = 0; iteration < denoiser.iterationCount; iteration++)
+    {
+        for (u32 i = 0; i < tileCount; i++)
+        {
+            sp_DenoiseTile(&denoiser, tiles[i], iteration);
+        }
+    }
+
+    // Then the noise on each side is reduced without blurring across the edge
+    for (u32 side = 0; side < 2; side++)
+    {
+        f32 expected = (side == 0) ? 0.5f : 2.0f;
+        f32 maxError = 0.0f;
+        for (u32 y = 0; y < height; y++)
+        {
+            for (u32 x = side * width / 2; x < (side + 1) * width / 2; x++)
+            {
+                f32 error = Abs(pixels[x + y * width].x - expected);
+                maxError = Max(maxError, error);
+            }
+        }
+
+        TEST_ASSERT_TRUE(maxError < expected * noise * 0.5f);
+    }
+}
+
+void TestConfigureCamera()
+{
+    vec4 pixels[4*4] = {};
+
+    ImagePlane imagePlane = {};
+    imagePlane.width = 4;
+    imagePlane.height = 2;
+    imagePlane.pixels = pixels;
+
+    vec3 position = Vec3(0, 2, 0);
+    quat rotation = Quat();
+    f32 filmDistance = 0.1f;
+
+    sp_Camera camera = {};
+    sp_ConfigureCamera(&camera, &imagePlane, position, rotation, filmDistance);
+
+    TEST_ASSERT_TRUE(camera.imagePlane == &imagePlane);
+
+    AssertWithinVec3(EPSILON, position, camera.position);
+    // Compute basis vectors
+    AssertWithinVec3(EPSILON, Vec3(1, 0, 0), camera.basis.right);
+    AssertWithinVec3(EPSILON, Vec3(0, 1, 0), camera.basis.up);
+    AssertWithinVec3(EPSILON, Vec3(0, 0, -1), camera.basis.forward);
+    // Compute filmCenter
+    AssertWithinVec3(EPSILON, Vec3(0, 2, -0.1f), camera.filmCenter);
+    // Compute halfPixelWidth/halfPixelHeight
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.125f, camera.halfPixelWidth);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.25f, camera.halfPixelHeight);
+    // Compute halfFilmWidth/halfFilmHeight;
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.5f, camera.halfFilmWidth);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.25f, camera.halfFilmHeight);
+}
+
+void TestCalculateFilmP()
+{
+    vec4 pixels[4*4] = {};
+
+    ImagePlane imagePlane = {};
+    imagePlane.width = 4;
+    imagePlane.height = 4;
+    imagePlane.pixels = pixels;
+
+    vec3 position = Vec3(0, 2, 0);
+    quat rotation = Quat();
+    f32 filmDistance = 0.1f;
+
+    sp_Camera camera = {};
+    sp_ConfigureCamera(&camera, &imagePlane, position, rotation, filmDistance);
+
+    vec3 filmPositions[4] = {};
+
+    vec2 pixelPositions[4] = {
+        Vec2(0.5, 0.5),
+        Vec2(1.5, 0.5),
+        Vec2(0.5, 1.5),
+        Vec2(3.5, 3.5),
+    };
+
+    u32 count =
+        sp_CalculateFilmPositions(&camera, filmPositions, pixelPositions, 4);
+    TEST_ASSERT_EQUAL_UINT32(4, count);
+    AssertWithinVec3(EPSILON, Vec3(-0.375, 2.375, -0.1), filmPositions[0]);
+    AssertWithinVec3(EPSILON, Vec3(0.375, 1.625, -0.1), filmPositions[3]);
+}
+
+void TestTransformAabb()
+{
+    // Given an Aabb
+    vec3 boxMin = Vec3(-0.5);
+    vec3 boxMax = Vec3(0.5);
+
+    // When it is transformed by a model matrix?
+    Aabb result = TransformAabb(boxMin, boxMax, Vec3(5, 0, 0), Quat(), Vec3(1));
+
+    // Then the min and max are updated
+    AssertWithinVec3(EPSILON, Vec3(4.5, -0.5, -0.5), result.min);
+    AssertWithinVec3(EPSILON, Vec3(5.5, 0.5, 0.5), result.max);
+}
+
+void TestRayIntersectScene()
+{
+    // Given a scene with multiple objects
+    sp_Scene scene = {};
+    sp_InitializeScene(&scene, &memoryArena);
+
+    sp_Mesh meshes[2];
+    vec3 positions[2] = {
+        Vec3(0, 2, -5),
+        Vec3(0, 2, -15),
+    };
+
+    quat orientations[2] = {
+        Quat(),
+        Quat(Vec3(0, 1, 0), PI * 0.25f),
+    };
+
+    vec3 scale[2] = {
+        Vec3(1),
+        Vec3(2),
+    };
+
+    VertexPNT vertices[] = {
+        {Vec3(-0.5, -0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+        {Vec3(0.5, -0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+        {Vec3(0.0, 0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+    };
+
+    u32 indices[] = { 0, 1, 2 };
+
+    u32 material = 53;
+
+    // TODO: Do we copy the vertex data and store it in the collision world?
+    meshes[0] = sp_CreateMesh(
+        vertices, ArrayCount(vertices), indices, ArrayCount(indices));
+    meshes[1] = sp_CreateMesh(
+        vertices, ArrayCount(vertices), indices, ArrayCount(indices));
+
+    MemoryArena bvhNodeArena = SubAllocateArena(&memoryArena, Kilobytes(4));
+    MemoryArena tempArena = SubAllocateArena(&memoryArena, Kilobytes(8));
+    sp_BuildMeshMidphase(&meshes[0], &bvhNodeArena, &tempArena);
+    sp_BuildMeshMidphase(&meshes[1], &bvhNodeArena, &tempArena);
+
+    sp_AddObjectToScene(
+        &scene, meshes[0], material, positions[0], orientations[0], scale[0]);
+    sp_AddObjectToScene(
+        &scene, meshes[1], material, positions[1], orientations[1], scale[1]);
+    sp_BuildSceneBroadphase(&scene);
+
+    // When we test if a ray intersects with the collision world
+    vec3 rayOrigin = Vec3(0, 2, 0);
+    vec3 rayDirection = Vec3(0, 0, -1);
+    sp_Metrics metrics = {};
+    sp_RayIntersectSceneResult result =
+        sp_RayIntersectScene(&scene, rayOrigin, rayDirection, &metrics);
+
+    // Then we find an intersection
+    TEST_ASSERT_TRUE(result.t >= 0.0f);
+    TEST_ASSERT_EQUAL_UINT32(material, result.materialId);
+    // TODO: Check other properties of the intersection
+}
+
+void TestRayIntersectSceneManyOverlappingObjects()
+{
+    // Given a scene with more objects along a ray than the broadphase used to
+    // have room for
+    sp_Scene *scene = AllocateStruct(&memoryArena, sp_Scene);
+    sp_InitializeScene(scene, &memoryArena);
+
+    VertexPNT vertices[] = {
+        {Vec3(-0.5, -0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+        {Vec3(0.5, -0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+        {Vec3(0.0, 0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+    };
+    u32 indices[] = { 0, 1, 2 };
+
+    sp_Mesh mesh = sp_CreateMesh(
+        vertices, ArrayCount(vertices), indices, ArrayCount(indices));
+    MemoryArena bvhNodeArena = SubAllocateArena(&memoryArena, Kilobytes(4));
+    MemoryArena tempArena = SubAllocateArena(&memoryArena, Kilobytes(8));
+    sp_BuildMeshMidphase(&mesh, &bvhNodeArena, &tempArena);
+
+    u32 objectCount = 200;
+    for (u32 i = 0; i < objectCount; i++)
+    {
+        // Nearest object has the material id 0
+        sp_AddObjectToScene(scene, mesh, i, Vec3(0, 0, -1.0f - (f32)i),
+            Quat(), Vec3(1));
+    }
+    sp_BuildSceneBroadphase(scene);
+
+    // When a ray is traced through all of them
+    sp_Metrics metrics = {};
+    sp_RayIntersectSceneResult result = sp_RayIntersectScene(
+        scene, Vec3(0), Vec3(0, 0, -1), &metrics);
+
+    // Then the nearest one is hit
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, result.t);
+    TEST_ASSERT_EQUAL_UINT32(0, result.materialId);
+}
+
+void TestCreateMeshComputesBounds()
+{
+    // Given vertices for a single triangle
+    VertexPNT vertices[] = {
+        {Vec3(-0.5, -0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+        {Vec3(0.5, -0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+        {Vec3(0.0, 0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+    };
+
+    u32 indices[] = { 0, 1, 2 };
+
+    // When we create a mesh
+    sp_Mesh mesh = sp_CreateMesh(
+        vertices, ArrayCount(vertices), indices, ArrayCount(indices));
+
+    // Then the local bounds of the mesh are cached
+    AssertWithinVec3(EPSILON, Vec3(-0.5f, -0.5f, 0.0f), mesh.aabbMin);
+    AssertWithinVec3(EPSILON, Vec3(0.5f, 0.5f, 0.0f), mesh.aabbMax);
+}
+
+void TestSetObjectTransform()
+{
+    // Given a scene with a single object
+    sp_Scene scene = {};
+    sp_InitializeScene(&scene, &memoryArena);
+
+    VertexPNT vertices[] = {
+        {Vec3(-0.5, -0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+        {Vec3(0.5, -0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+        {Vec3(0.0, 0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+    };
+
+    u32 indices[] = { 0, 1, 2 };
+
+    sp_Mesh mesh = sp_CreateMesh(
+        vertices, ArrayCount(vertices), indices, ArrayCount(indices));
+
+    MemoryArena bvhNodeArena = SubAllocateArena(&memoryArena, Kilobytes(4));
+    MemoryArena tempArena = SubAllocateArena(&memoryArena, Kilobytes(8));
+    sp_BuildMeshMidphase(&mesh, &bvhNodeArena, &tempArena);
+
+    u32 material = 7;
+    u32 object = sp_AddObjectToScene(
+        &scene, mesh, material, Vec3(0, 0, -5), Quat(), Vec3(1));
+    sp_BuildSceneBroadphase(&scene);
+
+    // When we move the object and rebuild the broadphase
+    sp_SetObjectTransform(&scene, object, Vec3(10, 0, -5), Quat(), Vec3(2));
+    sp_BuildSceneBroadphase(&scene);
+
+    // Then the object AABB is updated
+    AssertWithinVec3(EPSILON, Vec3(9, -1, -5), scene.aabbMin[object]);
+    AssertWithinVec3(EPSILON, Vec3(11, 1, -5), scene.aabbMax[object]);
+
+    // And rays intersect the object at its new position only
+    sp_Metrics metrics = {};
+    sp_RayIntersectSceneResult oldResult = sp_RayIntersectScene(
+        &scene, Vec3(0, 0, 0), Vec3(0, 0, -1), &metrics);
+    TEST_ASSERT_TRUE(oldResult.t < 0.0f);
+
+    sp_RayIntersectSceneResult newResult = sp_RayIntersectScene(
+        &scene, Vec3(10, 0, 0), Vec3(0, 0, -1), &metrics);
+    TEST_ASSERT_FLOAT_WITHIN(1.0e-4f, 5.0f, newResult.t);
+    TEST_ASSERT_EQUAL_UINT32(material, newResult.materialId);
+}
+
+void TestRayOccluded()
+{
+    // Given a scene with a single triangle scaled by 2 at z = -5
+    sp_Scene scene = {};
+    sp_InitializeScene(&scene, &memoryArena);
+
+    VertexPNT vertices[] = {
+        {Vec3(-0.5, -0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+        {Vec3(0.5, -0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+        {Vec3(0.0, 0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
+    };
+
+    u32 indices[] = { 0, 1, 2 };
+
+    sp_Mesh mesh = sp_CreateMesh(
+        vertices, ArrayCount(vertices), indices, ArrayCount(indices));
+
+    MemoryArena bvhNodeArena = SubAllocateArena(&memoryArena, Kilobytes(4));
+    MemoryArena tempArena = SubAllocateArena(&memoryArena, Kilobytes(8));
+    sp_BuildMeshMidphase(&mesh, &bvhNodeArena, &tempArena);
+
+    sp_AddObjectToScene(&scene, mesh, 0, Vec3(0, 0, -5), Quat(), Vec3(2));
+    sp_BuildSceneBroadphase(&scene);
+
+    vec3 rayOrigin = Vec3(0, 0, 0);
+
+    // Then a ray towards the triangle is occluded only if tmax is beyond it
+    TEST_ASSERT_TRUE(sp_RayOccluded(&scene, rayOrigin, Vec3(0, 0, -1)));
+    TEST_ASSERT_TRUE(sp_RayOccluded(&scene, rayOrigin, Vec3(0, 0, -1), 5.1f));
+    TEST_ASSERT_FALSE(sp_RayOccluded(&scene, rayOrigin, Vec3(0, 0, -1), 4.9f));
+
+    // And rays which miss the triangle are not occluded
+    TEST_ASSERT_FALSE(sp_RayOccluded(&scene, rayOrigin, Vec3(0, 0, 1)));
+    TEST_ASSERT_FALSE(
+        sp_RayOccluded(&scene, Vec3(3, 0, 0), Vec3(0, 0, -1)));
+}
+
+void TestRayIntersectLights()
+{
+    sp_Scene scene = {};
+    sp_AddSphereLight(&scene, Vec3(0, 0, -5), 1.0f, Vec3(1));
+    sp_AddDiskLight(&scene, Vec3(0, 0, 5), Vec3(0, 0, -1), 1.0f, Vec3(1));
+
+    // Sphere lights are hit on their near side
+    sp_RayIntersectLightsResult result =
+        sp_RayIntersectLights(&scene, Vec3(0), Vec3(0, 0, -1));
+    TEST_ASSERT_EQUAL_UINT32(0, result.lightIndex);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 4.0f, result.t);
+
+    // Disk lights are hit on their emitting side
+    result = sp_RayIntersectLights(&scene, Vec3(0.5, 0, 0), Vec3(0, 0, 1));
+    TEST_ASSERT_EQUAL_UINT32(1, result.lightIndex);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 5.0f, result.t);
+
+    // But not from behind
+    result = sp_RayIntersectLights(&scene, Vec3(0, 0, 10), Vec3(0, 0, -1));
+    TEST_ASSERT_EQUAL_UINT32(0, result.lightIndex);
+
+    // And lights beyond tmax are ignored
+    result = sp_RayIntersectLights(&scene, Vec3(0), Vec3(0, 0, -1), 3.0f);
+    TEST_ASSERT_EQUAL_UINT32(U32_MAX, result.lightIndex);
+}
+
+// Checks that every sample hits the light at the sampled distance with a pdf
+// matching sp_ComputeLightPdf and returns the mean of 1 / pdf, which is an
+// estimate of the solid angle subtended by the light
+internal f32 CheckLightSamples(sp_Scene *scene, vec3 p, u32 sampleCount)
+{
+    RandomNumberGenerator rng = { 0x1234567 };
+    sp_Sampler sampler = sp_CreateSampler(sp_SamplerType_Random, &rng);
+
+    f32 total = 0.0f;
+    for (u32 i = 0; i < sampleCount; i++)
+    {
+        sp_LightSample sample = sp_SampleLight(scene, p, &sampler);
+        TEST_ASSERT_TRUE(sample.pdf > 0.0f);
+        TEST_ASSERT_FLOAT_WITHIN(0.00001f, 1.0f, Length(sample.direction));
+
+        sp_RayIntersectLightsResult hit =
+            sp_RayIntersectLights(scene, p, sample.direction);
+        TEST_ASSERT_EQUAL_UINT32(0, hit.lightIndex);
+        TEST_ASSERT_FLOAT_WITHIN(0.001f, hit.t, sample.distance);
+
+        f32 pdf = sp_ComputeLightPdf(scene, 0, p, sample.direction, hit.t);
+        TEST_ASSERT_FLOAT_WITHIN(pdf * 0.001f, pdf, sample.pdf);
+
+        total += 1.0f / sample.pdf;
+    }
+
+    return total / (f32)sampleCount;
+}
+
+void TestSampleSphereLight()
+{
+    sp_Scene scene = {};
+    sp_AddSphereLight(&scene, Vec3(0, 4, 0), 2.0f, Vec3(1));
+
+    f32 solidAngle = CheckLightSamples(&scene, Vec3(0), 1000);
+
+    // Cone subtended by the sphere has sin(thetaMax) = 0.5
+    f32 expected = 2.0f * PI * (1.0f - Cos(PI / 6.0f));
+    TEST_ASSERT_FLOAT_WITHIN(expected * 0.001f, expected, solidAngle);
+}
+
+void TestSampleDiskLight()
+{
+    sp_Scene scene = {};
+    sp_AddDiskLight(&scene, Vec3(0, 2, 0), Vec3(0, -1, 0), 2.0f, Vec3(1));
+
+    f32 solidAngle = CheckLightSamples(&scene, Vec3(0), 10000);
+
+    // Solid angle of a disk of radius r seen on axis from distance h
+    f32 expected = 2.0f * PI * (1.0f - 2.0f / Sqrt(8.0f));
+    TEST_ASSERT_FLOAT_WITHIN(expected * 0.05f, expected, solidAngle);
+
+    // No samples are generated from behind the light
+    RandomNumberGenerator rng = { 0x1234567 };
+    sp_Sampler sampler = sp_CreateSampler(sp_SamplerType_Random, &rng);
+    sp_LightSample sample = sp_SampleLight(&scene, Vec3(0, 4, 0), &sampler);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, sample.pdf);
+}
+
+void TestPathTraceNextEventEstimation()
+{
+    // Given a plane facing the camera lit by a disk light behind the camera
+    vec4 pixels[16] = {};
+    TestScene test;
+    InitializeTestScene(&test);
+    ConfigureTestCamera(&test, pixels, 4, 4, Vec3(0), 1.0f);
+
+    u32 materialId = 1;
+    sp_AddObjectToScene(
+        &test.scene, test.quad, materialId, Vec3(0, 0, -5), Quat(), Vec3(10));
+    sp_BuildSceneBroadphase(&test.scene);
+
+    sp_AddDiskLight(
+        &test.scene, Vec3(0, 0, 1), Vec3(0, 0, -1), 1.0f, Vec3(4));
+
+    RegisterTestMaterial(&test, 0, Vec3(0), Vec3(0), 0.0f);
+    RegisterTestMaterial(&test, materialId, Vec3(1), Vec3(0), 1.0f);
+
+    RandomNumberGenerator rng = { 0x1234567 };
+
+    sp_Metrics metrics = {};
+
+    // When we path trace a tile
+    Tile tile = {};
+    tile.minX = 0;
+    tile.minY = 0;
+    tile.maxX = 4;
+    tile.maxY = 4;
+    sp_PathTraceTile(&test.ctx, tile, &rng, &metrics);
+
+    // Then every pixel receives light through its light sample
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(
+        16, (u32)metrics.values[sp_Metric_ShadowRaysTraced]);
+    for (u32 i = 0; i < 16; i++)
+    {
+        TEST_ASSERT_TRUE(pixels[i].x > 0.0f);
+        TEST_ASSERT_TRUE(pixels[i].x < 1.0f);
+    }
+}
+
+void TestTracePathRussianRoulette()
+{
+    // Given a ray trapped between two facing planes which never escapes
+    TestScene test;
+    CreateFacingPlanesScene(&test, 10000.0f);
+
+    RandomNumberGenerator rng = { 0x1234567 };
+    sp_Sampler sampler = sp_CreateSampler(sp_SamplerType_Random, &rng);
+
+    sp_Metrics metrics = {};
+
+    // When we trace paths with a large maximum depth
+    u32 maxBounces = 64;
+    u32 pathCount = 1000;
+    u32 totalLength = 0;
+    for (u32 i = 0; i < pathCount; i++)
+    {
+        sp_TracePathResult result = sp_TracePath(
+            &test.ctx, Vec3(0), Vec3(0, 0, -1), maxBounces, &sampler, &metrics);
+
+        // Then no path is longer than the maximum depth
+        TEST_ASSERT_TRUE(result.pathLength <= maxBounces);
+        totalLength += result.pathLength;
+    }
+
+    // And most of them are terminated by russian roulette long before the
+    // maximum depth, the rest end when a BSDF sample goes below the surface
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(pathCount * 3 / 4,
+        (u32)metrics.values[sp_Metric_PathsTerminatedByRoulette]);
+    TEST_ASSERT_TRUE((f32)totalLength / (f32)pathCount < 8.0f);
+}
+
+void TestRadianceCache()
+{
+    sp_RadianceCache cache = {};
+    sp_InitializeRadianceCache(&cache, &memoryArena, 1024, 1.0f);
+
+    // Given points in the same grid cell
+    u32 a =
+        sp_FindRadianceCacheCell(&cache, Vec3(0.2, 0.5, 0.1), Vec3(0, 1, 0));
+    u32 b =
+        sp_FindRadianceCacheCell(&cache, Vec3(0.8, 0.1, 0.9), Vec3(0, 1, 0));
+    TEST_ASSERT_NOT_EQUAL(U32_MAX, a);
+    TEST_ASSERT_EQUAL_UINT32(a, b);
+
+    // Then a different normal axis, side or grid cell maps to another entry
+    u32 c =
+        sp_FindRadianceCacheCell(&cache, Vec3(0.2, 0.5, 0.1), Vec3(1, 0, 0));
+    u32 d =
+        sp_FindRadianceCacheCell(&cache, Vec3(0.2, 0.5, 0.1), Vec3(0, -1, 0));
+    u32 e =
+        sp_FindRadianceCacheCell(&cache, Vec3(1.2, 0.5, 0.1), Vec3(0, 1, 0));
+    TEST_ASSERT_NOT_EQUAL(a, c);
+    TEST_ASSERT_NOT_EQUAL(a, d);
+    TEST_ASSERT_NOT_EQUAL(a, e);
+
+    // And the cell is not usable until it has enough samples
+    for (u32 i = 0; i < SP_RADIANCE_CACHE_MIN_SAMPLES - 1; i++)
+    {
+        sp_AddRadianceCacheSample(&cache, a, Vec3(1, 2, 3));
+    }
+    TEST_ASSERT_FALSE(sp_LookupRadianceCache(&cache, a).isValid);
+
+    // When it does it returns the mean of the samples
+    sp_AddRadianceCacheSample(&cache, a, Vec3(1 + 16, 2 + 16, 3 + 16));
+    sp_RadianceCacheLookupResult lookup = sp_LookupRadianceCache(&cache, a);
+    TEST_ASSERT_TRUE(lookup.isValid);
+    AssertWithinVec3(0.001f, Vec3(2, 3, 4), lookup.radiance);
+
+    // Until the cache is reset
+    sp_ResetRadianceCache(&cache);
+    TEST_ASSERT_FALSE(sp_LookupRadianceCache(&cache, a).isValid);
+}
+
+void TestTracePathRadianceCache()
 {
-    vec4 pixels[4*4] = {};
+    // Given a ray trapped between two facing diffuse planes
+    TestScene test;
+    CreateFacingPlanesScene(&test, 10000.0f);
 
-    ImagePlane imagePlane = {};
-    imagePlane.width = 4;
-    imagePlane.height = 2;
-    imagePlane.pixels = pixels;
+    RandomNumberGenerator rng = { 0x1234567 };
+    sp_Sampler sampler = sp_CreateSampler(sp_SamplerType_Random, &rng);
 
-    vec3 position = Vec3(0, 2, 0);
-    quat rotation = Quat();
-    f32 filmDistance = 0.1f;
+    sp_Metrics metrics = {};
 
-    sp_Camera camera = {};
-    sp_ConfigureCamera(&camera, &imagePlane, position, rotation, filmDistance);
+    u32 maxBounces = 64;
+    u32 pathCount = 4000;
 
-    TEST_ASSERT_TRUE(camera.imagePlane == &imagePlane);
+    // Reference estimate without the cache
+    f32 expected = 0.0f;
+    for (u32 i = 0; i < pathCount; i++)
+    {
+        sp_TracePathResult result = sp_TracePath(
+            &test.ctx, Vec3(0), Vec3(0, 0, -1), maxBounces, &sampler, &metrics);
+        expected += result.radiance.x;
+    }
+    expected /= (f32)pathCount;
+    TEST_ASSERT_EQUAL_UINT64(
+        0, metrics.values[sp_Metric_PathsTerminatedByRadianceCache]);
 
-    AssertWithinVec3(EPSILON, position, camera.position);
-    // Compute basis vectors
-    AssertWithinVec3(EPSILON, Vec3(1, 0, 0), camera.basis.right);
-    AssertWithinVec3(EPSILON, Vec3(0, 1, 0), camera.basis.up);
-    AssertWithinVec3(EPSILON, Vec3(0, 0, -1), camera.basis.forward);
-    // Compute filmCenter
-    AssertWithinVec3(EPSILON, Vec3(0, 2, -0.1f), camera.filmCenter);
-    // Compute halfPixelWidth/halfPixelHeight
-    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.125f, camera.halfPixelWidth);
-    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.25f, camera.halfPixelHeight);
-    // Compute halfFilmWidth/halfFilmHeight;
-    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.5f, camera.halfFilmWidth);
-    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.25f, camera.halfFilmHeight);
-}
+    // When we trace the same paths with the radiance cache enabled
+    sp_RadianceCache cache = {};
+    sp_InitializeRadianceCache(&cache, &memoryArena, 1024, 4.0f);
+    test.ctx.radianceCache = &cache;
 
-void TestCalculateFilmP()
-{
-    vec4 pixels[4*4] = {};
+    f32 actual = 0.0f;
+    for (u32 i = 0; i < pathCount; i++)
+    {
+        sp_TracePathResult result = sp_TracePath(
+            &test.ctx, Vec3(0), Vec3(0, 0, -1), maxBounces, &sampler, &metrics);
+        actual += result.radiance.x;
+    }
+    actual /= (f32)pathCount;
 
-    ImagePlane imagePlane = {};
-    imagePlane.width = 4;
-    imagePlane.height = 4;
-    imagePlane.pixels = pixels;
+    // Then most paths terminate into the cache after their first bounce
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(pathCount / 2,
+        (u32)metrics.values[sp_Metric_PathsTerminatedByRadianceCache]);
 
-    vec3 position = Vec3(0, 2, 0);
-    quat rotation = Quat();
-    f32 filmDistance = 0.1f;
+    // And the estimate matches the reference
+    TEST_ASSERT_FLOAT_WITHIN(0.1f * expected, expected, actual);
 
-    sp_Camera camera = {};
-    sp_ConfigureCamera(&camera, &imagePlane, position, rotation, filmDistance);
+    // When paths are stored in the shading cache
+    metrics = {};
+    for (u32 i = 0; i < 100; i++)
+    {
+        sp_CachedPath cachedPath = {};
+        sp_TracePath(&test.ctx, Vec3(0), Vec3(0, 0, -1), maxBounces, &sampler,
+            &metrics, &cachedPath);
+    }
 
-    vec3 filmPositions[4] = {};
+    // Then none of them terminate into the radiance cache, whose radiance
+    // can't be shaded again with edited materials
+    TEST_ASSERT_EQUAL_UINT64(
+        0, metrics.values[sp_Metric_PathsTerminatedByRadianceCache]);
+}
 
-    vec2 pixelPositions[4] = {
-        Vec2(0.5, 0.5),
-        Vec2(1.5, 0.5),
-        Vec2(0.5, 1.5),
-        Vec2(3.5, 3.5),
+void TestGuidingCoordinates()
+{
+    vec3 directions[] = {
+        Vec3(0, 0, 1),
+        Vec3(0, 0, -1),
+        Vec3(1, 0, 0),
+        Vec3(0, -1, 0),
+        Normalize(Vec3(-1, 2, 0.5)),
+        Normalize(Vec3(0.3, -0.2, -0.9)),
     };
 
-    u32 count =
-        sp_CalculateFilmPositions(&camera, filmPositions, pixelPositions, 4);
-    TEST_ASSERT_EQUAL_UINT32(4, count);
-    AssertWithinVec3(EPSILON, Vec3(-0.375, 2.375, -0.1), filmPositions[0]);
-    AssertWithinVec3(EPSILON, Vec3(0.375, 1.625, -0.1), filmPositions[3]);
+    for (u32 i = 0; i < ArrayCount(directions); i++)
+    {
+        vec2 p = sp_DirectionToGuidingCoordinates(directions[i]);
+        TEST_ASSERT_TRUE(p.x >= 0.0f && p.x < 1.0f);
+        TEST_ASSERT_TRUE(p.y >= 0.0f && p.y < 1.0f);
+
+        vec3 direction = sp_GuidingCoordinatesToDirection(p);
+        // Coordinates are kept below 1 which costs some precision at the
+        // poles
+        AssertWithinVec3(1e-3f, directions[i], direction);
+    }
 }
 
-void TestTransformAabb()
+void TestGuidingQuadTree()
 {
-    // Given an Aabb
-    vec3 boxMin = Vec3(-0.5);
-    vec3 boxMax = Vec3(0.5);
+    sp_GuidingQuadTree training = {};
+    sp_ResetGuidingQuadTree(&training);
+    sp_GuidingQuadTree sampling = {};
+
+    // Given most of the energy recorded in a small region of the sphere over
+    // a few passes
+    RandomNumberGenerator rng = { 0x1234567 };
+    for (u32 pass = 0; pass < 3; pass++)
+    {
+        for (u32 i = 0; i < 1000; i++)
+        {
+            vec2 p = Vec2(RandomUnilateral(&rng), RandomUnilateral(&rng));
+            sp_RecordGuidingQuadTreeSample(&training, p, 0.01f);
+
+            vec2 q = Vec2(0.8f, 0.1f) + p * 0.1f;
+            sp_RecordGuidingQuadTreeSample(&training, q, 1.0f);
+        }
+
+        // When the tree is refined for the next pass
+        sampling = training;
+        sp_RefineGuidingQuadTree(&training, &sampling);
+
+        // Then the region is subdivided and the new tree holds no energy
+        TEST_ASSERT_GREATER_THAN_UINT32(1, training.nodeCount);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(
+            SP_GUIDING_MAX_NODES, training.nodeCount);
+        TEST_ASSERT_EQUAL_FLOAT(0.0f, sp_GetGuidingNodeTotal(training.nodes));
+        TEST_ASSERT_TRUE(sp_IsGuidingQuadTreeValid(&sampling));
+    }
 
-    // When it is transformed by a model matrix?
-    Aabb result = TransformAabb(boxMin, boxMax, Vec3(5, 0, 0), Quat(), Vec3(1));
+    // And samples drawn from the last trained tree mostly land in the region
+    // and always have a non-zero pdf
+    u32 sampleCount = 1000;
+    u32 hitCount = 0;
+    for (u32 i = 0; i < sampleCount; i++)
+    {
+        vec2 u = Vec2(RandomUnilateral(&rng), RandomUnilateral(&rng));
+        vec2 p = sp_SampleGuidingQuadTree(&sampling, u);
+        TEST_ASSERT_TRUE(p.x >= 0.0f && p.x < 1.0f);
+        TEST_ASSERT_TRUE(p.y >= 0.0f && p.y < 1.0f);
+
+        if (p.x >= 0.75f && p.x < 0.95f && p.y >= 0.05f && p.y < 0.25f)
+        {
+            hitCount++;
+        }
+
+        f32 pdf = sp_ComputeGuidingQuadTreePdf(&sampling, p);
+        TEST_ASSERT_TRUE(pdf > 0.0f);
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(sampleCount * 9 / 10, hitCount);
 
-    // Then the min and max are updated
-    AssertWithinVec3(EPSILON, Vec3(4.5, -0.5, -0.5), result.min);
-    AssertWithinVec3(EPSILON, Vec3(5.5, 0.5, 0.5), result.max);
+    // And the pdf integrates to 1 over the unit square
+    u32 n = 128;
+    f32 integral = 0.0f;
+    for (u32 y = 0; y < n; y++)
+    {
+        for (u32 x = 0; x < n; x++)
+        {
+            vec2 p = Vec2(((f32)x + 0.5f) / (f32)n, ((f32)y + 0.5f) / (f32)n);
+            integral += sp_ComputeGuidingQuadTreePdf(&sampling, p);
+        }
+    }
+    integral /= (f32)(n * n);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 1.0f, integral);
 }
 
-void TestRayIntersectScene()
+void TestTracePathGuiding()
 {
-    // Given a scene with multiple objects
-    sp_Scene scene = {};
-    sp_InitializeScene(&scene, &memoryArena);
-
-    sp_Mesh meshes[2];
-    vec3 positions[2] = {
-        Vec3(0, 2, -5),
-        Vec3(0, 2, -15),
-    };
-
-    quat orientations[2] = {
-        Quat(),
-        Quat(Vec3(0, 1, 0), PI * 0.25f),
-    };
+    // Given a ray trapped between two facing diffuse planes
+    TestScene test;
+    CreateFacingPlanesScene(&test, 10.0f);
 
-    vec3 scale[2] = {
-        Vec3(1),
-        Vec3(2),
-    };
+    RandomNumberGenerator rng = { 0x1234567 };
+    sp_Sampler sampler = sp_CreateSampler(sp_SamplerType_Random, &rng);
 
-    VertexPNT vertices[] = {
-        {Vec3(-0.5, -0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
-        {Vec3(0.5, -0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
-        {Vec3(0.0, 0.5, 0), Vec3(0, 0, 1), Vec2(0, 0)},
-    };
+    sp_Metrics metrics = {};
 
-    u32 indices[] = { 0, 1, 2 };
+    u32 maxBounces = 64;
+    u32 pathCount = 4000;
 
-    u32 material = 53;
+    // Reference estimate without guiding
+    f32 expected = 0.0f;
+    for (u32 i = 0; i < pathCount; i++)
+    {
+        sp_TracePathResult result = sp_TracePath(
+            &test.ctx, Vec3(0), Vec3(0, 0, -1), maxBounces, &sampler, &metrics);
+        expected += result.radiance.x;
+    }
+    expected /= (f32)pathCount;
 
-    // TODO: Do we copy the vertex data and store it in the collision world?
-    meshes[0] = sp_CreateMesh(
-        vertices, ArrayCount(vertices), indices, ArrayCount(indices));
-    meshes[1] = sp_CreateMesh(
-        vertices, ArrayCount(vertices), indices, ArrayCount(indices));
+    // When the guiding field has been trained for a pass
+    sp_GuidingField field = {};
+    sp_InitializeGuidingField(&field, &memoryArena, &test.scene);
+    test.ctx.guidingField = &field;
 
-    MemoryArena bvhNodeArena = SubAllocateArena(&memoryArena, Kilobytes(4));
-    MemoryArena tempArena = SubAllocateArena(&memoryArena, Kilobytes(8));
-    sp_BuildMeshMidphase(&meshes[0], &bvhNodeArena, &tempArena);
-    sp_BuildMeshMidphase(&meshes[1], &bvhNodeArena, &tempArena);
+    for (u32 i = 0; i < pathCount; i++)
+    {
+        sp_TracePath(
+            &test.ctx, Vec3(0), Vec3(0, 0, -1), maxBounces, &sampler, &metrics);
+    }
+    sp_UpdateGuidingField(&field);
 
-    sp_AddObjectToScene(
-        &scene, meshes[0], material, positions[0], orientations[0], scale[0]);
-    sp_AddObjectToScene(
-        &scene, meshes[1], material, positions[1], orientations[1], scale[1]);
-    sp_BuildSceneBroadphase(&scene);
+    u32 cellIndex = sp_FindGuidingCell(&field, Vec3(0, 0, -1));
+    TEST_ASSERT_TRUE(sp_CanSampleGuidingCell(&field, cellIndex));
 
-    // When we test if a ray intersects with the collision world
-    vec3 rayOrigin = Vec3(0, 2, 0);
-    vec3 rayDirection = Vec3(0, 0, -1);
-    sp_Metrics metrics = {};
-    sp_RayIntersectSceneResult result =
-        sp_RayIntersectScene(&scene, rayOrigin, rayDirection, &metrics);
+    // Then the guided estimate matches the reference
+    f32 actual = 0.0f;
+    for (u32 i = 0; i < pathCount; i++)
+    {
+        sp_TracePathResult result = sp_TracePath(
+            &test.ctx, Vec3(0), Vec3(0, 0, -1), maxBounces, &sampler, &metrics);
+        actual += result.radiance.x;
+    }
+    actual /= (f32)pathCount;
 
-    // Then we find an intersection
-    TEST_ASSERT_TRUE(result.t >= 0.0f);
-    TEST_ASSERT_EQUAL_UINT32(material, result.materialId);
-    // TODO: Check other properties of the intersection
+    TEST_ASSERT_FLOAT_WITHIN(0.1f * expected, expected, actual);
 }
 
 void TestEvaluateLightPath()
@@ -291,6 +1776,7 @@ void TestEvaluateLightPath()
     material.albedo = Vec3(0.18, 0.18, 0.18);
     material.albedoTexture = U32_MAX;
     material.emissionTexture = U32_MAX;
+    material.roughness = 1.0f;
 
     u32 materialId = 1;
     sp_RegisterMaterial(&materialSystem, material, materialId);
@@ -298,11 +1784,43 @@ void TestEvaluateLightPath()
     sp_PathVertex path[2] = {};
     path[0].materialId = materialId;
     path[0].normal = Vec3(0, 1, 0);
+    path[0].outgoingDir = Vec3(0, 1, 0);
     path[0].incomingDir = Vec3(0, 1, 0);
+    path[0].incomingPdf = 1.0f / PI;
     path[1].materialId = backgroundMaterialId;
     vec3 radiance = ComputeRadianceForPath(
         path, ArrayCount(path), &materialSystem);
-    AssertWithinVec3(EPSILON, Vec3(0.18, 0.18, 0.18), radiance);
+
+    // Diffuse term is kD * albedo = 0.96 * 0.18 and the specular term is
+    // F * D * G / 4 * PI = 0.04 / 4 once divided by the pdf
+    AssertWithinVec3(0.0001f, Vec3(0.1828f), radiance);
+}
+
+void TestEvaluateLightPathNextEventEstimation()
+{
+    sp_MaterialSystem materialSystem = {};
+
+    sp_Material material = {};
+    material.albedo = Vec3(0.18, 0.18, 0.18);
+    material.albedoTexture = U32_MAX;
+    material.emissionTexture = U32_MAX;
+    material.roughness = 1.0f;
+
+    u32 materialId = 1;
+    sp_RegisterMaterial(&materialSystem, material, materialId);
+
+    // Given a path which only receives light from its light sample
+    sp_PathVertex path[1] = {};
+    path[0].materialId = materialId;
+    path[0].normal = Vec3(0, 1, 0);
+    path[0].outgoingDir = Vec3(0, 1, 0);
+    path[0].lightDir = Vec3(0, 1, 0);
+    path[0].lightRadiance = Vec3(PI);
+
+    // Then the light sample is shaded the same way as a BSDF sample
+    vec3 radiance = ComputeRadianceForPath(
+        path, ArrayCount(path), &materialSystem);
+    AssertWithinVec3(0.0001f, Vec3(0.1828f), radiance);
 }
 
 void TestMaterialAlbedoTexture()
@@ -330,6 +1848,163 @@ void TestMaterialAlbedoTexture()
     AssertWithinVec3(EPSILON, Vec3(1, 0, 0), output.albedo);
 }
 
+void TestImageDistribution()
+{
+    // Given an image with a single bright pixel and a black row
+    HdrImage image = AllocateImage(4, 3, &memoryArena);
+    for (u32 y = 0; y < 3; y++)
+    {
+        for (u32 x = 0; x < 4; x++)
+        {
+            f32 value = (y == 1) ? 0.0f : 1.0f;
+            SetPixel(&image, x, y, Vec4(value, value, value, 1));
+        }
+    }
+    SetPixel(&image, 2, 2, Vec4(100, 100, 100, 1));
+
+    sp_ImageDistribution distribution =
+        sp_BuildImageDistribution(image, &memoryArena);
+
+    // Then the pdf integrates to 1 over the image
+    f32 total = 0.0f;
+    for (u32 y = 0; y < 3; y++)
+    {
+        for (u32 x = 0; x < 4; x++)
+        {
+            vec2 uv = Vec2((x + 0.5f) / 4.0f, (y + 0.5f) / 3.0f);
+            total += sp_ComputeImageDistributionPdf(&distribution, uv) / 12.0f;
+        }
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 1.0f, total);
+
+    // And samples are proportional to luminance, never landing on black
+    // pixels
+    RandomNumberGenerator rng = { 123456789 };
+    u32 sampleCount = 10000;
+    u32 brightCount = 0;
+    for (u32 i = 0; i < sampleCount; i++)
+    {
+        f32 pdf = 0.0f;
+        vec2 uv = sp_SampleImageDistribution(&distribution,
+            RandomUnilateral(&rng), RandomUnilateral(&rng), &pdf);
+        TEST_ASSERT_TRUE(uv.x >= 0.0f && uv.x < 1.0f);
+        TEST_ASSERT_TRUE(uv.y >= 0.0f && uv.y < 1.0f);
+        TEST_ASSERT_FLOAT_WITHIN(pdf * 0.0001f, pdf,
+            sp_ComputeImageDistributionPdf(&distribution, uv));
+
+        u32 x = (u32)(uv.x * 4.0f);
+        u32 y = (u32)(uv.y * 3.0f);
+        TEST_ASSERT_NOT_EQUAL(1, y);
+        if (x == 2 && y == 2)
+        {
+            brightCount++;
+        }
+    }
+
+    f32 expected = 100.0f / 107.0f;
+    TEST_ASSERT_FLOAT_WITHIN(
+        0.01f, expected, (f32)brightCount / (f32)sampleCount);
+}
+
+void TestSampleEnvironment()
+{
+    // Given a background material with an environment map
+    HdrImage image = AllocateImage(8, 4, &memoryArena);
+    for (u32 y = 0; y < 4; y++)
+    {
+        for (u32 x = 0; x < 8; x++)
+        {
+            f32 value = (f32)(x + y * 8 + 1);
+            SetPixel(&image, x, y, Vec4(value, value, value, 1));
+        }
+    }
+
+    sp_MaterialSystem materialSystem = {};
+
+    u32 imageId = 1;
+    sp_RegisterTexture(&materialSystem, image, imageId, &memoryArena);
+
+    sp_Material material = {};
+    material.albedoTexture = U32_MAX;
+    material.emissionTexture = imageId;
+
+    u32 materialId = 2;
+    sp_RegisterMaterial(&materialSystem, material, materialId);
+
+    // When we sample directions towards the environment
+    RandomNumberGenerator rng = { 123456789 };
+    sp_Sampler sampler = sp_CreateSampler(sp_SamplerType_Random, &rng);
+    u32 sampleCount = 10000;
+    f32 total = 0.0f;
+    for (u32 i = 0; i < sampleCount; i++)
+    {
+        sp_EnvironmentSample sample =
+            sp_SampleEnvironment(&materialSystem, materialId, &sampler);
+        TEST_ASSERT_TRUE(sample.pdf > 0.0f);
+        TEST_ASSERT_FLOAT_WITHIN(0.0001f, 1.0f, Length(sample.direction));
+
+        // Then the pdf matches the pdf computed for the direction
+        f32 pdf = sp_ComputeEnvironmentPdf(
+            &materialSystem, materialId, sample.direction);
+        TEST_ASSERT_FLOAT_WITHIN(sample.pdf * 0.001f, sample.pdf, pdf);
+
+        total += sample.radiance.x / sample.pdf;
+    }
+
+    // And the samples give an estimate of the total incoming radiance, as each
+    // pixel covers an equal solid angle of 4 PI / 32
+    f32 expected = (32.0f * 33.0f * 0.5f) * (4.0f * PI / 32.0f);
+    TEST_ASSERT_FLOAT_WITHIN(
+        expected * 0.01f, expected, total / (f32)sampleCount);
+
+    // Textures registered without an arena are not importance sampled
+    sp_RegisterTexture(&materialSystem, image, 3);
+    material.emissionTexture = 3;
+    sp_RegisterMaterial(&materialSystem, material, 4);
+    sp_EnvironmentSample sample =
+        sp_SampleEnvironment(&materialSystem, 4, &sampler);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, sample.pdf);
+}
+
+void TestRunningStats()
+{
+    // Given a set of samples
+    f32 samples[] = { 2.0f, 4.0f, 4.0f, 4.0f, 5.0f, 5.0f, 7.0f, 9.0f };
+
+    sp_RunningStats stats = {};
+    for (u32 i = 0; i < ArrayCount(samples); i++)
+    {
+        sp_AddSample(&stats, samples[i]);
+    }
+
+    // Then the mean and the sample variance match the two pass result
+    TEST_ASSERT_EQUAL_UINT32(ArrayCount(samples), stats.count);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 5.0f, stats.mean);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 32.0f / 7.0f, sp_GetVariance(&stats));
+
+    // And the standard error (0.756) relative to the mean decides convergence
+    TEST_ASSERT_TRUE(sp_HasConverged(&stats, 0.16f, 8));
+    TEST_ASSERT_FALSE(sp_HasConverged(&stats, 0.14f, 8));
+    TEST_ASSERT_FALSE(sp_HasConverged(&stats, 0.16f, 9));
+}
+
+void TestRunningStatsConstantSamples()
+{
+    // A pixel which always returns the same value converges immediately
+    sp_RunningStats stats = {};
+    sp_AddSample(&stats, 0.5f);
+    TEST_ASSERT_FALSE(sp_HasConverged(&stats, 0.01f, 0));
+
+    sp_AddSample(&stats, 0.5f);
+    TEST_ASSERT_TRUE(sp_HasConverged(&stats, 0.01f, 0));
+
+    // Including black pixels
+    sp_RunningStats blackStats = {};
+    sp_AddSample(&blackStats, 0.0f);
+    sp_AddSample(&blackStats, 0.0f);
+    TEST_ASSERT_TRUE(sp_HasConverged(&blackStats, 0.01f, 2));
+}
+
 void TestMetrics()
 {
     // Given a context
@@ -422,6 +2097,67 @@ void TestCreateMeshBuildsBvhTreeSingleTriangle()
     AssertWithinVec3(EPSILON, Vec3(0.5f, 0.5f, 0.0f), root->max);
 }
 
+u32 GetMaxLeafItemCount(bvh_Node *node)
+{
+    u32 result = node->itemCount;
+    for (u32 i = 0; i < BVH_CHILDREN_PER_NODE; ++i)
+    {
+        if (node->children[i] != NULL)
+        {
+            result = MaxU32(result, GetMaxLeafItemCount(node->children[i]));
+        }
+    }
+
+    return result;
+}
+
+void TestRayIntersectMeshMultipleTrianglesPerLeaf()
+{
+    // Given a mesh made from a stack of triangles along the z axis
+    VertexPNT vertices[30] = {};
+    u32 indices[30] = {};
+    for (u32 i = 0; i < 10; ++i)
+    {
+        f32 z = -(f32)i;
+        vertices[i * 3 + 0] = {Vec3(-0.5, -0.5, z), Vec3(0, 0, 1), Vec2(0, 0)};
+        vertices[i * 3 + 1] = {Vec3(0.5, -0.5, z), Vec3(0, 0, 1), Vec2(1, 0)};
+        vertices[i * 3 + 2] = {Vec3(0.0, 0.5, z), Vec3(0, 0, 1), Vec2(0, 1)};
+        indices[i * 3 + 0] = i * 3 + 0;
+        indices[i * 3 + 1] = i * 3 + 1;
+        indices[i * 3 + 2] = i * 3 + 2;
+    }
+
+    sp_Mesh mesh = sp_CreateMesh(
+        vertices, ArrayCount(vertices), indices, ArrayCount(indices));
+
+    MemoryArena bvhNodeArena = SubAllocateArena(&memoryArena, Kilobytes(16));
+    MemoryArena tempArena = SubAllocateArena(&memoryArena, Kilobytes(16));
+    sp_BuildMeshMidphase(&mesh, &bvhNodeArena, &tempArena);
+
+    // Then the midphase leaves contain multiple triangles
+    TEST_ASSERT_EQUAL_UINT32(10, mesh.triangles.count);
+#if RAY_INTERSECT_TRIANGLES_WIDTH > 1
+    // NOTE: The SAH only favours larger leaves when multiple triangles are
+    // tested at once
+    TEST_ASSERT_GREATER_THAN_UINT32(
+        1, GetMaxLeafItemCount(mesh.midphaseTree.root));
+#endif
+
+    // When we intersect a ray against it
+    vec3 rayOrigin = Vec3(0, 0, 10);
+    vec3 rayDirection = Vec3(0, 0, -1);
+    sp_Metrics metrics = {};
+    sp_RayIntersectMeshResult result =
+        sp_RayIntersectMesh(mesh, rayOrigin, rayDirection, &metrics);
+
+    // Then we get the nearest triangle and its interpolated UVs
+    TEST_ASSERT_FLOAT_WITHIN(1.0e-5f, 10.0f, result.triangleIntersection.t);
+    AssertWithinVec3(
+        1.0e-5f, Vec3(0, 0, 1), result.triangleIntersection.normal);
+    TEST_ASSERT_FLOAT_WITHIN(1.0e-5f, 0.25f, result.triangleIntersection.uv.x);
+    TEST_ASSERT_FLOAT_WITHIN(1.0e-5f, 0.5f, result.triangleIntersection.uv.y);
+}
+
 void TestRayIntersectAabb()
 {
     // Given an AABB
@@ -543,6 +2279,137 @@ void TestRandomDirectionOnHemisphere()
     }
 }
 
+void TestRandomDirectionOnHemisphereDistribution()
+{
+    RandomNumberGenerator rng = { 123456789 };
+
+    vec3 normal = Normalize(Vec3(1, 2, -1));
+
+    u32 sampleCount = 20000;
+    f32 uniformTotal = 0.0f;
+    f32 cosineTotal = 0.0f;
+    for (u32 i = 0; i < sampleCount; i++)
+    {
+        uniformTotal += Dot(normal, RandomDirectionOnHemisphere(normal, &rng));
+
+        vec3 v = RandomCosineDirectionOnHemisphere(normal, &rng);
+        TEST_ASSERT_FLOAT_WITHIN(0.00001f, 1.0f, Length(v));
+        TEST_ASSERT_TRUE(Dot(v, normal) >= 0.0f);
+        cosineTotal += Dot(normal, v);
+    }
+
+    // Mean cosine is 1/2 for uniform directions and 2/3 for cosine weighted
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.5f, uniformTotal / (f32)sampleCount);
+    TEST_ASSERT_FLOAT_WITHIN(
+        0.01f, 2.0f / 3.0f, cosineTotal / (f32)sampleCount);
+}
+
+void TestSampleBsdf()
+{
+    RandomNumberGenerator rng = { 123456789 };
+    sp_Sampler sampler = sp_CreateSampler(sp_SamplerType_Random, &rng);
+
+    sp_MaterialOutput materialOutput = {};
+    materialOutput.albedo = Vec3(0.5f);
+    materialOutput.roughness = 0.5f;
+
+    vec3 N = Vec3(0, 1, 0);
+    vec3 V = Normalize(Vec3(1, 1, 0));
+
+    u32 sampleCount = 20000;
+    f32 pdfIntegral = 0.0f;
+    f32 cosineIntegral = 0.0f;
+    for (u32 i = 0; i < sampleCount; i++)
+    {
+        // Integrate the pdf over the hemisphere with uniform samples
+        vec3 L = RandomDirectionOnHemisphere(N, &rng);
+        pdfIntegral += ComputeBsdfPdf(materialOutput, N, V, L) * 2.0f * PI;
+
+        // Integrate the cosine over the hemisphere with BSDF samples
+        sp_BsdfSample sample = SampleBsdf(materialOutput, N, V, &sampler);
+        if (sample.pdf > 0.0f)
+        {
+            TEST_ASSERT_FLOAT_WITHIN(
+                0.0001f, 1.0f, Length(sample.direction));
+            TEST_ASSERT_TRUE(Dot(N, sample.direction) > 0.0f);
+            cosineIntegral += Dot(N, sample.direction) / sample.pdf;
+        }
+    }
+
+    // Pdf integrates to at most 1 as some reflected directions end up below
+    // the surface
+    pdfIntegral /= (f32)sampleCount;
+    TEST_ASSERT_TRUE(pdfIntegral < 1.02f);
+    TEST_ASSERT_TRUE(pdfIntegral > 0.9f);
+
+    // Estimate using the BSDF samples is unbiased
+    TEST_ASSERT_FLOAT_WITHIN(PI * 0.03f, PI, cosineIntegral / (f32)sampleCount);
+}
+
+void TestSobolSamplerStratification()
+{
+    sp_Sampler sampler = sp_CreateSampler(sp_SamplerType_Sobol, NULL);
+
+    // Check a few different pixels and dimensions
+    for (u32 pixel = 0; pixel < 4; pixel++)
+    {
+        for (u32 dimension = 0; dimension < 8; dimension++)
+        {
+            // Given the first 16 samples of a 2D dimension
+            u32 cellCounts[16] = {};
+            u32 intervalCounts[16] = {};
+            for (u32 sample = 0; sample < 16; sample++)
+            {
+                sp_StartPixelSample(&sampler, pixel, 7, sample);
+                sp_SetSamplerDimension(&sampler, dimension);
+                vec2 u = sp_Next2D(&sampler);
+
+                TEST_ASSERT_TRUE(u.x >= 0.0f && u.x < 1.0f);
+                TEST_ASSERT_TRUE(u.y >= 0.0f && u.y < 1.0f);
+
+                u32 cellX = (u32)(u.x * 4.0f);
+                u32 cellY = (u32)(u.y * 4.0f);
+                cellCounts[cellX + cellY * 4]++;
+                intervalCounts[(u32)(u.x * 16.0f)]++;
+            }
+
+            // Then every 4x4 cell and every 1D interval gets exactly 1 sample
+            for (u32 i = 0; i < 16; i++)
+            {
+                TEST_ASSERT_EQUAL_UINT32(1, cellCounts[i]);
+                TEST_ASSERT_EQUAL_UINT32(1, intervalCounts[i]);
+            }
+        }
+    }
+}
+
+void TestSobolSamplerDecorrelated()
+{
+    sp_Sampler sampler = sp_CreateSampler(sp_SamplerType_Sobol, NULL);
+
+    // Values are deterministic for a given pixel, sample and dimension
+    sp_StartPixelSample(&sampler, 3, 5, 11);
+    vec2 a = sp_Next2D(&sampler);
+    f32 b = sp_Next1D(&sampler);
+    TEST_ASSERT_EQUAL_UINT32(2, sampler.dimension);
+
+    sp_StartPixelSample(&sampler, 3, 5, 11);
+    vec2 e = sp_Next2D(&sampler);
+    TEST_ASSERT_EQUAL_FLOAT(a.x, e.x);
+    TEST_ASSERT_EQUAL_FLOAT(a.y, e.y);
+    TEST_ASSERT_EQUAL_FLOAT(b, sp_Next1D(&sampler));
+
+    // But differ between pixels and dimensions
+    sp_StartPixelSample(&sampler, 4, 5, 11);
+    vec2 c = sp_Next2D(&sampler);
+    TEST_ASSERT_TRUE(a.x != c.x || a.y != c.y);
+
+    sp_StartPixelSample(&sampler, 3, 5, 11);
+    sp_SetSamplerDimension(&sampler, 1);
+    vec2 d = sp_Next2D(&sampler);
+    TEST_ASSERT_TRUE(a.x != d.x || a.y != d.y);
+}
+
 int main()
 {
     InitializeMemoryArena(
@@ -551,18 +2418,36 @@ int main()
     UNITY_BEGIN();
     RUN_TEST(TestPathTraceSingleColor);
     RUN_TEST(TestPathTraceTile);
+    RUN_TEST(TestPathTraceTileAovs);
+    RUN_TEST(TestPathTraceTileAdaptiveSamplingAcrossPasses);
+    RUN_TEST(TestDenoiser);
     RUN_TEST(TestConfigureCamera);
     RUN_TEST(TestCalculateFilmP);
     RUN_TEST(TestTransformAabb);
     RUN_TEST(TestRayIntersectScene);
-
+    RUN_TEST(TestRayIntersectSceneManyOverlappingObjects);
+    RUN_TEST(TestCreateMeshComputesBounds);
+    RUN_TEST(TestSetObjectTransform);
+    RUN_TEST(TestRayOccluded);
+
+    RUN_TEST(TestRayIntersectLights);
+    RUN_TEST(TestSampleSphereLight);
+    RUN_TEST(TestSampleDiskLight);
+    RUN_TEST(TestPathTraceNextEventEstimation);
+    RUN_TEST(TestTracePathRussianRoulette);
     RUN_TEST(TestEvaluateLightPath);
+    RUN_TEST(TestEvaluateLightPathNextEventEstimation);
     RUN_TEST(TestMaterialAlbedoTexture);
+    RUN_TEST(TestImageDistribution);
+    RUN_TEST(TestSampleEnvironment);
 
+    RUN_TEST(TestRunningStats);
+    RUN_TEST(TestRunningStatsConstantSamples);
     RUN_TEST(TestMetrics);
 
     RUN_TEST(TestRayIntersectMesh);
     RUN_TEST(TestCreateMeshBuildsBvhTreeSingleTriangle);
+    RUN_TEST(TestRayIntersectMeshMultipleTrianglesPerLeaf);
 
     RUN_TEST(TestRayIntersectAabb);
     RUN_TEST(TestRayIntersectAabb4);
@@ -570,6 +2455,27 @@ int main()
     RUN_TEST(TestRayIntersectAabbCompare);
 
     RUN_TEST(TestRandomDirectionOnHemisphere);
+    RUN_TEST(TestRandomDirectionOnHemisphereDistribution);
+    RUN_TEST(TestSampleBsdf);
+    RUN_TEST(TestSobolSamplerStratification);
+    RUN_TEST(TestSobolSamplerDecorrelated);
+    RUN_TEST(TestRadianceCache);
+    RUN_TEST(TestTracePathRadianceCache);
+    RUN_TEST(TestGuidingCoordinates);
+    RUN_TEST(TestGuidingQuadTree);
+    RUN_TEST(TestTracePathGuiding);
+    RUN_TEST(TestPathTraceTilePreview);
+    RUN_TEST(TestPathTraceTileCancelled);
+    RUN_TEST(TestTemporalReprojection);
+    RUN_TEST(TestPartialRenderMerge);
+    RUN_TEST(TestAccumulationRounding);
+    RUN_TEST(TestMergePartialFileInvalid);
+    RUN_TEST(TestLoadCheckpoint);
+    RUN_TEST(TestShadingCacheCompressVertex);
+    RUN_TEST(TestReshadeTile);
+    RUN_TEST(TestToneMapSrgbEncoding);
+    RUN_TEST(TestToneMapAccumulationBuffer);
+    RUN_TEST(TestToneMapHalf);
 
     free(memoryArena.base);
 
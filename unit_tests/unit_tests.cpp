@@ -5,6 +5,7 @@
 #include "intrinsics.h"
 #include "profiler.h"
 #include "work_queue.h"
+#include "frame_budget.h"
 #include "math_lib.h"
 #include "ray_intersection.h"
 #include "mesh.h"
@@ -12,6 +13,7 @@
 #include "asset_loader/asset_loader.h"
 #include "image.h"
 #include "tile.h"
+#include "dirty_tiles.h"
 
 #include "custom_assertions.h"
 
@@ -78,6 +80,134 @@ void TestComputeTilesInsufficientSpace()
     TEST_ASSERT_EQUAL_UINT32(tileCount, ArrayCount(tiles));
 }
 
+void TestComputeTilesInRegion()
+{
+    Tile region = {};
+    region.minX = 3;
+    region.minY = 1;
+    region.maxX = 6;
+    region.maxY = 3;
+
+    Tile tiles[64] = {};
+    u32 tileCount =
+        ComputeTilesInRegion(10, 10, 2, 2, region, tiles, ArrayCount(tiles));
+
+    // Only the 2 x 2 grid tiles overlapping the region are generated
+    TEST_ASSERT_EQUAL_UINT32(2 * 2, tileCount);
+
+    // And they are clipped to the region
+    TEST_ASSERT_EQUAL_UINT32(3, tiles[0].minX);
+    TEST_ASSERT_EQUAL_UINT32(1, tiles[0].minY);
+    TEST_ASSERT_EQUAL_UINT32(4, tiles[0].maxX);
+    TEST_ASSERT_EQUAL_UINT32(2, tiles[0].maxY);
+    TEST_ASSERT_EQUAL_UINT32(4, tiles[1].minX);
+    TEST_ASSERT_EQUAL_UINT32(6, tiles[1].maxX);
+    TEST_ASSERT_EQUAL_UINT32(2, tiles[3].minY);
+    TEST_ASSERT_EQUAL_UINT32(3, tiles[3].maxY);
+}
+
+void TestComputeTilesInRegionOutsideImage()
+{
+    Tile region = {};
+    region.minX = 12;
+    region.maxX = 16;
+    region.maxY = 4;
+
+    Tile tiles[64] = {};
+    u32 tileCount =
+        ComputeTilesInRegion(10, 10, 2, 2, region, tiles, ArrayCount(tiles));
+
+    TEST_ASSERT_EQUAL_UINT32(0, tileCount);
+}
+
+void TestCollectDirtyTilesInitiallyAll()
+{
+    // Given a new 9x9 image of 4x4 tiles
+    DirtyTiles dirtyTiles = {};
+    InitializeDirtyTiles(&dirtyTiles, 9, 9, 4, 4);
+
+    // When the dirty tiles are collected
+    Tile regions[16] = {};
+    u32 regionCount =
+        CollectDirtyTiles(&dirtyTiles, regions, ArrayCount(regions));
+
+    // Then each row of tiles is a single region clipped to the image
+    TEST_ASSERT_EQUAL_UINT32(3, regionCount);
+    TEST_ASSERT_EQUAL_UINT32(0, regions[0].minX);
+    TEST_ASSERT_EQUAL_UINT32(0, regions[0].minY);
+    TEST_ASSERT_EQUAL_UINT32(9, regions[0].maxX);
+    TEST_ASSERT_EQUAL_UINT32(4, regions[0].maxY);
+    TEST_ASSERT_EQUAL_UINT32(8, regions[2].minY);
+    TEST_ASSERT_EQUAL_UINT32(9, regions[2].maxY);
+
+    // And nothing is left to upload afterwards
+    TEST_ASSERT_EQUAL_UINT32(
+        0, CollectDirtyTiles(&dirtyTiles, regions, ArrayCount(regions)));
+}
+
+void TestCollectDirtyTilesMarked()
+{
+    // Given an image with nothing left to upload
+    DirtyTiles dirtyTiles = {};
+    InitializeDirtyTiles(&dirtyTiles, 16, 16, 4, 4);
+    Tile regions[16] = {};
+    CollectDirtyTiles(&dirtyTiles, regions, ArrayCount(regions));
+
+    // When a region spanning two tiles and a separate tile are written
+    Tile region = {};
+    region.minX = 2;
+    region.minY = 5;
+    region.maxX = 6;
+    region.maxY = 7;
+    MarkTilesDirty(&dirtyTiles, region);
+
+    region.minX = 12;
+    region.maxX = 16;
+    MarkTilesDirty(&dirtyTiles, region);
+
+    u32 regionCount =
+        CollectDirtyTiles(&dirtyTiles, regions, ArrayCount(regions));
+
+    // Then the two adjacent tiles are merged and the other is kept separate
+    TEST_ASSERT_EQUAL_UINT32(2, regionCount);
+    TEST_ASSERT_EQUAL_UINT32(0, regions[0].minX);
+    TEST_ASSERT_EQUAL_UINT32(4, regions[0].minY);
+    TEST_ASSERT_EQUAL_UINT32(8, regions[0].maxX);
+    TEST_ASSERT_EQUAL_UINT32(8, regions[0].maxY);
+    TEST_ASSERT_EQUAL_UINT32(12, regions[1].minX);
+    TEST_ASSERT_EQUAL_UINT32(16, regions[1].maxX);
+}
+
+void TestCollectDirtyTilesInsufficientSpace()
+{
+    // Given an image where every other tile is dirty
+    DirtyTiles dirtyTiles = {};
+    InitializeDirtyTiles(&dirtyTiles, 16, 4, 4, 4);
+    Tile regions[4] = {};
+    CollectDirtyTiles(&dirtyTiles, regions, ArrayCount(regions));
+
+    Tile region = {};
+    region.maxY = 4;
+    for (u32 x = 0; x < 16; x += 8)
+    {
+        region.minX = x;
+        region.maxX = x + 4;
+        MarkTilesDirty(&dirtyTiles, region);
+    }
+
+    // When only one region fits
+    u32 regionCount = CollectDirtyTiles(&dirtyTiles, regions, 1);
+
+    // Then the remaining tile stays dirty for the next collection
+    TEST_ASSERT_EQUAL_UINT32(1, regionCount);
+    TEST_ASSERT_EQUAL_UINT32(0, regions[0].minX);
+
+    regionCount = CollectDirtyTiles(&dirtyTiles, regions, 1);
+    TEST_ASSERT_EQUAL_UINT32(1, regionCount);
+    TEST_ASSERT_EQUAL_UINT32(8, regions[0].minX);
+    TEST_ASSERT_EQUAL_UINT32(12, regions[0].maxX);
+}
+
 struct TestWorkQueueTask
 {
     u32 value;
@@ -121,6 +251,46 @@ void TestWorkQueuePop()
     TEST_ASSERT_EQUAL_UINT32(second.value, 2);
 }
 
+void TestFrameBudget()
+{
+    // Given a budget of 10ms per frame on a 1MHz clock
+    FrameBudget budget = CreateFrameBudget(10.0, 1000000.0);
+    TEST_ASSERT_EQUAL_INT64(10000, budget.cyclesPerFrame);
+    TEST_ASSERT_TRUE(HasFrameBudget(&budget));
+
+    // When a task overshoots the budget
+    ChargeFrameBudget(&budget, 15000);
+
+    // Then no more tasks can be started this frame
+    TEST_ASSERT_FALSE(HasFrameBudget(&budget));
+
+    // And the overshoot is paid back from the next frame
+    RefillFrameBudget(&budget);
+    TEST_ASSERT_EQUAL_INT64(5000, budget.cyclesRemaining);
+
+    // And budget left unused is not carried over
+    RefillFrameBudget(&budget);
+    TEST_ASSERT_EQUAL_INT64(10000, budget.cyclesRemaining);
+}
+
+void TestFrameBudgetDisabled()
+{
+    FrameBudget budget = {};
+    ChargeFrameBudget(&budget, 15000);
+    RefillFrameBudget(&budget);
+    TEST_ASSERT_TRUE(HasFrameBudget(&budget));
+}
+
+void TestComputeCyclesPerSecond()
+{
+    f64 cyclesPerSecond = ComputeCyclesPerSecond(100, 300, 1.0, 1.5);
+    TEST_ASSERT_EQUAL_FLOAT(400.0f, (f32)cyclesPerSecond);
+
+    // No time passing gives no rate rather than dividing by zero
+    cyclesPerSecond = ComputeCyclesPerSecond(100, 300, 1.0, 1.0);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, (f32)cyclesPerSecond);
+}
+
 void TestParseCommandLineArgs()
 {
     const char *assetDir = NULL;
@@ -141,6 +311,123 @@ void TestParseCommandLineArgsEmpty()
     TEST_ASSERT_FALSE(ParseCommandLineArgs(0, NULL, &assetDir));
 }
 
+void TestParsePartialRenderArgs()
+{
+    PartialRenderArgs args = {};
+    const char *argv[] = {
+        "/path/to/my/app",
+        "--asset-dir",
+        "/my/asset/dir",
+        "--partial-output",
+        "partial_3.spac",
+        "--sample-range",
+        "64",
+        "32",
+        "--tile-subset",
+        "1",
+        "2",
+        "--checkpoint",
+        "partial_3.checkpoint",
+        "--resume",
+    };
+    int argc = ArrayCount(argv);
+
+    TEST_ASSERT_TRUE(ParsePartialRenderArgs(argc, argv, &args));
+    TEST_ASSERT_EQUAL_STRING(argv[4], args.outputPath);
+    TEST_ASSERT_EQUAL_UINT32(64, args.firstSample);
+    TEST_ASSERT_EQUAL_UINT32(32, args.sampleCount);
+    TEST_ASSERT_EQUAL_UINT32(1, args.tileSubsetIndex);
+    TEST_ASSERT_EQUAL_UINT32(2, args.tileSubsetCount);
+    TEST_ASSERT_EQUAL_STRING(argv[12], args.checkpointPath);
+    TEST_ASSERT_TRUE(args.resume);
+}
+
+void TestParsePartialRenderArgsResumeWithoutCheckpoint()
+{
+    PartialRenderArgs args = {};
+    const char *argv[] = {
+        "/path/to/my/app",
+        "--partial-output",
+        "partial.spac",
+        "--resume",
+    };
+    int argc = ArrayCount(argv);
+
+    TEST_ASSERT_FALSE(ParsePartialRenderArgs(argc, argv, &args));
+}
+
+void TestParsePartialRenderArgsInvalidSubset()
+{
+    PartialRenderArgs args = {};
+    const char *argv[] = {
+        "/path/to/my/app",
+        "--partial-output",
+        "partial.spac",
+        "--tile-subset",
+        "2",
+        "2",
+    };
+    int argc = ArrayCount(argv);
+
+    TEST_ASSERT_FALSE(ParsePartialRenderArgs(argc, argv, &args));
+}
+
+void TestParsePartialRenderArgsMissingArguments()
+{
+    PartialRenderArgs args = {};
+    const char *argv[] = {
+        "/path/to/my/app",
+        "--partial-output",
+    };
+    TEST_ASSERT_FALSE(ParsePartialRenderArgs(ArrayCount(argv), argv, &args));
+
+    const char *sampleRangeArgv[] = {
+        "/path/to/my/app",
+        "--partial-output",
+        "partial.spac",
+        "--sample-range",
+        "0",
+    };
+    TEST_ASSERT_FALSE(ParsePartialRenderArgs(
+        ArrayCount(sampleRangeArgv), sampleRangeArgv, &args));
+}
+
+void TestParsePartialRenderArgsInvalidNumber()
+{
+    PartialRenderArgs args = {};
+    const char *argv[] = {
+        "/path/to/my/app",
+        "--partial-output",
+        "partial.spac",
+        "--sample-range",
+        "first",
+        "32",
+    };
+    TEST_ASSERT_FALSE(ParsePartialRenderArgs(ArrayCount(argv), argv, &args));
+
+    const char *subsetArgv[] = {
+        "/path/to/my/app",
+        "--partial-output",
+        "partial.spac",
+        "--tile-subset",
+        "1",
+        "4x",
+    };
+    TEST_ASSERT_FALSE(
+        ParsePartialRenderArgs(ArrayCount(subsetArgv), subsetArgv, &args));
+
+    const char *negativeArgv[] = {
+        "/path/to/my/app",
+        "--partial-output",
+        "partial.spac",
+        "--sample-range",
+        "-1",
+        "32",
+    };
+    TEST_ASSERT_FALSE(
+        ParsePartialRenderArgs(ArrayCount(negativeArgv), negativeArgv, &args));
+}
+
 void TestToSphericalCoordinates()
 {
     // Given
@@ -425,6 +712,137 @@ void TestRayIntersectTriangleMTBarycentricCoordsIssue()
     TEST_ASSERT_FLOAT_WITHIN(EPSILON, -1.0f, result.t);
 }
 
+TriangleBatch CreateTriangleBatch(
+    vec3 *vertices, u32 triangleCount, MemoryArena *arena)
+{
+    TriangleBatch result = {};
+
+    u32 capacity = triangleCount + RAY_INTERSECT_TRIANGLES_PADDING;
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+        result.vertex[axis] = AllocateArray(arena, f32, capacity);
+        result.edge1[axis] = AllocateArray(arena, f32, capacity);
+        result.edge2[axis] = AllocateArray(arena, f32, capacity);
+        ClearToZero(result.vertex[axis], sizeof(f32) * capacity);
+        ClearToZero(result.edge1[axis], sizeof(f32) * capacity);
+        ClearToZero(result.edge2[axis], sizeof(f32) * capacity);
+    }
+
+    for (u32 i = 0; i < triangleCount; ++i)
+    {
+        vec3 a = vertices[i * 3 + 0];
+        vec3 e1 = vertices[i * 3 + 1] - a;
+        vec3 e2 = vertices[i * 3 + 2] - a;
+        for (u32 axis = 0; axis < 3; ++axis)
+        {
+            result.vertex[axis][i] = a.data[axis];
+            result.edge1[axis][i] = e1.data[axis];
+            result.edge2[axis][i] = e2.data[axis];
+        }
+    }
+
+    return result;
+}
+
+void TestRayIntersectTriangles()
+{
+    // Given a batch of triangles, the nearest front facing one is in the
+    // second SIMD lane group and is preceded by a nearer back facing one
+    vec3 vertices[] = {
+        Vec3(-0.5f, -0.5f, -5.0f), Vec3(0.5f, -0.5f, -5.0f), Vec3(0, 0.5f, -5),
+        Vec3(4.5f, -0.5f, -1.0f), Vec3(5.5f, -0.5f, -1.0f), Vec3(5, 0.5f, -1),
+        Vec3(-0.5f, -0.5f, -4.0f), Vec3(0.5f, -0.5f, -4.0f), Vec3(0, 0.5f, -4),
+        Vec3(-0.5f, -0.5f, -1.0f), Vec3(0, 0.5f, -1.0f), Vec3(0.5f, -0.5f, -1),
+        Vec3(-0.5f, -0.5f, -6.0f), Vec3(0.5f, -0.5f, -6.0f), Vec3(0, 0.5f, -6),
+        Vec3(-0.5f, -0.5f, -2.0f), Vec3(0.5f, -0.5f, -2.0f), Vec3(0, 0.5f, -2),
+    };
+    u32 triangleCount = ArrayCount(vertices) / 3;
+    TriangleBatch batch =
+        CreateTriangleBatch(vertices, triangleCount, &memoryArena);
+
+    vec3 rayOrigin = Vec3(0, 0, 1);
+    vec3 rayDirection = Vec3(0, 0, -1);
+
+    // When we intersect a ray against them
+    RayIntersectTrianglesResult result = RayIntersectTriangles(
+        batch, 0, triangleCount, rayOrigin, rayDirection);
+
+    // Then we get the nearest front facing triangle
+    TEST_ASSERT_EQUAL_UINT32(5, result.index);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 3.0f, result.t);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.25f, result.uv.x);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, 0.5f, result.uv.y);
+
+    // And triangles outside of the range or beyond tmax are ignored
+    result = RayIntersectTriangles(batch, 0, 5, rayOrigin, rayDirection);
+    TEST_ASSERT_EQUAL_UINT32(2, result.index);
+    result = RayIntersectTriangles(batch, 0, 5, rayOrigin, rayDirection, 5.5f);
+    TEST_ASSERT_EQUAL_UINT32(2, result.index);
+    result = RayIntersectTriangles(batch, 0, 5, rayOrigin, rayDirection, 5.0f);
+    TEST_ASSERT_EQUAL_UINT32(U32_MAX, result.index);
+    TEST_ASSERT_FLOAT_WITHIN(EPSILON, -1.0f, result.t);
+}
+
+/* Differential test of the SIMD ray triangle kernels against the scalar
+ * reference using random triangles and rays.
+ */
+void TestRayIntersectTrianglesCompare()
+{
+    RandomNumberGenerator rng = { 0x2F6E2B1 };
+
+    vec3 vertices[64 * 3];
+    u32 triangleCount = ArrayCount(vertices) / 3;
+    for (u32 i = 0; i < ArrayCount(vertices); ++i)
+    {
+        vertices[i] = Vec3(RandomBilateral(&rng), RandomBilateral(&rng),
+            RandomBilateral(&rng)) * 2.0f;
+    }
+
+    TriangleBatch batch =
+        CreateTriangleBatch(vertices, triangleCount, &memoryArena);
+
+    u32 rayCount = 256;
+    u32 hitCount = 0;
+    for (u32 i = 0; i < rayCount; ++i)
+    {
+        vec3 p = Vec3(RandomBilateral(&rng), RandomBilateral(&rng),
+            RandomBilateral(&rng)) * 5.0f;
+        vec3 q = Vec3(RandomBilateral(&rng), RandomBilateral(&rng),
+            RandomBilateral(&rng));
+
+        vec3 rayOrigin = p;
+        vec3 rayDirection = Normalize(q - p);
+
+        // Test odd sized sub-ranges so that the masking of lanes past the end
+        // of the range is exercised as well
+        u32 first = i % 5;
+        u32 count = triangleCount - first - (i % 7);
+
+        RayIntersectTrianglesResult expected = RayIntersectTrianglesScalar(
+            batch, first, count, rayOrigin, rayDirection);
+
+        RayIntersectTrianglesResult result4 = RayIntersectTriangles4(
+            batch, first, count, rayOrigin, rayDirection);
+        TEST_ASSERT_EQUAL_UINT32(expected.index, result4.index);
+        TEST_ASSERT_FLOAT_WITHIN(1.0e-5f, expected.t, result4.t);
+
+#if RAY_INTERSECT_TRIANGLES_WIDTH == 8
+        RayIntersectTrianglesResult result8 = RayIntersectTriangles8(
+            batch, first, count, rayOrigin, rayDirection);
+        TEST_ASSERT_EQUAL_UINT32(expected.index, result8.index);
+        TEST_ASSERT_FLOAT_WITHIN(1.0e-5f, expected.t, result8.t);
+#endif
+
+        if (expected.index != U32_MAX)
+        {
+            hitCount++;
+        }
+    }
+
+    // Sanity check that the rays actually hit something
+    TEST_ASSERT_GREATER_THAN_UINT32(0, hitCount);
+}
+
 void TestNearestSampling()
 {
     // Given an image   | (0, 0, 0, 0) | (1, 1, 1, 1) |
@@ -580,10 +998,23 @@ int main()
     RUN_TEST(TestComputeTiles);
     RUN_TEST(TestComputeTilesNonDivisible);
     RUN_TEST(TestComputeTilesInsufficientSpace);
+    RUN_TEST(TestComputeTilesInRegion);
+    RUN_TEST(TestComputeTilesInRegionOutsideImage);
+    RUN_TEST(TestCollectDirtyTilesInitiallyAll);
+    RUN_TEST(TestCollectDirtyTilesMarked);
+    RUN_TEST(TestCollectDirtyTilesInsufficientSpace);
     RUN_TEST(TestWorkQueuePush);
     RUN_TEST(TestWorkQueuePop);
+    RUN_TEST(TestFrameBudget);
+    RUN_TEST(TestFrameBudgetDisabled);
+    RUN_TEST(TestComputeCyclesPerSecond);
     RUN_TEST(TestParseCommandLineArgs);
     RUN_TEST(TestParseCommandLineArgsEmpty);
+    RUN_TEST(TestParsePartialRenderArgs);
+    RUN_TEST(TestParsePartialRenderArgsInvalidSubset);
+    RUN_TEST(TestParsePartialRenderArgsResumeWithoutCheckpoint);
+    RUN_TEST(TestParsePartialRenderArgsMissingArguments);
+    RUN_TEST(TestParsePartialRenderArgsInvalidNumber);
 
     RUN_TEST(TestToSphericalCoordinates);
 
@@ -596,6 +1027,8 @@ int main()
     RUN_TEST(TestRayIntersectTriangleMiss);
     RUN_TEST(TestRayIntersectTriangleHitUV);
     RUN_TEST(TestRayIntersectTriangleMTBarycentricCoordsIssue);
+    RUN_TEST(TestRayIntersectTriangles);
+    RUN_TEST(TestRayIntersectTrianglesCompare);
 
     RUN_TEST(TestNearestSampling);
     RUN_TEST(TestBilinearSampling);